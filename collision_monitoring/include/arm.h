@@ -6,6 +6,8 @@
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 #include "primitives.h"
+#include "chain_model.h"
+#include "kinematic_state.h"
 
 /**
  * A pure virtual class that represents a robotic manipulator
@@ -27,13 +29,119 @@ class Arm
          *     in order of the joint in radians
          * @return The boolean true for a successful update, False otherwise
          */
-        virtual bool updatePose(std::vector<double> jointPositions);
+        virtual bool updatePose(const std::vector<double> &jointPositions);
 
         /// Used to get the endeffector frame of the manipulator
         virtual Eigen::Matrix4d getPose(void) = 0;
         /// Used to get the frame 
         virtual Eigen::Matrix4d getPose(int frameNumber) = 0;
 
+        /**
+         * Velocities of the links for the given joint velocities
+         * 
+         * Link k goes from frame k to frame k+1. Its motion is given as the
+         * linear velocity of the origin of frame k and the angular velocity
+         * of the link, both in the world frame, for the current pose.
+         * 
+         * @param jointVelocities The velocities of the arm joints in rad/s
+         * @param[out] linear The linear velocity of the start of each link
+         * @param[out] angular The angular velocity of each link
+         * @return True if the velocities were computed, the default 
+         *     implementation returns false
+         */
+        virtual bool linkVelocities(const std::vector<double> &jointVelocities,
+                                    std::vector<Eigen::Vector3d> &linear,
+                                    std::vector<Eigen::Vector3d> &angular);
+
+        /**
+         * Creates an independent copy of the arm
+         * 
+         * The copy has its own links and kinematic state, so it can be 
+         * moved without changing this arm, for example to evaluate 
+         * configurations on another thread.
+         * 
+         * @return The copy, owned by the caller, the default implementation
+         *     returns NULL
+         */
+        virtual Arm* clone();
+
+        /**
+         * Describes the kinematic chain and the link capsules of the arm
+         * 
+         * The model is used to bound the poses of the links over a range of
+         * joint positions, it does not depend on the current pose.
+         * 
+         * @param[out] model The chain of the arm from the world frame
+         * @return True if the model was filled, the default implementation
+         *     returns false
+         */
+        virtual bool getChainModel(ChainModel &model);
+
+        /**
+         * The kinematics of the current pose of the arm
+         * 
+         * The state is computed once by updatePose when the joint positions
+         * change and shared by the readers of the frames and Jacobians. 
+         * 
+         * @return The state, owned by the arm, the default implementation
+         *     returns NULL
+         */
+        virtual const KinematicState* getKinematicState();
+
+        /**
+         * Joint velocities that move the endeffector with a twist
+         * 
+         * Safe to call on a real-time thread, the solution is found from 
+         * the kinematic state of the current pose.
+         * 
+         * @param twist The linear then angular velocity of the endeffector
+         *     in the arm base frame
+         * @param[out] jointVelocities The joint velocities used to achieve
+         *     the desired velocity
+         * @param nVelocities The size of jointVelocities, at least nJoints
+         * @return True if the velocities were found, the default 
+         *     implementation returns false
+         */
+        virtual bool ikVelocitySolver(const Eigen::Matrix<double, 6, 1> &twist,
+                                      double* jointVelocities, int nVelocities);
+
+        /**
+         * A function to check if a pair of links may be in contact
+         * 
+         * @param first The number of the first link
+         * @param second The number of the second link
+         * @return True if the pair touches by design and is not checked, 
+         *     the default implementation checks every pair
+         */
+        virtual bool allowedCollision(int first, int second);
+
+        /**
+         * The ends of the axis of a link capsule for the current pose
+         * 
+         * The capsule is rigid in the frame of its link, but a fitted 
+         * capsule may start before that frame and end past the next one. 
+         * Links that are not capsules and the empty capsules of frames at 
+         * the same point are taken to span their two frames.
+         * 
+         * @param link The index of the link
+         * @param[out] start The start of the axis in the world frame
+         * @param[out] end The end of the axis in the world frame
+         */
+        void linkEndPoints(int link, Eigen::Vector3d &start, Eigen::Vector3d &end);
+
+        /**
+         * The reach of the chain past every joint
+         * 
+         * A bound on the distance from the axis of joint i to the ends of 
+         * the links it moves, found with linkEndPoints() so that fitted 
+         * capsules are covered. Turning joint i by an angle moves no point 
+         * of the links by more than the angle times reach[i]. It only 
+         * depends on the geometry of the chain, not on the configuration.
+         * 
+         * @param[out] reach The reach of each joint in m
+         */
+        void jointReach(std::vector<double> &reach);
+
         /// The homogeneous transformation from the world to arm base frame
         Eigen::Matrix4d baseTransform;
 
@@ -0,0 +1,150 @@
+#ifndef BATCH_KINEMATICS_H
+#define BATCH_KINEMATICS_H
+
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+#include "chain_model.h"
+
+/**
+ * Forward kinematics of many configurations of a chain at once
+ *
+ * The configurations are laid out joint by joint, the positions of one
+ * joint for all the configurations being contiguous, so every entry of the
+ * frames is an array over the configurations and the chain is walked once
+ * for the whole batch with vectorised array operations.
+ *
+ * A turn of angle q about a fixed axis is R = I + sin(q) K + (1 - cos(q)) K^2,
+ * so the motion of every segment is a constant plus the sine and the
+ * versine of its joint times constants, which are computed once from the
+ * model. The results are the end points of the link capsules, one
+ * contiguous array per link and coordinate.
+ */
+class BatchKinematics
+{
+    public:
+        /// Constructor of BatchKinematics, creates an empty chain
+        BatchKinematics();
+
+        /** Constructor of BatchKinematics for a chain
+        *
+        * @param model the chain, for example from Arm::getChainModel
+        */
+        BatchKinematics(const ChainModel &model);
+
+        /// Destructor of BatchKinematics
+        ~BatchKinematics();
+
+        /** Sets the chain of the configurations
+        *
+        * @param model the chain, for example from Arm::getChainModel
+        */
+        void setModel(const ChainModel &model);
+
+        /** Getter of the number of joints
+        *
+        * @return the number of revolute segments
+        */
+        int nJoints();
+
+        /** Getter of the number of links
+        *
+        * @return the number of segments
+        */
+        int nLinks();
+
+        /** Getter of the number of configurations of the last batch
+        *
+        * @return the number of configurations
+        */
+        int size();
+
+        /** End points of the links for a batch of configurations
+        *
+        * @param jointPositions the joint positions in rad, the position of
+        *     joint i in configuration c is jointPositions[i * count + c]
+        * @param count the number of configurations
+        * @return false if the chain is empty
+        */
+        bool linkEndpoints(const double* jointPositions, int count);
+
+        /** End points of the links for configurations stored one by one
+        *
+        * The configurations are first laid out joint by joint.
+        *
+        * @param configurations the joint positions of every configuration
+        * @return false if the chain is empty or a configuration has the
+        *     wrong number of joints
+        */
+        bool linkEndpoints(const std::vector<std::vector<double>> &configurations);
+
+        /** Start of a link for a configuration of the last batch
+        *
+        * @param link the index of the link
+        * @param configuration the index of the configuration
+        * @return the start of the link capsule in the world
+        */
+        Eigen::Vector3d linkStart(int link, int configuration);
+
+        /** End of a link for a configuration of the last batch
+        *
+        * @param link the index of the link
+        * @param configuration the index of the configuration
+        * @return the end of the link capsule in the world
+        */
+        Eigen::Vector3d linkEnd(int link, int configuration);
+
+        /// Starts of the links, column 3 * link + axis for all configurations
+        Eigen::ArrayXXd starts;
+
+        /// Ends of the links, column 3 * link + axis for all configurations
+        Eigen::ArrayXXd ends;
+
+        /// Radius of the capsule of every link
+        std::vector<double> radii;
+
+    private:
+        /// Motion of a segment, constant + sine * A + versine * B
+        struct BatchSegment
+        {
+            bool revolute;
+            Eigen::Matrix3d rotation;
+            Eigen::Matrix3d rotationSine;
+            Eigen::Matrix3d rotationVersine;
+            Eigen::Vector3d position;
+            Eigen::Vector3d positionSine;
+            Eigen::Vector3d positionVersine;
+            Eigen::Vector3d linkStart;
+            Eigen::Vector3d linkEnd;
+
+            EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+        };
+
+        /// The transform from the world to the base of the chain
+        Eigen::Matrix4d baseTransform;
+
+        /// The segments from the base to the tip
+        std::vector<BatchSegment, Eigen::aligned_allocator<BatchSegment>> segments;
+
+        /// Number of revolute segments
+        int joints;
+
+        /// Number of configurations of the last batch
+        int count;
+
+        /// The joint positions laid out joint by joint
+        std::vector<double> interleaved;
+
+        /// Frame of every configuration, column 3 * row + column of rotation
+        Eigen::ArrayXXd rotation;
+        Eigen::ArrayXXd position;
+
+        /// Buffers of a segment, kept for the next batches
+        Eigen::ArrayXd sine;
+        Eigen::ArrayXd versine;
+        Eigen::ArrayXXd localRotation;
+        Eigen::ArrayXXd localPosition;
+        Eigen::ArrayXXd nextRotation;
+};
+
+#endif // BATCH_KINEMATICS_H
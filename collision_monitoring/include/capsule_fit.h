@@ -0,0 +1,90 @@
+#ifndef CAPSULE_FIT_H
+#define CAPSULE_FIT_H
+
+#include <string>
+#include <vector>
+#include <Eigen/Core>
+
+/// The capsule of a link, in the frame of the link
+struct LinkCapsule
+{
+    /// Name of the link in the URDF
+    std::string link;
+    /// Start of the capsule axis
+    Eigen::Vector3d start;
+    /// End of the capsule axis, equal to the start for a sphere
+    Eigen::Vector3d end;
+    /// Radius of the capsule
+    double radius;
+};
+
+/**
+ * Fits bounding capsules to the meshes of links and caches them
+ *
+ * The fitting is done offline, from the STL meshes of the links, and the
+ * capsules are saved in a small binary file next to the URDF, which the
+ * arms read when they are created.
+ *
+ * For an axis direction the axis goes through the center of the smallest
+ * circle enclosing the points projected on the plane normal to the
+ * direction, and for a radius the shortest axis covering every point
+ * follows exactly from the axial position and the distance to the axis of
+ * the points. The radius is searched numerically, from the radius of the
+ * circle to the sphere on the axis enclosing every point, and the
+ * direction from the principal axes of the points, so the capsule is
+ * close to, but not guaranteed to be, the capsule of minimum volume.
+ */
+class CapsuleFit
+{
+    public:
+        /** Reads the vertices of a binary or ASCII STL mesh
+        *
+        * @param filename the path of the STL file
+        * @param[out] vertices the distinct vertices of the mesh
+        * @return false if the file cannot be read
+        */
+        static bool readStl(const std::string &filename,
+                            std::vector<Eigen::Vector3d> &vertices);
+
+        /** Fits a bounding capsule of small volume to points
+        *
+        * @param points the points to enclose
+        * @param[out] capsule the start, end and radius of the capsule
+        * @return false if there are no points
+        */
+        static bool fit(const std::vector<Eigen::Vector3d> &points, LinkCapsule &capsule);
+
+        /** Volume of a capsule
+        *
+        * @param capsule the capsule
+        * @return the volume of the cylinder and of the two half spheres
+        */
+        static double volume(const LinkCapsule &capsule);
+
+        /** The cache file of a URDF
+        *
+        * @param urdfFilename the path of the URDF
+        * @return the path of the cache, the URDF path followed by .capsules
+        */
+        static std::string cacheFilename(const std::string &urdfFilename);
+
+        /** Writes the capsules of the links to a cache file
+        *
+        * @param filename the path of the cache
+        * @param capsules the capsules of the links
+        * @return false if the file cannot be written
+        */
+        static bool writeCache(const std::string &filename,
+                               const std::vector<LinkCapsule> &capsules);
+
+        /** Reads the capsules of the links from a cache file
+        *
+        * @param filename the path of the cache
+        * @param[out] capsules the capsules of the links
+        * @return false if the file is missing or is not a capsule cache
+        */
+        static bool readCache(const std::string &filename,
+                              std::vector<LinkCapsule> &capsules);
+};
+
+#endif // CAPSULE_FIT_H
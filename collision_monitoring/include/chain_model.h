@@ -0,0 +1,94 @@
+#ifndef CHAIN_MODEL_H
+#define CHAIN_MODEL_H
+
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+
+/**
+ * The kinematic model of a serial chain of revolute joints
+ *
+ * Frame 0 is the base of the chain and segment k moves frame k to frame
+ * k+1, first by turning about the axis of its joint, if it has one, and
+ * then by the fixed transform of the segment. Link k is a capsule rigidly
+ * attached to frame k, so it only moves with the joints before it.
+ *
+ * Besides the poses of a configuration, the model bounds the poses of the
+ * links over a box of joint positions with interval arithmetic.
+ */
+class ChainModel
+{
+    public:
+        /// One segment of the chain and the capsule of its link
+        struct Segment
+        {
+            /// True if the segment turns about its joint axis
+            bool revolute;
+            /// Unit axis of the joint in the frame of the segment start
+            Eigen::Vector3d axis;
+            /// A point of the joint axis in the frame of the segment start
+            Eigen::Vector3d axisPoint;
+            /// Transform of the segment when the joint is at 0
+            Eigen::Matrix4d tip;
+            /// End points of the link capsule in the frame of the segment start
+            Eigen::Vector3d linkStart;
+            Eigen::Vector3d linkEnd;
+            /// Radius of the link capsule
+            double linkRadius;
+
+            EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+        };
+
+        /// Constructor of ChainModel, creates an empty chain
+        ChainModel();
+
+        /// Destructor of ChainModel
+        ~ChainModel();
+
+        /// The transform from the world to the base of the chain
+        Eigen::Matrix4d baseTransform;
+
+        /// The segments from the base to the tip
+        std::vector<Segment, Eigen::aligned_allocator<Segment>> segments;
+
+        /** Getter of the number of joints
+        *
+        * @return the number of revolute segments
+        */
+        int nJoints();
+
+        /** Poses of the frames for a configuration
+        *
+        * @param jointPositions the joint positions in rad
+        * @param[out] frames the world poses of the segments.size() + 1 frames
+        * @return false if the number of joint positions is wrong
+        */
+        bool forwardKinematics(const std::vector<double> &jointPositions,
+                               std::vector<Eigen::Matrix4d,
+                                   Eigen::aligned_allocator<Eigen::Matrix4d>> &frames);
+
+        /** Capsules enclosing the links over a box of joint positions
+        *
+        * The poses of the frames are enclosed in intervals, joint by joint,
+        * and so are the end points of the links. Every link is then
+        * enclosed by the capsule between the middles of its end point
+        * intervals, inflated by the largest distance from a middle to a
+        * corner of its interval. Whatever the joint positions in the box,
+        * the link lies inside this capsule.
+        *
+        * @param lower the lowest joint positions of the box in rad
+        * @param upper the highest joint positions of the box in rad
+        * @param[out] starts the start of every enclosing capsule in the world
+        * @param[out] ends the end of every enclosing capsule in the world
+        * @param[out] inflations the radius added to every link radius in m
+        * @return false if the box is empty or has the wrong size
+        */
+        bool sweptLinks(const std::vector<double> &lower,
+                        const std::vector<double> &upper,
+                        std::vector<Eigen::Vector3d> &starts,
+                        std::vector<Eigen::Vector3d> &ends,
+                        std::vector<double> &inflations);
+};
+
+#endif // CHAIN_MODEL_H
@@ -0,0 +1,122 @@
+#ifndef CONFIGURATION_CACHE_H
+#define CONFIGURATION_CACHE_H
+
+#include <vector>
+#include <list>
+#include <cstddef>
+#include <unordered_map>
+#include "distance_matrix.h"
+
+/**
+ * A bounded cache of distances by joint configuration
+ *
+ * Joint positions are quantized to a grid with a step of the tolerance, two
+ * configurations in the same cell share the same entry. All the entries are
+ * created by configure() and their buffers sized by reserve(). When the
+ * cache is full the least recently used entry is overwritten, so its
+ * buffers are reused and a full cache does not allocate.
+ */
+class ConfigurationCache
+{
+    public:
+        /// The distances stored for one cell of configurations
+        struct Entry
+        {
+            /// The quantized joint positions of the cell
+            std::vector<long> key;
+            /// Distances from the links to the static obstacles
+            DistanceMatrix obstacleDistances;
+            /// Distances between the links
+            DistanceMatrix linkDistances;
+        };
+
+        /// Constructor of ConfigurationCache, creates a disabled cache
+        ConfigurationCache();
+
+        /// Destructor of ConfigurationCache
+        ~ConfigurationCache();
+
+        /** Sets the size and the tolerance, removes all the entries
+        *
+        * The entries are created here, the later inserts reuse them.
+        *
+        * @param capacity maximum number of entries, 0 disables the cache
+        * @param tolerance quantization step of the joint positions in rad
+        */
+        void configure(int capacity, double tolerance);
+
+        /** Sizes the buffers of all the entries
+        *
+        * @param nObstacles number of static obstacles
+        * @param nLinks number of links
+        * @param nJoints number of joints
+        */
+        void reserve(int nObstacles, int nLinks, int nJoints);
+
+        /** Checks if the cache is in use
+        *
+        * @return true if the capacity is not 0
+        */
+        bool enabled();
+
+        /** Getter of the quantization step
+        *
+        * @return the tolerance in rad
+        */
+        double tolerance();
+
+        /** Getter of the number of entries
+        *
+        * @return the number of configurations stored
+        */
+        int size();
+
+        /// Removes all the entries, the memory is kept
+        void clear();
+
+        /** Finds the entry of a configuration and marks it as recently used
+        *
+        * @param jointPositions the joint positions in rad
+        * @return the entry, NULL if the cell of the configuration is not stored
+        */
+        Entry* find(const std::vector<double> &jointPositions);
+
+        /** Adds the entry of a configuration, evicting the least recently
+        * used entry if the cache is full
+        *
+        * @param jointPositions the joint positions in rad
+        * @return the entry to fill
+        */
+        Entry& insert(const std::vector<double> &jointPositions);
+
+        /// Version of the static scene the entries were computed for
+        unsigned long sceneVersion;
+
+    private:
+        /// Hash of a quantized configuration
+        struct KeyHash
+        {
+            size_t operator()(const std::vector<long> &key) const;
+        };
+
+        int maxEntries;
+        double step;
+
+        /// The entries, most recently used first
+        std::list<Entry> entries;
+        /// Entries kept to be reused once evicted or cleared
+        std::list<Entry> spare;
+        /// The entries by quantized configuration
+        std::unordered_map<std::vector<long>, std::list<Entry>::iterator, KeyHash> index;
+
+        /// Reused to quantize without allocating
+        std::vector<long> scratchKey;
+
+        /** Quantizes a configuration into scratchKey
+        *
+        * @param jointPositions the joint positions in rad
+        */
+        void quantize(const std::vector<double> &jointPositions);
+};
+
+#endif // CONFIGURATION_CACHE_H
@@ -0,0 +1,118 @@
+#ifndef DISTANCE_MATRIX_H
+#define DISTANCE_MATRIX_H
+
+#include <vector>
+
+/**
+ * A caller owned buffer that the monitor fills with distances
+ *
+ * The distances are stored in one contiguous row-major block so the buffer
+ * can be reused every control cycle and copied to other consumers in one go.
+ * Memory is only reallocated when the number of rows or columns grows,
+ * which happens when obstacles are added to the monitor.
+ *
+ * The buffer also remembers the version of the primitive behind every row
+ * and column, so the monitor only recomputes the entries whose primitives
+ * changed since the buffer was last filled.
+ */
+class DistanceMatrix
+{
+    public:
+        /// Number of values stored for the witness points of one entry
+        static const int WITNESS_SIZE = 6;
+
+        /** Constructor of DistanceMatrix
+        *
+        * Creates an empty buffer, the monitor sets the shape on first use.
+        */
+        DistanceMatrix();
+
+        /// Destructor of DistanceMatrix
+        ~DistanceMatrix();
+
+        /** Sets the shape of the buffer
+        *
+        * The underlying storage keeps its capacity, so shrinking or keeping
+        * the same shape never reallocates. Changing the number of columns or
+        * turning on the witness points invalidates the cached entries.
+        *
+        * @param rows number of rows of the matrix
+        * @param cols number of columns of the matrix
+        */
+        void resize(int rows, int cols);
+
+        /** Marks all the entries as outdated
+        *
+        * The next time the buffer is filled every entry is recomputed.
+        */
+        void invalidate();
+
+        /** Copies the entries of another buffer
+        *
+        * Unlike the assignment operator only the rows * cols entries are
+        * copied into the storage of this buffer, which only reallocates when
+        * it grows. The witness points are copied if this buffer computes
+        * them and the other one stored them.
+        *
+        * @param other the buffer to copy
+        */
+        void assign(const DistanceMatrix &other);
+
+        /** Access to one distance
+        *
+        * @param row row of the entry
+        * @param col column of the entry
+        * @return reference to the distance stored in the entry
+        */
+        double& at(int row, int col);
+
+        /** Access to the first distance of a row
+        *
+        * @param row the row to access
+        * @return pointer to the cols contiguous distances of the row
+        */
+        double* row(int row);
+
+        /** Access to the witness points of one entry
+        *
+        * The witness points are the closest points found on the two
+        * primitives, stored as x, y, z of the first primitive followed by
+        * x, y, z of the second primitive.
+        *
+        * @param row row of the entry
+        * @param col column of the entry
+        * @return pointer to the WITNESS_SIZE values of the entry
+        */
+        double* witness(int row, int col);
+
+        /// Number of rows in the matrix
+        int rows;
+        /// Number of columns in the matrix
+        int cols;
+
+        /// If false the witness points are not computed nor stored
+        bool computeWitnessPoints;
+
+        /// Smallest distance of the matrix, set by Monitor::distanceToObjects
+        double minimum;
+        /// Row of the smallest distance, the first in row-major order on ties
+        int minimumRow;
+        /// Column of the smallest distance, -1 when the matrix is empty
+        int minimumCol;
+
+        /// The row-major distances, rows * cols values
+        std::vector<double> distances;
+        /// The row-major witness points, rows * cols * WITNESS_SIZE values
+        std::vector<double> witnessPoints;
+
+        /// Version of the primitive of each row when its entries were computed
+        std::vector<unsigned long> rowVersions;
+        /// Version of the primitive of each column when its entries were computed
+        std::vector<unsigned long> colVersions;
+
+    private:
+        /// Whether the cached entries were computed with witness points
+        bool witnessesStored;
+};
+
+#endif // DISTANCE_MATRIX_H
@@ -0,0 +1,226 @@
+#ifndef ID_MAP_H
+#define ID_MAP_H
+
+#include <vector>
+#include <string>
+
+/**
+ * A hash map from a (namespace, id) pair to a value
+ *
+ * Rviz markers are identified by their namespace and id. This map finds the
+ * entry of a marker in constant time using open addressing with linear
+ * probing in one flat array. Removed entries leave a tombstone that is
+ * cleared when the array is rebuilt. The capacity is a power of two and the
+ * array is rebuilt before it is half full, tombstones included, so probe
+ * sequences stay short.
+ */
+template<typename Value>
+class IdMap
+{
+    public:
+        /** Constructor of IdMap
+        *
+        * @param capacity initial number of entries, rounded up to a power
+        *     of two
+        */
+        IdMap(int capacity = 16)
+        {
+            this->count = 0;
+            this->used = 0;
+            int size = 4;
+            while (size < capacity) {
+                size *= 2;
+            }
+            entries.resize(size);
+        }
+
+        /** Finds the value of a key
+        *
+        * @param ns namespace of the key
+        * @param id id of the key
+        * @return address of the value, NULL if the key is not in the map
+        */
+        Value* find(const std::string &ns, int id)
+        {
+            int index = findIndex(ns, id);
+            if (index < 0) {
+                return NULL;
+            }
+            return &entries[index].value;
+        }
+
+        /** Sets the value of a key, adding the key if needed
+        *
+        * @param ns namespace of the key
+        * @param id id of the key
+        * @param value the value to store
+        * @return reference to the stored value
+        */
+        Value& insert(const std::string &ns, int id, const Value &value)
+        {
+            int index = findIndex(ns, id);
+            if (index >= 0) {
+                entries[index].value = value;
+                return entries[index].value;
+            }
+
+            // Keep at least half of the entries empty
+            if ((used + 1) * 2 > entries.size()) {
+                int size = entries.size();
+                if ((count + 1) * 4 > size) {
+                    size *= 2;
+                }
+                rebuild(size);
+            }
+
+            unsigned int mask = entries.size() - 1;
+            unsigned int i = hash(ns, id) & mask;
+            while (entries[i].state == FULL) {
+                i = (i + 1) & mask;
+            }
+            if (entries[i].state == EMPTY) {
+                used++;
+            }
+            entries[i].state = FULL;
+            entries[i].ns = ns;
+            entries[i].id = id;
+            entries[i].value = value;
+            count++;
+            return entries[i].value;
+        }
+
+        /** Removes a key from the map
+        *
+        * @param ns namespace of the key
+        * @param id id of the key
+        * @return true if the key was in the map
+        */
+        bool erase(const std::string &ns, int id)
+        {
+            int index = findIndex(ns, id);
+            if (index < 0) {
+                return false;
+            }
+            entries[index].state = DELETED;
+            entries[index].value = Value();
+            count--;
+            return true;
+        }
+
+        /// Removes all the keys, the capacity is kept
+        void clear()
+        {
+            for (int i = 0; i < entries.size(); i++) {
+                entries[i].state = EMPTY;
+                entries[i].value = Value();
+            }
+            count = 0;
+            used = 0;
+        }
+
+        /** Getter of the number of keys
+        *
+        * @return the number of keys in the map
+        */
+        int size()
+        {
+            return count;
+        }
+
+        /** Calls a function on every entry, in no particular order
+        *
+        * @param function callable taking the namespace, the id and a
+        *     reference to the value
+        */
+        template<typename Function>
+        void forEach(Function function)
+        {
+            for (int i = 0; i < entries.size(); i++) {
+                if (entries[i].state == FULL) {
+                    function(entries[i].ns, entries[i].id, entries[i].value);
+                }
+            }
+        }
+
+    private:
+        /// The state of one entry of the array
+        enum State { EMPTY, FULL, DELETED };
+
+        /// One entry of the array
+        struct Entry
+        {
+            State state;
+            std::string ns;
+            int id;
+            Value value;
+
+            Entry() : state(EMPTY), id(0), value() {}
+        };
+
+        /// The flat array of entries, its size is a power of two
+        std::vector<Entry> entries;
+        /// Number of keys in the map
+        int count;
+        /// Number of entries that are not empty, keys and tombstones
+        int used;
+
+        /** Hash of a key, FNV-1a over the namespace and the id
+        *
+        * @param ns namespace of the key
+        * @param id id of the key
+        * @return the hash of the key
+        */
+        static unsigned int hash(const std::string &ns, int id)
+        {
+            unsigned int value = 2166136261u;
+            for (int i = 0; i < ns.size(); i++) {
+                value = (value ^ (unsigned char)ns[i]) * 16777619u;
+            }
+            unsigned int key = id;
+            for (int i = 0; i < 4; i++) {
+                value = (value ^ (key & 0xff)) * 16777619u;
+                key >>= 8;
+            }
+            return value;
+        }
+
+        /** Finds the entry of a key
+        *
+        * @param ns namespace of the key
+        * @param id id of the key
+        * @return index of the entry, -1 if the key is not in the map
+        */
+        int findIndex(const std::string &ns, int id)
+        {
+            unsigned int mask = entries.size() - 1;
+            unsigned int i = hash(ns, id) & mask;
+            while (entries[i].state != EMPTY) {
+                if (entries[i].state == FULL && entries[i].id == id &&
+                    entries[i].ns == ns) {
+                    return i;
+                }
+                i = (i + 1) & mask;
+            }
+            return -1;
+        }
+
+        /** Moves all the keys to a new array, dropping the tombstones
+        *
+        * @param size the number of entries of the new array
+        */
+        void rebuild(int size)
+        {
+            std::vector<Entry> old;
+            old.swap(entries);
+            entries.resize(size);
+            count = 0;
+            used = 0;
+            for (int i = 0; i < old.size(); i++) {
+                if (old[i].state == FULL) {
+                    insert(old[i].ns, old[i].id, old[i].value);
+                }
+            }
+        }
+};
+
+#endif // ID_MAP_H
@@ -0,0 +1,121 @@
+#ifndef JOINT_STATE_ESTIMATOR_H
+#define JOINT_STATE_ESTIMATOR_H
+
+#include <Eigen/Core>
+
+/**
+ * Estimates the joint positions of an arm between its feedback messages
+ *
+ * The feedback of an arm arrives at its own rate, often a lot slower than
+ * the monitor and with jitter. The estimator keeps the last two timestamped
+ * samples and gives the positions at any time, so the monitor can tick at a
+ * fixed rate:
+ *  - after the latest sample the positions are extrapolated with its
+ *    velocities,
+ *  - between the two samples they follow the cubic Hermite curve matching
+ *    the positions and velocities of both.
+ *
+ * With every estimate comes a bound of its error, from the largest
+ * acceleration of the joints. Extrapolating for dt is off by at most
+ * a dt^2 / 2. The Hermite curve H is exact at both samples, so its error is
+ * at most (a + max|H''|) d^2 / 2 with d the time to the nearest sample.
+ * Samples without velocities get those of the difference with the previous
+ * sample, off by at most e = a h with h the time between the samples. The
+ * curve is then off by at most 4/27 h (e0 + e1) from the one of the exact
+ * velocities, and its H'' by at most 4 (e0 + e1) / h, both are added.
+ *
+ * The bound holds for any motion within the acceleration, it is meant for
+ * safety: ArmController widens the protective distance of its speed and
+ * separation monitoring by the motion of the links it allows.
+ *
+ * Only the constructor allocates, the estimator can run in the control
+ * loop. It is not thread safe, the samples and the estimates must come
+ * from the same thread.
+ */
+class JointStateEstimator
+{
+    public:
+        /** Constructor of JointStateEstimator
+        *
+        * @param nJoints the number of joints of the arm
+        * @param maxAcceleration the largest acceleration of a joint in rad/s^2
+        * @param maxExtrapolation the longest time in s the positions are
+        *     extrapolated for
+        */
+        JointStateEstimator(int nJoints, double maxAcceleration = 5.0,
+                            double maxExtrapolation = 0.2);
+
+        /// Destructor of JointStateEstimator
+        ~JointStateEstimator();
+
+        /** Adds a feedback sample
+        *
+        * Samples must come in the order of their time, an older or repeated
+        * sample is ignored. Feedback with more joints than the estimator,
+        * such as a gripper after the arm, only has its first nJoints used.
+        *
+        * @param time the time the positions were measured at in s
+        * @param positions the positions of the joints in rad
+        * @param velocities the velocities of the joints in rad/s, NULL if
+        *     the feedback has none, as many as the positions
+        * @param nPositions the number of positions, at least nJoints
+        * @return false if the sample was ignored
+        */
+        bool addSample(double time, const double* positions, const double* velocities,
+                       int nPositions);
+
+        /** Estimates the joint positions at a time
+        *
+        * Past the extrapolation limit the positions are those at the limit,
+        * and the bound is that of the limit.
+        *
+        * @param time the time of the estimate in s
+        * @param[out] positions the positions of the joints in rad
+        * @param nPositions the space for the positions
+        * @param[out] errorBound the largest error of a joint position in rad,
+        *     infinite if the velocities are not known yet
+        * @return false if there is no sample yet, the time is beyond the
+        *     extrapolation limit or the bound does not hold
+        */
+        bool estimate(double time, double* positions, int nPositions,
+                      double &errorBound) const;
+
+        /// Forgets the samples
+        void reset();
+
+        /** The time of the latest sample
+        *
+        * @return the time in s, 0 if there is no sample
+        */
+        double latestTime() const;
+
+        /// The largest acceleration of a joint in rad/s^2
+        double maxAcceleration;
+
+        /// The longest time in s the positions are extrapolated for
+        double maxExtrapolation;
+
+    private:
+        /// The number of joints of the arm
+        int nJoints;
+
+        /// The number of samples kept, up to 2
+        int nSamples;
+
+        /// Time of the previous and the latest sample
+        double times[2];
+
+        /// Positions of the previous and the latest sample
+        Eigen::VectorXd samplePositions[2];
+
+        /// Velocities of the previous and the latest sample
+        Eigen::VectorXd sampleVelocities[2];
+
+        /// Largest error of the velocities of each sample, 0 if measured
+        double velocityErrors[2];
+
+        /// Largest second derivative of the Hermite curve of each joint
+        Eigen::VectorXd curvatures;
+};
+
+#endif // JOINT_STATE_ESTIMATOR_H
@@ -0,0 +1,77 @@
+#ifndef KINEMATIC_STATE_H
+#define KINEMATIC_STATE_H
+
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+/**
+ * The kinematics of an arm for one set of joint positions
+ *
+ * The poses of the frames and the Jacobian of every frame are computed by
+ * the arm in one walk of the chain when its joint positions change, and
+ * then read by everything that needs them during the tick: the pose of
+ * the links, the link velocities of the monitor and the velocity IK. The
+ * version changes with every computation, so readers can tell when the
+ * values they derived are out of date.
+ *
+ * Everything is expressed in the base frame of the arm, so a motion of
+ * the base alone does not change the state.
+ */
+class KinematicState
+{
+    public:
+        /// Constructor of KinematicState, for an arm without joints
+        KinematicState();
+
+        /// Destructor of KinematicState
+        ~KinematicState();
+
+        /** Sizes the state for an arm, the only allocation of the state
+        *
+        * @param nJoints the number of joints of the arm
+        * @param nFrames the number of frames of the arm
+        */
+        void resize(int nJoints, int nFrames);
+
+        /** Checks if the state was computed for joint positions
+        *
+        * @param jointPositions the positions of the joints in rad
+        * @param nPositions the number of positions
+        * @return true if the state was computed for exactly these positions
+        */
+        bool isCurrent(const double* jointPositions, int nPositions) const;
+
+        /** Starts a new computation of the state
+        *
+        * Stores the positions and gives the state a new version, the arm
+        * then fills the frames and the Jacobians.
+        *
+        * @param jointPositions the positions of the joints in rad, one per
+        *     joint of the state
+        */
+        void setJointPositions(const double* jointPositions);
+
+        /// Version of the state, changes every time it is computed
+        unsigned long version;
+
+        /// The joint positions the state was computed for
+        Eigen::VectorXd jointPositions;
+
+        /// The poses of the frames in the arm base frame
+        std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>> frames;
+
+        /** The Jacobian of every frame, 6 rows by one column per joint
+        *
+        * The first three rows are the linear velocity of the origin of the
+        * frame and the last three its angular velocity, both in the arm
+        * base frame. The joints after the frame have zero columns.
+        */
+        std::vector<Eigen::MatrixXd> jacobians;
+
+    private:
+        /// False until the state is computed a first time
+        bool computed;
+};
+
+#endif // KINEMATIC_STATE_H
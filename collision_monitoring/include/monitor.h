@@ -3,8 +3,63 @@
 
 #include <vector>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
 #include "arm.h"
+#include "whole_body_model.h"
 #include "primitives.h"
+#include "distance_matrix.h"
+#include "thread_pool.h"
+#include "obstacle_store.h"
+#include "id_map.h"
+#include "world_model.h"
+#include "configuration_cache.h"
+#include "obstacle_clusters.h"
+#include "batch_kinematics.h"
+
+/**
+ * A pair of a link and an obstacle that may collide soon
+ */
+struct ImminentContact
+{
+    /// Index of the obstacle in Monitor::obstacles
+    int obstacle;
+    /// Index of the link of the arm
+    int link;
+    /// Current distance between the link and the obstacle
+    double distance;
+    /// First order rate of change of the distance, negative when closing
+    double distanceRate;
+    /// Fastest any point of the link can move towards the obstacle
+    double maxClosingSpeed;
+    /// Time to collision at the current rate, infinity when not closing
+    double timeToCollision;
+    /// Time to collision if the link moved straight at its fastest speed
+    double minimumTimeToCollision;
+};
+
+/**
+ * Parameters of the speed and separation monitoring
+ *
+ * The arm must be able to stop before reaching an obstacle, taking into 
+ * account the time it needs to react and to brake and the motion of the 
+ * obstacle meanwhile.
+ */
+struct SeparationParameters
+{
+    /// Time between a distance change and the start of the braking in s
+    double reactionTime;
+    /// Deceleration of the points of the arm when braking in m/s^2
+    double deceleration;
+    /// Largest speed of the obstacles towards the arm in m/s
+    double obstacleSpeed;
+    /// Distance that must be kept once stopped in m
+    double protectiveDistance;
+
+    /// Creates parameters for a slow reacting arm and still obstacles
+    SeparationParameters() : reactionTime(0.1), deceleration(1.0), 
+                             obstacleSpeed(0), protectiveDistance(0.05) {}
+};
 
 /**
  * A collision monitor to determine the distance to obstacles and other links
@@ -14,6 +69,11 @@
  * collision monitoring with obstacles by determining the distance to obstacles 
  * in the workspace, or collision monitoring with the arm itself by monitoring 
  * the distance between the links.  
+ *
+ * A monitor can also be a view of one robot of a WorldModel. The obstacles
+ * are then those of the world followed by the primitives of the other 
+ * robots, and the distances to them are read from the world instead of 
+ * being computed by the monitor.
  */
 class Monitor
 {
@@ -24,10 +84,16 @@ class Monitor
         Arm* arm; 
 		Base* base;
 
-        /// Obstacles in the workspace
+        /// Obstacles owned by the monitor, stored by value per shape
+        ObstacleStore store;
+
+        /** Obstacles in the workspace
+        *
+        * The obstacles of the store followed by the links and bases added 
+        * as obstacles. The list is rebuilt when obstacles are added or 
+        * removed, so it must not be modified directly.
+        */
         std::vector<Primitive*> obstacles; 
-        /// Obstacles to delete in destructor
-        std::vector<Primitive*> obstaclesToDelete; 
         /** Collision monitoring with obstacles. 
         *
         * This methods monitors the distance from one link of the arm 
@@ -37,6 +103,60 @@ class Monitor
         * obstacles.
         */
         std::vector<std::vector<double>> distanceToObjects();
+
+        /** Collision monitoring with obstacles into a reusable buffer.
+        *
+        * Same as distanceToObjects() but the distances are written into a
+        * caller owned row-major buffer with one row per obstacle and one
+        * column per link. The buffer only reallocates when obstacles are 
+        * added, and the witness points are only computed when the buffer
+        * asks for them. The smallest distance and its entry are stored in
+        * the buffer as well.
+        *
+        * Only the entries whose obstacle or link changed since the buffer
+        * was last filled are recomputed, the others keep their cached 
+        * values. If nothing changed the call returns right away.
+        *
+        * When a thread pool is set the obstacles are split into tiles of 
+        * rows that are evaluated in parallel. The result, including the 
+        * smallest distance, is the same as in the serial evaluation.
+        *
+        * The monitor of a world robot updates the world and copies its 
+        * distances, which is a no-op for the world if it was already 
+        * updated after the robots moved.
+        *
+        * @param[out] result the buffer to fill with the distances.
+        */
+        void distanceToObjects(DistanceMatrix &result);
+        /** Collision monitoring with obstacles within a time budget
+        *
+        * Entries whose obstacle and link did not change since the buffer 
+        * was last filled exactly are kept. Every other obstacle-link pair 
+        * first gets the distance between their enclosing spheres, a lower 
+        * bound of the distance. The pairs are then computed exactly from 
+        * the smallest bound up, until the budget runs out. Entries of the 
+        * pairs left unresolved keep their lower bound, so the matrix and 
+        * its smallest distance never overestimate a distance. The witness 
+        * points are only stored for the exact entries.
+        *
+        * Only the pairs that fit in the budget are ordered, by batches 
+        * that double in size, and with a thread pool the pairs of a batch 
+        * are spread over the workers. The clock is read between obstacles 
+        * while bounding and between pairs after, so the budget is exceeded 
+        * by at most a few pair evaluations. The pairs of the obstacles the 
+        * bounding did not reach get minus infinity as bound. The rows with
+        * unresolved pairs are recomputed by the next call.
+        *
+        * @param[out] result the buffer to fill with the distances.
+        * @param budget the time allowed for the call in s
+        * @param[out] resolvedDistance every pair closer than this was 
+        *     computed exactly, infinity if all the pairs were and minus 
+        *     infinity if the bounding did not finish
+        * @return the number of pairs left with a lower bound
+        */
+        int distanceToObjects(DistanceMatrix &result, double budget, 
+                              double &resolvedDistance);
+
 	 /** Collision monitoring with the base and other obstacles.
         *
         * This methods monitors the distance from base of the robot 
@@ -46,37 +166,386 @@ class Monitor
         */
         std::vector<double> baseDistanceToObjects();
 
+        /** Collision monitoring of the base with the obstacles into a 
+        * reusable buffer.
+        *
+        * Same as baseDistanceToObjects() but the distances are written 
+        * into a caller owned vector, one per obstacle.
+        *
+        * @param[out] result the vector to fill with the distances.
+        * @return false if the monitor does not have a base
+        */
+        bool baseDistanceToObjects(std::vector<double> &result);
+
+        /** Collision monitoring of the arm with its own base.
+        *
+        * The distance from every link of the arm to the box of the base 
+        * the arm is mounted on. The links resting on the base, the first
+        * WholeBodyModel::mountedLinks of a mobile manipulator, touch it by
+        * design and are infinitely far.
+        *
+        * @returns the distance of each link to the base, empty if the 
+        *     monitor does not have both an arm and a base
+        */
+        std::vector<double> armDistanceToBase();
+
+        /** Collision monitoring of the arm with its own base into a 
+        * reusable buffer.
+        *
+        * Same as armDistanceToBase() but the distances are written into a
+        * caller owned buffer with one row, the base, and one column per 
+        * link. Nothing is recomputed if neither the base nor a link moved.
+        *
+        * @param[out] result the buffer to fill with the distances.
+        * @return false if the monitor does not have both an arm and a base
+        */
+        bool armDistanceToBase(DistanceMatrix &result);
+
         /** Collision monitoring with the arm itself.
         *
         * This methods monitors the distance from one link of the arm 
-        * to other links. 
+        * to other links. The pairs allowed to collide by the arm, such as
+        * neighbouring links, are not checked and are infinitely far.
         *
         * @returns a matrix with the distance of each link to the other links.
         */
         std::vector<std::vector<double>> distanceBetweenArmLinks();
 
-        /** Adds primitive to list of obstacles
+        /** Collision monitoring with the arm itself into a reusable buffer.
+        *
+        * Same as distanceBetweenArmLinks() but the distances are written 
+        * into a caller owned row-major buffer with one row and one column 
+        * per link. Only the pairs with a link that moved are recomputed.
+        *
+        * @param[out] result the buffer to fill with the distances.
+        */
+        void distanceBetweenArmLinks(DistanceMatrix &result);
+
+        /** Predicts which links may hit an obstacle within a horizon
+        *
+        * The arm is moved to the joint positions and the link velocities 
+        * are found from the joint velocities through the Jacobian of the 
+        * arm. A pair is kept when its link, at the speed bound of its end
+        * points, could reach the obstacle within the horizon. For each kept
+        * pair the rate of change of the distance is taken at the closest 
+        * point of the link, obstacles are considered still.
+        *
+        * @param jointPositions the current joint positions in rad
+        * @param jointVelocities the current joint velocities in rad/s
+        * @param horizon how far ahead to look in seconds
+        * @param[out] contacts the pairs kept, sorted by timeToCollision 
+        *     then by minimumTimeToCollision
+        * @return false if the arm does not provide its link velocities
+        */
+        bool predictCollisions(const std::vector<double> &jointPositions,
+                               const std::vector<double> &jointVelocities,
+                               double horizon, 
+                               std::vector<ImminentContact> &contacts);
+
+        /** Largest scale of the joint velocities that keeps the separation
+        *
+        * For every link and obstacle the speed at which the closest point
+        * of the link approaches the obstacle is found from the joint 
+        * velocities through the Jacobian of the arm, at the current pose. 
+        * The allowed speed is the one from which the arm can still stop 
+        * with the protective distance left, so the scale is 1 when nothing 
+        * is near and reaches 0 at the protective distance. Links moving 
+        * away from an obstacle are not limited by it.
+        *
+        * @param jointVelocities the joint velocities to be commanded
+        * @param parameters the reaction and braking of the arm
+        * @return the scale between 0 and 1 to apply to all the joint 
+        *     velocities, 0 if the arm does not provide link velocities
+        */
+        double speedScale(const std::vector<double> &jointVelocities,
+                          const SeparationParameters &parameters);
+
+        /** Largest scale of the joint velocities from distances already computed
+        *
+        * Same as speedScale() for a caller that already filled the distances
+        * to the obstacles at the current pose, they are not computed again.
+        *
+        * @param jointVelocities the joint velocities to be commanded
+        * @param parameters the reaction and braking of the arm
+        * @param distances the distances to the obstacles at the current pose
+        *     from distanceToObjects(DistanceMatrix&), with witness points
+        * @return the scale between 0 and 1 to apply to all the joint 
+        *     velocities, 0 if the arm does not provide link velocities or 
+        *     the distances have no witness points
+        */
+        double speedScale(const std::vector<double> &jointVelocities,
+                          const SeparationParameters &parameters,
+                          DistanceMatrix &distances);
+
+        /** Largest scale of the joint velocities that keeps the separation
+        * to the obstacles and to the base of a mobile manipulator
+        *
+        * Same as speedScale() from distances already computed, with the 
+        * base the arm is mounted on as one more obstacle. The mounted links
+        * are infinitely far from it and never limit the scale.
+        *
+        * @param jointVelocities the joint velocities to be commanded
+        * @param parameters the reaction and braking of the arm
+        * @param distances the distances to the obstacles at the current pose
+        *     from distanceToObjects(DistanceMatrix&), with witness points
+        * @param baseDistances the distances to the base at the current pose
+        *     from armDistanceToBase(DistanceMatrix&), with witness points
+        * @return the scale between 0 and 1 to apply to all the joint 
+        *     velocities
+        */
+        double speedScale(const std::vector<double> &jointVelocities,
+                          const SeparationParameters &parameters,
+                          DistanceMatrix &distances,
+                          DistanceMatrix &baseDistances);
+
+        /** Lower bounds of the distances over a box of joint positions
+        *
+        * Every link is enclosed by a capsule that contains it for all the
+        * joint positions of the box, see ChainModel::sweptLinks, and the 
+        * distance from this capsule to an obstacle bounds the distance 
+        * from the link from below. If the smallest bound is above a 
+        * clearance, every configuration of the box is farther than the 
+        * clearance from the obstacles, for example all along a planning 
+        * edge, without checking any configuration. The bounds get looser
+        * as the box grows.
+        *
+        * The pose of the arm is not used nor changed. The rows of the 
+        * links of the arm itself, if it was added as an obstacle, are set
+        * to infinity. No witness points are stored and the next call of 
+        * distanceToObjects() recomputes every entry.
+        *
+        * @param lower the lowest joint positions of the box in rad
+        * @param upper the highest joint positions of the box in rad
+        * @param[out] result the buffer to fill with one row per obstacle 
+        *     and one column per link
+        * @return false if the arm has no chain model or the box is empty 
+        *     or has the wrong size
+        */
+        bool distanceBoundsOverBox(const std::vector<double> &lower,
+                                   const std::vector<double> &upper,
+                                   DistanceMatrix &result);
+
+        /** Checks many configurations of the arm at once
+        *
+        * When the arm gives its chain, see Arm::getChainModel, the end 
+        * points of the links are computed for all the configurations at 
+        * once with BatchKinematics and the distances from these capsules 
+        * to the obstacles are shared by the workers of the thread pool. 
+        * Otherwise every configuration is evaluated on a copy of the arm 
+        * made with Arm::clone, one per worker. The arm of the monitor is 
+        * not moved. The links of the arm itself are skipped if it was added
+        * as an obstacle.
+        *
+        * @param configurations the joint positions of every configuration
+        * @param clearance a configuration closer than this to an obstacle 
+        *     is invalid
+        * @param[out] minimumDistances the smallest distance from the links 
+        *     to the obstacles for every configuration
+        * @param[out] firstInvalid index of the first invalid configuration, 
+        *     -1 if all of them are valid
+        * @return false if the arm cannot be copied or a configuration has 
+        *     the wrong number of joints
+        */
+        bool checkConfigurations(const std::vector<std::vector<double>> &configurations,
+                                 double clearance,
+                                 std::vector<double> &minimumDistances,
+                                 int &firstInvalid);
+
+        /// Number of configurations evaluated in one parallel tile
+        int tileConfigurations;
+
+        /** Distance from a capsule given by its end points to an obstacle
+        *
+        * Spheres and capsules use the exact distance between segments, 
+        * the other shapes the distance of a Capsule primitive.
+        *
+        * @param start start of the axis of the capsule
+        * @param end end of the axis of the capsule
+        * @param radius radius of the capsule
+        * @param obstacle the obstacle
+        * @return the distance, negative when they overlap
+        */
+        static double capsuleDistance(const Eigen::Vector3d &start, 
+                                      const Eigen::Vector3d &end, 
+                                      double radius, Primitive* obstacle);
+
+        /** Turns on the cache of distances by joint configuration
+        *
+        * The joint positions are rounded to multiples of the tolerance 
+        * and the configurations that round to the same cell share their 
+        * distances, see configurationDistances(). Two configurations that
+        * close may still fall in neighbouring cells and both be computed.
+        * The cache is cleared whenever the static obstacles or the base 
+        * of the arm change.
+        *
+        * @param capacity maximum number of configurations kept, the least 
+        *     recently used is dropped first
+        * @param tolerance quantization step of the joint positions in rad
+        */
+        void enableConfigurationCache(int capacity, double tolerance);
+
+        /// Turns off the cache of distances by joint configuration
+        void disableConfigurationCache();
+
+        /** Distances of a configuration, from the cache when possible
+        *
+        * On a hit the stored distances are copied and neither the pose of 
+        * the arm nor any distance is computed, so the links keep their 
+        * previous pose. On a miss the arm is moved to the configuration 
+        * and the distances are computed and stored.
+        *
+        * Only the static obstacles, the ones added by copy, are covered. 
+        * Their rows are the first obstacleStore size rows of obstacles, 
+        * the arms and bases added as obstacles are not included. A hit 
+        * can differ from the exact distances by up to 
+        * configurationCacheError() for the obstacles and twice that 
+        * between links.
+        *
+        * @param jointPositions the joint positions in rad
+        * @param[out] obstacleDistances distances to the static obstacles, 
+        *     without witness points
+        * @param[out] linkDistances distances between the links
+        * @return true on a cache hit
+        */
+        bool configurationDistances(const std::vector<double> &jointPositions,
+                                    DistanceMatrix &obstacleDistances,
+                                    DistanceMatrix &linkDistances);
+
+        /** Largest error of a cached distance to an obstacle
+        *
+        * Every joint of a hit is within the tolerance of the stored one. 
+        * Joint i turning by the tolerance moves no point of the links by 
+        * more than the tolerance times its Arm::jointReach(), the sum of 
+        * these for all the joints bounds the error.
+        *
+        * @return the bound in m, 0 if the cache is off
+        */
+        double configurationCacheError();
+
+        /** Turns on the grouping of distant obstacles
+        *
+        * The obstacles are grouped by cells of a grid and each group is
+        * enclosed by a sphere. distanceToObjects() first computes the
+        * distance of the links to the spheres, and only computes the
+        * obstacles of a group whose sphere is closer than the refinement
+        * distance to a link. The other obstacles get the distance to the
+        * sphere of their group, a lower bound, with the witness points on
+        * the sphere. Every distance below the refinement distance is exact.
+        *
+        * The groups are rebuilt when an obstacle is added, removed or
+        * moved, not when the arm moves. The evaluation is serial and only
+        * used by a standalone monitor.
+        *
+        * @param cellSize edge of the cells of the grid in m
+        * @param refinementDistance distance below which the obstacles of a
+        *     group are computed one by one in m
+        */
+        void enableObstacleClustering(double cellSize, double refinementDistance);
+
+        /// Turns off the grouping of distant obstacles
+        void disableObstacleClustering();
+
+        /** Number of obstacles and groups computed by the last evaluation
+        *
+        * @return the number of groups plus the number of obstacles of the
+        *     refined groups, the number of obstacles without grouping,
+        *     0 if nothing moved
+        */
+        int effectiveObstacleCount();
+
+        /** Adds or updates the obstacle of a marker
+        *
+        * Markers are identified by their namespace and id. The first call
+        * for a marker adds a copy of the obstacle, the next calls update 
+        * its pose and dimensions, or replace it if the shape changed. 
+        * Finding the marker takes constant time.
+        *
+        * @param ns namespace of the marker
+        * @param id id of the marker
+        * @param obstacle address of the obstacle representing the marker
+        * @return handle of the obstacle, invalid if the shape is not 
+        *     supported
+        */
+        ObstacleHandle setMarkerObstacle(const std::string &ns, int id, 
+                                         Primitive* obstacle);
+
+        /** Removes the obstacle of a marker
+        *
+        * @param ns namespace of the marker
+        * @param id id of the marker
+        * @return true if the marker had an obstacle
+        */
+        bool removeMarkerObstacle(const std::string &ns, int id);
+
+        /// Removes the obstacles of all the markers
+        void removeAllMarkerObstacles();
+
+        /** Finds the obstacle of a marker
+        *
+        * @param ns namespace of the marker
+        * @param id id of the marker
+        * @return handle of the obstacle, invalid if the marker is unknown
+        */
+        ObstacleHandle markerObstacle(const std::string &ns, int id);
+
+        /** Moves an obstacle of the monitor
+        *
+        * The version of the obstacle only changes if the pose is different,
+        * so the cached distances to a still obstacle are kept.
+        *
+        * @param index the index of the obstacle in obstacles
+        * @param pose the new pose of the obstacle
+        * @return true if the obstacle exists, false otherwise
+        */
+        bool updateObstacle(int index, const Eigen::Matrix4d &pose);
+
+        /** Moves an obstacle added with addObstacle
+        *
+        * @param handle the handle returned when adding the obstacle
+        * @param pose the new pose of the obstacle
+        * @return true if the obstacle exists, false otherwise
+        */
+        bool updateObstacle(ObstacleHandle handle, const Eigen::Matrix4d &pose);
+
+        /** Sets the thread pool used to evaluate the obstacles
+        *
+        * The pool is not owned by the monitor and can be shared between
+        * monitors that are not evaluated at the same time. 
+        *
+        * @param pool the pool to use, NULL to evaluate on the calling thread.
+        */
+        void setThreadPool(ThreadPool* pool);
+
+        /// Number of obstacle-link pairs evaluated in one parallel tile
+        int tilePairs;
+
+        /** Adds a copy of a primitive to the obstacles
+        *
+        * The copy is kept in the store of the monitor, the primitive 
+        * passed can be destroyed after the call.
         *
-        * Adds a primitive to the list of obstacles.
         * @param obstacle address of the obstacle to be added.
+        * @return handle to update or remove the obstacle, invalid if the 
+        *     shape is not supported
         */
-        void addObstacle(Primitive* obstacle);
-        /** Adds primitive to list of obstacles
+        ObstacleHandle addObstacle(Primitive* obstacle);
+        /** Adds a copy of a sphere to the obstacles
         *
-        * Adds a primitive to the list of obstacles.
         * @param obstacle address of the obstacle to be added.
+        * @return handle to update or remove the obstacle
         */
-        void addObstacle(Sphere* obstacle);
-        /** Adds primitive to list of obstacles
+        ObstacleHandle addObstacle(Sphere* obstacle);
+        /** Adds a copy of a capsule to the obstacles
         *
-        * Adds a primitive to the list of obstacles.
         * @param obstacle address of the obstacle to be added.
+        * @return handle to update or remove the obstacle
         */
-        void addObstacle(Capsule* obstacle);
+        ObstacleHandle addObstacle(Capsule* obstacle);
         /** Adds arm to list of obstacles
         *
         * This method decomposes an arm into its primitives to add it into 
-        * the vector of obstacles.
+        * the vector of obstacles. The links are not copied, so they follow
+        * the arm when it moves.
         *
         * @param arm address of the arm to be treated as an obstacle.
         */
@@ -84,21 +553,42 @@ class Monitor
 	
         /** Adds base to list of obstacles
         *
-        * This method decomposes a base into its box3 primitive to add it into 
-        * the vector of obstacles.
+        * This method adds the box3 primitive of a base into the vector of 
+        * obstacles. The box is not copied, so it follows the base.
         *
         * @param base address of the base to be treated as an obstacle.
         */
         void addObstacle(Base* base_obstacle);
-	/** Adds box to list of obstacles
-         *
-        * Adds a box to the list of obstacles.
+        /** Adds a copy of a box to the obstacles
+        *
         * @param box address of the box obstacle to be added.
+        * @return handle to update or remove the obstacle
         */
+        ObstacleHandle addObstacle(Box3* box); 
 
+        /** Adds copies of many primitives at once
+        *
+        * Reserves the memory for all the obstacles up front and rebuilds
+        * the list of obstacles only once.
+        *
+        * @param newObstacles addresses of the obstacles to be added.
+        * @return the handles of the obstacles in the same order
+        */
+        std::vector<ObstacleHandle> addObstacles(std::vector<Primitive*> &newObstacles);
 
+        /** Removes an obstacle added with addObstacle
+        *
+        * @param handle the handle returned when adding the obstacle
+        * @return true if the obstacle was found and removed
+        */
+        bool removeObstacle(ObstacleHandle handle);
 
-	void addObstacle(Box3* box); 
+        /** Position of an obstacle in obstacles and in the distance rows
+        *
+        * @param handle the handle returned when adding the obstacle
+        * @return the position, -1 if the obstacle is not in the monitor
+        */
+        int obstacleIndex(ObstacleHandle handle);
         /** Constructor of Monitor
         *
         * This is the constructor for the monitor class, it takes as 
@@ -118,9 +608,335 @@ class Monitor
         Monitor(Base* base);
         Monitor(Arm* arm);
 
+        /** Constructor of a Monitor viewing a robot of a world
+        *
+        * The obstacles added to the monitor are added to the world and 
+        * shared with the other robots.
+        *
+        * @param world the world of the robot, it must outlive the monitor
+        * @param robot index of the robot in the world
+        */
+        Monitor(WorldModel* world, int robot);
+
+        /** Constructor of a Monitor of a mobile manipulator
+        *
+        * The arm and the base of the model are monitored against the same
+        * obstacles, and the model is updated before the distances are 
+        * computed, so they are for the last base pose and joint positions 
+        * set.
+        *
+        * @param body the arm and its base, it must outlive the monitor
+        */
+        Monitor(WholeBodyModel* body);
+
         /** Destructor for the monitor class
         */
         ~Monitor();
+
+    private:
+
+        /// The world viewed by the monitor, NULL for a standalone monitor
+        WorldModel* world;
+        /// Index of the robot of the monitor in the world
+        int robot;
+        /// Layout version of the world when obstacles was last built
+        unsigned long worldLayout;
+
+        /** The store the obstacles are added to
+        *
+        * @return the store of the world or the one of the monitor
+        */
+        ObstacleStore& obstacleStore();
+
+        /// The mobile manipulator of the monitor, NULL if there is none
+        WholeBodyModel* body;
+
+        /** Builds obstacles again if robots or obstacles of the world 
+        * changed, and places the mobile manipulator if it moved
+        */
+        void refreshWorldObstacles();
+
+        /** Fills a buffer with the distances computed by the world
+        *
+        * @param[out] result the buffer to fill with the distances.
+        */
+        void copyWorldDistances(DistanceMatrix &result);
+
+        /// Handles of the obstacles added by marker
+        IdMap<ObstacleHandle> markerObstacles;
+
+        /// Links and bases added as obstacles, not owned by the monitor
+        std::vector<Primitive*> externalObstacles;
+
+        /// Rebuilds obstacles after obstacles were added or removed
+        void rebuildObstacleList();
+
+        /// Builds obstacles from the stored and the external obstacles
+        void collectObstacles();
+
+        /// Scratch matrices for the closest points, one per worker
+        std::vector<Eigen::MatrixXd> closestPoints;
+
+        /// Copies of the arm used by checkConfigurations, one per worker
+        std::vector<Arm*> batchArms;
+        /// The obstacles checked by checkConfigurations
+        std::vector<Primitive*> batchObstacles;
+        /// End points of the links of the configurations checked
+        BatchKinematics batchKinematics;
+
+        /// Kinematic model of the arm, loaded on first use
+        ChainModel chainModel;
+        /// True once chainModel was filled by the arm
+        bool chainModelLoaded;
+        /// Capsules enclosing the links over a box of joint positions
+        std::vector<Eigen::Vector3d> sweptStarts;
+        std::vector<Eigen::Vector3d> sweptEnds;
+        std::vector<double> sweptInflations;
+
+        /** Distance from the middle capsule of a link to an obstacle
+        *
+        * @param link the link whose capsule of sweptStarts and sweptEnds 
+        *     is used, with the radius of the link
+        * @param obstacle the obstacle
+        * @return the distance, negative when they overlap
+        */
+        double sweptDistance(int link, Primitive* obstacle);
+
+        /// A pair of the anytime evaluation and its lower bound
+        struct PairBound
+        {
+            double bound;
+            int row;
+            int col;
+        };
+        /// The pairs of the anytime evaluation, kept to avoid allocations
+        std::vector<PairBound> boundedPairs;
+        /// Flags the bounded pairs that were computed exactly
+        std::vector<char> pairResolved;
+        /// The task run by the pool for the anytime evaluation
+        ThreadPool::Task boundedPairsTask;
+        /// Time the anytime evaluation must stop
+        std::chrono::steady_clock::time_point anytimeDeadline;
+        /// First pair of the batch of the anytime evaluation
+        int anytimeBatch;
+
+        /** Computes pairs of the current anytime batch exactly
+        *
+        * Stops once the deadline passed, the pairs computed are flagged in
+        * pairResolved.
+        *
+        * @param begin first pair, relative to the batch
+        * @param end pair after the last one, relative to the batch
+        * @param worker the worker evaluating the pairs
+        */
+        void computeBoundedPairs(int begin, int end, int worker);
+        /// Enclosing spheres of the links and the obstacles
+        std::vector<Eigen::Vector3d> linkCenters;
+        std::vector<double> linkRadii;
+        std::vector<Eigen::Vector3d> obstacleCenters;
+        std::vector<double> obstacleRadii;
+
+        /// Distances by joint configuration, off unless enabled
+        ConfigurationCache configurationCache;
+        /// Bound on the error of a cached distance to an obstacle
+        double configurationError;
+
+        /** Fingerprint of the static obstacles
+        *
+        * @return a value that changes when a static obstacle is added, 
+        *     removed or changed, or when the base of the arm moves
+        */
+        unsigned long staticSceneVersion();
+
+        /// True if distant obstacles are grouped by distanceToObjects
+        bool clustering;
+        /// Groups of obstacles enclosed by spheres
+        ObstacleClusters clusters;
+        /// Distance below which the obstacles of a group are computed
+        double refinementDistance;
+        /// Distances of the links to the sphere of a group
+        std::vector<double> clusterDistances;
+        /// Witness points of the links to the sphere of a group
+        std::vector<double> clusterWitnesses;
+        /// Obstacles and groups computed by the last evaluation
+        int effectiveObstacles;
+
+        /** Evaluates the obstacle rows with the groups of obstacles
+        *
+        * @param[out] result the buffer to fill, sized for the obstacles
+        */
+        void computeClusteredRows(DistanceMatrix &result);
+
+        /// Distances and witness points used by predictCollisions and speedScale
+        DistanceMatrix predictionDistances;
+        /// Distances and witness points to the base of a WholeBodyModel used by speedScale
+        DistanceMatrix predictionBaseDistances;
+        /** Rate of change of a distance
+        *
+        * @param distances the distances with their witness points
+        * @param obstacle the row of the obstacle
+        * @param link the column of the link
+        * @return the rate at the closest point of the link for the link 
+        *     velocities, negative when closing
+        */
+        double distanceRate(DistanceMatrix &distances, int obstacle, int link);
+
+        /// Velocities of the links used by predictCollisions and speedScale
+        std::vector<Eigen::Vector3d> linkLinear;
+        std::vector<Eigen::Vector3d> linkAngular;
+
+        /// Flags the links that moved since a buffer was last filled
+        std::vector<char> linkDirty;
+
+        /** Finds the links that moved since a buffer was last filled
+        *
+        * @param result the buffer whose columns are the links of the arm
+        * @return true if at least one link moved
+        */
+        bool findMovedLinks(DistanceMatrix &result);
+
+        /// Pool used for the parallel evaluation, NULL when serial
+        ThreadPool* pool;
+        /// The task run by the pool, created once to avoid allocations
+        ThreadPool::Task obstacleRowsTask;
+        /// The buffer the pool is currently filling
+        DistanceMatrix* tileTarget;
+        /// Number of obstacle rows in one tile of the current evaluation
+        int tileRows;
+        /// Smallest distance found in each tile and its entry
+        std::vector<double> tileMinimum;
+        std::vector<int> tileMinimumRow;
+        std::vector<int> tileMinimumCol;
+
+        /** Stores the closest points of two primitives in a witness entry
+        *
+        * @param first the primitive whose point is stored first
+        * @param second the primitive whose point is stored second, of its 
+        *     concrete shape when known
+        * @param[out] witness the WITNESS_SIZE values to fill
+        * @param worker the worker whose scratch matrix is used
+        */
+        template<typename Shape>
+        void storeWitness(Primitive* first, Shape* second, double* witness,
+                          int worker);
+
+        /// The smallest distance of a block of rows and its entry
+        struct BlockMinimum
+        {
+            double distance;
+            int row;
+            int col;
+        };
+
+        /** Fills the outdated distances of one obstacle row
+        *
+        * @param[out] result the buffer to fill
+        * @param row the row of the obstacle
+        * @param obstacle the obstacle, of its concrete shape when it comes
+        *     from the store so the distances need no cast
+        * @param worker the worker evaluating the row
+        * @param[in,out] minimum the smallest distance of the block so far
+        */
+        template<typename Shape>
+        void computeObstacleRow(DistanceMatrix &result, int row, Shape* obstacle,
+                                int worker, BlockMinimum &minimum);
+
+        /// Fills the rows of the stored obstacles, one shape array at a time
+        struct RowKernel
+        {
+            Monitor* monitor;
+            DistanceMatrix* result;
+            int worker;
+            BlockMinimum minimum;
+
+            template<typename Shape>
+            void operator()(int row, Shape &obstacle)
+            {
+                monitor->computeObstacleRow(*result, row, &obstacle, worker, minimum);
+            }
+        };
+
+        /** Computes one entry of the obstacle rows
+        *
+        * @param[out] result the buffer to fill
+        * @param row the row of the obstacle
+        * @param col the column of the link
+        * @param obstacle the obstacle, of its concrete shape when known
+        * @param worker the worker whose scratch matrix is used
+        */
+        template<typename Shape>
+        void computeEntry(DistanceMatrix &result, int row, int col, Shape* obstacle,
+                          int worker);
+
+        /// Computes the entry of one link and a stored obstacle
+        struct EntryKernel
+        {
+            Monitor* monitor;
+            DistanceMatrix* result;
+            int col;
+            int worker;
+
+            template<typename Shape>
+            void operator()(int row, Shape &obstacle)
+            {
+                monitor->computeEntry(*result, row, col, &obstacle, worker);
+            }
+        };
+
+        /// Smallest distance from a link to the stored obstacles
+        struct MinimumKernel
+        {
+            Primitive* link;
+            double minimum;
+
+            template<typename Shape>
+            void operator()(int, Shape &obstacle)
+            {
+                minimum = std::min(minimum, link->getShortestDistance(&obstacle));
+            }
+        };
+
+        /// Smallest distance from a capsule given by its end points to the
+        /// stored obstacles, in closed form for the spheres and capsules
+        struct EndpointKernel
+        {
+            Eigen::Vector3d start;
+            Eigen::Vector3d end;
+            double radius;
+            double minimum;
+
+            void operator()(int, Sphere &obstacle);
+            void operator()(int, Capsule &obstacle);
+
+            template<typename Shape>
+            void operator()(int, Shape &obstacle)
+            {
+                minimum = std::min(minimum, capsuleDistance(start, end, radius, &obstacle));
+            }
+        };
+
+        /** Evaluates a block of obstacle rows
+        *
+        * Fills the outdated distances of the rows and keeps the smallest one
+        * of the block, the first one in row-major order on ties.
+        *
+        * @param[out] result the buffer to fill
+        * @param begin first row of the block
+        * @param end row after the last row of the block
+        * @param tile index of the block
+        * @param worker the worker evaluating the block
+        */
+        void computeObstacleRows(DistanceMatrix &result, int begin, int end, 
+                                 int tile, int worker);
+
+        /** Distances from the links to the static obstacles only
+        *
+        * Used on a miss of the configuration cache, the rows of the links
+        * and bases added as obstacles are not computed.
+        *
+        * @param[out] result one row per static obstacle, without witness points
+        */
+        void staticObstacleDistances(DistanceMatrix &result);
 };
 
 #endif // MONITOR_H
\ No newline at end of file
@@ -0,0 +1,94 @@
+#ifndef OBSTACLE_CLUSTERS_H
+#define OBSTACLE_CLUSTERS_H
+
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+#include "primitives.h"
+
+/**
+ * Groups of nearby obstacles enclosed by one sphere
+ *
+ * The obstacles are binned in a grid by the center of their enclosing
+ * sphere, every occupied cell is a cluster. The sphere of a cluster
+ * encloses the spheres of all its obstacles, so the distance to the
+ * cluster sphere is a lower bound of the distance to any of them.
+ *
+ * The clusters are only rebuilt when an obstacle is added, removed or
+ * changed, so for still obstacles updating them is a check of versions.
+ */
+class ObstacleClusters
+{
+    public:
+        /// Constructor of ObstacleClusters, creates no cluster
+        ObstacleClusters();
+
+        /// Destructor of ObstacleClusters
+        ~ObstacleClusters();
+
+        /** Sets the size of the cells of the grid, the clusters are rebuilt
+        *
+        * @param cellSize the edge of a cell in m
+        */
+        void setCellSize(double cellSize);
+
+        /** Rebuilds the clusters if the obstacles changed
+        *
+        * @param obstacles the obstacles to group
+        * @return true if the clusters were rebuilt
+        */
+        bool update(std::vector<Primitive*> &obstacles);
+
+        /** Getter of the number of clusters
+        *
+        * @return the number of occupied cells
+        */
+        int size();
+
+        /** Sphere enclosing the obstacles of a cluster
+        *
+        * @param cluster index of the cluster
+        * @return the sphere, owned by the clusters
+        */
+        Sphere* bound(int cluster);
+
+        /** Obstacles of a cluster
+        *
+        * @param cluster index of the cluster
+        * @return pointer to the indices of the obstacles of the cluster
+        */
+        const int* members(int cluster);
+
+        /** Number of obstacles of a cluster
+        *
+        * @param cluster index of the cluster
+        * @return the number of obstacles in the cluster
+        */
+        int nMembers(int cluster);
+
+    private:
+        double cellSize;
+
+        /// Version of every obstacle when the clusters were built
+        std::vector<unsigned long> versions;
+
+        /// Enclosing sphere of every cluster
+        std::vector<Sphere, Eigen::aligned_allocator<Sphere>> bounds;
+        /// Indices of the obstacles grouped by cluster
+        std::vector<int> memberList;
+        /// Start of the obstacles of each cluster in memberList, plus the end
+        std::vector<int> memberStart;
+
+        /// Scratch of the rebuild
+        std::vector<Eigen::Vector3d> centers;
+        std::vector<double> radii;
+        std::vector<int> clusterOf;
+
+        /** Groups the obstacles again
+        *
+        * @param obstacles the obstacles to group
+        */
+        void rebuild(std::vector<Primitive*> &obstacles);
+};
+
+#endif // OBSTACLE_CLUSTERS_H
@@ -0,0 +1,275 @@
+#ifndef OBSTACLE_STORE_H
+#define OBSTACLE_STORE_H
+
+#include <vector>
+#include <algorithm>
+#include <Eigen/StdVector>
+#include "primitives.h"
+
+/**
+ * A stable reference to an obstacle in an ObstacleStore
+ *
+ * The handle stays valid while the obstacle is in the store, even when other
+ * obstacles are added or removed and the obstacle moves in memory. Once the
+ * obstacle is removed the handle no longer resolves, also if its slot is
+ * reused by a new obstacle.
+ */
+struct ObstacleHandle
+{
+    /// Slot of the obstacle in the store, -1 for an invalid handle
+    int slot;
+    /// Generation of the slot when the handle was created
+    unsigned int generation;
+
+    /// Creates an invalid handle
+    ObstacleHandle() : slot(-1), generation(0) {}
+
+    /** Checks if the handle was given by a store
+    *
+    * @return true if the handle refers to a slot
+    */
+    bool valid() const { return slot >= 0; }
+};
+
+/**
+ * An arena that stores obstacles by value, one contiguous array per shape
+ *
+ * Obstacles of the same shape are kept next to each other in memory, so
+ * iterating over them does not chase pointers and adding many obstacles
+ * only allocates when an array grows. Removing an obstacle moves the last
+ * obstacle of the same shape into its place, the handles follow the move.
+ *
+ * The obstacles are listed spheres first, then capsules, then boxes.
+ */
+class ObstacleStore
+{
+    public:
+        /// The shapes stored, in the order they are listed
+        enum ShapeType { SPHERE = 0, CAPSULE = 1, BOX = 2, N_SHAPE_TYPES = 3 };
+
+        /// Contiguous storage of one shape, aligned for the Eigen members
+        template<typename Shape>
+        using Array = std::vector<Shape, Eigen::aligned_allocator<Shape>>;
+
+        /// Constructor of ObstacleStore, creates an empty store
+        ObstacleStore();
+
+        /// Destructor of ObstacleStore
+        ~ObstacleStore();
+
+        /** Reserves memory for obstacles that are about to be added
+        *
+        * @param nSpheres number of spheres to make room for
+        * @param nCapsules number of capsules to make room for
+        * @param nBoxes number of boxes to make room for
+        */
+        void reserve(int nSpheres, int nCapsules, int nBoxes);
+
+        /** Adds a copy of an obstacle to the store
+        *
+        * @param obstacle address of the obstacle to copy
+        * @return handle to the stored copy, invalid for unknown shapes
+        */
+        ObstacleHandle add(Primitive* obstacle);
+        ObstacleHandle add(Sphere* obstacle);
+        ObstacleHandle add(Capsule* obstacle);
+        ObstacleHandle add(Box3* obstacle);
+
+        /** Sets a stored obstacle to the shape and pose of another one
+        *
+        * Only the pose is updated when the dimensions are the same, so the
+        * version of the obstacle only changes if it moved or was resized.
+        *
+        * @param handle handle of the obstacle to update
+        * @param obstacle address of the obstacle to copy
+        * @return false if the obstacle is not in the store or if the shapes
+        *     differ, in which case nothing is changed
+        */
+        bool update(ObstacleHandle handle, Primitive* obstacle);
+
+        /** Removes an obstacle from the store
+        *
+        * @param handle handle of the obstacle to remove
+        * @return true if the obstacle was in the store
+        */
+        bool remove(ObstacleHandle handle);
+
+        /// Removes all the obstacles, all the handles become invalid
+        void clear();
+
+        /** Access to a stored obstacle
+        *
+        * The address is only valid until the next obstacle is added or
+        * removed, keep the handle to refer to the obstacle for longer.
+        *
+        * @param handle handle of the obstacle
+        * @return address of the obstacle, NULL if it is not in the store
+        */
+        Primitive* get(ObstacleHandle handle);
+
+        /** Position of an obstacle in the list of all obstacles
+        *
+        * @param handle handle of the obstacle
+        * @return the position, -1 if the obstacle is not in the store
+        */
+        int position(ObstacleHandle handle);
+
+        /** Getter of the number of obstacles
+        *
+        * @return the number of obstacles of all shapes
+        */
+        int size();
+
+        /** Appends the address of every obstacle to a list
+        *
+        * The obstacles are appended in the order given by position().
+        *
+        * @param[out] list the list to append to
+        */
+        void collect(std::vector<Primitive*> &list);
+
+        /** Access to the contiguous array of one shape
+        *
+        * @return the array storing all the obstacles of the shape
+        */
+        template<typename Shape>
+        Array<Shape>& items();
+
+        /** Calls a function on every obstacle of one shape
+        *
+        * @param function callable taking a Shape&
+        */
+        template<typename Shape, typename Function>
+        void forEach(Function function)
+        {
+            Array<Shape> &array = items<Shape>();
+            for (int i = 0; i < array.size(); i++) {
+                function(array[i]);
+            }
+        }
+
+        /** Calls a function on every obstacle, shape by shape
+        *
+        * @param function a functor with overloads for Sphere&, Capsule& and
+        *     Box3&, or a callable taking a Primitive&
+        */
+        template<typename Function>
+        void forEachObstacle(Function function)
+        {
+            forEach<Sphere>(function);
+            forEach<Capsule>(function);
+            forEach<Box3>(function);
+        }
+
+        /** Calls a function on the obstacles of a range of positions
+        *
+        * The obstacles are visited shape by shape in the order of their
+        * positions, each shape straight from its contiguous array, so the
+        * function gets the concrete shape and needs no cast.
+        *
+        * @param begin the first position
+        * @param end the position after the last one, at most size()
+        * @param function a functor with an operator()(int position, Shape&)
+        *     for Sphere, Capsule and Box3
+        */
+        template<typename Function>
+        void forEachInRange(int begin, int end, Function &function)
+        {
+            int offset = 0;
+            forEachInRange(spheres, offset, begin, end, function);
+            offset += spheres.size();
+            forEachInRange(capsules, offset, begin, end, function);
+            offset += capsules.size();
+            forEachInRange(boxes, offset, begin, end, function);
+        }
+
+    private:
+        /** Calls a function on the obstacles of one array in a range
+        *
+        * @param array the array of the shape
+        * @param offset the position of the first obstacle of the array
+        * @param begin the first position
+        * @param end the position after the last one
+        * @param function the functor called with the position and the shape
+        */
+        template<typename Shape, typename Function>
+        void forEachInRange(Array<Shape> &array, int offset, int begin, int end,
+                            Function &function)
+        {
+            int first = std::max(begin - offset, 0);
+            int last = std::min(end - offset, (int)array.size());
+            for (int k = first; k < last; k++) {
+                function(offset + k, array[k]);
+            }
+        }
+
+        /// Where the obstacle of a handle is stored
+        struct Slot
+        {
+            /// ShapeType of the obstacle
+            int type;
+            /// Index of the obstacle in the array of its shape
+            int index;
+            /// Increased every time the slot is freed
+            unsigned int generation;
+        };
+
+        /// The slots handed out, indexed by ObstacleHandle::slot
+        std::vector<Slot> slots;
+        /// Slots that can be reused
+        std::vector<int> freeSlots;
+
+        Array<Sphere> spheres;
+        Array<Capsule> capsules;
+        Array<Box3> boxes;
+
+        /// Slot of every stored obstacle, one list per shape
+        std::vector<int> owners[N_SHAPE_TYPES];
+
+        /** Gives a slot to the obstacle just added to an array
+        *
+        * @param type ShapeType of the obstacle
+        * @param index index of the obstacle in the array of its shape
+        * @return the handle of the obstacle
+        */
+        ObstacleHandle createHandle(int type, int index);
+
+        /** Removes an obstacle from the array of its shape
+        *
+        * @param array the array of the shape
+        * @param type ShapeType of the obstacle
+        * @param index index of the obstacle in the array
+        */
+        template<typename Shape>
+        void removeAt(Array<Shape> &array, int type, int index)
+        {
+            int last = array.size() - 1;
+            if (index != last) {
+                array[index] = array[last];
+                owners[type][index] = owners[type][last];
+                slots[owners[type][index]].index = index;
+            }
+            array.pop_back();
+            owners[type].pop_back();
+        }
+};
+
+template<>
+inline ObstacleStore::Array<Sphere>& ObstacleStore::items<Sphere>()
+{
+    return spheres;
+}
+
+template<>
+inline ObstacleStore::Array<Capsule>& ObstacleStore::items<Capsule>()
+{
+    return capsules;
+}
+
+template<>
+inline ObstacleStore::Array<Box3>& ObstacleStore::items<Box3>()
+{
+    return boxes;
+}
+
+#endif // OBSTACLE_STORE_H
@@ -32,6 +32,33 @@ class Ray;
 class Primitive
 {    
     public:
+        /** Constructor of Primitive
+        *
+        * Gives the primitive a version that no other primitive has.
+        */
+        Primitive();
+
+        /// Destructor of Primitive
+        virtual ~Primitive();
+
+        /** Sets the pose of the primitive
+        *
+        * The version of the primitive is only increased if the pose is
+        * different from the current one, so cached distances to this
+        * primitive stay valid when the same pose is set again.
+        *
+        * @param newPose the new pose of the primitive
+        * @return true if the pose changed
+        */
+        virtual bool setPose(const Eigen::Matrix4d &newPose);
+
+        /** Marks the primitive as changed
+        *
+        * Gives the primitive a new version. Must be called after changing
+        * the pose or the dimensions without setPose().
+        */
+        void touch();
+
         /** Performs a dynamic cast to overload the direction functions
         * 
         * This method takes an object that inherits from primitive and
@@ -161,6 +188,17 @@ class Primitive
         */
         virtual double getShortestDistance(Box3 *box) = 0;
 
+        /** Finds a sphere that encloses the primitive
+        * 
+        * The distance between the enclosing spheres of two primitives is 
+        * never larger than the distance between the primitives, so it is a
+        * cheap lower bound of it.
+        *
+        * @param[out]   center  center of the sphere
+        * @param[out]   radius  radius of the sphere
+        */
+        virtual void getBoundingSphere(Eigen::Vector3d &center, double &radius) = 0;
+
         /** Finds the shortest distance between this primitive and a Cylinder primitive
         * 
         * This method takes a capsule object and returns the closest distance
@@ -173,6 +211,9 @@ class Primitive
 
         Eigen::Matrix4d pose; /* pose of the primitive */
 
+        /// Changes every time the primitive changes, unique among all primitives
+        unsigned long version;
+
 };
 
 /**
@@ -241,6 +282,17 @@ class Line{
         */
         void getClosestPointsBetweenLines(Eigen::MatrixXd &closestPoints, Line line);
 
+        /** Finds the closest points on this Line and on another Line
+        *
+        * Same as the matrix version, without a matrix on the heap.
+        * 
+        * @param[out]   ownClosestPoint        the closest point on this line
+        * @param[out]   obstacleClosestPoint   the closest point on line
+        * @param        line                   the other line
+        */
+        void getClosestPointsBetweenLines(Eigen::Vector3d &ownClosestPoint,
+                                          Eigen::Vector3d &obstacleClosestPoint, Line line);
+
         /** Finds the shortest distance between this Line and a point
         *
         * This method takes a point and returns the closest distance
@@ -260,6 +312,23 @@ class Line{
         * @return   the closest distance between the Line and line
         */
         double getShortestDistanceToLine(Line line);
+
+        /** Squared distance between two segments and their closest points
+        *
+        * The exact closest pair, also for parallel segments and segments
+        * of zero length.
+        *
+        * @param p1 start of the first segment
+        * @param q1 end of the first segment
+        * @param p2 start of the second segment
+        * @param q2 end of the second segment
+        * @param[out] c1 closest point of the first segment
+        * @param[out] c2 closest point of the second segment
+        * @return the squared distance between c1 and c2
+        */
+        static double segmentDistanceSquared(const Eigen::Vector3d &p1, const Eigen::Vector3d &q1,
+                                             const Eigen::Vector3d &p2, const Eigen::Vector3d &q2,
+                                             Eigen::Vector3d &c1, Eigen::Vector3d &c2);
         
 };
 
@@ -319,6 +388,8 @@ class Capsule: public Primitive{
         double getShortestDistance(Capsule *capsule);
         double getShortestDistance(Sphere *sphere);
 		double getShortestDistance(Box3 *box);
+
+        void getBoundingSphere(Eigen::Vector3d &center, double &radius);
 };
 
 /**
@@ -367,6 +438,8 @@ class Sphere: public Primitive{
         double getShortestDistance(Capsule *capsule);
         double getShortestDistance(Sphere *sphere);
 		double getShortestDistance(Box3 *box);
+
+        void getBoundingSphere(Eigen::Vector3d &center, double &radius);
 };
 
 
@@ -441,6 +514,13 @@ public:
     Box3(Eigen::Matrix4d &pose, double x,double y,double z);
     Box3(Eigen::Vector3d &pose, double x,double y,double z);
 
+    /** Sets the pose of the box and moves its bounds to the new center
+        *
+        * @param newPose the new pose of the box
+        * @return true if the pose changed
+        */
+    bool setPose(const Eigen::Matrix4d &newPose);
+
 
 
 
@@ -524,6 +604,8 @@ public:
    double getShortestDistance(Capsule *capsule);
    double getShortestDistance(Sphere *sphere);
    double getShortestDistance(Box3 *box);
+
+   void getBoundingSphere(Eigen::Vector3d &center, double &radius);
    
 };
 #endif // PRIMITIVES_H
\ No newline at end of file
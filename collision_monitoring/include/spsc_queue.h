@@ -0,0 +1,90 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <vector>
+
+/**
+ * A bounded queue from one producer thread to one consumer thread
+ *
+ * The items are kept in a ring allocated once by the constructor. Pushing
+ * and popping never lock nor allocate, each side only writes its own index
+ * and reads the index of the other side.
+ *
+ * There must be at most one producer thread and one consumer thread at a
+ * time.
+ */
+template<typename T>
+class SpscQueue
+{
+    public:
+        /** Constructor of SpscQueue
+        *
+        * @param capacity the number of items the queue can hold
+        */
+        SpscQueue(int capacity)
+            : items(capacity + 1), head(0), tail(0)
+        {
+        }
+
+        /** Adds an item at the back of the queue, producer side
+        *
+        * @param item the item to add
+        * @return false if the queue is full, the item is then not added
+        */
+        bool push(const T &item)
+        {
+            unsigned int current = tail.load(std::memory_order_relaxed);
+            unsigned int next = increment(current);
+            if (next == head.load(std::memory_order_acquire)) {
+                return false;
+            }
+            items[current] = item;
+            tail.store(next, std::memory_order_release);
+            return true;
+        }
+
+        /** Takes the item at the front of the queue, consumer side
+        *
+        * @param[out] item the item taken
+        * @return false if the queue is empty
+        */
+        bool pop(T &item)
+        {
+            unsigned int current = head.load(std::memory_order_relaxed);
+            if (current == tail.load(std::memory_order_acquire)) {
+                return false;
+            }
+            item = items[current];
+            // Do not keep shared resources alive in the ring
+            items[current] = T();
+            head.store(increment(current), std::memory_order_release);
+            return true;
+        }
+
+        /** Checks if there is nothing to pop
+        *
+        * @return true if the queue is empty
+        */
+        bool empty() const
+        {
+            return head.load(std::memory_order_acquire) ==
+                   tail.load(std::memory_order_acquire);
+        }
+
+    private:
+        /// The ring, one entry is always left free to tell full from empty
+        std::vector<T> items;
+        /// Index of the next item to pop, written by the consumer
+        std::atomic<unsigned int> head;
+        /// Index of the next free entry, written by the producer
+        std::atomic<unsigned int> tail;
+
+        unsigned int increment(unsigned int index) const
+        {
+            index++;
+            return index == items.size() ? 0 : index;
+        }
+};
+
+#endif // SPSC_QUEUE_H
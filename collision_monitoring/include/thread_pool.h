@@ -0,0 +1,136 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+/**
+ * A persistent pool of worker threads with work stealing
+ *
+ * The pool is created once and reused every control cycle, so no thread is
+ * created on the hot path. A job is split into tiles that are spread over
+ * one queue per worker. Every worker works through its own queue and, when
+ * it runs dry, steals tiles from the back of the other queues. The thread
+ * that submits the job takes part in it as worker 0. The queues are fixed
+ * rings sized in the constructor, so submitting a job does not allocate.
+ */
+class ThreadPool
+{
+    public:
+        /// The function executed for every tile: begin, end and worker index
+        typedef std::function<void(int, int, int)> Task;
+
+        /** Constructor of ThreadPool
+        *
+        * @param nThreads total number of workers including the calling
+        *     thread, values below 1 are treated as 1
+        * @param cores the cores the background workers are pinned to.
+        *     Worker i (i >= 1) is pinned to cores[(i - 1) % cores.size()].
+        *     Leave empty to let the scheduler place the threads.
+        * @param queueCapacity the number of tiles each worker queue holds,
+        *     values below 1 are treated as 1
+        */
+        ThreadPool(int nThreads, std::vector<int> cores = std::vector<int>(),
+                   int queueCapacity = 64);
+
+        /// Destructor, stops and joins all the workers
+        ~ThreadPool();
+
+        /** Getter of the number of workers
+        *
+        * @return the number of workers including the calling thread
+        */
+        int size();
+
+        /** Getter of the number of tiles one job is split into at most
+        *
+        * @return the capacity of a worker queue times the number of workers
+        */
+        int maxTiles();
+
+        /** Runs a task over a range of indices
+        *
+        * The range [0, count) is split into tiles of grain indices and the
+        * task is called once per tile. The call returns once every tile has
+        * been processed. Tiles are processed in any order, so the task must
+        * only write to memory owned by its tile. If the range needs more
+        * than maxTiles() tiles, each tile is made a multiple of grain.
+        *
+        * @param count the number of indices to process
+        * @param grain the number of indices in one tile
+        * @param task the function called for every tile
+        */
+        void parallelFor(int count, int grain, const Task &task);
+
+    private:
+
+        /// A contiguous block of indices processed in one go
+        struct Tile
+        {
+            int begin;
+            int end;
+        };
+
+        /// The queue of tiles owned by one worker, a ring over tiles
+        struct WorkerQueue
+        {
+            std::mutex mutex;
+            std::vector<Tile> tiles;
+            /// The index of the front tile in tiles
+            int head;
+            /// The number of tiles in the queue
+            int count;
+        };
+
+        /// The background threads, worker i + 1 runs on threads[i]
+        std::vector<std::thread> threads;
+        /// One queue of tiles per worker
+        std::vector<WorkerQueue*> queues;
+        /// The number of tiles each queue holds
+        int queueCapacity;
+
+        /// The task of the current job
+        const Task* task;
+        /// The number of tiles of the current job that are not finished
+        std::atomic<int> remaining;
+
+        /// Guards the job generation and the stop flag
+        std::mutex jobMutex;
+        /// Wakes the workers when a job is submitted
+        std::condition_variable jobStart;
+        /// Wakes the caller when the last tile is finished
+        std::condition_variable jobDone;
+        /// Increased for every submitted job
+        unsigned long generation;
+        /// Set in the destructor to end the workers
+        bool stopping;
+
+        /** The main loop of a background worker
+        *
+        * @param worker the index of the worker
+        */
+        void workerLoop(int worker);
+
+        /** Processes tiles until all the queues are empty
+        *
+        * @param worker the index of the worker processing the tiles
+        */
+        void runTiles(int worker);
+
+        /** Takes the next tile for a worker
+        *
+        * First takes from the front of its own queue, then steals from the
+        * back of the queues of the other workers.
+        *
+        * @param worker the index of the worker
+        * @param[out] tile the tile to process
+        * @return true if a tile was found
+        */
+        bool nextTile(int worker, Tile &tile);
+};
+
+#endif // THREAD_POOL_H
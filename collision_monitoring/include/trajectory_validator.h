@@ -0,0 +1,144 @@
+#ifndef TRAJECTORY_VALIDATOR_H
+#define TRAJECTORY_VALIDATOR_H
+
+#include <vector>
+#include "arm.h"
+#include "primitives.h"
+#include "monitor.h"
+
+/**
+ * Checks joint trajectories against the obstacles of a monitor
+ *
+ * The trajectory is a list of waypoints joined by straight segments in
+ * joint space. Instead of sampling every segment densely, the validator
+ * uses the clearance of a checked configuration to skip the part of the
+ * segment the links cannot cross. No point of a capsule link moves faster
+ * than the sum over the joints before it of the joint speed times the
+ * reach of the chain past that joint, so the clearance divided by this
+ * bound is a time the arm is certainly free for.
+ *
+ * A segment is split in halves until the free intervals around the checked
+ * configurations cover it, so the checks gather where the clearance is
+ * small. A collision of the capsule model with the obstacles can not be
+ * missed. An interval that is still not covered once shorter than the
+ * resolution is reported as invalid, the arm is then within the clearance
+ * of an obstacle or very close to it.
+ *
+ * Only the obstacles of the monitor are checked, the distances between the
+ * links of the arm are not.
+ */
+class TrajectoryValidator
+{
+    public:
+        /** Constructor of TrajectoryValidator
+        *
+        * The end points of the links are computed with BatchKinematics
+        * when the arm gives its chain, otherwise the configurations are
+        * evaluated on a copy of the arm of the monitor. The arm of the
+        * monitor is never moved. The links of the arm must be capsules.
+        *
+        * @param monitor the monitor of the arm whose obstacles are checked,
+        *     it must outlive the validator
+        */
+        TrajectoryValidator(Monitor* monitor);
+
+        /// Destructor of TrajectoryValidator
+        ~TrajectoryValidator();
+
+        /// Distance to the obstacles under which a configuration is invalid
+        double clearance;
+
+        /// Largest joint motion in rad of an interval that is not split
+        double resolution;
+
+        /** Checks a trajectory
+        *
+        * @param waypoints the joint positions of the waypoints in rad
+        * @return true if no configuration of the trajectory is closer to
+        *     an obstacle than the clearance, false otherwise or if the
+        *     trajectory can not be checked
+        */
+        bool validate(const std::vector<std::vector<double>> &waypoints);
+
+        /// Segment of the invalid configuration found, -1 if none
+        int invalidSegment;
+
+        /// Position of the invalid configuration in its segment, from 0 to 1
+        double invalidFraction;
+
+        /// Number of configurations evaluated by the last validation
+        int nChecks;
+
+        /** Bound on the motion of the links along a segment
+        *
+        * @param start the joint positions at the start of the segment
+        * @param end the joint positions at the end of the segment
+        * @return the largest distance any point of a link can move over
+        *     the whole segment in m
+        */
+        double motionBound(const std::vector<double> &start,
+                           const std::vector<double> &end);
+
+    private:
+        /// The monitor whose obstacles are checked
+        Monitor* monitor;
+
+        /// Copy of the arm moved to the checked configurations
+        Arm* arm;
+
+        /// The chain of the arm, see Arm::getChainModel
+        ChainModel chainModel;
+        /// True if the arm gave its chain, otherwise the copy is moved
+        bool chainLoaded;
+        /// End points of the links of the checked configuration
+        BatchKinematics kinematics;
+
+        /** Reach of the chain past every joint
+        *
+        * A bound on the distance from a point of the axis of joint i to
+        * the ends of the capsules moved by joint i, which may lie before
+        * or past the frames of a fitted link. It only depends on the
+        * geometry of the chain, not on the configuration.
+        */
+        std::vector<double> reach;
+
+        /// The obstacles checked, the links of the arm itself excluded
+        std::vector<Primitive*> checked;
+
+        /// Scratch configuration
+        std::vector<double> configuration;
+
+        /// An interval of a segment waiting to be covered
+        struct Interval
+        {
+            double start;
+            double end;
+            double startFree;
+            double endFree;
+        };
+
+        /// Intervals left to cover, kept to avoid allocations
+        std::vector<Interval> pending;
+
+        /** Free distance of a configuration of a segment
+        *
+        * @param start the joint positions at the start of the segment
+        * @param end the joint positions at the end of the segment
+        * @param fraction position in the segment, from 0 to 1
+        * @return the distance to the obstacles minus the clearance
+        */
+        double freeDistance(const std::vector<double> &start,
+                            const std::vector<double> &end, double fraction);
+
+        /** Checks one segment of the trajectory
+        *
+        * @param start the joint positions at the start of the segment
+        * @param end the joint positions at the end of the segment
+        * @param[out] fraction position of the invalid configuration
+        * @return true if the segment is valid
+        */
+        bool validateSegment(const std::vector<double> &start,
+                             const std::vector<double> &end, double &fraction);
+};
+
+#endif // TRAJECTORY_VALIDATOR_H
@@ -0,0 +1,102 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+/**
+ * Passes the latest version of a value from one writer thread to one reader
+ * thread without locks
+ *
+ * The writer fills its own buffer and publishes it by swapping it with the
+ * middle buffer, the reader picks up the middle buffer by swapping it with
+ * its own. Both swaps are a single atomic exchange, so neither side ever
+ * waits for the other and the reader always sees a complete version. Versions
+ * published between two reads are skipped, only the latest one is kept.
+ *
+ * There must be at most one writer thread and one reader thread at a time.
+ */
+template<typename T>
+class TripleBuffer
+{
+    public:
+        /** Constructor of TripleBuffer
+        *
+        * @param initial the value read until the first publish
+        */
+        TripleBuffer(const T &initial = T())
+            : middle(1), writeIndex(0), readIndex(2)
+        {
+            for (int i = 0; i < 3; i++) {
+                buffers[i] = initial;
+            }
+        }
+
+        /** Access to the buffer of the writer
+        *
+        * The content is that of an older version, not necessarily the last
+        * one published. Call publish() once it is filled.
+        *
+        * @return the buffer owned by the writer
+        */
+        T& writeBuffer()
+        {
+            return buffers[writeIndex];
+        }
+
+        /// Makes the buffer of the writer the latest version
+        void publish()
+        {
+            unsigned int previous = middle.exchange(writeIndex | NEW_VERSION,
+                                                    std::memory_order_acq_rel);
+            writeIndex = previous & INDEX_MASK;
+        }
+
+        /** Copies a value to the buffer of the writer and publishes it
+        *
+        * @param value the new version
+        */
+        void write(const T &value)
+        {
+            buffers[writeIndex] = value;
+            publish();
+        }
+
+        /** Takes the latest version published, if there is a new one
+        *
+        * @return true if read() now returns a newer version
+        */
+        bool update()
+        {
+            if (!(middle.load(std::memory_order_relaxed) & NEW_VERSION)) {
+                return false;
+            }
+            unsigned int previous = middle.exchange(readIndex,
+                                                    std::memory_order_acq_rel);
+            readIndex = previous & INDEX_MASK;
+            return true;
+        }
+
+        /** Access to the version taken by the last update()
+        *
+        * @return the buffer owned by the reader
+        */
+        const T& read() const
+        {
+            return buffers[readIndex];
+        }
+
+    private:
+        /// Flag set in middle when it holds a version not read yet
+        static const unsigned int NEW_VERSION = 4;
+        static const unsigned int INDEX_MASK = 3;
+
+        T buffers[3];
+        /// Index of the middle buffer and the NEW_VERSION flag
+        std::atomic<unsigned int> middle;
+        /// Index of the buffer owned by the writer
+        unsigned int writeIndex;
+        /// Index of the buffer owned by the reader
+        unsigned int readIndex;
+};
+
+#endif // TRIPLE_BUFFER_H
@@ -0,0 +1,104 @@
+#ifndef WHOLE_BODY_MODEL_H
+#define WHOLE_BODY_MODEL_H
+
+#include <vector>
+#include <Eigen/Core>
+#include "arm.h"
+#include "primitives.h"
+
+/**
+ * A mobile manipulator, an arm mounted on a moving base
+ *
+ * The planar pose of the base (x, y, yaw), as given by the odometry, is the
+ * root of the kinematic chain: the base transform of the arm is the frame
+ * of the base followed by the mount of the arm on the base. The base and
+ * the joint positions are only stored when they are set, and all the world
+ * geometry, the box of the base and the links of the arm, is placed in one
+ * pass by update(), when a monitor needs it.
+ *
+ * The box of the base is axis aligned, so it is replaced by the axis
+ * aligned box enclosing the rotated base.
+ */
+class WholeBodyModel
+{
+    public:
+        /** Constructor of WholeBodyModel
+        *
+        * The arm and the base are not owned by the model and must outlive
+        * it. The base box keeps the size and the height it has.
+        *
+        * @param arm the arm mounted on the base
+        * @param base the base
+        * @param armMount the transformation from the base frame to the arm
+        *     base frame
+        */
+        WholeBodyModel(Arm* arm, Base* base, const Eigen::Matrix4d &armMount);
+
+        /// Destructor of WholeBodyModel
+        ~WholeBodyModel();
+
+        /** Sets the pose of the base, applied by the next update
+        *
+        * @param x the position of the base along the world x axis
+        * @param y the position of the base along the world y axis
+        * @param yaw the rotation of the base around the world z axis in rad
+        */
+        void setBasePose(double x, double y, double yaw);
+
+        /** Sets the pose of the base, applied by the next update
+        *
+        * @param pose the x, y and yaw of the base, as read from the odometry
+        */
+        void setBasePose(const Eigen::Vector3d &pose);
+
+        /** Sets the positions of the joints of the arm, applied by the next
+        * update
+        *
+        * @param jointPositions the positions of the arm joints in rad
+        * @return false if there is not a position for every joint
+        */
+        bool setJointPositions(const std::vector<double> &jointPositions);
+
+        /** Places the base and the arm in the world
+        *
+        * Nothing is done if neither the base nor the joints were set since
+        * the last update. A base motion moves the links of the arm too. The
+        * arm is placed once its joint positions have been set.
+        *
+        * @return false if the arm could not be updated
+        */
+        bool update();
+
+        /** The frame of the base in the world
+        *
+        * @return the homogeneous transformation from the world to the base,
+        *     for the last pose set
+        */
+        Eigen::Matrix4d baseFrame();
+
+        /// The arm mounted on the base
+        Arm* arm;
+        /// The base
+        Base* base;
+        /// The transformation from the base frame to the arm base frame
+        Eigen::Matrix4d armMount;
+        /// The center of the base box in the base frame
+        Eigen::Vector3d boxCenter;
+        /// Half of the size of the base box along the base axes
+        Eigen::Vector3d boxHalfSize;
+        /// Number of links from the mount that rest on the base box by
+        /// design, they are not checked against it
+        int mountedLinks;
+
+    private:
+        /// The x, y and yaw of the base
+        Eigen::Vector3d basePose;
+        /// The positions of the arm joints, empty until they are set
+        std::vector<double> jointPositions;
+        /// True if the base was set since the last update
+        bool baseChanged;
+        /// True if the joints were set since the last update
+        bool jointsChanged;
+};
+
+#endif // WHOLE_BODY_MODEL_H
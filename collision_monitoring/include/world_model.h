@@ -0,0 +1,272 @@
+#ifndef WORLD_MODEL_H
+#define WORLD_MODEL_H
+
+#include <vector>
+#include <string>
+#include <Eigen/Core>
+#include "arm.h"
+#include "primitives.h"
+#include "distance_matrix.h"
+#include "thread_pool.h"
+#include "obstacle_store.h"
+#include "id_map.h"
+
+/**
+ * The robots of a cell and the obstacles they share
+ *
+ * The world model holds the arms and bases of several robots and one copy
+ * of the obstacles of the workspace. Every update computes the distances
+ * from each robot to the obstacles and the distances between every pair of
+ * robots, each pair once. A Monitor created for one robot of the world is a
+ * view of these results for that robot.
+ *
+ * Like the monitor, only the entries whose primitives changed since the
+ * previous update are recomputed.
+ */
+class WorldModel
+{
+    public:
+        /// Constructor of WorldModel, creates a world without robots
+        WorldModel();
+
+        /// Destructor of WorldModel
+        ~WorldModel();
+
+        /** Adds an arm to the world
+        *
+        * The arm is not owned by the world and must outlive it.
+        *
+        * @param arm address of the arm
+        * @return the index of the robot
+        */
+        int addArm(Arm* arm);
+
+        /** Adds a base to the world
+        *
+        * @param base address of the base
+        * @return the index of the robot
+        */
+        int addBase(Base* base);
+
+        /** Getter of the number of robots
+        *
+        * @return the number of arms and bases added
+        */
+        int nRobots();
+
+        /** Arm of a robot
+        *
+        * @param robot index of the robot
+        * @return the arm, NULL if the robot is a base
+        */
+        Arm* arm(int robot);
+
+        /** Base of a robot
+        *
+        * @param robot index of the robot
+        * @return the base, NULL if the robot is an arm
+        */
+        Base* base(int robot);
+
+        /** Primitives of a robot
+        *
+        * @param robot index of the robot
+        * @return the links of an arm or the box of a base
+        */
+        std::vector<Primitive*>& primitives(int robot);
+
+        /// Obstacles shared by all the robots, stored by value per shape
+        ObstacleStore store;
+
+        /** The shared obstacles
+        *
+        * The list is rebuilt when obstacles are added or removed, so it
+        * must not be modified directly.
+        */
+        std::vector<Primitive*> obstacles;
+
+        /** Adds a copy of a primitive to the shared obstacles
+        *
+        * @param obstacle address of the obstacle to be added.
+        * @return handle to update or remove the obstacle, invalid if the
+        *     shape is not supported
+        */
+        ObstacleHandle addObstacle(Primitive* obstacle);
+
+        /** Removes a shared obstacle
+        *
+        * @param handle the handle returned when adding the obstacle
+        * @return true if the obstacle was found and removed
+        */
+        bool removeObstacle(ObstacleHandle handle);
+
+        /** Adds or updates the obstacle of a marker
+        *
+        * Same as Monitor::setMarkerObstacle, the obstacle is shared by all
+        * the robots so a marker received by several controllers is only
+        * stored once.
+        *
+        * @param ns namespace of the marker
+        * @param id id of the marker
+        * @param obstacle address of the obstacle representing the marker
+        * @return handle of the obstacle, invalid if the shape is not
+        *     supported
+        */
+        ObstacleHandle setMarkerObstacle(const std::string &ns, int id,
+                                         Primitive* obstacle);
+
+        /** Removes the obstacle of a marker
+        *
+        * @param ns namespace of the marker
+        * @param id id of the marker
+        * @return true if the marker had an obstacle
+        */
+        bool removeMarkerObstacle(const std::string &ns, int id);
+
+        /// Removes the obstacles of all the markers
+        void removeAllMarkerObstacles();
+
+        /** Finds the obstacle of a marker
+        *
+        * @param ns namespace of the marker
+        * @param id id of the marker
+        * @return handle of the obstacle, invalid if the marker is unknown
+        */
+        ObstacleHandle markerObstacle(const std::string &ns, int id);
+
+        /** Rebuilds obstacles from the store
+        *
+        * Done by the methods of the world, only needed after adding or
+        * removing obstacles of the store directly.
+        */
+        void rebuildObstacleList();
+
+        /** Getter of the layout version
+        *
+        * The version changes every time a robot or an obstacle is added
+        * or removed, so views know when to rebuild their lists.
+        *
+        * @return the layout version
+        */
+        unsigned long layoutVersion();
+
+        /** Sets the thread pool used for the updates
+        *
+        * The robots and the pairs of robots are spread over the workers.
+        *
+        * @param pool the pool to use, NULL to update on the calling thread.
+        */
+        void setThreadPool(ThreadPool* pool);
+
+        /// If true the witness points of all the distances are computed
+        bool computeWitnessPoints;
+
+        /** Computes the distances that changed since the last update
+        *
+        * Call it once all the robots have their new pose, every pair of
+        * robots is then evaluated once for the cycle.
+        */
+        void update();
+
+        /** Computes the distances that changed since the last update
+        *
+        * The witness points are computed for this update only, a later
+        * update without them keeps them off.
+        *
+        * @param witnesses if true the witness points are computed as well
+        */
+        void update(bool witnesses);
+
+        /** Distances from the shared obstacles to a robot
+        *
+        * One row per obstacle and one column per primitive of the robot.
+        *
+        * @param robot index of the robot
+        * @return the distances computed by the last update
+        */
+        DistanceMatrix& obstacleDistances(int robot);
+
+        /** Distances between two robots
+        *
+        * One row per primitive of the robot with the lower index and one
+        * column per primitive of the other. The witness points are stored
+        * for the row primitive first.
+        *
+        * @param robot index of a robot
+        * @param other index of another robot
+        * @return the distances computed by the last update
+        */
+        DistanceMatrix& robotDistances(int robot, int other);
+
+        /** Distance between a primitive of two robots
+        *
+        * @param robot index of a robot
+        * @param primitive index of the primitive of robot
+        * @param other index of another robot
+        * @param otherPrimitive index of the primitive of other
+        * @return the distance computed by the last update
+        */
+        double distance(int robot, int primitive, int other, int otherPrimitive);
+
+    private:
+        /// A robot of the world and its distances to the obstacles
+        struct Robot
+        {
+            Arm* arm;
+            Base* base;
+            std::vector<Primitive*> primitives;
+            DistanceMatrix obstacleDistances;
+        };
+
+        std::vector<Robot> robots;
+
+        /// Distances of every pair of robots, see pairIndex()
+        std::vector<DistanceMatrix> pairs;
+
+        /// Handles of the obstacles added by marker
+        IdMap<ObstacleHandle> markerObstacles;
+
+        /// Changed every time a robot or an obstacle is added or removed
+        unsigned long layout;
+
+        /** Index of the matrix of a pair of robots in pairs
+        *
+        * @param first index of the robot with the lower index
+        * @param second index of the other robot
+        * @return the index in pairs
+        */
+        int pairIndex(int first, int second);
+
+        /// Pool used for the updates, NULL when serial
+        ThreadPool* pool;
+        /// The task run by the pool, created once to avoid allocations
+        ThreadPool::Task updateTask;
+        /// Scratch matrices for the closest points, one per worker
+        std::vector<Eigen::MatrixXd> closestPoints;
+        /// If true the running update computes the witness points
+        bool witnessesRequested;
+
+        /** Updates the distances of a robot to the obstacles or of a pair
+        *
+        * @param job the robots come first, then the pairs in pairs order
+        * @param worker the worker running the job
+        */
+        void updateJob(int job, int worker);
+
+        /** Fills the outdated entries of a matrix between two lists
+        *
+        * Entries are recomputed when the version of the row or the column
+        * primitive changed. The smallest distance is stored in the matrix.
+        *
+        * @param[out] result the matrix to fill
+        * @param rows the primitives of the rows
+        * @param cols the primitives of the columns
+        * @param colFirst if true the witness points of the column primitive
+        *     are stored first
+        * @param worker the worker whose scratch matrix is used
+        */
+        void fill(DistanceMatrix &result, std::vector<Primitive*> &rows,
+                  std::vector<Primitive*> &cols, bool colFirst, int worker);
+};
+
+#endif // WORLD_MODEL_H
@@ -1,8 +1,60 @@
 #include "arm.h"
+#include <algorithm>
 
 // This file only exists so the code will compile
 
 Arm::~Arm (){}
-bool Arm::updatePose(std::vector<double>) {}
+bool Arm::updatePose(const std::vector<double> &) {}
+bool Arm::linkVelocities(const std::vector<double> &, std::vector<Eigen::Vector3d> &,
+                         std::vector<Eigen::Vector3d> &) { return false; }
+Arm* Arm::clone() { return NULL; }
+bool Arm::getChainModel(ChainModel &) { return false; }
+const KinematicState* Arm::getKinematicState() { return NULL; }
+bool Arm::ikVelocitySolver(const Eigen::Matrix<double, 6, 1> &, double*, int) { return false; }
+bool Arm::allowedCollision(int, int) { return false; }
+
+void Arm::linkEndPoints(int link, Eigen::Vector3d &start, Eigen::Vector3d &end){
+    // The capsule of frames at the same point has no rotation
+    Capsule* capsule = dynamic_cast<Capsule*>(links[link]);
+    if (capsule != NULL && !capsule->pose.block<3, 3>(0, 0).isZero()) {
+        start = capsule->pose.block<3, 1>(0, 3);
+        end = (capsule->pose * Eigen::Vector4d(0, 0, capsule->getLength(), 1)).head(3);
+        return;
+    }
+    start = getPose(link).block<3, 1>(0, 3);
+    end = getPose(link + 1).block<3, 1>(0, 3);
+}
+
+void Arm::jointReach(std::vector<double> &reach){
+    // Lengths of the rigid parts of the chain between the frames
+    std::vector<double> frameDistances(nFrames - 1);
+    for (int k = 0; k + 1 < nFrames; k++) {
+        frameDistances[k] = (getPose(k + 1).block<3, 1>(0, 3) -
+                             getPose(k).block<3, 1>(0, 3)).norm();
+    }
+
+    // The ends of a capsule are rigid in the frame of its link, a fitted 
+    // capsule may start before the frame and end past the next one
+    int nLinks = links.size();
+    std::vector<double> linkOffsets(nLinks);
+    for (int k = 0; k < nLinks; k++) {
+        Eigen::Vector3d frame = getPose(k).block<3, 1>(0, 3);
+        Eigen::Vector3d linkStart, linkEnd;
+        linkEndPoints(k, linkStart, linkEnd);
+        linkOffsets[k] = std::max((linkStart - frame).norm(), (linkEnd - frame).norm());
+    }
+
+    // The axis of joint i goes through frame i + 1, so joint i moves the 
+    // links after i
+    reach.assign(nJoints, 0);
+    for (int i = 0; i < nJoints; i++) {
+        double along = 0;
+        for (int k = i + 1; k < nLinks; k++) {
+            reach[i] = std::max(reach[i], along + linkOffsets[k]);
+            along += frameDistances[k];
+        }
+    }
+}
+
 Base::~Base (){}
 bool Base::updatePose( Eigen::Vector3d ) {}
\ No newline at end of file
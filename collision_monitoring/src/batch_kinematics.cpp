@@ -0,0 +1,183 @@
+#include "batch_kinematics.h"
+#include <iostream>
+//#define DEBUG
+
+BatchKinematics::BatchKinematics(){
+    this->baseTransform = Eigen::Matrix4d::Identity();
+    this->joints = 0;
+    this->count = 0;
+}
+
+BatchKinematics::BatchKinematics(const ChainModel &model){
+    this->count = 0;
+    setModel(model);
+}
+
+BatchKinematics::~BatchKinematics(){
+
+}
+
+void BatchKinematics::setModel(const ChainModel &model){
+    baseTransform = model.baseTransform;
+    segments.resize(model.segments.size());
+    radii.resize(model.segments.size());
+    joints = 0;
+
+    for (int k = 0; k < segments.size(); k++) {
+        const ChainModel::Segment &segment = model.segments[k];
+        BatchSegment &batch = segments[k];
+        Eigen::Matrix3d tipRotation = segment.tip.block<3, 3>(0, 0);
+        Eigen::Vector3d arm = segment.tip.block<3, 1>(0, 3) - segment.axisPoint;
+
+        // The turn about the axis through its point, then the tip
+        batch.revolute = segment.revolute;
+        batch.rotation = tipRotation;
+        batch.position = segment.tip.block<3, 1>(0, 3);
+        batch.rotationSine.setZero();
+        batch.rotationVersine.setZero();
+        batch.positionSine.setZero();
+        batch.positionVersine.setZero();
+        if (segment.revolute) {
+            Eigen::Matrix3d K;
+            K <<               0, -segment.axis(2),  segment.axis(1),
+                 segment.axis(2),                0, -segment.axis(0),
+                -segment.axis(1),  segment.axis(0),                0;
+            Eigen::Matrix3d K2 = K * K;
+            batch.rotationSine = K * tipRotation;
+            batch.rotationVersine = K2 * tipRotation;
+            batch.positionSine = K * arm;
+            batch.positionVersine = K2 * arm;
+            joints++;
+        }
+        batch.linkStart = segment.linkStart;
+        batch.linkEnd = segment.linkEnd;
+        radii[k] = segment.linkRadius;
+    }
+}
+
+int BatchKinematics::nJoints(){
+    return joints;
+}
+
+int BatchKinematics::nLinks(){
+    return segments.size();
+}
+
+int BatchKinematics::size(){
+    return count;
+}
+
+bool BatchKinematics::linkEndpoints(const std::vector<std::vector<double>> &configurations){
+    int configurationCount = configurations.size();
+    interleaved.resize(joints * configurationCount);
+    for (int c = 0; c < configurationCount; c++) {
+        if (configurations[c].size() != joints) {
+            std::cout << "[BatchKinematics] configuration " << c << " does not have "
+                      << joints << " joints" << std::endl;
+            return false;
+        }
+        for (int i = 0; i < joints; i++) {
+            interleaved[i * configurationCount + c] = configurations[c][i];
+        }
+    }
+    return linkEndpoints(interleaved.data(), configurationCount);
+}
+
+bool BatchKinematics::linkEndpoints(const double* jointPositions, int count){
+    if (segments.empty()) {
+        std::cout << "[BatchKinematics] the chain is empty" << std::endl;
+        return false;
+    }
+
+    // Only reallocated when the number of configurations changes
+    int nLinks = segments.size();
+    this->count = count;
+    starts.resize(count, 3 * nLinks);
+    ends.resize(count, 3 * nLinks);
+    rotation.resize(count, 9);
+    position.resize(count, 3);
+    sine.resize(count);
+    versine.resize(count);
+    localRotation.resize(count, 9);
+    localPosition.resize(count, 3);
+    nextRotation.resize(count, 9);
+
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+            rotation.col(3 * r + c).setConstant(baseTransform(r, c));
+        }
+        position.col(r).setConstant(baseTransform(r, 3));
+    }
+
+    int joint = 0;
+    for (int k = 0; k < nLinks; k++) {
+        const BatchSegment &segment = segments[k];
+
+        // The ends of the link, which is rigid in the current frame
+        for (int r = 0; r < 3; r++) {
+            starts.col(3 * k + r) = position.col(r) +
+                                    rotation.col(3 * r) * segment.linkStart(0) +
+                                    rotation.col(3 * r + 1) * segment.linkStart(1) +
+                                    rotation.col(3 * r + 2) * segment.linkStart(2);
+            ends.col(3 * k + r) = position.col(r) +
+                                  rotation.col(3 * r) * segment.linkEnd(0) +
+                                  rotation.col(3 * r + 1) * segment.linkEnd(1) +
+                                  rotation.col(3 * r + 2) * segment.linkEnd(2);
+        }
+
+        // Motion of the segment for every configuration
+        if (segment.revolute) {
+            Eigen::Map<const Eigen::ArrayXd> q(jointPositions + joint * count, count);
+            sine = q.sin();
+            versine = 1 - q.cos();
+            joint++;
+            for (int m = 0; m < 3; m++) {
+                for (int c = 0; c < 3; c++) {
+                    localRotation.col(3 * m + c) = segment.rotation(m, c) +
+                                                   sine * segment.rotationSine(m, c) +
+                                                   versine * segment.rotationVersine(m, c);
+                }
+                localPosition.col(m) = segment.position(m) +
+                                       sine * segment.positionSine(m) +
+                                       versine * segment.positionVersine(m);
+            }
+        } else {
+            for (int m = 0; m < 3; m++) {
+                for (int c = 0; c < 3; c++) {
+                    localRotation.col(3 * m + c).setConstant(segment.rotation(m, c));
+                }
+                localPosition.col(m).setConstant(segment.position(m));
+            }
+        }
+
+        // Next frame, the current frame times the local motion
+        for (int r = 0; r < 3; r++) {
+            position.col(r) += rotation.col(3 * r) * localPosition.col(0) +
+                               rotation.col(3 * r + 1) * localPosition.col(1) +
+                               rotation.col(3 * r + 2) * localPosition.col(2);
+            for (int c = 0; c < 3; c++) {
+                nextRotation.col(3 * r + c) = rotation.col(3 * r) * localRotation.col(c) +
+                                              rotation.col(3 * r + 1) * localRotation.col(3 + c) +
+                                              rotation.col(3 * r + 2) * localRotation.col(6 + c);
+            }
+        }
+        rotation.swap(nextRotation);
+    }
+    #ifdef DEBUG
+    std::cout << "[BatchKinematics] " << count << " configurations of " << nLinks
+              << " links" << std::endl;
+    #endif
+    return true;
+}
+
+Eigen::Vector3d BatchKinematics::linkStart(int link, int configuration){
+    return Eigen::Vector3d(starts(configuration, 3 * link),
+                           starts(configuration, 3 * link + 1),
+                           starts(configuration, 3 * link + 2));
+}
+
+Eigen::Vector3d BatchKinematics::linkEnd(int link, int configuration){
+    return Eigen::Vector3d(ends(configuration, 3 * link),
+                           ends(configuration, 3 * link + 1),
+                           ends(configuration, 3 * link + 2));
+}
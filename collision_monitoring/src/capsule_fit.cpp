@@ -0,0 +1,421 @@
+#include "capsule_fit.h"
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <random>
+#include <Eigen/Eigenvalues>
+#include <Eigen/StdVector>
+//#define DEBUG
+
+/// First bytes of a capsule cache
+static const char CACHE_MAGIC[4] = {'L', 'C', 'A', 'P'};
+/// Version of the layout of a capsule cache
+static const uint32_t CACHE_VERSION = 1;
+
+typedef std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d>> Points2d;
+
+/// Lexicographic order of the vertices, to remove the duplicates
+static bool lessVertex(const Eigen::Vector3d &a, const Eigen::Vector3d &b){
+    if (a(0) != b(0)) {
+        return a(0) < b(0);
+    }
+    if (a(1) != b(1)) {
+        return a(1) < b(1);
+    }
+    return a(2) < b(2);
+}
+
+/** Smallest circle enclosing points, Welzl's algorithm without recursion
+*
+* @param points the points, in a random order for an expected linear time
+* @param[out] center the center of the circle
+* @return the radius of the circle
+*/
+static double enclosingCircle(const Points2d &points, Eigen::Vector2d &center){
+    const double tolerance = 1e-12;
+    center = points[0];
+    double radius = 0;
+    for (int i = 1; i < points.size(); i++) {
+        if ((points[i] - center).norm() <= radius + tolerance) {
+            continue;
+        }
+        // points[i] is on the circle of the first i + 1 points
+        center = points[i];
+        radius = 0;
+        for (int j = 0; j < i; j++) {
+            if ((points[j] - center).norm() <= radius + tolerance) {
+                continue;
+            }
+            // points[i] and points[j] are on the circle
+            center = 0.5 * (points[i] + points[j]);
+            radius = 0.5 * (points[i] - points[j]).norm();
+            for (int k = 0; k < j; k++) {
+                if ((points[k] - center).norm() <= radius + tolerance) {
+                    continue;
+                }
+                // The circle through the three points
+                Eigen::Vector2d b = points[j] - points[i];
+                Eigen::Vector2d c = points[k] - points[i];
+                double d = 2 * (b(0) * c(1) - b(1) * c(0));
+                if (std::fabs(d) < 1e-18) {
+                    // Aligned points, the circle of the two farthest ones
+                    Eigen::Vector2d pairs[3][2] = {{points[i], points[j]},
+                                                   {points[i], points[k]},
+                                                   {points[j], points[k]}};
+                    radius = -1;
+                    for (int p = 0; p < 3; p++) {
+                        double half = 0.5 * (pairs[p][0] - pairs[p][1]).norm();
+                        if (half > radius) {
+                            radius = half;
+                            center = 0.5 * (pairs[p][0] + pairs[p][1]);
+                        }
+                    }
+                    continue;
+                }
+                Eigen::Vector2d offset((c(1) * b.squaredNorm() - b(1) * c.squaredNorm()) / d,
+                                       (b(0) * c.squaredNorm() - c(0) * b.squaredNorm()) / d);
+                center = points[i] + offset;
+                radius = offset.norm();
+            }
+        }
+    }
+    return radius;
+}
+
+/** Smallest capsule with a given axis direction
+*
+* @param points the points to enclose
+* @param direction the unit direction of the axis
+* @param[out] capsule the capsule of smallest volume found
+* @return the volume of the capsule
+*/
+static double fitAlong(const std::vector<Eigen::Vector3d> &points,
+                       const Eigen::Vector3d &direction, LinkCapsule &capsule){
+    // Basis of the plane normal to the axis
+    Eigen::Vector3d u = direction.unitOrthogonal();
+    Eigen::Vector3d v = direction.cross(u);
+
+    // Shuffled with a fixed seed, so the fit is the same on every run
+    Points2d projected(points.size());
+    std::vector<double> axial(points.size());
+    for (int p = 0; p < points.size(); p++) {
+        projected[p] = Eigen::Vector2d(points[p].dot(u), points[p].dot(v));
+    }
+    std::mt19937 generator(0);
+    std::shuffle(projected.begin(), projected.end(), generator);
+
+    Eigen::Vector2d center;
+    double minimumRadius = enclosingCircle(projected, center);
+    Eigen::Vector3d axisPoint = center(0) * u + center(1) * v;
+
+    // The squared distances to the axis and positions along it
+    std::vector<double> squaredDistances(points.size());
+    for (int p = 0; p < points.size(); p++) {
+        Eigen::Vector3d offset = points[p] - axisPoint;
+        axial[p] = offset.dot(direction);
+        squaredDistances[p] = (offset - axial[p] * direction).squaredNorm();
+    }
+
+    // The shortest axis covering every point for a radius
+    auto evaluate = [&](double radius, LinkCapsule &candidate) {
+        double lowest = std::numeric_limits<double>::max();
+        double highest = -std::numeric_limits<double>::max();
+        for (int p = 0; p < points.size(); p++) {
+            // A point is covered by the end sphere within this axial distance
+            double reach = std::sqrt(std::max(radius * radius - squaredDistances[p], 0.0));
+            lowest = std::min(lowest, axial[p] + reach);
+            highest = std::max(highest, axial[p] - reach);
+        }
+        if (lowest > highest) {
+            // Every point is within the radius of any point between the two
+            lowest = highest = 0.5 * (lowest + highest);
+        }
+        candidate.start = axisPoint + lowest * direction;
+        candidate.end = axisPoint + highest * direction;
+        candidate.radius = radius;
+        return CapsuleFit::volume(candidate);
+    };
+
+    // A larger radius gives shorter ends, up to the sphere on the axis that
+    // encloses every point, past which the volume only grows
+    LinkCapsule candidate;
+    double smallest = minimumRadius + 1e-12;
+    double largest = smallest;
+    evaluate(largest, candidate);
+    while ((candidate.end - candidate.start).norm() > 0) {
+        largest *= 2;
+        evaluate(largest, candidate);
+    }
+    double low = 0.5 * largest > smallest ? 0.5 * largest : smallest;
+    for (int bisection = 0; bisection < 60 && largest - low > 1e-12; bisection++) {
+        double middle = 0.5 * (low + largest);
+        evaluate(middle, candidate);
+        if ((candidate.end - candidate.start).norm() > 0) {
+            low = middle;
+        } else {
+            largest = middle;
+        }
+    }
+
+    // The volume is not convex in the radius, so the range is sampled and 
+    // the best sample refined by a golden section search between its 
+    // neighbours
+    const int steps = 32;
+    double bestVolume = std::numeric_limits<double>::max();
+    int bestStep = 0;
+    double spacing = (largest - smallest) / steps;
+    for (int step = 0; step <= steps; step++) {
+        double candidateVolume = evaluate(smallest + spacing * step, candidate);
+        if (candidateVolume < bestVolume) {
+            bestVolume = candidateVolume;
+            bestStep = step;
+            capsule.start = candidate.start;
+            capsule.end = candidate.end;
+            capsule.radius = candidate.radius;
+        }
+    }
+    const double ratio = 0.5 * (std::sqrt(5.0) - 1);
+    double a = smallest + spacing * std::max(bestStep - 1, 0);
+    double b = smallest + spacing * std::min(bestStep + 1, steps);
+    for (int iteration = 0; iteration < 40 && b - a > 1e-12; iteration++) {
+        double first = b - ratio * (b - a);
+        double second = a + ratio * (b - a);
+        LinkCapsule firstCapsule, secondCapsule;
+        double firstVolume = evaluate(first, firstCapsule);
+        double secondVolume = evaluate(second, secondCapsule);
+        LinkCapsule &better = firstVolume < secondVolume ? firstCapsule : secondCapsule;
+        double betterVolume = std::min(firstVolume, secondVolume);
+        if (betterVolume < bestVolume) {
+            bestVolume = betterVolume;
+            capsule.start = better.start;
+            capsule.end = better.end;
+            capsule.radius = better.radius;
+        }
+        if (firstVolume < secondVolume) {
+            b = second;
+        } else {
+            a = first;
+        }
+    }
+    return bestVolume;
+}
+
+bool CapsuleFit::readStl(const std::string &filename,
+                         std::vector<Eigen::Vector3d> &vertices){
+    vertices.clear();
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    if (!file) {
+        std::cout << "[CapsuleFit] cannot open " << filename << std::endl;
+        return false;
+    }
+    std::string content((std::istreambuf_iterator<char>(file)),
+                        std::istreambuf_iterator<char>());
+
+    // Binary if the size matches the number of triangles, ASCII files
+    // start with solid but so do some binary ones
+    uint32_t triangles = 0;
+    if (content.size() >= 84) {
+        std::memcpy(&triangles, content.data() + 80, sizeof(triangles));
+    }
+    if (content.size() >= 84 && content.size() == 84 + 50 * (size_t)triangles) {
+        for (uint32_t t = 0; t < triangles; t++) {
+            const char* triangle = content.data() + 84 + 50 * t;
+            for (int corner = 0; corner < 3; corner++) {
+                float coordinates[3];
+                std::memcpy(coordinates, triangle + 12 * (corner + 1), sizeof(coordinates));
+                vertices.push_back(Eigen::Vector3d(coordinates[0], coordinates[1],
+                                                   coordinates[2]));
+            }
+        }
+    } else if (content.compare(0, 5, "solid") == 0) {
+        std::istringstream stream(content);
+        std::string word;
+        while (stream >> word) {
+            if (word == "vertex") {
+                Eigen::Vector3d vertex;
+                stream >> vertex(0) >> vertex(1) >> vertex(2);
+                vertices.push_back(vertex);
+            }
+        }
+        if (stream.bad()) {
+            std::cout << "[CapsuleFit] cannot read " << filename << std::endl;
+            return false;
+        }
+    } else {
+        std::cout << "[CapsuleFit] " << filename << " is not an STL file" << std::endl;
+        return false;
+    }
+
+    // The triangles share their corners
+    std::sort(vertices.begin(), vertices.end(), lessVertex);
+    vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+    #ifdef DEBUG
+    std::cout << "[CapsuleFit] " << vertices.size() << " vertices in " << filename
+              << std::endl;
+    #endif
+    return true;
+}
+
+bool CapsuleFit::fit(const std::vector<Eigen::Vector3d> &points, LinkCapsule &capsule){
+    if (points.empty()) {
+        std::cout << "[CapsuleFit] no points to fit" << std::endl;
+        return false;
+    }
+
+    // Start from the principal axes and the axes of the frame
+    Eigen::Vector3d mean = Eigen::Vector3d::Zero();
+    for (int p = 0; p < points.size(); p++) {
+        mean += points[p];
+    }
+    mean /= points.size();
+    Eigen::Matrix3d covariance = Eigen::Matrix3d::Zero();
+    for (int p = 0; p < points.size(); p++) {
+        covariance += (points[p] - mean) * (points[p] - mean).transpose();
+    }
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(covariance);
+    Eigen::Vector3d candidates[6] = {solver.eigenvectors().col(0),
+                                     solver.eigenvectors().col(1),
+                                     solver.eigenvectors().col(2),
+                                     Eigen::Vector3d::UnitX(),
+                                     Eigen::Vector3d::UnitY(),
+                                     Eigen::Vector3d::UnitZ()};
+    Eigen::Vector3d direction;
+    double bestVolume = std::numeric_limits<double>::max();
+    LinkCapsule candidate;
+    for (int c = 0; c < 6; c++) {
+        double candidateVolume = fitAlong(points, candidates[c].normalized(), candidate);
+        if (candidateVolume < bestVolume) {
+            bestVolume = candidateVolume;
+            direction = candidates[c].normalized();
+            capsule.start = candidate.start;
+            capsule.end = candidate.end;
+            capsule.radius = candidate.radius;
+        }
+    }
+
+    // Tilt the direction while the volume decreases, with smaller steps
+    for (double angle = 0.2; angle > 1e-3; ) {
+        Eigen::Vector3d u = direction.unitOrthogonal();
+        Eigen::Vector3d v = direction.cross(u);
+        Eigen::Vector3d tilts[4] = {u, -u, v, -v};
+        bool improved = false;
+        for (int t = 0; t < 4; t++) {
+            Eigen::Vector3d tilted = (direction * std::cos(angle) +
+                                      tilts[t] * std::sin(angle)).normalized();
+            double candidateVolume = fitAlong(points, tilted, candidate);
+            if (candidateVolume < bestVolume) {
+                bestVolume = candidateVolume;
+                direction = tilted;
+                capsule.start = candidate.start;
+                capsule.end = candidate.end;
+                capsule.radius = candidate.radius;
+                improved = true;
+            }
+        }
+        if (!improved) {
+            angle /= 2;
+        }
+    }
+    #ifdef DEBUG
+    std::cout << "[CapsuleFit] capsule of radius " << capsule.radius << " and length "
+              << (capsule.end - capsule.start).norm() << " around " << points.size()
+              << " points" << std::endl;
+    #endif
+    return true;
+}
+
+double CapsuleFit::volume(const LinkCapsule &capsule){
+    double length = (capsule.end - capsule.start).norm();
+    double radius = capsule.radius;
+    return M_PI * radius * radius * (length + 4.0 / 3.0 * radius);
+}
+
+std::string CapsuleFit::cacheFilename(const std::string &urdfFilename){
+    return urdfFilename + ".capsules";
+}
+
+bool CapsuleFit::writeCache(const std::string &filename,
+                            const std::vector<LinkCapsule> &capsules){
+    std::ofstream file(filename.c_str(), std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cout << "[CapsuleFit] cannot write " << filename << std::endl;
+        return false;
+    }
+
+    // Magic, version and count, then per link the name and 7 floats
+    uint32_t count = capsules.size();
+    file.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    file.write(reinterpret_cast<const char*>(&CACHE_VERSION), sizeof(CACHE_VERSION));
+    file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (int c = 0; c < capsules.size(); c++) {
+        const LinkCapsule &capsule = capsules[c];
+        if (capsule.link.size() > 255) {
+            std::cout << "[CapsuleFit] the name of link " << c << " is too long" << std::endl;
+            return false;
+        }
+        uint8_t nameLength = capsule.link.size();
+        file.write(reinterpret_cast<const char*>(&nameLength), sizeof(nameLength));
+        file.write(capsule.link.data(), nameLength);
+
+        // The radius grows by the rounding of the ends and is rounded up,
+        // so the capsule still encloses the mesh in floats
+        float values[7];
+        double rounding = 0;
+        for (int k = 0; k < 3; k++) {
+            values[k] = capsule.start(k);
+            values[k + 3] = capsule.end(k);
+            rounding = std::max(rounding, std::fabs(values[k] - capsule.start(k)));
+            rounding = std::max(rounding, std::fabs(values[k + 3] - capsule.end(k)));
+        }
+        values[6] = std::nextafter((float)(capsule.radius + std::sqrt(3.0) * rounding),
+                                   std::numeric_limits<float>::max());
+        file.write(reinterpret_cast<const char*>(values), sizeof(values));
+    }
+    return file.good();
+}
+
+bool CapsuleFit::readCache(const std::string &filename,
+                           std::vector<LinkCapsule> &capsules){
+    capsules.clear();
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version = 0;
+    uint32_t count = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    file.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if (!file || std::memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0 ||
+        version != CACHE_VERSION) {
+        std::cout << "[CapsuleFit] " << filename << " is not a capsule cache" << std::endl;
+        return false;
+    }
+
+    for (uint32_t c = 0; c < count; c++) {
+        LinkCapsule capsule;
+        uint8_t nameLength = 0;
+        file.read(reinterpret_cast<char*>(&nameLength), sizeof(nameLength));
+        capsule.link.resize(nameLength);
+        file.read(&capsule.link[0], nameLength);
+        float values[7];
+        file.read(reinterpret_cast<char*>(values), sizeof(values));
+        if (!file) {
+            std::cout << "[CapsuleFit] " << filename << " is truncated" << std::endl;
+            capsules.clear();
+            return false;
+        }
+        capsule.start = Eigen::Vector3d(values[0], values[1], values[2]);
+        capsule.end = Eigen::Vector3d(values[3], values[4], values[5]);
+        capsule.radius = values[6];
+        capsules.push_back(capsule);
+    }
+    return true;
+}
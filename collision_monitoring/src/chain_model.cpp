@@ -0,0 +1,233 @@
+#include "chain_model.h"
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+//#define DEBUG
+
+/// A closed interval of reals
+struct Interval
+{
+    double lo;
+    double hi;
+};
+
+/// The poses of a frame over a box of joint positions
+struct IntervalFrame
+{
+    Interval rotation[3][3];
+    Interval position[3];
+};
+
+static Interval exactly(double value){
+    Interval result = {value, value};
+    return result;
+}
+
+static Interval add(const Interval &a, const Interval &b){
+    Interval result = {a.lo + b.lo, a.hi + b.hi};
+    return result;
+}
+
+static Interval multiply(const Interval &a, const Interval &b){
+    double p1 = a.lo * b.lo;
+    double p2 = a.lo * b.hi;
+    double p3 = a.hi * b.lo;
+    double p4 = a.hi * b.hi;
+    Interval result = {std::min(std::min(p1, p2), std::min(p3, p4)),
+                       std::max(std::max(p1, p2), std::max(p3, p4))};
+    return result;
+}
+
+static Interval multiply(const Interval &a, double b){
+    Interval result = {std::min(a.lo * b, a.hi * b), std::max(a.lo * b, a.hi * b)};
+    return result;
+}
+
+/// Range of the sine over an interval of angles
+static Interval sine(double lo, double hi){
+    if (hi - lo >= 2 * M_PI) {
+        Interval result = {-1, 1};
+        return result;
+    }
+    Interval result = {std::min(std::sin(lo), std::sin(hi)),
+                       std::max(std::sin(lo), std::sin(hi))};
+
+    // The extrema inside the interval
+    double top = M_PI_2 + 2 * M_PI * std::ceil((lo - M_PI_2) / (2 * M_PI));
+    if (top <= hi) {
+        result.hi = 1;
+    }
+    double bottom = -M_PI_2 + 2 * M_PI * std::ceil((lo + M_PI_2) / (2 * M_PI));
+    if (bottom <= hi) {
+        result.lo = -1;
+    }
+    return result;
+}
+
+ChainModel::ChainModel(){
+    this->baseTransform = Eigen::Matrix4d::Identity();
+}
+
+ChainModel::~ChainModel(){
+
+}
+
+int ChainModel::nJoints(){
+    int count = 0;
+    for (int k = 0; k < segments.size(); k++) {
+        count += segments[k].revolute ? 1 : 0;
+    }
+    return count;
+}
+
+bool ChainModel::forwardKinematics(const std::vector<double> &jointPositions,
+                                   std::vector<Eigen::Matrix4d,
+                                       Eigen::aligned_allocator<Eigen::Matrix4d>> &frames){
+    if (jointPositions.size() != nJoints()) {
+        std::cout << "[ChainModel] expected " << nJoints() << " joint positions"
+                  << std::endl;
+        return false;
+    }
+
+    frames.resize(segments.size() + 1);
+    frames[0] = baseTransform;
+    int joint = 0;
+    for (int k = 0; k < segments.size(); k++) {
+        const Segment &segment = segments[k];
+        Eigen::Matrix4d motion = Eigen::Matrix4d::Identity();
+        if (segment.revolute) {
+            // Turn about the axis through its point
+            Eigen::Matrix3d turn = Eigen::AngleAxisd(jointPositions[joint++],
+                                                     segment.axis).toRotationMatrix();
+            motion.block<3, 3>(0, 0) = turn;
+            motion.block<3, 1>(0, 3) = segment.axisPoint - turn * segment.axisPoint;
+        }
+        frames[k + 1] = frames[k] * motion * segment.tip;
+    }
+    return true;
+}
+
+bool ChainModel::sweptLinks(const std::vector<double> &lower,
+                            const std::vector<double> &upper,
+                            std::vector<Eigen::Vector3d> &starts,
+                            std::vector<Eigen::Vector3d> &ends,
+                            std::vector<double> &inflations){
+    int nJoints = this->nJoints();
+    if (lower.size() != nJoints || upper.size() != nJoints) {
+        std::cout << "[ChainModel] expected " << nJoints << " joint bounds" << std::endl;
+        return false;
+    }
+    for (int i = 0; i < nJoints; i++) {
+        if (lower[i] > upper[i]) {
+            std::cout << "[ChainModel] empty interval for joint " << i << std::endl;
+            return false;
+        }
+    }
+
+    int nLinks = segments.size();
+    starts.resize(nLinks);
+    ends.resize(nLinks);
+    inflations.resize(nLinks);
+
+    IntervalFrame frame;
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+            frame.rotation[r][c] = exactly(baseTransform(r, c));
+        }
+        frame.position[r] = exactly(baseTransform(r, 3));
+    }
+
+    int joint = 0;
+    for (int k = 0; k < nLinks; k++) {
+        const Segment &segment = segments[k];
+
+        // The ends of the link, which is rigid in the current frame
+        const Eigen::Vector3d* points[2] = {&segment.linkStart, &segment.linkEnd};
+        Eigen::Vector3d* middles[2] = {&starts[k], &ends[k]};
+        inflations[k] = 0;
+        for (int e = 0; e < 2; e++) {
+            Eigen::Vector3d halfWidth;
+            for (int r = 0; r < 3; r++) {
+                Interval value = frame.position[r];
+                for (int c = 0; c < 3; c++) {
+                    value = add(value, multiply(frame.rotation[r][c], (*points[e])(c)));
+                }
+                (*middles[e])(r) = 0.5 * (value.lo + value.hi);
+                halfWidth(r) = 0.5 * (value.hi - value.lo);
+            }
+            inflations[k] = std::max(inflations[k], halfWidth.norm());
+        }
+
+        // Motion of the segment, a turn about the joint axis then the tip
+        Interval turn[3][3];
+        Eigen::Matrix3d tipRotation = segment.tip.block<3, 3>(0, 0);
+        if (segment.revolute) {
+            // Rodrigues formula R = I + sin(q) K + (1 - cos(q)) K^2
+            Eigen::Matrix3d K;
+            K <<               0, -segment.axis(2),  segment.axis(1),
+                 segment.axis(2),                0, -segment.axis(0),
+                -segment.axis(1),  segment.axis(0),                0;
+            Eigen::Matrix3d K2 = K * K;
+            Interval s = sine(lower[joint], upper[joint]);
+            Interval c = sine(lower[joint] + M_PI_2, upper[joint] + M_PI_2);
+            Interval versine = {1 - c.hi, 1 - c.lo};
+            joint++;
+            for (int r = 0; r < 3; r++) {
+                for (int col = 0; col < 3; col++) {
+                    turn[r][col] = add(exactly(r == col ? 1 : 0),
+                                       add(multiply(s, K(r, col)),
+                                           multiply(versine, K2(r, col))));
+                }
+            }
+        } else {
+            for (int r = 0; r < 3; r++) {
+                for (int col = 0; col < 3; col++) {
+                    turn[r][col] = exactly(r == col ? 1 : 0);
+                }
+            }
+        }
+
+        // Local motion [turn * tip rotation, turn * (tip - point) + point]
+        Interval localRotation[3][3];
+        Interval localPosition[3];
+        Eigen::Vector3d arm = segment.tip.block<3, 1>(0, 3) - segment.axisPoint;
+        for (int r = 0; r < 3; r++) {
+            for (int col = 0; col < 3; col++) {
+                localRotation[r][col] = exactly(0);
+                for (int m = 0; m < 3; m++) {
+                    localRotation[r][col] = add(localRotation[r][col],
+                                                multiply(turn[r][m], tipRotation(m, col)));
+                }
+            }
+            localPosition[r] = exactly(segment.axisPoint(r));
+            for (int m = 0; m < 3; m++) {
+                localPosition[r] = add(localPosition[r], multiply(turn[r][m], arm(m)));
+            }
+        }
+
+        // Next frame, the current frame times the local motion
+        IntervalFrame next;
+        for (int r = 0; r < 3; r++) {
+            for (int col = 0; col < 3; col++) {
+                next.rotation[r][col] = exactly(0);
+                for (int m = 0; m < 3; m++) {
+                    next.rotation[r][col] = add(next.rotation[r][col],
+                        multiply(frame.rotation[r][m], localRotation[m][col]));
+                }
+            }
+            next.position[r] = frame.position[r];
+            for (int m = 0; m < 3; m++) {
+                next.position[r] = add(next.position[r],
+                    multiply(frame.rotation[r][m], localPosition[m]));
+            }
+        }
+        frame = next;
+    }
+    #ifdef DEBUG
+    for (int k = 0; k < nLinks; k++) {
+        std::cout << "[ChainModel] link " << k << " inflated by " << inflations[k]
+                  << std::endl;
+    }
+    #endif
+    return true;
+}
@@ -0,0 +1,111 @@
+#include "configuration_cache.h"
+#include <cmath>
+#include <iterator>
+#include <iostream>
+//#define DEBUG
+
+ConfigurationCache::ConfigurationCache(){
+    this->maxEntries = 0;
+    this->step = 1e-3;
+    this->sceneVersion = 0;
+}
+
+ConfigurationCache::~ConfigurationCache(){
+
+}
+
+void ConfigurationCache::configure(int capacity, double tolerance){
+    clear();
+    this->maxEntries = capacity;
+    this->step = tolerance;
+    this->index.reserve(capacity);
+    while (spare.size() < capacity) {
+        spare.push_back(Entry());
+    }
+}
+
+void ConfigurationCache::reserve(int nObstacles, int nLinks, int nJoints){
+    for (std::list<Entry>::iterator entry = spare.begin(); entry != spare.end(); ++entry) {
+        entry->key.reserve(nJoints);
+        entry->obstacleDistances.resize(nObstacles, nLinks);
+        entry->linkDistances.resize(nLinks, nLinks);
+    }
+    scratchKey.reserve(nJoints);
+}
+
+bool ConfigurationCache::enabled(){
+    return maxEntries > 0;
+}
+
+double ConfigurationCache::tolerance(){
+    return step;
+}
+
+int ConfigurationCache::size(){
+    return entries.size();
+}
+
+void ConfigurationCache::clear(){
+    index.clear();
+    spare.splice(spare.end(), entries);
+}
+
+size_t ConfigurationCache::KeyHash::operator()(const std::vector<long> &key) const{
+    // FNV-1a over the cells of the joints
+    size_t value = 2166136261u;
+    for (int i = 0; i < key.size(); i++) {
+        value = (value ^ (size_t)key[i]) * 16777619u;
+    }
+    return value;
+}
+
+void ConfigurationCache::quantize(const std::vector<double> &jointPositions){
+    scratchKey.resize(jointPositions.size());
+    for (int i = 0; i < jointPositions.size(); i++) {
+        scratchKey[i] = std::lround(jointPositions[i] / step);
+    }
+}
+
+ConfigurationCache::Entry* ConfigurationCache::find(const std::vector<double> &jointPositions){
+    if (!enabled()) {
+        return NULL;
+    }
+    quantize(jointPositions);
+    std::unordered_map<std::vector<long>, std::list<Entry>::iterator, KeyHash>::iterator
+        found = index.find(scratchKey);
+    if (found == index.end()) {
+        return NULL;
+    }
+
+    // Most recently used first
+    entries.splice(entries.begin(), entries, found->second);
+    return &entries.front();
+}
+
+ConfigurationCache::Entry& ConfigurationCache::insert(const std::vector<double> &jointPositions){
+    quantize(jointPositions);
+    std::unordered_map<std::vector<long>, std::list<Entry>::iterator, KeyHash>::iterator
+        found = index.find(scratchKey);
+    if (found != index.end()) {
+        entries.splice(entries.begin(), entries, found->second);
+        return entries.front();
+    }
+
+    if (entries.size() >= maxEntries) {
+        // Reuse the least recently used entry and its buffers
+        #ifdef DEBUG
+        std::cout << "[ConfigurationCache] evicting an entry" << std::endl;
+        #endif
+        index.erase(entries.back().key);
+        entries.splice(entries.begin(), entries, std::prev(entries.end()));
+    } else if (!spare.empty()) {
+        entries.splice(entries.begin(), spare, spare.begin());
+    } else {
+        entries.push_front(Entry());
+    }
+
+    Entry &entry = entries.front();
+    entry.key = scratchKey;
+    index[entry.key] = entries.begin();
+    return entry;
+}
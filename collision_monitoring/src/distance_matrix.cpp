@@ -0,0 +1,76 @@
+#include "distance_matrix.h"
+#include <limits>
+#include <algorithm>
+
+DistanceMatrix::DistanceMatrix(){
+    this->rows = 0;
+    this->cols = 0;
+    this->computeWitnessPoints = false;
+    this->minimum = std::numeric_limits<double>::max();
+    this->minimumRow = -1;
+    this->minimumCol = -1;
+    this->witnessesStored = false;
+}
+
+DistanceMatrix::~DistanceMatrix(){
+
+}
+
+void DistanceMatrix::resize(int rows, int cols){
+    // The entries of a row move when the number of columns changes
+    if(cols != this->cols || (computeWitnessPoints && !witnessesStored)){
+        invalidate();
+    }
+    witnessesStored = computeWitnessPoints;
+
+    this->rows = rows;
+    this->cols = cols;
+
+    // std::vector keeps its capacity so this only allocates when growing
+    distances.resize(rows * cols);
+    if(computeWitnessPoints){
+        witnessPoints.resize(rows * cols * WITNESS_SIZE);
+    }
+    // Version 0 is never given to a primitive, new rows are always computed
+    rowVersions.resize(rows, 0);
+    colVersions.resize(cols, 0);
+}
+
+void DistanceMatrix::invalidate(){
+    std::fill(rowVersions.begin(), rowVersions.end(), 0);
+    std::fill(colVersions.begin(), colVersions.end(), 0);
+}
+
+void DistanceMatrix::assign(const DistanceMatrix &other){
+    bool witnesses = computeWitnessPoints;
+    computeWitnessPoints = witnesses && other.witnessesStored;
+    resize(other.rows, other.cols);
+    computeWitnessPoints = witnesses;
+
+    std::copy(other.distances.begin(), other.distances.begin() + rows * cols, 
+              distances.begin());
+    if (witnessesStored) {
+        std::copy(other.witnessPoints.begin(), 
+                  other.witnessPoints.begin() + rows * cols * WITNESS_SIZE,
+                  witnessPoints.begin());
+    }
+    std::copy(other.rowVersions.begin(), other.rowVersions.begin() + rows, 
+              rowVersions.begin());
+    std::copy(other.colVersions.begin(), other.colVersions.begin() + cols, 
+              colVersions.begin());
+    minimum = other.minimum;
+    minimumRow = other.minimumRow;
+    minimumCol = other.minimumCol;
+}
+
+double& DistanceMatrix::at(int row, int col){
+    return distances[row * cols + col];
+}
+
+double* DistanceMatrix::row(int row){
+    return &distances[row * cols];
+}
+
+double* DistanceMatrix::witness(int row, int col){
+    return &witnessPoints[(row * cols + col) * WITNESS_SIZE];
+}
@@ -0,0 +1,140 @@
+#include "joint_state_estimator.h"
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+// #define DEBUG
+
+JointStateEstimator::JointStateEstimator(int nJoints, double maxAcceleration,
+                                         double maxExtrapolation){
+    this->nJoints = nJoints;
+    this->maxAcceleration = maxAcceleration;
+    this->maxExtrapolation = maxExtrapolation;
+    for (int k = 0; k < 2; k++) {
+        samplePositions[k] = Eigen::VectorXd::Zero(nJoints);
+        sampleVelocities[k] = Eigen::VectorXd::Zero(nJoints);
+    }
+    curvatures = Eigen::VectorXd::Zero(nJoints);
+    reset();
+}
+
+JointStateEstimator::~JointStateEstimator(){
+}
+
+void JointStateEstimator::reset(){
+    nSamples = 0;
+    for (int k = 0; k < 2; k++) {
+        times[k] = 0;
+        velocityErrors[k] = HUGE_VAL;
+    }
+}
+
+double JointStateEstimator::latestTime() const{
+    return nSamples > 0 ? times[1] : 0;
+}
+
+bool JointStateEstimator::addSample(double time, const double* positions,
+                                    const double* velocities, int nPositions){
+    if (nPositions < nJoints) {
+        std::cout << "[JointStateEstimator] expected at least " << nJoints 
+                  << " joint positions" << std::endl;
+        return false;
+    }
+    if (nSamples > 0 && time <= times[1]) {
+        #ifdef DEBUG
+        std::cout << "[JointStateEstimator] sample at " << time << " is not newer than "
+                  << times[1] << std::endl;
+        #endif
+        return false;
+    }
+
+    // The latest sample becomes the previous one, swapping keeps the buffers
+    if (nSamples > 0) {
+        samplePositions[0].swap(samplePositions[1]);
+        sampleVelocities[0].swap(sampleVelocities[1]);
+        times[0] = times[1];
+        velocityErrors[0] = velocityErrors[1];
+    }
+    times[1] = time;
+    samplePositions[1] = Eigen::Map<const Eigen::VectorXd>(positions, nJoints);
+    if (velocities != NULL) {
+        sampleVelocities[1] = Eigen::Map<const Eigen::VectorXd>(velocities, nJoints);
+        velocityErrors[1] = 0;
+    } else if (nSamples > 0) {
+        // A difference quotient is the velocity somewhere in the interval
+        double h = times[1] - times[0];
+        sampleVelocities[1] = (samplePositions[1] - samplePositions[0]) / h;
+        velocityErrors[1] = maxAcceleration * h;
+    } else {
+        sampleVelocities[1].setZero();
+        velocityErrors[1] = HUGE_VAL;
+    }
+    nSamples = std::min(nSamples + 1, 2);
+
+    // The second derivative of a cubic is largest at one of the samples
+    if (nSamples == 2) {
+        double h = times[1] - times[0];
+        for (int i = 0; i < nJoints; i++) {
+            double step = samplePositions[1](i) - samplePositions[0](i);
+            double v0 = sampleVelocities[0](i) * h;
+            double v1 = sampleVelocities[1](i) * h;
+            double start = 6 * step - 4 * v0 - 2 * v1;
+            double end = -6 * step + 2 * v0 + 4 * v1;
+            curvatures(i) = std::max(fabs(start), fabs(end)) / (h * h);
+        }
+    }
+    return true;
+}
+
+bool JointStateEstimator::estimate(double time, double* positions, int nPositions,
+                                   double &errorBound) const{
+    errorBound = HUGE_VAL;
+    if (nPositions < nJoints) {
+        std::cout << "[JointStateEstimator] expected space for " << nJoints
+                  << " joint positions" << std::endl;
+        return false;
+    }
+    if (nSamples == 0) {
+        return false;
+    }
+
+    Eigen::Map<Eigen::VectorXd> estimated(positions, nJoints);
+    if (nSamples == 2 && time >= times[0] && time < times[1]) {
+        // Cubic Hermite curve between the samples
+        double h = times[1] - times[0];
+        double s = (time - times[0]) / h;
+        double s2 = s * s;
+        double s3 = s2 * s;
+        estimated = (2 * s3 - 3 * s2 + 1) * samplePositions[0] +
+                    ((s3 - 2 * s2 + s) * h) * sampleVelocities[0] +
+                    (-2 * s3 + 3 * s2) * samplePositions[1] +
+                    ((s3 - s2) * h) * sampleVelocities[1];
+
+        // The basis of the velocities is at most 4/27 in the interval and
+        // its second derivative at most 4 / h, so wrong velocities move the
+        // curve and its curvature from those of the exact velocities
+        double nearest = std::min(time - times[0], times[1] - time);
+        double sampleErrors = velocityErrors[0] + velocityErrors[1];
+        double velocityError = 4.0 / 27.0 * h * sampleErrors;
+        double curvature = curvatures.maxCoeff() + 4 * sampleErrors / h;
+        errorBound = 0.5 * (maxAcceleration + curvature) * nearest * nearest +
+                     velocityError;
+        return std::isfinite(errorBound);
+    }
+
+    // Extrapolation from the nearest sample, up to the limit
+    int k = (nSamples == 2 && time < times[0]) ? 0 : 1;
+    double dt = time - times[k];
+    bool fresh = fabs(dt) <= maxExtrapolation;
+    dt = std::max(-maxExtrapolation, std::min(maxExtrapolation, dt));
+    estimated = samplePositions[k] + dt * sampleVelocities[k];
+    errorBound = 0.5 * maxAcceleration * dt * dt;
+    if (dt != 0) {
+        errorBound += velocityErrors[k] * fabs(dt);
+    }
+    #ifdef DEBUG
+    std::cout << "[JointStateEstimator] extrapolated " << dt << " s, error below "
+              << errorBound << " rad" << std::endl;
+    #endif
+    return fresh && std::isfinite(errorBound);
+}
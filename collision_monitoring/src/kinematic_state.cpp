@@ -0,0 +1,36 @@
+#include "kinematic_state.h"
+
+KinematicState::KinematicState(){
+    this->version = 0;
+    this->computed = false;
+}
+
+KinematicState::~KinematicState(){
+}
+
+void KinematicState::resize(int nJoints, int nFrames){
+    jointPositions = Eigen::VectorXd::Zero(nJoints);
+    frames.assign(nFrames, Eigen::Matrix4d::Identity());
+    jacobians.assign(nFrames, Eigen::MatrixXd::Zero(6, nJoints));
+    computed = false;
+}
+
+bool KinematicState::isCurrent(const double* jointPositions, int nPositions) const{
+    if (!computed || nPositions < this->jointPositions.size()) {
+        return false;
+    }
+    for (int i = 0; i < this->jointPositions.size(); i++) {
+        if (this->jointPositions(i) != jointPositions[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void KinematicState::setJointPositions(const double* jointPositions){
+    for (int i = 0; i < this->jointPositions.size(); i++) {
+        this->jointPositions(i) = jointPositions[i];
+    }
+    computed = true;
+    version++;
+}
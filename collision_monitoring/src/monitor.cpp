@@ -1,6 +1,11 @@
 #include "monitor.h"
 #include <vector>
 #include <typeinfo>
+#include <limits>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 //#define DEBUG
 
 Monitor::Monitor(Arm* arm){
@@ -8,72 +13,295 @@ Monitor::Monitor(Arm* arm){
     std::cout << "Monitor have arm with " << arm->links.size() << "links" << std::endl;
     #endif
     this->arm = arm;
+    this->base = NULL;
+    this->world = NULL;
+    this->body = NULL;
+    this->robot = -1;
+    this->worldLayout = 0;
+    this->closestPoints.resize(1, Eigen::MatrixXd(2, 3));
+    this->pool = NULL;
+    this->tilePairs = 256;
+    this->tileConfigurations = 64;
+    this->tileTarget = NULL;
+    this->tileRows = 1;
+    this->configurationError = 0;
+    this->clustering = false;
+    this->refinementDistance = 0;
+    this->effectiveObstacles = 0;
+    this->chainModelLoaded = false;
 }
 
 Monitor::Monitor(Base* base){
     #ifdef DEBUG
     std::cout << "Monitor have a base added." << std::endl;
     #endif
+    this->arm = NULL;
     this->base = base;
+    this->world = NULL;
+    this->body = NULL;
+    this->robot = -1;
+    this->worldLayout = 0;
+    this->closestPoints.resize(1, Eigen::MatrixXd(2, 3));
+    this->pool = NULL;
+    this->tilePairs = 256;
+    this->tileConfigurations = 64;
+    this->tileTarget = NULL;
+    this->tileRows = 1;
+    this->configurationError = 0;
+    this->clustering = false;
+    this->refinementDistance = 0;
+    this->effectiveObstacles = 0;
+    this->chainModelLoaded = false;
 }
+Monitor::Monitor(WorldModel* world, int robot){
+    #ifdef DEBUG
+    std::cout << "Monitor views robot " << robot << " of a world" << std::endl;
+    #endif
+    this->arm = world->arm(robot);
+    this->base = world->base(robot);
+    this->world = world;
+    this->body = NULL;
+    this->robot = robot;
+    this->worldLayout = 0;
+    this->closestPoints.resize(1, Eigen::MatrixXd(2, 3));
+    this->pool = NULL;
+    this->tilePairs = 256;
+    this->tileConfigurations = 64;
+    this->tileTarget = NULL;
+    this->tileRows = 1;
+    this->configurationError = 0;
+    this->clustering = false;
+    this->refinementDistance = 0;
+    this->effectiveObstacles = 0;
+    this->chainModelLoaded = false;
+    collectObstacles();
+}
+
+Monitor::Monitor(WholeBodyModel* body){
+    #ifdef DEBUG
+    std::cout << "Monitor have an arm on a base" << std::endl;
+    #endif
+    this->arm = body->arm;
+    this->base = body->base;
+    this->world = NULL;
+    this->body = body;
+    this->robot = -1;
+    this->worldLayout = 0;
+    this->closestPoints.resize(1, Eigen::MatrixXd(2, 3));
+    this->pool = NULL;
+    this->tilePairs = 256;
+    this->tileConfigurations = 64;
+    this->tileTarget = NULL;
+    this->tileRows = 1;
+    this->configurationError = 0;
+    this->clustering = false;
+    this->refinementDistance = 0;
+    this->effectiveObstacles = 0;
+    this->chainModelLoaded = false;
+}
+
 Monitor::~Monitor(){
     #ifdef DEBUG
     std::cout << "Monitor had:" << this->obstacles.size() << "obstacles before destruction" << std::endl;
     #endif //DEBUG
-    for( int i=0; i < this->obstaclesToDelete.size(); i++){
-        delete obstaclesToDelete[i];
-        obstaclesToDelete[i] = NULL;
+    for (int i = 0; i < batchArms.size(); i++) {
+        delete batchArms[i];
     }
 }
 
-void Monitor::addObstacle(Primitive* obstacle) {
-    #ifdef DEBUG
-    std::cout << "[Monitor] obstacle root method, received obstacle" << std::endl;
-    #endif //DEBUG
-    Capsule *capsule = dynamic_cast<Capsule*>(obstacle);
-    if(capsule){
-        this->addObstacle(capsule);
-    }else{
-        Sphere *sphere = dynamic_cast<Sphere*>(obstacle);
-        if(sphere){
-            this->addObstacle(sphere);
-        }
-        else{
-        Box3 *box = dynamic_cast<Box3*>(obstacle);
-        if(box){
-            this->addObstacle(box);
+void Monitor::rebuildObstacleList(){
+    if (world != NULL) {
+        // The obstacles were added to or removed from the world store
+        world->rebuildObstacleList();
+    }
+    collectObstacles();
+}
+
+void Monitor::collectObstacles(){
+    obstacles.clear();
+    if (world == NULL) {
+        obstacles.reserve(store.size() + externalObstacles.size());
+        store.collect(obstacles);
+    } else {
+        // The shared obstacles, then the primitives of the other robots
+        obstacles.insert(obstacles.end(), world->obstacles.begin(), 
+                         world->obstacles.end());
+        for (int r = 0; r < world->nRobots(); r++) {
+            if (r != robot) {
+                std::vector<Primitive*> &primitives = world->primitives(r);
+                obstacles.insert(obstacles.end(), primitives.begin(), 
+                                 primitives.end());
+            }
         }
+        worldLayout = world->layoutVersion();
     }
+    obstacles.insert(obstacles.end(), externalObstacles.begin(), 
+                     externalObstacles.end());
+}
 
+void Monitor::refreshWorldObstacles(){
+    if (world != NULL && worldLayout != world->layoutVersion()) {
+        collectObstacles();
+    }
+    if (body != NULL) {
+        body->update();
+    }
+}
+
+ObstacleStore& Monitor::obstacleStore(){
+    if (world != NULL) {
+        return world->store;
+    }
+    return store;
 }
+
+ObstacleHandle Monitor::addObstacle(Primitive* obstacle) {
+    #ifdef DEBUG
+    std::cout << "[Monitor] obstacle root method, received obstacle" << std::endl;
+    #endif //DEBUG
+    ObstacleHandle handle = obstacleStore().add(obstacle);
+    rebuildObstacleList();
+    return handle;
 }
 
-void Monitor::addObstacle(Sphere* obstacle) {
+ObstacleHandle Monitor::addObstacle(Sphere* obstacle) {
     #ifdef DEBUG
     std::cout << "[Monitor] obstacle sphere method" << std::endl;
     #endif
-    Sphere* obstacleCopy = new Sphere(obstacle);
-    obstaclesToDelete.push_back(obstacleCopy);
-    obstacles.push_back(obstacleCopy);
+    ObstacleHandle handle = obstacleStore().add(obstacle);
+    rebuildObstacleList();
+    return handle;
 }
 
-void Monitor::addObstacle(Box3 *box) {
+ObstacleHandle Monitor::addObstacle(Box3 *box) {
     #ifdef DEBUG
     std::cout << "[Monitor] obstacle box method" << std::endl;
     #endif
-    Box3* obstacleCopy = new Box3(box);
-    obstaclesToDelete.push_back(obstacleCopy);
-    obstacles.push_back(obstacleCopy);
+    ObstacleHandle handle = obstacleStore().add(box);
+    rebuildObstacleList();
+    return handle;
 }
-void Monitor::addObstacle(Capsule* obstacle) {
+ObstacleHandle Monitor::addObstacle(Capsule* obstacle) {
     #ifdef DEBUG
     std::cout << "[Monitor] obstacle capsule method" << std::endl;
     #endif
-    Capsule* obstacleCopy = new Capsule(obstacle);
-    obstaclesToDelete.push_back(obstacleCopy);
-    obstacles.push_back(obstacleCopy);
+    ObstacleHandle handle = obstacleStore().add(obstacle);
+    rebuildObstacleList();
+    return handle;
+}
+
+std::vector<ObstacleHandle> Monitor::addObstacles(std::vector<Primitive*> &newObstacles) {
+    #ifdef DEBUG
+    std::cout << "[Monitor] adding " << newObstacles.size() << " obstacles" << std::endl;
+    #endif
+    // Count the shapes to grow every array only once
+    int nSpheres = 0;
+    int nCapsules = 0;
+    int nBoxes = 0;
+    for (int i = 0; i < newObstacles.size(); i++) {
+        if (dynamic_cast<Capsule*>(newObstacles[i])) {
+            nCapsules++;
+        } else if (dynamic_cast<Sphere*>(newObstacles[i])) {
+            nSpheres++;
+        } else if (dynamic_cast<Box3*>(newObstacles[i])) {
+            nBoxes++;
+        }
+    }
+    obstacleStore().reserve(nSpheres, nCapsules, nBoxes);
+
+    std::vector<ObstacleHandle> handles;
+    handles.reserve(newObstacles.size());
+    for (int i = 0; i < newObstacles.size(); i++) {
+        handles.push_back(obstacleStore().add(newObstacles[i]));
+    }
+    rebuildObstacleList();
+    return handles;
+}
+
+bool Monitor::removeObstacle(ObstacleHandle handle) {
+    if (!obstacleStore().remove(handle)) {
+        std::cout << "[Monitor] obstacle to remove not found" << std::endl;
+        return false;
+    }
+    rebuildObstacleList();
+    return true;
+}
+
+int Monitor::obstacleIndex(ObstacleHandle handle) {
+    // The obstacles of the world come first in the list of a view
+    return obstacleStore().position(handle);
 }
 
+ObstacleHandle Monitor::setMarkerObstacle(const std::string &ns, int id,
+                                          Primitive* obstacle) {
+    if (world != NULL) {
+        ObstacleHandle handle = world->setMarkerObstacle(ns, id, obstacle);
+        refreshWorldObstacles();
+        return handle;
+    }
+    ObstacleHandle* handle = markerObstacles.find(ns, id);
+    if (handle != NULL) {
+        // Same shape, updated in place without touching the obstacle list
+        if (store.update(*handle, obstacle)) {
+            return *handle;
+        }
+        #ifdef DEBUG
+        std::cout << "[Monitor] marker " << ns << "/" << id << " changed shape" << std::endl;
+        #endif
+        store.remove(*handle);
+    }
+
+    ObstacleHandle newHandle = store.add(obstacle);
+    if (newHandle.valid()) {
+        markerObstacles.insert(ns, id, newHandle);
+    } else {
+        markerObstacles.erase(ns, id);
+    }
+    rebuildObstacleList();
+    return newHandle;
+}
+
+bool Monitor::removeMarkerObstacle(const std::string &ns, int id) {
+    if (world != NULL) {
+        bool removed = world->removeMarkerObstacle(ns, id);
+        refreshWorldObstacles();
+        return removed;
+    }
+    ObstacleHandle* handle = markerObstacles.find(ns, id);
+    if (handle == NULL) {
+        return false;
+    }
+    store.remove(*handle);
+    markerObstacles.erase(ns, id);
+    rebuildObstacleList();
+    return true;
+}
+
+void Monitor::removeAllMarkerObstacles() {
+    if (world != NULL) {
+        world->removeAllMarkerObstacles();
+        refreshWorldObstacles();
+        return;
+    }
+    ObstacleStore &obstacleStore = this->store;
+    markerObstacles.forEach([&obstacleStore](const std::string &, int,
+                                             ObstacleHandle &handle) {
+        obstacleStore.remove(handle);
+    });
+    markerObstacles.clear();
+    rebuildObstacleList();
+}
+
+ObstacleHandle Monitor::markerObstacle(const std::string &ns, int id) {
+    if (world != NULL) {
+        return world->markerObstacle(ns, id);
+    }
+    ObstacleHandle* handle = markerObstacles.find(ns, id);
+    if (handle == NULL) {
+        return ObstacleHandle();
+    }
+    return *handle;
+}
 
 void Monitor::addObstacle(Arm* arm_obstacle) {
     #ifdef DEBUG
@@ -81,12 +309,12 @@ void Monitor::addObstacle(Arm* arm_obstacle) {
     #endif
     // Adds every link of the arm (a primitive) to the obstacles vector.
     for (int i = 0; i < arm_obstacle->links.size(); i++) {
-        // this->obstacles.push_back(arm->links[i]);
         #ifdef DEBUG
         std::cout << "link ["<< i << "]\n" << arm_obstacle->links[i]->pose << std::endl;
         #endif
-        obstacles.push_back(arm_obstacle->links[i]);
+        externalObstacles.push_back(arm_obstacle->links[i]);
     }
+    rebuildObstacleList();
     #ifdef DEBUG
     std::cout << "[Monitor] new obstacle length: " << obstacles.size() << std::endl;
     #endif
@@ -95,24 +323,99 @@ void Monitor::addObstacle(Base* base_obstacle) {
     #ifdef DEBUG
     std::cout << "[Monitor] obstacle base method" << std::endl;
     #endif
-    Box3* base_prim = new Box3(base_obstacle->base_primitive);
-    obstacles.push_back(base_prim);
+    externalObstacles.push_back(base_obstacle->base_primitive);
+    rebuildObstacleList();
     #ifdef DEBUG
     std::cout << "[Monitor] new obstacle length: " << obstacles.size() << std::endl;
     #endif
 }
   std::vector<double> Monitor:: baseDistanceToObjects(){
    std::vector<double> distances;
-  std::vector<double> distanceToObjects;
-  for (int i = 0; i < this->obstacles.size(); i++ ) {
-        distances.push_back(this->base->base_primitive->getShortestDistance( this->obstacles[i])); 
-     }
-     return distances;
+   baseDistanceToObjects(distances);
+   return distances;
+}
+
+bool Monitor::baseDistanceToObjects(std::vector<double> &result){
+    refreshWorldObstacles();
+    result.clear();
+    if (this->base == NULL) {
+        std::cout << "[Monitor] the base distances need a base" << std::endl;
+        return false;
+    }
+    for (int i = 0; i < this->obstacles.size(); i++) {
+        result.push_back(this->base->base_primitive->getShortestDistance(this->obstacles[i]));
+    }
+    return true;
+}
+
+std::vector<double> Monitor::armDistanceToBase(){
+    std::vector<double> distances;
+    refreshWorldObstacles();
+    if (this->arm == NULL || this->base == NULL) {
+        return distances;
+    }
+    int mountedLinks = body != NULL ? body->mountedLinks : 0;
+    for (int j = 0; j < this->arm->links.size(); j++) {
+        if (j < mountedLinks) {
+            distances.push_back(std::numeric_limits<double>::infinity());
+        } else {
+            distances.push_back(this->arm->links[j]->getShortestDistance(
+                this->base->base_primitive));
+        }
+    }
+    return distances;
+}
+
+bool Monitor::armDistanceToBase(DistanceMatrix &result){
+    refreshWorldObstacles();
+    if (this->arm == NULL || this->base == NULL) {
+        std::cout << "[Monitor] the arm distances to the base need an arm and a base" 
+                  << std::endl;
+        return false;
+    }
+    int nLinks = this->arm->links.size();
+    Box3* box = this->base->base_primitive;
+    result.resize(1, nLinks);
+
+    // Nothing to do if neither the base nor a link moved
+    bool baseMoved = result.rowVersions[0] != box->version;
+    if (!findMovedLinks(result) && !baseMoved) {
+        return true;
+    }
+
+    // The links resting on the base touch it by design
+    int mountedLinks = body != NULL ? body->mountedLinks : 0;
+    double* distances = result.row(0);
+    for (int j = 0; j < nLinks; j++) {
+        if (!baseMoved && !linkDirty[j]) {
+            continue;
+        }
+        if (j < mountedLinks) {
+            distances[j] = std::numeric_limits<double>::infinity();
+            if (result.computeWitnessPoints) {
+                double* witness = result.witness(0, j);
+                for (int k = 0; k < DistanceMatrix::WITNESS_SIZE; k++) {
+                    witness[k] = 0;
+                }
+            }
+            continue;
+        }
+        distances[j] = this->arm->links[j]->getShortestDistance(box);
+        if (result.computeWitnessPoints) {
+            storeWitness(this->arm->links[j], box, result.witness(0, j), 0);
+        }
+    }
+    result.rowVersions[0] = box->version;
+    for (int j = 0; j < nLinks; j++) {
+        result.colVersions[j] = this->arm->links[j]->version;
+    }
+    return true;
 }
 
 std::vector<std::vector<double>> Monitor::distanceToObjects(){
 
     std::vector<std::vector<double>> distanceToObjects;
+    refreshWorldObstacles();
 
     // For every obstacle calculate the distaces to each link
     for (int i = 0; i < this->obstacles.size(); i++ ) {
@@ -147,17 +450,21 @@ std::vector<std::vector<double>> Monitor::distanceBetweenArmLinks()
 {
     
     std::vector<std::vector<double>> distanceToObjects;
+    refreshWorldObstacles();
 
     // For every link calculate the distance to other links
     for (int i = 0; i < this->arm->links.size(); i++) {
 
         std::vector<double> distances;
         for (int j = 0; j < this->arm->links.size(); j++) {
-            if (i != j) {
+            if (i == j) {
+                distances.push_back(0);
+            } else if (this->arm->allowedCollision(i, j)) {
+                // The links touch by design, the pair is never close
+                distances.push_back(std::numeric_limits<double>::infinity());
+            } else {
                 distances.push_back(this->arm->links[i]->getShortestDistance(
                     this->arm->links[j]));
-            } else {
-                distances.push_back(0);
             }
         }
         distanceToObjects.push_back(distances);
@@ -176,4 +483,1029 @@ std::vector<std::vector<double>> Monitor::distanceBetweenArmLinks()
     #endif //DEBUG
 
     return distanceToObjects;
-}
\ No newline at end of file
+}
+
+bool Monitor::updateObstacle(int index, const Eigen::Matrix4d &pose){
+    refreshWorldObstacles();
+    if (index < 0 || index >= this->obstacles.size()) {
+        std::cout << "[Monitor] no obstacle with index " << index << std::endl;
+        return false;
+    }
+    this->obstacles[index]->setPose(pose);
+    return true;
+}
+
+bool Monitor::updateObstacle(ObstacleHandle handle, const Eigen::Matrix4d &pose){
+    Primitive* obstacle = obstacleStore().get(handle);
+    if (obstacle == NULL) {
+        std::cout << "[Monitor] obstacle to update not found" << std::endl;
+        return false;
+    }
+    obstacle->setPose(pose);
+    return true;
+}
+
+void Monitor::setThreadPool(ThreadPool* pool){
+    this->pool = pool;
+    int nWorkers = pool ? pool->size() : 1;
+    this->closestPoints.resize(nWorkers, Eigen::MatrixXd(2, 3));
+
+    // Captures only this so the function does not allocate on each call
+    this->obstacleRowsTask = [this](int begin, int end, int worker) {
+        this->computeObstacleRows(*this->tileTarget, begin, end, 
+                                  begin / this->tileRows, worker);
+    };
+    this->boundedPairsTask = [this](int begin, int end, int worker) {
+        this->computeBoundedPairs(begin, end, worker);
+    };
+}
+
+template<typename Shape>
+void Monitor::storeWitness(Primitive* first, Shape* second, double* witness,
+                           int worker){
+    Eigen::MatrixXd &points = closestPoints[worker];
+    first->getClosestPoints(points, second);
+    for (int k = 0; k < 3; k++) {
+        witness[k] = points(0, k);
+        witness[k + 3] = points(1, k);
+    }
+}
+
+template<typename Shape>
+void Monitor::computeEntry(DistanceMatrix &result, int row, int col, Shape* obstacle,
+                           int worker){
+    // The overload of the shape is called directly, without a cast
+    result.at(row, col) = this->arm->links[col]->getShortestDistance(obstacle);
+    if (result.computeWitnessPoints) {
+        storeWitness(this->arm->links[col], obstacle, result.witness(row, col), worker);
+    }
+}
+
+template<typename Shape>
+void Monitor::computeObstacleRow(DistanceMatrix &result, int row, Shape* obstacle,
+                                 int worker, BlockMinimum &minimum){
+    int nLinks = result.cols;
+    double* distances = result.row(row);
+    bool obstacleMoved = result.rowVersions[row] != obstacle->version;
+
+    for (int j = 0; j < nLinks; j++) {
+        // Keep the cached entry if neither primitive changed
+        if (obstacleMoved || linkDirty[j]) {
+            computeEntry(result, row, j, obstacle, worker);
+        }
+        if (distances[j] < minimum.distance) {
+            minimum.distance = distances[j];
+            minimum.row = row;
+            minimum.col = j;
+        }
+    }
+    result.rowVersions[row] = obstacle->version;
+}
+
+void Monitor::computeObstacleRows(DistanceMatrix &result, int begin, int end,
+                                  int tile, int worker){
+    // The stored obstacles come first, each shape from its own array
+    ObstacleStore &stored = obstacleStore();
+    int nStored = std::min(end, stored.size());
+    RowKernel kernel = {this, &result, worker, 
+                        {std::numeric_limits<double>::max(), -1, -1}};
+    if (begin < nStored) {
+        stored.forEachInRange(begin, nStored, kernel);
+    }
+    // Then the links and bases added as obstacles
+    for (int i = std::max(begin, nStored); i < end; i++) {
+        computeObstacleRow(result, i, this->obstacles[i], worker, kernel.minimum);
+    }
+    tileMinimum[tile] = kernel.minimum.distance;
+    tileMinimumRow[tile] = kernel.minimum.row;
+    tileMinimumCol[tile] = kernel.minimum.col;
+}
+
+void Monitor::distanceToObjects(DistanceMatrix &result){
+
+    refreshWorldObstacles();
+    if (world != NULL) {
+        copyWorldDistances(result);
+        return;
+    }
+
+    int nLinks = this->arm->links.size();
+    int previousRows = result.rows;
+    result.resize(this->obstacles.size(), nLinks);
+
+    // Nothing to do if no primitive changed since the last call
+    bool changed = findMovedLinks(result) || result.rows != previousRows;
+    for (int i = 0; i < result.rows && !changed; i++) {
+        changed = result.rowVersions[i] != this->obstacles[i]->version;
+    }
+    if (!changed) {
+        effectiveObstacles = 0;
+        return;
+    }
+
+    // Rows of a tile share the links, so size the tiles by number of pairs
+    int nTiles = 1;
+    tileRows = std::max(result.rows, 1);
+    if (this->pool != NULL && this->pool->size() > 1 && !clustering) {
+        tileRows = std::max(1, tilePairs / std::max(nLinks, 1));
+        // Every tile keeps its own minimum, so stay within the pool queues
+        int maxTiles = this->pool->maxTiles();
+        if ((result.rows + tileRows - 1) / tileRows > maxTiles) {
+            tileRows = (result.rows + maxTiles - 1) / maxTiles;
+        }
+        nTiles = std::max(1, (result.rows + tileRows - 1) / tileRows);
+    }
+    // Only grows with the number of obstacles
+    if (tileMinimum.size() < nTiles) {
+        tileMinimum.resize(nTiles);
+        tileMinimumRow.resize(nTiles);
+        tileMinimumCol.resize(nTiles);
+    }
+
+    if (clustering) {
+        computeClusteredRows(result);
+    } else if (nTiles > 1) {
+        tileTarget = &result;
+        this->pool->parallelFor(result.rows, tileRows, obstacleRowsTask);
+        tileTarget = NULL;
+        effectiveObstacles = result.rows;
+    } else {
+        computeObstacleRows(result, 0, result.rows, 0, 0);
+        effectiveObstacles = result.rows;
+    }
+    for (int j = 0; j < nLinks; j++) {
+        result.colVersions[j] = this->arm->links[j]->version;
+    }
+
+    // Reduce in tile order with a strict comparison, so ties resolve to the 
+    // first entry in row-major order whatever the number of threads
+    result.minimum = std::numeric_limits<double>::max();
+    result.minimumRow = -1;
+    result.minimumCol = -1;
+    for (int t = 0; t < nTiles; t++) {
+        if (tileMinimumRow[t] >= 0 && tileMinimum[t] < result.minimum) {
+            result.minimum = tileMinimum[t];
+            result.minimumRow = tileMinimumRow[t];
+            result.minimumCol = tileMinimumCol[t];
+        }
+    }
+
+    #ifdef DEBUG
+    // prints the distances calculated
+    for (int i = 0; i < result.rows; i++) {
+        std::cout << "distances to obstacle [" << i << "]:";
+
+        for (int j = 0; j < result.cols; j++){
+            std::cout << result.at(i, j) << " "; 
+        }
+        std::cout << std::endl;
+    }
+    #endif //DEBUG
+}
+
+void Monitor::computeClusteredRows(DistanceMatrix &result){
+    clusters.update(this->obstacles);
+    int nLinks = result.cols;
+    clusterDistances.resize(nLinks);
+    if (result.computeWitnessPoints) {
+        clusterWitnesses.resize(nLinks * DistanceMatrix::WITNESS_SIZE);
+    }
+    bool linksMoved = false;
+    for (int j = 0; j < nLinks; j++) {
+        linksMoved = linksMoved || linkDirty[j];
+    }
+    double minimum = std::numeric_limits<double>::max();
+    int minimumRow = -1;
+    int minimumCol = -1;
+    effectiveObstacles = clusters.size();
+
+    for (int c = 0; c < clusters.size(); c++) {
+        Sphere* bound = clusters.bound(c);
+        const int* members = clusters.members(c);
+        int nMembers = clusters.nMembers(c);
+
+        // A group of one obstacle is always computed exactly
+        bool refine = nMembers == 1;
+        for (int j = 0; j < nLinks && !refine; j++) {
+            clusterDistances[j] = this->arm->links[j]->getShortestDistance(bound);
+            refine = clusterDistances[j] < refinementDistance;
+        }
+
+        if (refine) {
+            if (nMembers > 1) {
+                effectiveObstacles += nMembers;
+            }
+            for (int m = 0; m < nMembers; m++) {
+                int i = members[m];
+                computeObstacleRows(result, i, i + 1, 0, 0);
+                if (tileMinimumRow[0] >= 0 && tileMinimum[0] < minimum) {
+                    minimum = tileMinimum[0];
+                    minimumRow = tileMinimumRow[0];
+                    minimumCol = tileMinimumCol[0];
+                }
+            }
+            continue;
+        }
+
+        // The members still hold the distances of this sphere if neither
+        // the links nor the group changed, each sphere has its own version
+        bool cached = !linksMoved && result.rowVersions[members[0]] == bound->version;
+        if (!cached && result.computeWitnessPoints) {
+            for (int j = 0; j < nLinks; j++) {
+                storeWitness(this->arm->links[j], bound, 
+                             &clusterWitnesses[j * DistanceMatrix::WITNESS_SIZE], 0);
+            }
+        }
+        for (int m = 0; m < nMembers; m++) {
+            int i = members[m];
+            double* distances = result.row(i);
+            if (!cached) {
+                std::copy(clusterDistances.begin(), clusterDistances.end(), distances);
+                if (result.computeWitnessPoints) {
+                    std::copy(clusterWitnesses.begin(), clusterWitnesses.end(), 
+                              result.witness(i, 0));
+                }
+            }
+            for (int j = 0; j < nLinks; j++) {
+                if (distances[j] < minimum) {
+                    minimum = distances[j];
+                    minimumRow = i;
+                    minimumCol = j;
+                }
+            }
+            // Not the version of the obstacle, so it is computed once the 
+            // group is refined
+            result.rowVersions[i] = bound->version;
+        }
+    }
+    tileMinimum[0] = minimum;
+    tileMinimumRow[0] = minimumRow;
+    tileMinimumCol[0] = minimumCol;
+}
+
+int Monitor::distanceToObjects(DistanceMatrix &result, double budget, 
+                               double &resolvedDistance){
+    typedef std::chrono::steady_clock Clock;
+    anytimeDeadline = Clock::now() + 
+        std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(budget));
+
+    refreshWorldObstacles();
+    int nLinks = this->arm->links.size();
+    int nObstacles = this->obstacles.size();
+    result.resize(nObstacles, nLinks);
+    // The rows with unresolved pairs were left with version 0, the others 
+    // are exact for the links that did not move
+    findMovedLinks(result);
+
+    linkCenters.resize(nLinks);
+    linkRadii.resize(nLinks);
+    for (int j = 0; j < nLinks; j++) {
+        this->arm->links[j]->getBoundingSphere(linkCenters[j], linkRadii[j]);
+    }
+    obstacleCenters.resize(nObstacles);
+    obstacleRadii.resize(nObstacles);
+
+    // Lower bound of every outdated pair from the enclosing spheres
+    boundedPairs.resize(nObstacles * nLinks);
+    int nBounded = 0;
+    int reached = 0;
+    for (; reached < nObstacles && Clock::now() < anytimeDeadline; reached++) {
+        int i = reached;
+        bool obstacleMoved = result.rowVersions[i] != this->obstacles[i]->version;
+        this->obstacles[i]->getBoundingSphere(obstacleCenters[i], obstacleRadii[i]);
+        double* distances = result.row(i);
+        for (int j = 0; j < nLinks; j++) {
+            if (!obstacleMoved && !linkDirty[j]) {
+                continue;
+            }
+            // Negative like the distance when the spheres overlap
+            distances[j] = (obstacleCenters[i] - linkCenters[j]).norm() - 
+                           obstacleRadii[i] - linkRadii[j];
+            PairBound &pair = boundedPairs[nBounded++];
+            pair.bound = distances[j];
+            pair.row = i;
+            pair.col = j;
+        }
+        result.rowVersions[i] = this->obstacles[i]->version;
+    }
+
+    // The most critical pairs first, ordering only the batches computed
+    PairBound* pairs = boundedPairs.data();
+    pairResolved.assign(nBounded, 0);
+    int batchSize = std::max(tilePairs, 1);
+    for (int first = 0; first < nBounded && Clock::now() < anytimeDeadline;
+         first += batchSize, batchSize *= 2) {
+        int size = std::min(batchSize, nBounded - first);
+        std::nth_element(pairs + first, pairs + first + size - 1, pairs + nBounded, 
+                         [](const PairBound &a, const PairBound &b) {
+            return a.bound < b.bound;
+        });
+        std::sort(pairs + first, pairs + first + size, 
+                  [](const PairBound &a, const PairBound &b) {
+            return a.bound < b.bound;
+        });
+
+        anytimeBatch = first;
+        tileTarget = &result;
+        if (this->pool != NULL && this->pool->size() > 1 && size > 1) {
+            int grain = std::max(1, size / (4 * this->pool->size()));
+            this->pool->parallelFor(size, grain, boundedPairsTask);
+        } else {
+            computeBoundedPairs(0, size, 0);
+        }
+        tileTarget = NULL;
+    }
+
+    // The rows of the pairs left with their bound are recomputed next time
+    int unresolved = 0;
+    resolvedDistance = std::numeric_limits<double>::infinity();
+    for (int k = 0; k < nBounded; k++) {
+        if (!pairResolved[k]) {
+            unresolved++;
+            resolvedDistance = std::min(resolvedDistance, pairs[k].bound);
+            result.rowVersions[pairs[k].row] = 0;
+        }
+    }
+    for (int i = reached; i < nObstacles; i++) {
+        bool obstacleMoved = result.rowVersions[i] != this->obstacles[i]->version;
+        double* distances = result.row(i);
+        for (int j = 0; j < nLinks; j++) {
+            if (obstacleMoved || linkDirty[j]) {
+                distances[j] = -std::numeric_limits<double>::infinity();
+                unresolved++;
+                resolvedDistance = -std::numeric_limits<double>::infinity();
+                result.rowVersions[i] = 0;
+            }
+        }
+    }
+    for (int j = 0; j < nLinks; j++) {
+        result.colVersions[j] = this->arm->links[j]->version;
+    }
+
+    result.minimum = std::numeric_limits<double>::max();
+    result.minimumRow = -1;
+    result.minimumCol = -1;
+    for (int i = 0; i < nObstacles; i++) {
+        double* distances = result.row(i);
+        for (int j = 0; j < nLinks; j++) {
+            if (distances[j] < result.minimum) {
+                result.minimum = distances[j];
+                result.minimumRow = i;
+                result.minimumCol = j;
+            }
+        }
+    }
+    #ifdef DEBUG
+    std::cout << "[Monitor] anytime distances: " << unresolved << " of " 
+              << nObstacles * nLinks << " pairs unresolved" << std::endl;
+    #endif
+    return unresolved;
+}
+
+void Monitor::computeBoundedPairs(int begin, int end, int worker){
+    ObstacleStore &stored = obstacleStore();
+    int nStored = stored.size();
+    for (int k = anytimeBatch + begin; k < anytimeBatch + end; k++) {
+        if (std::chrono::steady_clock::now() >= anytimeDeadline) {
+            return;
+        }
+        PairBound &pair = boundedPairs[k];
+        if (pair.row < nStored) {
+            EntryKernel kernel = {this, tileTarget, pair.col, worker};
+            stored.forEachInRange(pair.row, pair.row + 1, kernel);
+        } else {
+            computeEntry(*tileTarget, pair.row, pair.col, this->obstacles[pair.row], 
+                         worker);
+        }
+        pairResolved[k] = 1;
+    }
+}
+
+void Monitor::copyWorldDistances(DistanceMatrix &result){
+
+    world->update(world->computeWitnessPoints || result.computeWitnessPoints);
+    refreshWorldObstacles();
+
+    // The columns are the primitives of the robot in the world, the base
+    // primitive for a base
+    std::vector<Primitive*> &links = world->primitives(robot);
+    int nLinks = links.size();
+    result.resize(this->obstacles.size(), nLinks);
+    result.minimum = std::numeric_limits<double>::max();
+    result.minimumRow = -1;
+    result.minimumCol = -1;
+    bool witnesses = result.computeWitnessPoints;
+
+    // Rows of the shared obstacles, same layout in the world
+    DistanceMatrix &shared = world->obstacleDistances(robot);
+    int row = 0;
+    for (int i = 0; i < shared.rows; i++, row++) {
+        std::copy(shared.row(i), shared.row(i) + nLinks, result.row(row));
+        if (witnesses) {
+            std::copy(shared.witness(i, 0), shared.witness(i, 0) + 
+                      nLinks * DistanceMatrix::WITNESS_SIZE, result.witness(row, 0));
+        }
+    }
+
+    // Rows of the other robots, the pair matrices have the robot with the 
+    // lower index in the rows
+    for (int r = 0; r < world->nRobots(); r++) {
+        if (r == robot) {
+            continue;
+        }
+        DistanceMatrix &pair = world->robotDistances(robot, r);
+        int nPrimitives = world->primitives(r).size();
+        for (int p = 0; p < nPrimitives; p++, row++) {
+            double* distances = result.row(row);
+            for (int j = 0; j < nLinks; j++) {
+                if (robot < r) {
+                    distances[j] = pair.at(j, p);
+                } else {
+                    distances[j] = pair.at(p, j);
+                }
+                if (witnesses) {
+                    // The link of this robot comes first
+                    double* witness = result.witness(row, j);
+                    double* source = robot < r ? pair.witness(j, p) : pair.witness(p, j);
+                    int offset = robot < r ? 0 : 3;
+                    for (int k = 0; k < 3; k++) {
+                        witness[k] = source[k + offset];
+                        witness[k + 3] = source[k + 3 - offset];
+                    }
+                }
+            }
+        }
+    }
+
+    // Links and bases added to this monitor only
+    for (; row < result.rows; row++) {
+        double* distances = result.row(row);
+        for (int j = 0; j < nLinks; j++) {
+            distances[j] = links[j]->getShortestDistance(this->obstacles[row]);
+            if (witnesses) {
+                storeWitness(links[j], this->obstacles[row], result.witness(row, j), 0);
+            }
+        }
+    }
+
+    for (int i = 0; i < result.rows; i++) {
+        double* distances = result.row(i);
+        for (int j = 0; j < nLinks; j++) {
+            if (distances[j] < result.minimum) {
+                result.minimum = distances[j];
+                result.minimumRow = i;
+                result.minimumCol = j;
+            }
+        }
+        result.rowVersions[i] = this->obstacles[i]->version;
+    }
+    for (int j = 0; j < nLinks; j++) {
+        result.colVersions[j] = links[j]->version;
+    }
+}
+
+void Monitor::distanceBetweenArmLinks(DistanceMatrix &result){
+
+    refreshWorldObstacles();
+    int nLinks = this->arm->links.size();
+    result.resize(nLinks, nLinks);
+
+    // Nothing to do if no link moved since the last call
+    if (!findMovedLinks(result)) {
+        return;
+    }
+
+    // For every link calculate the distance to other links
+    for (int i = 0; i < nLinks; i++) {
+        double* distances = result.row(i);
+
+        for (int j = 0; j < nLinks; j++) {
+            // Keep the cached entry if neither link moved
+            if (!linkDirty[i] && !linkDirty[j]) {
+                continue;
+            }
+            if (i != j && !this->arm->allowedCollision(i, j)) {
+                distances[j] = this->arm->links[i]->getShortestDistance(
+                    this->arm->links[j]);
+
+                if (result.computeWitnessPoints) {
+                    storeWitness(this->arm->links[i], this->arm->links[j], 
+                                 result.witness(i, j), 0);
+                }
+            } else {
+                // The links touch by design, the pair is never close
+                distances[j] = i == j ? 0 : std::numeric_limits<double>::infinity();
+
+                if (result.computeWitnessPoints) {
+                    double* witness = result.witness(i, j);
+                    for (int k = 0; k < DistanceMatrix::WITNESS_SIZE; k++) {
+                        witness[k] = 0;
+                    }
+                }
+            }
+        }
+    }
+    for (int i = 0; i < nLinks; i++) {
+        result.rowVersions[i] = this->arm->links[i]->version;
+        result.colVersions[i] = this->arm->links[i]->version;
+    }
+}
+
+bool Monitor::predictCollisions(const std::vector<double> &jointPositions,
+                                const std::vector<double> &jointVelocities,
+                                double horizon, 
+                                std::vector<ImminentContact> &contacts){
+    contacts.clear();
+    this->arm->updatePose(jointPositions);
+    if (!this->arm->linkVelocities(jointVelocities, linkLinear, linkAngular)) {
+        std::cout << "[Monitor] the arm does not provide link velocities" << std::endl;
+        return false;
+    }
+
+    predictionDistances.computeWitnessPoints = true;
+    distanceToObjects(predictionDistances);
+
+    int nLinks = this->arm->links.size();
+    for (int j = 0; j < nLinks; j++) {
+        // The points of a link move at most as fast as the ends of its 
+        // capsule, which need not be on the frames of the link
+        Eigen::Vector3d frame = this->arm->getPose(j).block<3, 1>(0, 3);
+        Eigen::Vector3d start, end;
+        this->arm->linkEndPoints(j, start, end);
+        Eigen::Vector3d startVelocity = linkLinear[j] + linkAngular[j].cross(start - frame);
+        Eigen::Vector3d endVelocity = linkLinear[j] + linkAngular[j].cross(end - frame);
+        double speed = std::max(startVelocity.norm(), endVelocity.norm());
+
+        for (int i = 0; i < predictionDistances.rows; i++) {
+            ImminentContact contact;
+            contact.obstacle = i;
+            contact.link = j;
+            contact.distance = std::max(predictionDistances.at(i, j), 0.0);
+            contact.maxClosingSpeed = speed;
+            if (contact.distance == 0) {
+                contact.minimumTimeToCollision = 0;
+            } else if (speed > 0) {
+                contact.minimumTimeToCollision = contact.distance / speed;
+            } else {
+                contact.minimumTimeToCollision = std::numeric_limits<double>::infinity();
+            }
+            if (contact.minimumTimeToCollision > horizon) {
+                continue;
+            }
+
+            contact.distanceRate = distanceRate(predictionDistances, i, j);
+
+            if (contact.distance == 0) {
+                contact.timeToCollision = 0;
+            } else if (contact.distanceRate < 0) {
+                contact.timeToCollision = contact.distance / -contact.distanceRate;
+            } else {
+                contact.timeToCollision = std::numeric_limits<double>::infinity();
+            }
+            contacts.push_back(contact);
+        }
+    }
+
+    std::sort(contacts.begin(), contacts.end(), 
+              [](const ImminentContact &a, const ImminentContact &b) {
+        if (a.timeToCollision != b.timeToCollision) {
+            return a.timeToCollision < b.timeToCollision;
+        }
+        return a.minimumTimeToCollision < b.minimumTimeToCollision;
+    });
+    return true;
+}
+
+double Monitor::distanceRate(DistanceMatrix &distances, int obstacle, int link){
+    // Rate along the direction from the obstacle to the link
+    double* witness = distances.witness(obstacle, link);
+    Eigen::Vector3d start = this->arm->getPose(link).block<3, 1>(0, 3);
+    Eigen::Vector3d linkPoint(witness[0], witness[1], witness[2]);
+    Eigen::Vector3d obstaclePoint(witness[3], witness[4], witness[5]);
+    Eigen::Vector3d direction = linkPoint - obstaclePoint;
+    Eigen::Vector3d pointVelocity = linkLinear[link] + 
+                                    linkAngular[link].cross(linkPoint - start);
+    if (direction.norm() > 0) {
+        return direction.normalized().dot(pointVelocity);
+    }
+    // In contact the direction is unknown, any motion may be closing
+    return -pointVelocity.norm();
+}
+
+double Monitor::speedScale(const std::vector<double> &jointVelocities,
+                           const SeparationParameters &parameters){
+    predictionDistances.computeWitnessPoints = true;
+    distanceToObjects(predictionDistances);
+    if (body != NULL) {
+        // The base of a whole body is not among the obstacles
+        predictionBaseDistances.computeWitnessPoints = true;
+        armDistanceToBase(predictionBaseDistances);
+        return speedScale(jointVelocities, parameters, predictionDistances, 
+                          predictionBaseDistances);
+    }
+    return speedScale(jointVelocities, parameters, predictionDistances);
+}
+
+double Monitor::speedScale(const std::vector<double> &jointVelocities,
+                           const SeparationParameters &parameters,
+                           DistanceMatrix &distances,
+                           DistanceMatrix &baseDistances){
+    double scale = speedScale(jointVelocities, parameters, distances);
+    if (scale > 0) {
+        scale = std::min(scale, speedScale(jointVelocities, parameters, baseDistances));
+    }
+    return scale;
+}
+
+double Monitor::speedScale(const std::vector<double> &jointVelocities,
+                           const SeparationParameters &parameters,
+                           DistanceMatrix &distances){
+    if (!distances.computeWitnessPoints) {
+        std::cout << "[Monitor] the speed scale needs the witness points" << std::endl;
+        return 0;
+    }
+    if (!this->arm->linkVelocities(jointVelocities, linkLinear, linkAngular)) {
+        std::cout << "[Monitor] the arm does not provide link velocities" << std::endl;
+        return 0;
+    }
+
+    // Robot stopping distance v Tr + v^2 / 2a plus the obstacle motion 
+    // during the reaction and the braking, vh (Tr + v / a), must fit in 
+    // the distance minus the protective distance
+    double a = parameters.deceleration;
+    double b = parameters.reactionTime + parameters.obstacleSpeed / a;
+    double scale = 1;
+    int nLinks = this->arm->links.size();
+    for (int j = 0; j < nLinks; j++) {
+        for (int i = 0; i < distances.rows; i++) {
+            double closingSpeed = -distanceRate(distances, i, j);
+            if (closingSpeed <= 0) {
+                continue;
+            }
+            double c = std::max(distances.at(i, j), 0.0) - 
+                       parameters.protectiveDistance - 
+                       parameters.obstacleSpeed * parameters.reactionTime;
+            double maximumSpeed = 0;
+            if (c > 0) {
+                maximumSpeed = a * (std::sqrt(b * b + 2 * c / a) - b);
+            }
+            scale = std::min(scale, maximumSpeed / closingSpeed);
+        }
+    }
+    #ifdef DEBUG
+    std::cout << "[Monitor] speed scale: " << scale << std::endl;
+    #endif
+    return scale;
+}
+
+bool Monitor::checkConfigurations(const std::vector<std::vector<double>> &configurations,
+                                  double clearance,
+                                  std::vector<double> &minimumDistances,
+                                  int &firstInvalid){
+    firstInvalid = -1;
+    minimumDistances.assign(configurations.size(), std::numeric_limits<double>::max());
+    if (this->arm == NULL) {
+        std::cout << "[Monitor] configurations can only be checked for an arm" << std::endl;
+        return false;
+    }
+    for (int i = 0; i < configurations.size(); i++) {
+        if (configurations[i].size() != this->arm->nJoints) {
+            std::cout << "[Monitor] configuration " << i << " does not have " 
+                      << this->arm->nJoints << " joints" << std::endl;
+            return false;
+        }
+    }
+
+    // The links of the arm move with the configurations, not with the arm.
+    // The stored obstacles are read from their arrays, the others listed.
+    refreshWorldObstacles();
+    ObstacleStore &stored = obstacleStore();
+    batchObstacles.clear();
+    for (int i = stored.size(); i < this->obstacles.size(); i++) {
+        if (std::find(this->arm->links.begin(), this->arm->links.end(), 
+                      this->obstacles[i]) == this->arm->links.end()) {
+            batchObstacles.push_back(this->obstacles[i]);
+        }
+    }
+    std::vector<Primitive*> &checked = batchObstacles;
+    ThreadPool::Task task;
+
+    if (!chainModelLoaded) {
+        chainModelLoaded = this->arm->getChainModel(chainModel);
+    }
+    if (chainModelLoaded) {
+        // The end points of the links of all the configurations in one 
+        // pass, the workers then only read the columns of their tiles
+        chainModel.baseTransform = this->arm->baseTransform;
+        batchKinematics.setModel(chainModel);
+        if (!batchKinematics.linkEndpoints(configurations)) {
+            return false;
+        }
+        BatchKinematics &batch = batchKinematics;
+        task = [&minimumDistances, &batch, &checked, &stored]
+               (int begin, int end, int) {
+            EndpointKernel kernel;
+            for (int c = begin; c < end; c++) {
+                kernel.minimum = std::numeric_limits<double>::max();
+                for (int j = 0; j < batch.nLinks(); j++) {
+                    kernel.start = batch.linkStart(j, c);
+                    kernel.end = batch.linkEnd(j, c);
+                    kernel.radius = batch.radii[j];
+                    stored.forEachInRange(0, stored.size(), kernel);
+                    for (int i = 0; i < checked.size(); i++) {
+                        kernel.minimum = std::min(kernel.minimum, capsuleDistance(
+                            kernel.start, kernel.end, kernel.radius, checked[i]));
+                    }
+                }
+                minimumDistances[c] = kernel.minimum;
+            }
+        };
+    } else {
+        // One copy of the arm per worker, kept for the next batches
+        int nWorkers = this->pool ? this->pool->size() : 1;
+        while (batchArms.size() < nWorkers) {
+            Arm* copy = this->arm->clone();
+            if (copy == NULL) {
+                std::cout << "[Monitor] the arm cannot be copied" << std::endl;
+                return false;
+            }
+            batchArms.push_back(copy);
+        }
+        std::vector<Arm*> &arms = batchArms;
+        task = [&configurations, &minimumDistances, &arms, &checked, &stored]
+               (int begin, int end, int worker) {
+            Arm* copy = arms[worker];
+            for (int c = begin; c < end; c++) {
+                copy->updatePose(configurations[c]);
+                MinimumKernel kernel = {NULL, std::numeric_limits<double>::max()};
+                for (int j = 0; j < copy->links.size(); j++) {
+                    kernel.link = copy->links[j];
+                    stored.forEachInRange(0, stored.size(), kernel);
+                    for (int i = 0; i < checked.size(); i++) {
+                        kernel.minimum = std::min(kernel.minimum, 
+                                                  kernel.link->getShortestDistance(checked[i]));
+                    }
+                }
+                minimumDistances[c] = kernel.minimum;
+            }
+        };
+    }
+
+    int count = configurations.size();
+    if (this->pool != NULL && this->pool->size() > 1 && count > tileConfigurations) {
+        this->pool->parallelFor(count, tileConfigurations, task);
+    } else {
+        task(0, count, 0);
+    }
+
+    for (int c = 0; c < count; c++) {
+        if (minimumDistances[c] < clearance) {
+            firstInvalid = c;
+            break;
+        }
+    }
+    #ifdef DEBUG
+    std::cout << "[Monitor] checked " << count << " configurations, first invalid: " 
+              << firstInvalid << std::endl;
+    #endif
+    return true;
+}
+
+double Monitor::capsuleDistance(const Eigen::Vector3d &start, const Eigen::Vector3d &end,
+                                double radius, Primitive* obstacle){
+    Eigen::Vector3d onLink, onObstacle;
+
+    // Closed forms for the shapes with an axis or a center
+    Sphere* sphere = dynamic_cast<Sphere*>(obstacle);
+    if (sphere != NULL) {
+        Eigen::Vector3d center = sphere->pose.block<3, 1>(0, 3);
+        return std::sqrt(Line::segmentDistanceSquared(start, end, center, center, 
+                                                      onLink, onObstacle)) 
+               - radius - sphere->getRadius();
+    }
+    Capsule* capsule = dynamic_cast<Capsule*>(obstacle);
+    if (capsule != NULL) {
+        Eigen::Vector3d base = capsule->pose.block<3, 1>(0, 3);
+        Eigen::Vector3d tip = (capsule->pose * 
+            Eigen::Vector4d(0, 0, capsule->getLength(), 1)).head(3);
+        return std::sqrt(Line::segmentDistanceSquared(start, end, base, tip, 
+                                                      onLink, onObstacle)) 
+               - radius - capsule->getRadius();
+    }
+
+    // Other shapes through the distance of a capsule primitive
+    Eigen::Vector3d axis = end - start;
+    double length = axis.norm();
+    Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+    if (length > 0) {
+        pose.block<3, 3>(0, 0) = Eigen::Quaterniond::FromTwoVectors(
+            Eigen::Vector3d::UnitZ(), axis).toRotationMatrix();
+    }
+    pose.block<3, 1>(0, 3) = start;
+    Capsule link(pose, length, radius);
+    // The length of a capsule is a float, its end may move by the rounding
+    return link.getShortestDistance(obstacle) - std::fabs(length - link.getLength());
+}
+
+void Monitor::EndpointKernel::operator()(int, Sphere &obstacle){
+    Eigen::Vector3d center = obstacle.pose.block<3, 1>(0, 3);
+    Eigen::Vector3d onLink, onObstacle;
+    double distance = std::sqrt(Line::segmentDistanceSquared(start, end, center, center, 
+                                                             onLink, onObstacle)) 
+                      - radius - obstacle.getRadius();
+    minimum = std::min(minimum, distance);
+}
+
+void Monitor::EndpointKernel::operator()(int, Capsule &obstacle){
+    Eigen::Vector3d base = obstacle.pose.block<3, 1>(0, 3);
+    Eigen::Vector3d tip = (obstacle.pose * 
+        Eigen::Vector4d(0, 0, obstacle.getLength(), 1)).head(3);
+    Eigen::Vector3d onLink, onObstacle;
+    double distance = std::sqrt(Line::segmentDistanceSquared(start, end, base, tip, 
+                                                             onLink, onObstacle)) 
+                      - radius - obstacle.getRadius();
+    minimum = std::min(minimum, distance);
+}
+
+double Monitor::sweptDistance(int link, Primitive* obstacle){
+    return capsuleDistance(sweptStarts[link], sweptEnds[link], 
+                           chainModel.segments[link].linkRadius, obstacle);
+}
+
+bool Monitor::distanceBoundsOverBox(const std::vector<double> &lower,
+                                    const std::vector<double> &upper,
+                                    DistanceMatrix &result){
+    if (!chainModelLoaded) {
+        chainModelLoaded = this->arm->getChainModel(chainModel);
+        if (!chainModelLoaded) {
+            std::cout << "[Monitor] the arm does not provide a chain model" << std::endl;
+            return false;
+        }
+    }
+    // The chain is fixed but the arm base follows a moving base
+    refreshWorldObstacles();
+    chainModel.baseTransform = this->arm->baseTransform;
+    if (!chainModel.sweptLinks(lower, upper, sweptStarts, sweptEnds, sweptInflations)) {
+        return false;
+    }
+
+    int nLinks = chainModel.segments.size();
+    result.resize(this->obstacles.size(), nLinks);
+    result.invalidate();
+
+    result.minimum = std::numeric_limits<double>::max();
+    result.minimumRow = -1;
+    result.minimumCol = -1;
+    for (int i = 0; i < result.rows; i++) {
+        bool ownLink = std::find(this->arm->links.begin(), this->arm->links.end(), 
+                                 this->obstacles[i]) != this->arm->links.end();
+        for (int j = 0; j < nLinks; j++) {
+            result.at(i, j) = ownLink ? std::numeric_limits<double>::infinity() :
+                sweptDistance(j, this->obstacles[i]) - sweptInflations[j];
+            if (result.at(i, j) < result.minimum) {
+                result.minimum = result.at(i, j);
+                result.minimumRow = i;
+                result.minimumCol = j;
+            }
+        }
+    }
+    #ifdef DEBUG
+    std::cout << "[Monitor] smallest distance over the box: " << result.minimum 
+              << std::endl;
+    #endif
+    return true;
+}
+
+void Monitor::enableConfigurationCache(int capacity, double tolerance){
+    configurationCache.configure(capacity, tolerance);
+    configurationCache.sceneVersion = staticSceneVersion();
+    configurationCache.reserve(obstacleStore().size(), this->arm->links.size(),
+                               this->arm->nJoints);
+
+    // The joints of a hit are in the same cell, each less than the 
+    // tolerance from the stored one
+    std::vector<double> reach;
+    this->arm->jointReach(reach);
+    configurationError = 0;
+    for (int i = 0; i < reach.size(); i++) {
+        configurationError += tolerance * reach[i];
+    }
+}
+
+void Monitor::disableConfigurationCache(){
+    configurationCache.configure(0, configurationCache.tolerance());
+    configurationError = 0;
+}
+
+double Monitor::configurationCacheError(){
+    return configurationError;
+}
+
+void Monitor::enableObstacleClustering(double cellSize, double refinementDistance){
+    clusters.setCellSize(cellSize);
+    this->refinementDistance = refinementDistance;
+    clustering = world == NULL;
+    if (!clustering) {
+        std::cout << "[Monitor] obstacle clustering is not used by the monitor of a world" 
+                  << std::endl;
+    }
+}
+
+void Monitor::disableObstacleClustering(){
+    clustering = false;
+}
+
+int Monitor::effectiveObstacleCount(){
+    return effectiveObstacles;
+}
+
+unsigned long Monitor::staticSceneVersion(){
+    refreshWorldObstacles();
+    int nStatic = obstacleStore().size();
+
+    // FNV-1a over the number of obstacles and their versions
+    unsigned long value = 2166136261u;
+    value = (value ^ nStatic) * 16777619u;
+    for (int i = 0; i < nStatic; i++) {
+        value = (value ^ this->obstacles[i]->version) * 16777619u;
+    }
+
+    // and over the base of the arm, which moves all the links with it
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            double entry = this->arm->baseTransform(i, j);
+            unsigned long bits = 0;
+            std::memcpy(&bits, &entry, std::min(sizeof(bits), sizeof(entry)));
+            value = (value ^ bits) * 16777619u;
+        }
+    }
+    return value;
+}
+
+bool Monitor::configurationDistances(const std::vector<double> &jointPositions,
+                                     DistanceMatrix &obstacleDistances,
+                                     DistanceMatrix &linkDistances){
+    if (configurationCache.enabled()) {
+        unsigned long scene = staticSceneVersion();
+        if (scene != configurationCache.sceneVersion) {
+            configurationCache.clear();
+            configurationCache.sceneVersion = scene;
+        }
+
+        ConfigurationCache::Entry* entry = configurationCache.find(jointPositions);
+        if (entry != NULL) {
+            obstacleDistances.computeWitnessPoints = false;
+            obstacleDistances.assign(entry->obstacleDistances);
+            linkDistances.assign(entry->linkDistances);
+            return true;
+        }
+    }
+
+    this->arm->updatePose(jointPositions);
+    staticObstacleDistances(obstacleDistances);
+    distanceBetweenArmLinks(linkDistances);
+
+    if (configurationCache.enabled()) {
+        ConfigurationCache::Entry &entry = configurationCache.insert(jointPositions);
+        entry.obstacleDistances.computeWitnessPoints = false;
+        entry.obstacleDistances.assign(obstacleDistances);
+        entry.linkDistances.computeWitnessPoints = linkDistances.computeWitnessPoints;
+        entry.linkDistances.assign(linkDistances);
+    }
+    return false;
+}
+
+void Monitor::staticObstacleDistances(DistanceMatrix &result){
+    refreshWorldObstacles();
+
+    // The static obstacles are the first rows, only those are computed
+    int nLinks = this->arm->links.size();
+    result.computeWitnessPoints = false;
+    result.resize(obstacleStore().size(), nLinks);
+    findMovedLinks(result);
+    if (tileMinimum.empty()) {
+        tileMinimum.resize(1);
+        tileMinimumRow.resize(1);
+        tileMinimumCol.resize(1);
+    }
+    computeObstacleRows(result, 0, result.rows, 0, 0);
+    for (int j = 0; j < nLinks; j++) {
+        result.colVersions[j] = this->arm->links[j]->version;
+    }
+    result.minimum = tileMinimum[0];
+    result.minimumRow = tileMinimumRow[0];
+    result.minimumCol = tileMinimumCol[0];
+}
+
+bool Monitor::findMovedLinks(DistanceMatrix &result){
+    int nLinks = this->arm->links.size();
+    bool moved = false;
+
+    // Only grows with the number of links
+    linkDirty.resize(nLinks);
+    for (int j = 0; j < nLinks; j++) {
+        linkDirty[j] = result.colVersions[j] != this->arm->links[j]->version;
+        moved = moved || linkDirty[j];
+    }
+    return moved;
+}
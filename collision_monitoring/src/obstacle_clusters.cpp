@@ -0,0 +1,119 @@
+#include "obstacle_clusters.h"
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+#include <iostream>
+//#define DEBUG
+
+ObstacleClusters::ObstacleClusters(){
+    this->cellSize = 1.0;
+}
+
+ObstacleClusters::~ObstacleClusters(){
+
+}
+
+void ObstacleClusters::setCellSize(double cellSize){
+    this->cellSize = cellSize;
+    // Forces a rebuild on the next update
+    versions.clear();
+    bounds.clear();
+    memberStart.clear();
+}
+
+int ObstacleClusters::size(){
+    return bounds.size();
+}
+
+Sphere* ObstacleClusters::bound(int cluster){
+    return &bounds[cluster];
+}
+
+const int* ObstacleClusters::members(int cluster){
+    return &memberList[memberStart[cluster]];
+}
+
+int ObstacleClusters::nMembers(int cluster){
+    return memberStart[cluster + 1] - memberStart[cluster];
+}
+
+bool ObstacleClusters::update(std::vector<Primitive*> &obstacles){
+    bool changed = versions.size() != obstacles.size() ||
+                   (obstacles.size() > 0 && memberStart.empty());
+    for (int i = 0; i < obstacles.size() && !changed; i++) {
+        changed = versions[i] != obstacles[i]->version;
+    }
+    if (!changed) {
+        return false;
+    }
+    rebuild(obstacles);
+    return true;
+}
+
+void ObstacleClusters::rebuild(std::vector<Primitive*> &obstacles){
+    int nObstacles = obstacles.size();
+    versions.resize(nObstacles);
+    centers.resize(nObstacles);
+    radii.resize(nObstacles);
+    clusterOf.resize(nObstacles);
+
+    // Bin the obstacles by the cell of the center of their sphere
+    std::unordered_map<std::int64_t, int> cells;
+    std::vector<int> counts;
+    for (int i = 0; i < nObstacles; i++) {
+        versions[i] = obstacles[i]->version;
+        obstacles[i]->getBoundingSphere(centers[i], radii[i]);
+
+        std::int64_t key = 0;
+        for (int k = 0; k < 3; k++) {
+            std::int64_t cell = (std::int64_t)std::floor(centers[i][k] / cellSize);
+            key = (key << 21) | (cell & 0x1FFFFF);
+        }
+        std::unordered_map<std::int64_t, int>::iterator found = cells.find(key);
+        if (found == cells.end()) {
+            found = cells.insert(std::make_pair(key, (int)counts.size())).first;
+            counts.push_back(0);
+        }
+        clusterOf[i] = found->second;
+        counts[found->second]++;
+    }
+
+    // Group the indices by cluster, in the order of the obstacles
+    int nClusters = counts.size();
+    memberStart.assign(nClusters + 1, 0);
+    for (int c = 0; c < nClusters; c++) {
+        memberStart[c + 1] = memberStart[c] + counts[c];
+    }
+    memberList.resize(nObstacles);
+    std::vector<int> next(memberStart.begin(), memberStart.end() - 1);
+    for (int i = 0; i < nObstacles; i++) {
+        memberList[next[clusterOf[i]]++] = i;
+    }
+
+    // A sphere around the mean of the centers enclosing every member sphere
+    bounds.clear();
+    bounds.reserve(nClusters);
+    for (int c = 0; c < nClusters; c++) {
+        Eigen::Vector3d center = Eigen::Vector3d::Zero();
+        for (int m = memberStart[c]; m < memberStart[c + 1]; m++) {
+            center += centers[memberList[m]];
+        }
+        center /= counts[c];
+
+        double radius = 0;
+        for (int m = memberStart[c]; m < memberStart[c + 1]; m++) {
+            int i = memberList[m];
+            radius = std::max(radius, (centers[i] - center).norm() + radii[i]);
+        }
+
+        // The radius of a sphere is a float, round it up
+        Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+        pose.block<3, 1>(0, 3) = center;
+        bounds.push_back(Sphere(pose, radius * (1 + 1e-6) + 1e-6));
+    }
+    #ifdef DEBUG
+    std::cout << "[ObstacleClusters] " << nObstacles << " obstacles in "
+              << nClusters << " clusters" << std::endl;
+    #endif
+}
@@ -0,0 +1,203 @@
+#include "obstacle_store.h"
+#include <iostream>
+//#define DEBUG
+
+ObstacleStore::ObstacleStore(){
+
+}
+
+ObstacleStore::~ObstacleStore(){
+
+}
+
+void ObstacleStore::reserve(int nSpheres, int nCapsules, int nBoxes){
+    spheres.reserve(spheres.size() + nSpheres);
+    owners[SPHERE].reserve(owners[SPHERE].size() + nSpheres);
+    capsules.reserve(capsules.size() + nCapsules);
+    owners[CAPSULE].reserve(owners[CAPSULE].size() + nCapsules);
+    boxes.reserve(boxes.size() + nBoxes);
+    owners[BOX].reserve(owners[BOX].size() + nBoxes);
+    slots.reserve(slots.size() + nSpheres + nCapsules + nBoxes);
+}
+
+ObstacleHandle ObstacleStore::add(Primitive* obstacle){
+    Capsule *capsule = dynamic_cast<Capsule*>(obstacle);
+    if(capsule){
+        return this->add(capsule);
+    }
+    Sphere *sphere = dynamic_cast<Sphere*>(obstacle);
+    if(sphere){
+        return this->add(sphere);
+    }
+    Box3 *box = dynamic_cast<Box3*>(obstacle);
+    if(box){
+        return this->add(box);
+    }
+    std::cout << "[ObstacleStore] unknown obstacle shape, not added" << std::endl;
+    return ObstacleHandle();
+}
+
+ObstacleHandle ObstacleStore::add(Sphere* obstacle){
+    // The copy constructors give the copy its own version
+    spheres.push_back(Sphere(obstacle));
+    return createHandle(SPHERE, spheres.size() - 1);
+}
+
+ObstacleHandle ObstacleStore::add(Capsule* obstacle){
+    capsules.push_back(Capsule(obstacle));
+    return createHandle(CAPSULE, capsules.size() - 1);
+}
+
+ObstacleHandle ObstacleStore::add(Box3* obstacle){
+    boxes.push_back(Box3(obstacle));
+    return createHandle(BOX, boxes.size() - 1);
+}
+
+ObstacleHandle ObstacleStore::createHandle(int type, int index){
+    ObstacleHandle handle;
+
+    if (!freeSlots.empty()) {
+        handle.slot = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        Slot slot;
+        slot.generation = 0;
+        slots.push_back(slot);
+        handle.slot = slots.size() - 1;
+    }
+    slots[handle.slot].type = type;
+    slots[handle.slot].index = index;
+    handle.generation = slots[handle.slot].generation;
+
+    owners[type].push_back(handle.slot);
+    #ifdef DEBUG
+    std::cout << "[ObstacleStore] obstacle of type " << type << " in slot " << handle.slot << std::endl;
+    #endif
+    return handle;
+}
+
+bool ObstacleStore::update(ObstacleHandle handle, Primitive* obstacle){
+    if (this->get(handle) == NULL) {
+        return false;
+    }
+    Slot &slot = slots[handle.slot];
+
+    if (slot.type == SPHERE) {
+        Sphere *sphere = dynamic_cast<Sphere*>(obstacle);
+        if (!sphere) {
+            return false;
+        }
+        if (sphere->getRadius() != spheres[slot.index].getRadius()) {
+            spheres[slot.index] = Sphere(sphere);
+            return true;
+        }
+        spheres[slot.index].setPose(sphere->pose);
+    } else if (slot.type == CAPSULE) {
+        Capsule *capsule = dynamic_cast<Capsule*>(obstacle);
+        if (!capsule) {
+            return false;
+        }
+        if (capsule->getRadius() != capsules[slot.index].getRadius() ||
+            capsule->getLength() != capsules[slot.index].getLength()) {
+            capsules[slot.index] = Capsule(capsule);
+            return true;
+        }
+        capsules[slot.index].setPose(capsule->pose);
+    } else {
+        Box3 *box = dynamic_cast<Box3*>(obstacle);
+        if (!box) {
+            return false;
+        }
+        if (box->extents != boxes[slot.index].extents) {
+            boxes[slot.index] = Box3(box);
+            return true;
+        }
+        boxes[slot.index].setPose(box->pose);
+    }
+    return true;
+}
+
+bool ObstacleStore::remove(ObstacleHandle handle){
+    if (this->get(handle) == NULL) {
+        return false;
+    }
+    Slot &slot = slots[handle.slot];
+
+    if (slot.type == SPHERE) {
+        removeAt(spheres, SPHERE, slot.index);
+    } else if (slot.type == CAPSULE) {
+        removeAt(capsules, CAPSULE, slot.index);
+    } else {
+        removeAt(boxes, BOX, slot.index);
+    }
+
+    // Older handles to this slot no longer resolve
+    slot.generation++;
+    slot.index = -1;
+    freeSlots.push_back(handle.slot);
+    return true;
+}
+
+void ObstacleStore::clear(){
+    spheres.clear();
+    capsules.clear();
+    boxes.clear();
+    freeSlots.clear();
+    for (int type = 0; type < N_SHAPE_TYPES; type++) {
+        owners[type].clear();
+    }
+    for (int i = 0; i < slots.size(); i++) {
+        if (slots[i].index >= 0) {
+            slots[i].generation++;
+            slots[i].index = -1;
+        }
+        freeSlots.push_back(i);
+    }
+}
+
+Primitive* ObstacleStore::get(ObstacleHandle handle){
+    if (handle.slot < 0 || handle.slot >= slots.size()) {
+        return NULL;
+    }
+    Slot &slot = slots[handle.slot];
+    if (slot.generation != handle.generation || slot.index < 0) {
+        return NULL;
+    }
+
+    if (slot.type == SPHERE) {
+        return &spheres[slot.index];
+    } else if (slot.type == CAPSULE) {
+        return &capsules[slot.index];
+    }
+    return &boxes[slot.index];
+}
+
+int ObstacleStore::position(ObstacleHandle handle){
+    if (this->get(handle) == NULL) {
+        return -1;
+    }
+    Slot &slot = slots[handle.slot];
+
+    if (slot.type == SPHERE) {
+        return slot.index;
+    } else if (slot.type == CAPSULE) {
+        return spheres.size() + slot.index;
+    }
+    return spheres.size() + capsules.size() + slot.index;
+}
+
+int ObstacleStore::size(){
+    return spheres.size() + capsules.size() + boxes.size();
+}
+
+void ObstacleStore::collect(std::vector<Primitive*> &list){
+    for (int i = 0; i < spheres.size(); i++) {
+        list.push_back(&spheres[i]);
+    }
+    for (int i = 0; i < capsules.size(); i++) {
+        list.push_back(&capsules[i]);
+    }
+    for (int i = 0; i < boxes.size(); i++) {
+        list.push_back(&boxes[i]);
+    }
+}
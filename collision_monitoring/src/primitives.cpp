@@ -1,6 +1,49 @@
 #include "primitives.h"
 #include <math.h> 
 #include <iostream>
+#include <atomic>
+
+/// Source of the primitive versions, shared by all the primitives
+static std::atomic<unsigned long> versionCounter(0);
+
+/**
+ * Closest points of two primitives, the first one on the first primitive
+ * 
+ * The shortest directions are queried on the control loop, so the points
+ * are kept in fixed size vectors instead of a matrix on the heap. The 
+ * getClosestPoints methods copy them into the rows of their matrix.
+ */
+static void pointsBetween(Capsule *capsule, Capsule *other,
+                          Eigen::Vector3d &first, Eigen::Vector3d &second);
+static void pointsBetween(Capsule *capsule, Sphere *sphere,
+                          Eigen::Vector3d &first, Eigen::Vector3d &second);
+static void pointsBetween(Capsule *capsule, Box3 *box,
+                          Eigen::Vector3d &first, Eigen::Vector3d &second);
+static void pointsBetween(Sphere *sphere, Sphere *other,
+                          Eigen::Vector3d &first, Eigen::Vector3d &second);
+static void pointsBetween(Sphere *sphere, Box3 *box,
+                          Eigen::Vector3d &first, Eigen::Vector3d &second);
+
+Primitive::Primitive(){
+    this->version = ++versionCounter;
+}
+
+Primitive::~Primitive(){
+
+}
+
+bool Primitive::setPose(const Eigen::Matrix4d &newPose){
+    if (this->pose == newPose) {
+        return false;
+    }
+    this->pose = newPose;
+    this->touch();
+    return true;
+}
+
+void Primitive::touch(){
+    this->version = ++versionCounter;
+}
 
 
 Line::Line(Eigen::Vector3d basePoint, Eigen::Vector3d endPoint){
@@ -57,6 +100,13 @@ Eigen::Vector3d Line::getClosestPointToPoint(Eigen::Vector3d point){
 
 void Line::getClosestPointsBetweenLines(Eigen::MatrixXd &closestPoints, Line line){
     Eigen::Vector3d ownClosestPoint, obstacleClosestPoint;
+    this->getClosestPointsBetweenLines(ownClosestPoint, obstacleClosestPoint, line);
+    closestPoints.row(0) = ownClosestPoint;
+    closestPoints.row(1) = obstacleClosestPoint;
+}
+
+void Line::getClosestPointsBetweenLines(Eigen::Vector3d &ownClosestPoint, 
+                                        Eigen::Vector3d &obstacleClosestPoint, Line line){
     Eigen::Vector3d obstacleProjectedClosestPoint;
 
     Eigen::Vector3d basePointProjected, endPointProjected, midPoint;
@@ -82,9 +132,6 @@ void Line::getClosestPointsBetweenLines(Eigen::MatrixXd &closestPoints, Line lin
         obstacleClosestPoint = (line.getEndPoint() - line.getBasePoint()) * ratio +  line.getBasePoint();
         ownClosestPoint = this->getClosestPointToPoint(obstacleClosestPoint);
     }
-    
-    closestPoints.row(0) = ownClosestPoint;
-    closestPoints.row(1) = obstacleClosestPoint;   
 }
 
 double Line::getShortestDistanceToPoint(Eigen::Vector3d point){
@@ -113,6 +160,48 @@ double Line::getShortestDistanceToLine(Line line){
     return shortestDistance;
 }
 
+double Line::segmentDistanceSquared(const Eigen::Vector3d &p1, const Eigen::Vector3d &q1,
+                                   const Eigen::Vector3d &p2, const Eigen::Vector3d &q2,
+                                   Eigen::Vector3d &c1, Eigen::Vector3d &c2){
+    Eigen::Vector3d d1 = q1 - p1;
+    Eigen::Vector3d d2 = q2 - p2;
+    Eigen::Vector3d r = p1 - p2;
+    double a = d1.squaredNorm();
+    double e = d2.squaredNorm();
+    double f = d2.dot(r);
+    double s = 0;
+    double t = 0;
+
+    if (a <= 1e-12 && e <= 1e-12) {
+        // Both segments are points
+    } else if (a <= 1e-12) {
+        t = std::min(std::max(f / e, 0.0), 1.0);
+    } else {
+        double c = d1.dot(r);
+        if (e <= 1e-12) {
+            s = std::min(std::max(-c / a, 0.0), 1.0);
+        } else {
+            // Closest points of the lines, clamped to the segments
+            double b = d1.dot(d2);
+            double denominator = a * e - b * b;
+            if (denominator > 1e-12) {
+                s = std::min(std::max((b * f - c * e) / denominator, 0.0), 1.0);
+            }
+            t = (b * s + f) / e;
+            if (t < 0) {
+                t = 0;
+                s = std::min(std::max(-c / a, 0.0), 1.0);
+            } else if (t > 1) {
+                t = 1;
+                s = std::min(std::max((b - c) / a, 0.0), 1.0);
+            }
+        }
+    }
+    c1 = p1 + d1 * s;
+    c2 = p2 + d2 * t;
+    return (c1 - c2).squaredNorm();
+}
+
 
 Capsule::Capsule(Eigen::Matrix4d pose, double length, double radius){
     this->pose = pose;
@@ -138,6 +227,13 @@ float Capsule::getRadius(){
     return this->radius;
 }
 
+void Capsule::getBoundingSphere(Eigen::Vector3d &center, double &radius){
+    // Centered on the middle of the axis
+    Eigen::Vector4d middle(0, 0, this->length / 2, 1);
+    center = (this->pose * middle).head(3);
+    radius = this->length / 2 + this->radius;
+}
+
 void Capsule::getClosestPoints(Eigen::MatrixXd &closestPoints, Primitive *primitive){
     Capsule *capsule = dynamic_cast<Capsule*>(primitive);
     if(capsule){
@@ -158,111 +254,69 @@ void Capsule::getClosestPoints(Eigen::MatrixXd &closestPoints, Primitive *primit
 
 void Capsule::getClosestPoints(Eigen::MatrixXd &closestPoints, Capsule *capsule){
     Eigen::Vector3d ownClosestPoint, obstacleClosestPoint;
-    
-    double lambdaM1, lambdaM2;
-    Eigen::Vector3d basePointObstacle, endPointObstacle, basePointOwn, endPointOwn;
-    Capsule *capsuleOwn;
-    Capsule *capsuleObstacle;
-
-    if(this->length > capsule->getLength()){
-        capsuleOwn = this;
-        capsuleObstacle = capsule;
-    }
-    else{
-        capsuleOwn = capsule;
-        capsuleObstacle = this;
-    }
-    
-    Eigen::Vector4d origin(0, 0, 0, 1);
-    Eigen::Vector4d zDirectionOwn(0, 0, capsuleOwn->length, 1);
-    Eigen::Vector4d zDirectionObstacle(0, 0, capsuleObstacle->length, 1);
-
-    basePointOwn = (capsuleOwn->pose * origin).head(3);
-    endPointOwn  = (capsuleOwn->pose * zDirectionOwn).head(3);
-
-    Line axisOfSymmetryOwn(basePointOwn, endPointOwn);
-
-    basePointObstacle = (capsuleObstacle->pose * origin).head(3);
-    endPointObstacle  = (capsuleObstacle->pose * zDirectionObstacle).head(3);
-
-    Line axisOfSymmetryObstacle(basePointObstacle, endPointObstacle);
-
-
-    lambdaM1 = (basePointObstacle - basePointOwn).dot(endPointOwn - basePointOwn) / pow(capsuleOwn->getLength(), 2);
-    lambdaM2 = (endPointObstacle - basePointOwn).dot(endPointOwn - basePointOwn) / pow(capsuleOwn->getLength(), 2);
+    pointsBetween(this, capsule, ownClosestPoint, obstacleClosestPoint);
+    closestPoints.row(0) = ownClosestPoint;
+    closestPoints.row(1) = obstacleClosestPoint;
+}
 
-    if(lambdaM1 >= 0 && lambdaM1 <= 1){
-        if(lambdaM2 >=0 && lambdaM2 <= 1){
-            //m1 and m2 inside
-            axisOfSymmetryOwn.getClosestPointsBetweenLines(closestPoints, axisOfSymmetryObstacle);
-            closestPoints.row(0).swap(closestPoints.row(1));
-        }else{
-            //m1 inside
-            if( axisOfSymmetryOwn.getShortestDistanceToPoint(basePointObstacle) < axisOfSymmetryObstacle.getShortestDistanceToPoint(endPointOwn) ){
-                axisOfSymmetryOwn.getClosestPointsBetweenLines(closestPoints, axisOfSymmetryObstacle);
-                closestPoints.row(0).swap(closestPoints.row(1));
-            }else{
-                axisOfSymmetryObstacle.getClosestPointsBetweenLines(closestPoints, axisOfSymmetryOwn);
-            }
-        }   
-    }else if(lambdaM2 >=0 && lambdaM2 <= 1){
-        //m2 inside
-        if( axisOfSymmetryOwn.getShortestDistanceToPoint(endPointObstacle) < axisOfSymmetryObstacle.getShortestDistanceToPoint(basePointOwn) ){
-            axisOfSymmetryOwn.getClosestPointsBetweenLines(closestPoints, axisOfSymmetryObstacle);
-            closestPoints.row(0).swap(closestPoints.row(1));
-        }else{
-            axisOfSymmetryObstacle.getClosestPointsBetweenLines(closestPoints, axisOfSymmetryOwn);
-        }
-    }else{
-        //m1 and m2 outside
-        if( axisOfSymmetryOwn.getShortestDistanceToPoint(endPointObstacle) < axisOfSymmetryOwn.getShortestDistanceToPoint(basePointObstacle) ){
-            axisOfSymmetryObstacle.getClosestPointsBetweenLines(closestPoints, axisOfSymmetryOwn);
-        }else{
-            axisOfSymmetryOwn.getClosestPointsBetweenLines(closestPoints, axisOfSymmetryObstacle);
-            closestPoints.row(0).swap(closestPoints.row(1));
-        }
-    }
+static void pointsBetween(Capsule *capsule, Capsule *other,
+                          Eigen::Vector3d &first, Eigen::Vector3d &second){
+    // The exact closest points of the axes, the first one on capsule
+    Eigen::Vector4d origin(0, 0, 0, 1);
+    Eigen::Vector3d basePoint = (capsule->pose * origin).head(3);
+    Eigen::Vector3d endPoint = 
+        (capsule->pose * Eigen::Vector4d(0, 0, capsule->getLength(), 1)).head(3);
+    Eigen::Vector3d otherBasePoint = (other->pose * origin).head(3);
+    Eigen::Vector3d otherEndPoint = 
+        (other->pose * Eigen::Vector4d(0, 0, other->getLength(), 1)).head(3);
+    Line::segmentDistanceSquared(basePoint, endPoint, otherBasePoint, otherEndPoint,
+                                 first, second);
 }
 
 void Capsule::getClosestPoints(Eigen::MatrixXd &closestPoints, Sphere *sphere){
-    Eigen::Vector3d basePoint, endPoint, ownClosestPoint, obstacleClosestPoint;
+    Eigen::Vector3d ownClosestPoint, obstacleClosestPoint;
+    pointsBetween(this, sphere, ownClosestPoint, obstacleClosestPoint);
+    closestPoints.row(0) = ownClosestPoint;
+    closestPoints.row(1) = obstacleClosestPoint;
+}
+
+static void pointsBetween(Capsule *capsule, Sphere *sphere,
+                          Eigen::Vector3d &first, Eigen::Vector3d &second){
+    Eigen::Vector3d basePoint, endPoint;
 
     Eigen::Vector4d origin(0, 0, 0, 1);
-    Eigen::Vector4d zDirectionCapsule(0, 0, this->length, 1);
+    Eigen::Vector4d zDirectionCapsule(0, 0, capsule->getLength(), 1);
 
-    basePoint = (this->pose * origin).head(3);
-    endPoint  = (this->pose * zDirectionCapsule).head(3);
+    basePoint = (capsule->pose * origin).head(3);
+    endPoint  = (capsule->pose * zDirectionCapsule).head(3);
 
     Line axisOfSymmetryCapsule(basePoint, endPoint);
     
-    obstacleClosestPoint = (sphere->pose * origin).head(3);
-    ownClosestPoint = axisOfSymmetryCapsule.getClosestPointToPoint(obstacleClosestPoint);
+    second = (sphere->pose * origin).head(3);
+    first = axisOfSymmetryCapsule.getClosestPointToPoint(second);
+}
 
+void Capsule::getClosestPoints(Eigen::MatrixXd &closestPoints, Box3 *box){
+    Eigen::Vector3d ownClosestPoint, obstacleClosestPoint;
+    pointsBetween(this, box, ownClosestPoint, obstacleClosestPoint);
     closestPoints.row(0) = ownClosestPoint;
     closestPoints.row(1) = obstacleClosestPoint;
 }
 
-void Capsule::getClosestPoints(Eigen::MatrixXd &closestPoints, Box3 *box){
-
-    Eigen::Vector3d basePoint, endPoint, ownClosestPoint, obstacleClosestPoint;
+static void pointsBetween(Capsule *capsule, Box3 *box,
+                          Eigen::Vector3d &first, Eigen::Vector3d &second){
+    Eigen::Vector3d basePoint, endPoint;
 
     Eigen::Vector4d origin(0, 0, 0, 1);
-    Eigen::Vector4d zDirectionCapsule(0, 0, this->length, 1);
+    Eigen::Vector4d zDirectionCapsule(0, 0, capsule->getLength(), 1);
 
-    basePoint = (this->pose * origin).head(3);
-    endPoint  = (this->pose * zDirectionCapsule).head(3);
+    basePoint = (capsule->pose * origin).head(3);
+    endPoint  = (capsule->pose * zDirectionCapsule).head(3);
 
     Line axisOfSymmetryCapsule(basePoint, endPoint);
 
-
-    
-
-    obstacleClosestPoint = box->OwnClosestPoint(&axisOfSymmetryCapsule);
-    ownClosestPoint = axisOfSymmetryCapsule.getClosestPointToPoint(obstacleClosestPoint);
-
-    closestPoints.row(0) = ownClosestPoint;
-    closestPoints.row(1) = obstacleClosestPoint;
-    
+    second = box->OwnClosestPoint(&axisOfSymmetryCapsule);
+    first = axisOfSymmetryCapsule.getClosestPointToPoint(second);
 }
 void Capsule::getShortestDirection(Eigen::Vector3d &shortestDirection, Primitive *primitive){
     Capsule *capsule = dynamic_cast<Capsule*>(primitive);
@@ -283,31 +337,18 @@ void Capsule::getShortestDirection(Eigen::Vector3d &shortestDirection, Primitive
 
 void Capsule::getShortestDirection(Eigen::Vector3d &shortestDirection, Capsule *capsule){
     Eigen::Vector3d ownClosestPoint, obstacleClosestPoint;
-    Eigen::MatrixXd closestPoints(2, 3);
-    
-    this->getClosestPoints(closestPoints, capsule);
-    ownClosestPoint = closestPoints.row(0);
-    obstacleClosestPoint = closestPoints.row(1);
-    
+    pointsBetween(this, capsule, ownClosestPoint, obstacleClosestPoint);
     shortestDirection = obstacleClosestPoint - ownClosestPoint;
 }
 void Capsule::getShortestDirection(Eigen::Vector3d &shortestDirection, Box3 *box){
     Eigen::Vector3d ownClosestPoint, obstacleClosestPoint;
-    Eigen::MatrixXd closestPoints(2, 3);
-    this->getClosestPoints(closestPoints, box);
-     ownClosestPoint = closestPoints.row(0);
-    obstacleClosestPoint = closestPoints.row(1);
+    pointsBetween(this, box, ownClosestPoint, obstacleClosestPoint);
     shortestDirection = obstacleClosestPoint - ownClosestPoint;
 }
 
 void Capsule::getShortestDirection(Eigen::Vector3d &shortestDirection, Sphere *sphere){
     Eigen::Vector3d ownClosestPoint, obstacleClosestPoint;
-    Eigen::MatrixXd closestPoints(2, 3);
-    
-    this->getClosestPoints(closestPoints, sphere);
-    ownClosestPoint = closestPoints.row(0);
-    obstacleClosestPoint = closestPoints.row(1);
-    
+    pointsBetween(this, sphere, ownClosestPoint, obstacleClosestPoint);
     shortestDirection = obstacleClosestPoint - ownClosestPoint;
 }
 
@@ -320,6 +361,10 @@ double Capsule::getShortestDistance(Primitive *primitive){
         if(sphere){
             return this->getShortestDistance(sphere);
         }else{
+            Box3 *box = dynamic_cast<Box3*>(primitive);
+        if(box){
+            return this->getShortestDistance(box);
+        }
 
         }
     }
@@ -370,6 +415,11 @@ float Sphere::getRadius(){
     return this->radius;
 }
 
+void Sphere::getBoundingSphere(Eigen::Vector3d &center, double &radius){
+    center = this->pose.block<3, 1>(0, 3);
+    radius = this->radius;
+}
+
 void Sphere::getClosestPoints(Eigen::MatrixXd &closestPoints, Primitive *primitive){
     Capsule *capsule = dynamic_cast<Capsule*>(primitive);
     if(capsule){
@@ -385,42 +435,40 @@ void Sphere::getClosestPoints(Eigen::MatrixXd &closestPoints, Primitive *primiti
 }
 
 void Sphere::getClosestPoints(Eigen::MatrixXd &closestPoints, Capsule *capsule){
-    Eigen::Vector3d basePoint, endPoint, ownClosestPoint, obstacleClosestPoint;
-
-    Eigen::Vector4d origin(0, 0, 0, 1);
-    Eigen::Vector4d zDirectionCapsule(0, 0, capsule->getLength(), 1);
-
-    basePoint = (capsule->pose * origin).head(3);
-    endPoint  = (capsule->pose * zDirectionCapsule).head(3);
-
-    Line axisOfSymmetryCapsule(basePoint, endPoint);
-    
-    ownClosestPoint = (this->pose * origin).head(3);
-    obstacleClosestPoint = axisOfSymmetryCapsule.getClosestPointToPoint(ownClosestPoint);
-
+    Eigen::Vector3d ownClosestPoint, obstacleClosestPoint;
+    pointsBetween(capsule, this, obstacleClosestPoint, ownClosestPoint);
     closestPoints.row(0) = ownClosestPoint;
     closestPoints.row(1) = obstacleClosestPoint;
 }
 
 void Sphere::getClosestPoints(Eigen::MatrixXd &closestPoints, Sphere *sphere){
     Eigen::Vector3d ownClosestPoint, obstacleClosestPoint;
-    Eigen::Vector4d origin(0, 0, 0, 1);
-
-    obstacleClosestPoint = (sphere->pose * origin).head(3);
-    ownClosestPoint = (this->pose * origin).head(3);
-
+    pointsBetween(this, sphere, ownClosestPoint, obstacleClosestPoint);
     closestPoints.row(0) = ownClosestPoint;
     closestPoints.row(1) = obstacleClosestPoint;
 }
 
+static void pointsBetween(Sphere *sphere, Sphere *other,
+                          Eigen::Vector3d &first, Eigen::Vector3d &second){
+    Eigen::Vector4d origin(0, 0, 0, 1);
+
+    second = (other->pose * origin).head(3);
+    first = (sphere->pose * origin).head(3);
+}
+
 void Sphere::getClosestPoints(Eigen::MatrixXd &closestPoints, Box3 *box){
     Eigen::Vector3d ownClosestPoint, obstacleClosestPoint;
-    Eigen::Vector4d origin(0, 0, 0, 1);
-    ownClosestPoint = (this->pose * origin).head(3);
-    obstacleClosestPoint = box->ClosestPoint( ownClosestPoint);
+    pointsBetween(this, box, ownClosestPoint, obstacleClosestPoint);
     closestPoints.row(0) = ownClosestPoint;
     closestPoints.row(1) = obstacleClosestPoint;
 }
+
+static void pointsBetween(Sphere *sphere, Box3 *box,
+                          Eigen::Vector3d &first, Eigen::Vector3d &second){
+    Eigen::Vector4d origin(0, 0, 0, 1);
+    first = (sphere->pose * origin).head(3);
+    second = box->ClosestPoint(first);
+}
 void Sphere::getShortestDirection(Eigen::Vector3d &shortestDirection, Primitive *primitive){
     Capsule *capsule = dynamic_cast<Capsule*>(primitive);
     if(capsule){
@@ -437,32 +485,19 @@ void Sphere::getShortestDirection(Eigen::Vector3d &shortestDirection, Primitive
 
 void Sphere::getShortestDirection(Eigen::Vector3d &shortestDirection, Capsule *capsule){
     Eigen::Vector3d ownClosestPoint, obstacleClosestPoint;
-    Eigen::MatrixXd closestPoints(2, 3);
-    
-    this->getClosestPoints(closestPoints, capsule);
-    ownClosestPoint = closestPoints.row(0);
-    obstacleClosestPoint = closestPoints.row(1);
-    
+    pointsBetween(capsule, this, obstacleClosestPoint, ownClosestPoint);
     shortestDirection = obstacleClosestPoint - ownClosestPoint;
 }
 
 void Sphere::getShortestDirection(Eigen::Vector3d &shortestDirection, Sphere *sphere){
     Eigen::Vector3d ownClosestPoint, obstacleClosestPoint;
-    Eigen::MatrixXd closestPoints(2, 3);
-    
-    this->getClosestPoints(closestPoints, sphere);
-    ownClosestPoint = closestPoints.row(0);
-    obstacleClosestPoint = closestPoints.row(1);
-    
+    pointsBetween(this, sphere, ownClosestPoint, obstacleClosestPoint);
     shortestDirection = obstacleClosestPoint - ownClosestPoint;
 }
 
 void Sphere::getShortestDirection(Eigen::Vector3d &shortestDirection, Box3 *box){
     Eigen::Vector3d ownClosestPoint, obstacleClosestPoint;
-    Eigen::MatrixXd closestPoints(2, 3);
-    this->getClosestPoints(closestPoints, box);
-    ownClosestPoint = closestPoints.row(0);
-    obstacleClosestPoint = closestPoints.row(1);
+    pointsBetween(this, box, ownClosestPoint, obstacleClosestPoint);
     shortestDirection = obstacleClosestPoint - ownClosestPoint;
 }
 double Sphere::getShortestDistance(Primitive *primitive){
@@ -475,7 +510,7 @@ double Sphere::getShortestDistance(Primitive *primitive){
             return this->getShortestDistance(sphere);
         }else{
             Box3 *box = dynamic_cast<Box3*>(primitive);
-        if(sphere){
+        if(box){
             return this->getShortestDistance(box);
         }
 
@@ -535,6 +570,7 @@ double Sphere::getShortestDistance(Box3 *box){
         extents[1]=y/2;
         extents[2]=z/2;
         Eigen::Vector4d origin(0, 0, 0, 1);
+        this->pose = pose;
         box_center = (pose * origin).head(3);
         minPoint = box_center -extents;
         maxPoint = box_center +extents;
@@ -546,16 +582,36 @@ double Sphere::getShortestDistance(Box3 *box){
         extents[1]=y/2;
         extents[2]=z/2;
         Eigen::Vector4d origin(0, 0, 0, 1);
+        this->pose.setIdentity();
+        this->pose.block<3, 1>(0, 3) = pose;
         box_center = pose;
         minPoint = box_center -extents;
         maxPoint = box_center +extents;
     }
     Box3::Box3(Box3* box){
 
+   this->pose= box->pose;
+   this->extents= box->extents;
    this->minPoint= box->minPoint;
    this->maxPoint= box->maxPoint;
    this->box_center= box->box_center;
     }
+
+    bool Box3::setPose(const Eigen::Matrix4d &newPose){
+        if(!Primitive::setPose(newPose)){
+            return false;
+        }
+        // The bounds are axis aligned, only the center follows the pose
+        box_center = newPose.block<3, 1>(0, 3);
+        minPoint = box_center -extents;
+        maxPoint = box_center +extents;
+        return true;
+    }
+    void Box3::getBoundingSphere(Eigen::Vector3d &center, double &radius){
+        // The corners are the farthest points from the center
+        center = box_center;
+        radius = extents.norm();
+    }
    Box3::~Box3(){}
     bool Box3::intersection ( const Ray &r) const 
             {
@@ -783,23 +839,14 @@ Eigen::Vector3d Box3::ClosestPoint(const Eigen::Vector3d &targetPoint)
 	   // Find the point on this AABB closest to the sphere center.
 
    void Box3::getShortestDirection(Eigen::Vector3d &shortestDirection, Capsule *capsule){
-      Eigen::Vector3d ownClosestPoint, obstacleClosestPoint;
-    Eigen::MatrixXd closestPoints(2, 3);
-    
-    this->getClosestPoints(closestPoints, capsule);
-    ownClosestPoint = closestPoints.row(0);
-    obstacleClosestPoint = closestPoints.row(1);
+    Eigen::Vector3d ownClosestPoint, obstacleClosestPoint;
+    pointsBetween(capsule, this, obstacleClosestPoint, ownClosestPoint);
     shortestDirection = obstacleClosestPoint - ownClosestPoint;
-
-
    }
    void Box3::getShortestDirection(Eigen::Vector3d &shortestDirection, Sphere *sphere){
 		  // this is the same as isPointInsideSphere
-   Eigen::Vector3d ownClosestPoint, obstacleClosestPoint;
-    Eigen::MatrixXd closestPoints(2, 3);
-    this->getClosestPoints(closestPoints, sphere);
-    ownClosestPoint = closestPoints.row(0);
-    obstacleClosestPoint = closestPoints.row(1);
+    Eigen::Vector3d ownClosestPoint, obstacleClosestPoint;
+    pointsBetween(sphere, this, obstacleClosestPoint, ownClosestPoint);
     shortestDirection = obstacleClosestPoint - ownClosestPoint;
    }
 
@@ -0,0 +1,185 @@
+#include "thread_pool.h"
+#include <iostream>
+#include <algorithm>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+//#define DEBUG
+
+ThreadPool::ThreadPool(int nThreads, std::vector<int> cores, int queueCapacity){
+    if (nThreads < 1) {
+        nThreads = 1;
+    }
+    if (queueCapacity < 1) {
+        queueCapacity = 1;
+    }
+    this->queueCapacity = queueCapacity;
+    this->task = NULL;
+    this->remaining = 0;
+    this->generation = 0;
+    this->stopping = false;
+
+    for (int i = 0; i < nThreads; i++) {
+        WorkerQueue* queue = new WorkerQueue();
+        queue->tiles.resize(queueCapacity);
+        queue->head = 0;
+        queue->count = 0;
+        queues.push_back(queue);
+    }
+
+    // The calling thread is worker 0, start the others
+    for (int i = 1; i < nThreads; i++) {
+        threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+
+        #ifdef __linux__
+        if (!cores.empty()) {
+            cpu_set_t cpuSet;
+            CPU_ZERO(&cpuSet);
+            CPU_SET(cores[(i - 1) % cores.size()], &cpuSet);
+            if (pthread_setaffinity_np(threads.back().native_handle(),
+                                       sizeof(cpu_set_t), &cpuSet) != 0) {
+                std::cout << "[ThreadPool] could not pin worker " << i
+                          << " to core " << cores[(i - 1) % cores.size()] << std::endl;
+            }
+        }
+        #endif
+    }
+    #ifdef DEBUG
+    std::cout << "[ThreadPool] started with " << nThreads << " workers" << std::endl;
+    #endif
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        stopping = true;
+    }
+    jobStart.notify_all();
+
+    for (int i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    for (int i = 0; i < queues.size(); i++) {
+        delete queues[i];
+    }
+}
+
+int ThreadPool::size(){
+    return queues.size();
+}
+
+int ThreadPool::maxTiles(){
+    return queueCapacity * queues.size();
+}
+
+void ThreadPool::parallelFor(int count, int grain, const Task &task){
+    if (count <= 0) {
+        return;
+    }
+    if (grain < 1) {
+        grain = 1;
+    }
+
+    // The queues are not resized, larger tiles are used instead
+    int nTiles = (count + grain - 1) / grain;
+    if (nTiles > maxTiles()) {
+        grain *= (nTiles + maxTiles() - 1) / maxTiles();
+        nTiles = (count + grain - 1) / grain;
+    }
+
+    // Nothing to share, run it on the calling thread
+    if (nTiles == 1 || queues.size() == 1) {
+        for (int begin = 0; begin < count; begin += grain) {
+            task(begin, std::min(begin + grain, count), 0);
+        }
+        return;
+    }
+
+    this->task = &task;
+    this->remaining = nTiles;
+
+    // Deal the tiles to the workers in contiguous blocks
+    int tilesPerWorker = (nTiles + queues.size() - 1) / queues.size();
+    for (int t = 0; t < nTiles; t++) {
+        Tile tile;
+        tile.begin = t * grain;
+        tile.end = std::min(tile.begin + grain, count);
+
+        WorkerQueue* queue = queues[t / tilesPerWorker];
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        queue->tiles[(queue->head + queue->count) % queueCapacity] = tile;
+        queue->count++;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        generation++;
+    }
+    jobStart.notify_all();
+
+    // Take part in the job and wait for the tiles stolen by others
+    runTiles(0);
+
+    std::unique_lock<std::mutex> lock(jobMutex);
+    while (remaining.load() != 0) {
+        jobDone.wait(lock);
+    }
+    this->task = NULL;
+}
+
+void ThreadPool::workerLoop(int worker){
+    unsigned long seenGeneration = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            while (!stopping && generation == seenGeneration) {
+                jobStart.wait(lock);
+            }
+            if (stopping) {
+                return;
+            }
+            seenGeneration = generation;
+        }
+        runTiles(worker);
+    }
+}
+
+void ThreadPool::runTiles(int worker){
+    Tile tile;
+    while (nextTile(worker, tile)) {
+        (*task)(tile.begin, tile.end, worker);
+
+        // The last tile wakes up the caller
+        if (--remaining == 0) {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            jobDone.notify_all();
+        }
+    }
+}
+
+bool ThreadPool::nextTile(int worker, Tile &tile){
+    {
+        WorkerQueue* own = queues[worker];
+        std::lock_guard<std::mutex> lock(own->mutex);
+        if (own->count > 0) {
+            tile = own->tiles[own->head];
+            own->head = (own->head + 1) % queueCapacity;
+            own->count--;
+            return true;
+        }
+    }
+
+    // Steal from the back of the other queues
+    for (int i = 1; i < queues.size(); i++) {
+        WorkerQueue* victim = queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim->mutex);
+        if (victim->count > 0) {
+            victim->count--;
+            tile = victim->tiles[(victim->head + victim->count) % queueCapacity];
+            return true;
+        }
+    }
+    return false;
+}
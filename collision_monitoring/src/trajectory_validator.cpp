@@ -0,0 +1,199 @@
+#include "trajectory_validator.h"
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <iostream>
+//#define DEBUG
+
+TrajectoryValidator::TrajectoryValidator(Monitor* monitor){
+    this->monitor = monitor;
+    this->arm = monitor->arm ? monitor->arm->clone() : NULL;
+    this->clearance = 0;
+    this->resolution = 1e-3;
+    this->invalidSegment = -1;
+    this->invalidFraction = 0;
+    this->nChecks = 0;
+    this->chainLoaded = false;
+
+    if (this->arm == NULL) {
+        std::cout << "[TrajectoryValidator] the arm of the monitor cannot be copied" << std::endl;
+        return;
+    }
+    this->chainLoaded = this->arm->getChainModel(chainModel);
+
+    // The reach is found from capsules, fitted ones may extend past 
+    // their frames
+    for (int k = 0; k < this->arm->nLinks; k++) {
+        if (dynamic_cast<Capsule*>(this->arm->links[k]) == NULL) {
+            std::cout << "[TrajectoryValidator] the links of the arm must be capsules" << std::endl;
+            delete this->arm;
+            this->arm = NULL;
+            return;
+        }
+    }
+    this->arm->jointReach(reach);
+    #ifdef DEBUG
+    for (int i = 0; i < reach.size(); i++) {
+        std::cout << "[TrajectoryValidator] reach of joint " << i << ": " << reach[i] << std::endl;
+    }
+    #endif
+}
+
+TrajectoryValidator::~TrajectoryValidator(){
+    delete this->arm;
+}
+
+double TrajectoryValidator::motionBound(const std::vector<double> &start,
+                                        const std::vector<double> &end){
+    double bound = 0;
+    for (int i = 0; i < reach.size(); i++) {
+        bound += reach[i] * std::abs(end[i] - start[i]);
+    }
+    return bound;
+}
+
+double TrajectoryValidator::freeDistance(const std::vector<double> &start,
+                                         const std::vector<double> &end,
+                                         double fraction){
+    for (int i = 0; i < configuration.size(); i++) {
+        configuration[i] = start[i] + fraction * (end[i] - start[i]);
+    }
+    nChecks++;
+
+    double minimum = std::numeric_limits<double>::max();
+    if (chainLoaded) {
+        // A single configuration is already laid out joint by joint
+        kinematics.linkEndpoints(configuration.data(), 1);
+        for (int j = 0; j < kinematics.nLinks(); j++) {
+            Eigen::Vector3d linkStart = kinematics.linkStart(j, 0);
+            Eigen::Vector3d linkEnd = kinematics.linkEnd(j, 0);
+            for (int i = 0; i < checked.size(); i++) {
+                minimum = std::min(minimum, Monitor::capsuleDistance(
+                    linkStart, linkEnd, kinematics.radii[j], checked[i]));
+            }
+        }
+        return minimum - clearance;
+    }
+
+    this->arm->updatePose(configuration);
+    for (int j = 0; j < this->arm->links.size(); j++) {
+        for (int i = 0; i < checked.size(); i++) {
+            minimum = std::min(minimum, this->arm->links[j]->getShortestDistance(checked[i]));
+        }
+    }
+    return minimum - clearance;
+}
+
+bool TrajectoryValidator::validateSegment(const std::vector<double> &start,
+                                          const std::vector<double> &end,
+                                          double &fraction){
+    double bound = motionBound(start, end);
+    double largestStep = 0;
+    for (int i = 0; i < start.size(); i++) {
+        largestStep = std::max(largestStep, std::abs(end[i] - start[i]));
+    }
+
+    Interval whole;
+    whole.start = 0;
+    whole.end = 1;
+    whole.startFree = freeDistance(start, end, 0);
+    if (whole.startFree < 0) {
+        fraction = 0;
+        return false;
+    }
+    whole.endFree = freeDistance(start, end, 1);
+    if (whole.endFree < 0) {
+        fraction = 1;
+        return false;
+    }
+
+    // The earlier half is covered first, so the first invalid
+    // configuration found is the earliest one
+    pending.clear();
+    pending.push_back(whole);
+    while (!pending.empty()) {
+        Interval interval = pending.back();
+        pending.pop_back();
+
+        // The links move at most bound per unit of the segment, the free
+        // distance at each end covers a part of the interval
+        double length = interval.end - interval.start;
+        if (interval.startFree + interval.endFree >= bound * length) {
+            continue;
+        }
+
+        double middle = 0.5 * (interval.start + interval.end);
+        if (largestStep * length <= resolution) {
+            fraction = middle;
+            return false;
+        }
+        double middleFree = freeDistance(start, end, middle);
+        if (middleFree < 0) {
+            fraction = middle;
+            return false;
+        }
+
+        Interval later = {middle, interval.end, middleFree, interval.endFree};
+        Interval earlier = {interval.start, middle, interval.startFree, middleFree};
+        pending.push_back(later);
+        pending.push_back(earlier);
+    }
+    return true;
+}
+
+bool TrajectoryValidator::validate(const std::vector<std::vector<double>> &waypoints){
+    invalidSegment = -1;
+    invalidFraction = 0;
+    nChecks = 0;
+    if (this->arm == NULL) {
+        std::cout << "[TrajectoryValidator] no arm to validate the trajectory" << std::endl;
+        return false;
+    }
+    for (int w = 0; w < waypoints.size(); w++) {
+        if (waypoints[w].size() != this->arm->nJoints) {
+            std::cout << "[TrajectoryValidator] waypoint " << w << " does not have "
+                      << this->arm->nJoints << " joints" << std::endl;
+            return false;
+        }
+    }
+
+    // The links of the monitored arm follow the trajectory, not the live arm
+    std::vector<Primitive*> &links = this->monitor->arm->links;
+    checked.clear();
+    for (int i = 0; i < this->monitor->obstacles.size(); i++) {
+        if (std::find(links.begin(), links.end(), this->monitor->obstacles[i]) == links.end()) {
+            checked.push_back(this->monitor->obstacles[i]);
+        }
+    }
+    configuration.resize(this->arm->nJoints);
+
+    // The chain follows the base of the monitored arm
+    if (chainLoaded) {
+        chainModel.baseTransform = this->monitor->arm->baseTransform;
+        kinematics.setModel(chainModel);
+    }
+
+    if (waypoints.size() == 1) {
+        if (freeDistance(waypoints[0], waypoints[0], 0) < 0) {
+            invalidSegment = 0;
+            return false;
+        }
+        return true;
+    }
+    for (int s = 0; s + 1 < waypoints.size(); s++) {
+        double fraction;
+        if (!validateSegment(waypoints[s], waypoints[s + 1], fraction)) {
+            invalidSegment = s;
+            invalidFraction = fraction;
+            #ifdef DEBUG
+            std::cout << "[TrajectoryValidator] invalid at segment " << s << " fraction "
+                      << fraction << " after " << nChecks << " checks" << std::endl;
+            #endif
+            return false;
+        }
+    }
+    #ifdef DEBUG
+    std::cout << "[TrajectoryValidator] valid after " << nChecks << " checks" << std::endl;
+    #endif
+    return true;
+}
@@ -0,0 +1,92 @@
+#include "whole_body_model.h"
+#include <iostream>
+#include <math.h>
+
+// #define DEBUG
+
+WholeBodyModel::WholeBodyModel(Arm* arm, Base* base, const Eigen::Matrix4d &armMount){
+    this->arm = arm;
+    this->base = base;
+    this->armMount = armMount;
+
+    // The box keeps its height above the ground and its size
+    Box3* box = base->base_primitive;
+    this->boxCenter << 0, 0, box->box_center[2];
+    this->boxHalfSize = box->extents;
+
+    // The first link stands on the mount
+    this->mountedLinks = 1;
+
+    // The first update places the base at the origin
+    this->basePose.setZero();
+    this->baseChanged = true;
+    this->jointsChanged = false;
+}
+
+WholeBodyModel::~WholeBodyModel(){
+}
+
+void WholeBodyModel::setBasePose(double x, double y, double yaw){
+    basePose << x, y, yaw;
+    baseChanged = true;
+}
+
+void WholeBodyModel::setBasePose(const Eigen::Vector3d &pose){
+    setBasePose(pose[0], pose[1], pose[2]);
+}
+
+bool WholeBodyModel::setJointPositions(const std::vector<double> &jointPositions){
+    if (jointPositions.size() < arm->nJoints) {
+        std::cout << "[WholeBodyModel] expected " << arm->nJoints << " joint positions"
+                  << std::endl;
+        return false;
+    }
+    this->jointPositions = jointPositions;
+    jointsChanged = true;
+    return true;
+}
+
+Eigen::Matrix4d WholeBodyModel::baseFrame(){
+    double c = cos(basePose[2]);
+    double s = sin(basePose[2]);
+    Eigen::Matrix4d frame;
+    frame << c, -s, 0, basePose[0],
+             s,  c, 0, basePose[1],
+             0,  0, 1, 0,
+             0,  0, 0, 1;
+    return frame;
+}
+
+bool WholeBodyModel::update(){
+    if (!baseChanged && !jointsChanged) {
+        return true;
+    }
+    Eigen::Matrix4d frame = baseFrame();
+
+    if (baseChanged) {
+        // The planar pose is read back by the base controllers
+        base->baseTransform = basePose;
+
+        // The axis aligned box enclosing the rotated base, the extents are
+        // set before the pose so the bounds are moved with them
+        Box3* box = base->base_primitive;
+        Eigen::Matrix4d boxPose = frame;
+        boxPose.block<3, 1>(0, 3) = (frame * boxCenter.homogeneous()).head(3);
+        box->extents = frame.block<3, 3>(0, 0).cwiseAbs() * boxHalfSize;
+        box->setPose(boxPose);
+
+        arm->baseTransform = frame * armMount;
+    }
+
+    // The links follow the base through the base transform of the arm
+    bool updated = true;
+    if (!jointPositions.empty()) {
+        updated = arm->updatePose(jointPositions);
+    }
+    #ifdef DEBUG
+    std::cout << "[WholeBodyModel] base at " << basePose.transpose() << std::endl;
+    #endif
+    baseChanged = false;
+    jointsChanged = false;
+    return updated;
+}
@@ -0,0 +1,271 @@
+#include "world_model.h"
+#include <iostream>
+#include <limits>
+//#define DEBUG
+
+WorldModel::WorldModel(){
+    this->layout = 0;
+    this->pool = NULL;
+    this->computeWitnessPoints = false;
+    this->witnessesRequested = false;
+    this->closestPoints.resize(1, Eigen::MatrixXd(2, 3));
+}
+
+WorldModel::~WorldModel(){
+
+}
+
+int WorldModel::addArm(Arm* arm){
+    Robot robot;
+    robot.arm = arm;
+    robot.base = NULL;
+    robot.primitives = arm->links;
+    robots.push_back(robot);
+
+    // The pairs of the new robot go at the end, see pairIndex()
+    pairs.resize(robots.size() * (robots.size() - 1) / 2);
+    layout++;
+    #ifdef DEBUG
+    std::cout << "[WorldModel] arm added as robot " << robots.size() - 1 << std::endl;
+    #endif
+    return robots.size() - 1;
+}
+
+int WorldModel::addBase(Base* base){
+    Robot robot;
+    robot.arm = NULL;
+    robot.base = base;
+    robot.primitives.push_back(base->base_primitive);
+    robots.push_back(robot);
+
+    pairs.resize(robots.size() * (robots.size() - 1) / 2);
+    layout++;
+    #ifdef DEBUG
+    std::cout << "[WorldModel] base added as robot " << robots.size() - 1 << std::endl;
+    #endif
+    return robots.size() - 1;
+}
+
+int WorldModel::nRobots(){
+    return robots.size();
+}
+
+Arm* WorldModel::arm(int robot){
+    return robots[robot].arm;
+}
+
+Base* WorldModel::base(int robot){
+    return robots[robot].base;
+}
+
+std::vector<Primitive*>& WorldModel::primitives(int robot){
+    return robots[robot].primitives;
+}
+
+int WorldModel::pairIndex(int first, int second){
+    return second * (second - 1) / 2 + first;
+}
+
+void WorldModel::rebuildObstacleList(){
+    obstacles.clear();
+    obstacles.reserve(store.size());
+    store.collect(obstacles);
+    layout++;
+}
+
+ObstacleHandle WorldModel::addObstacle(Primitive* obstacle){
+    ObstacleHandle handle = store.add(obstacle);
+    rebuildObstacleList();
+    return handle;
+}
+
+bool WorldModel::removeObstacle(ObstacleHandle handle){
+    if (!store.remove(handle)) {
+        std::cout << "[WorldModel] obstacle to remove not found" << std::endl;
+        return false;
+    }
+    rebuildObstacleList();
+    return true;
+}
+
+ObstacleHandle WorldModel::setMarkerObstacle(const std::string &ns, int id,
+                                             Primitive* obstacle){
+    ObstacleHandle* handle = markerObstacles.find(ns, id);
+    if (handle != NULL) {
+        // Same shape, updated in place without touching the obstacle list
+        if (store.update(*handle, obstacle)) {
+            return *handle;
+        }
+        store.remove(*handle);
+    }
+
+    ObstacleHandle newHandle = store.add(obstacle);
+    if (newHandle.valid()) {
+        markerObstacles.insert(ns, id, newHandle);
+    } else {
+        markerObstacles.erase(ns, id);
+    }
+    rebuildObstacleList();
+    return newHandle;
+}
+
+bool WorldModel::removeMarkerObstacle(const std::string &ns, int id){
+    ObstacleHandle* handle = markerObstacles.find(ns, id);
+    if (handle == NULL) {
+        return false;
+    }
+    store.remove(*handle);
+    markerObstacles.erase(ns, id);
+    rebuildObstacleList();
+    return true;
+}
+
+void WorldModel::removeAllMarkerObstacles(){
+    ObstacleStore &obstacleStore = this->store;
+    markerObstacles.forEach([&obstacleStore](const std::string &, int,
+                                             ObstacleHandle &handle) {
+        obstacleStore.remove(handle);
+    });
+    markerObstacles.clear();
+    rebuildObstacleList();
+}
+
+ObstacleHandle WorldModel::markerObstacle(const std::string &ns, int id){
+    ObstacleHandle* handle = markerObstacles.find(ns, id);
+    if (handle == NULL) {
+        return ObstacleHandle();
+    }
+    return *handle;
+}
+
+unsigned long WorldModel::layoutVersion(){
+    return layout;
+}
+
+void WorldModel::setThreadPool(ThreadPool* pool){
+    this->pool = pool;
+    int nWorkers = pool ? pool->size() : 1;
+    this->closestPoints.resize(nWorkers, Eigen::MatrixXd(2, 3));
+
+    // Captures only this so the function does not allocate on each call
+    this->updateTask = [this](int begin, int end, int worker) {
+        for (int job = begin; job < end; job++) {
+            this->updateJob(job, worker);
+        }
+    };
+}
+
+void WorldModel::update(){
+    update(this->computeWitnessPoints);
+}
+
+void WorldModel::update(bool witnesses){
+    this->witnessesRequested = witnesses;
+    int nJobs = robots.size() + pairs.size();
+    if (this->pool != NULL && this->pool->size() > 1 && nJobs > 1) {
+        this->pool->parallelFor(nJobs, 1, updateTask);
+    } else {
+        for (int job = 0; job < nJobs; job++) {
+            updateJob(job, 0);
+        }
+    }
+}
+
+void WorldModel::updateJob(int job, int worker){
+    if (job < robots.size()) {
+        Robot &robot = robots[job];
+        fill(robot.obstacleDistances, obstacles, robot.primitives, true, worker);
+        return;
+    }
+
+    // Find the pair of robots of the job, pairs are ordered by second robot
+    int index = job - robots.size();
+    int second = 1;
+    while (pairIndex(0, second + 1) <= index) {
+        second++;
+    }
+    int first = index - pairIndex(0, second);
+    fill(pairs[index], robots[first].primitives, robots[second].primitives,
+         false, worker);
+}
+
+void WorldModel::fill(DistanceMatrix &result, std::vector<Primitive*> &rows,
+                      std::vector<Primitive*> &cols, bool colFirst, int worker){
+    int previousRows = result.rows;
+    result.computeWitnessPoints = this->witnessesRequested;
+    result.resize(rows.size(), cols.size());
+
+    // Nothing to do if no primitive changed since the last update
+    bool changed = result.rows != previousRows;
+    for (int i = 0; i < result.rows && !changed; i++) {
+        changed = result.rowVersions[i] != rows[i]->version;
+    }
+    for (int j = 0; j < result.cols && !changed; j++) {
+        changed = result.colVersions[j] != cols[j]->version;
+    }
+    if (!changed) {
+        return;
+    }
+
+    double minimum = std::numeric_limits<double>::max();
+    int minimumRow = -1;
+    int minimumCol = -1;
+    Eigen::MatrixXd &points = closestPoints[worker];
+
+    for (int i = 0; i < result.rows; i++) {
+        double* distances = result.row(i);
+        bool rowMoved = result.rowVersions[i] != rows[i]->version;
+
+        for (int j = 0; j < result.cols; j++) {
+            // Keep the cached entry if neither primitive changed
+            if (rowMoved || result.colVersions[j] != cols[j]->version) {
+                distances[j] = cols[j]->getShortestDistance(rows[i]);
+
+                if (result.computeWitnessPoints) {
+                    double* witness = result.witness(i, j);
+                    if (colFirst) {
+                        cols[j]->getClosestPoints(points, rows[i]);
+                    } else {
+                        rows[i]->getClosestPoints(points, cols[j]);
+                    }
+                    for (int k = 0; k < 3; k++) {
+                        witness[k] = points(0, k);
+                        witness[k + 3] = points(1, k);
+                    }
+                }
+            }
+            if (distances[j] < minimum) {
+                minimum = distances[j];
+                minimumRow = i;
+                minimumCol = j;
+            }
+        }
+    }
+    for (int i = 0; i < result.rows; i++) {
+        result.rowVersions[i] = rows[i]->version;
+    }
+    for (int j = 0; j < result.cols; j++) {
+        result.colVersions[j] = cols[j]->version;
+    }
+    result.minimum = minimum;
+    result.minimumRow = minimumRow;
+    result.minimumCol = minimumCol;
+}
+
+DistanceMatrix& WorldModel::obstacleDistances(int robot){
+    return robots[robot].obstacleDistances;
+}
+
+DistanceMatrix& WorldModel::robotDistances(int robot, int other){
+    if (robot < other) {
+        return pairs[pairIndex(robot, other)];
+    }
+    return pairs[pairIndex(other, robot)];
+}
+
+double WorldModel::distance(int robot, int primitive, int other, int otherPrimitive){
+    if (robot < other) {
+        return pairs[pairIndex(robot, other)].at(primitive, otherPrimitive);
+    }
+    return pairs[pairIndex(other, robot)].at(otherPrimitive, primitive);
+}
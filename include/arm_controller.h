@@ -26,12 +26,17 @@
 #include <sensor_msgs/JointState.h>
 #include <geometry_msgs/Point.h>
 #include <visualization_msgs/Marker.h>
+#include <nav_msgs/Odometry.h>
+#include <tf/tf.h>
 
 //Collision monitoring imports
 #include "primitives.h"
 #include "kinova_arm.h"
 #include "monitor.h"
 #include "marker_publisher.h"
+#include "triple_buffer.h"
+#include "spsc_queue.h"
+#include "joint_state_estimator.h"
 
 /**
  * A class for dealing with obstacle displaying in ROS.
@@ -39,9 +44,6 @@
 class RvizObstacle
 {
     public:
-        /// The index of the obstacle in Monitor obstacle list
-        int idx;
-
         /// The marker that represents the obstacle in rviz
         visualization_msgs::Marker marker;
 
@@ -52,9 +54,8 @@ class RvizObstacle
          * Constructor
          * 
          * @param markerIn The marker with dimensions suiting the obstacle
-         * @param index The location of the obstacle in the monitor obstacle list
          */
-        RvizObstacle(visualization_msgs::Marker::ConstPtr markerIn, int index);
+        RvizObstacle(visualization_msgs::Marker::ConstPtr markerIn);
 
         /// Destructor
         ~RvizObstacle();
@@ -102,12 +103,19 @@ class ArmController
         /// The monitor class used to perform collision monitoring
         Monitor* monitor;
 
-        /// The goal point of the endeffector
+        /// The goal point of the endeffector used by the current control loop
         Eigen::Vector3d goal;
 
         /**
          * Callback function updating the arm positions
          * 
+         * The callbacks only publish their input for the next control loop,
+         * so they can run on a spinner thread while the control loop runs.
+         * All the callbacks of a controller must be called from the same
+         * thread. The joint states are timestamped by their header, or by
+         * their arrival when the header has no stamp. Only the first joints
+         * are used when the message has more than the arm.
+         * 
          * @param msg The ros sensor messsage containing the joint angles
          */
         void armCallback(const sensor_msgs::JointState::ConstPtr& msg);
@@ -119,11 +127,25 @@ class ArmController
          */
         void goalCallback(const geometry_msgs::Point::ConstPtr& msg);
 
+        /**
+         * Callback function updating the pose of a mobile base
+         * 
+         * Only used when the monitor has a WholeBodyModel, the x, y and yaw
+         * of the odometry are applied to the base with the joint angles by
+         * the next updateState().
+         * 
+         * @param msg The odometry of the base in the world frame
+         */
+        void odomCallback(const nav_msgs::Odometry::ConstPtr& msg);
+
         /**
          * Function that uses internal parameters to send instructions to arm
          * 
          * This is where the obstacle avoidance is implemented and is based off 
          * of the paper: 
+         * 
+         * updateState() must be called before, so that all the arms of a 
+         * world can be moved before the distances are computed.
          */
         KDL::Twist controlLoop(void);
 
@@ -138,17 +160,142 @@ class ArmController
                                                 Eigen::Vector3d velocity);
 
         /**
-         * A callback function that updates or adds obstacles
+         * A callback function that updates, adds or removes obstacles
+         * 
+         * The marker is queued and applied by the next control loop. Markers 
+         * are found by namespace and id in constant time. The DELETE and 
+         * DELETEALL actions remove the obstacles.
          * 
          * @param msg the ros marker message with the object parameters
          */
         void updateObstacles(const visualization_msgs::Marker::ConstPtr& msg);
 
-        /// A list of obstacles that are displayed in rviz
-        std::vector<RvizObstacle*> rvizObstacles;
+        /**
+         * Takes the latest input of the callbacks
+         * 
+         * The latest joint angles and goal are used, the queued obstacle 
+         * markers are applied to the monitor and the arm is moved to the 
+         * joint angles. With the joint state estimation the arm is moved to
+         * the joint angles estimated for the current time instead. The base
+         * of a mobile manipulator is placed with the arm, in one pass. It 
+         * must run on the control thread, before the control loop.
+         */
+        void updateState(void);
+
+        /**
+         * Turns on the speed and separation monitoring
+         * 
+         * The joint velocities are then scaled down by 
+         * scaleJointVelocities() so that the arm can always stop before 
+         * reaching an obstacle.
+         * 
+         * @param parameters the reaction and braking of the arm
+         */
+        void enableSpeedAndSeparation(const SeparationParameters &parameters);
+
+        /**
+         * Scales the joint velocities to keep the separation to obstacles
+         * 
+         * Must be called every control loop on the velocities found for the
+         * pose of updateState(), before they are published. The arm of a 
+         * mobile manipulator is also kept off its own base. Does nothing if
+         * the speed and separation monitoring is off.
+         * 
+         * @param[in,out] jointVelocities the joint velocities to scale
+         * @return the scale applied, between 0 and 1
+         */
+        double scaleJointVelocities(std::vector<double> &jointVelocities);
+
+        /**
+         * Caps the time spent on the obstacle distances of a control loop
+         * 
+         * With a budget the most critical obstacle-link pairs are computed 
+         * first and the others keep a lower bound of their distance, see 
+         * Monitor::distanceToObjects.
+         * 
+         * @param budget the time allowed in s, 0 to compute every pair
+         */
+        void setMonitorBudget(double budget);
+
+        /**
+         * Turns on the estimation of the joint angles between joint states
+         * 
+         * updateState() then moves the arm to the joint angles extrapolated 
+         * to the time of the control loop, so the control loop can run 
+         * faster than the joint states arrive, see JointStateEstimator.
+         * The protective distance of the speed and separation monitoring 
+         * grows by the motion of the links the error bound allows.
+         * 
+         * @param maxAcceleration the largest acceleration of a joint in 
+         *     rad/s^2, for the error bound
+         * @param maxExtrapolation the longest time in s the joint angles 
+         *     are extrapolated for
+         */
+        void enableJointStateEstimation(double maxAcceleration, double maxExtrapolation);
+
+        /**
+         * The largest error of the joint angles of the last updateState()
+         * 
+         * @return the error bound in rad, 0 without the joint state 
+         *     estimation and infinite until the velocities are known
+         */
+        double getStateErrorBound(void);
+
+        /// The obstacles that are displayed in rviz, by namespace and id
+        IdMap<RvizObstacle*> rvizObstacles;
 
     private:
 
+        /// The input of the control loop written by the callbacks
+        struct ControlInput
+        {
+            std::vector<double> jointAngles;
+            /// Empty if the joint states have no velocities
+            std::vector<double> jointVelocities;
+            /// The time of the joint angles in s, 0 before the first ones
+            double stamp;
+            Eigen::Vector3d goal;
+            /// The x, y and yaw of the base from the odometry
+            Eigen::Vector3d basePose;
+            /// False until the first odometry
+            bool baseReceived;
+        };
+
+        /// The latest input, only used by the callbacks
+        ControlInput callbackInput;
+        /// Passes the input from the callbacks to the control loop
+        TripleBuffer<ControlInput> input;
+        /// Markers received and not yet applied to the monitor
+        SpscQueue<visualization_msgs::Marker::ConstPtr> markerQueue;
+
+        /**
+         * Updates, adds or removes the obstacle of a marker
+         * 
+         * @param msg the ros marker message with the object parameters
+         */
+        void applyObstacle(const visualization_msgs::Marker::ConstPtr& msg);
+
+        /// True if the joint velocities are scaled to keep the separation
+        bool speedAndSeparation;
+        /// The parameters of the speed and separation monitoring
+        SeparationParameters separation;
+
+        /// Time allowed for the obstacle distances, 0 when not limited
+        double monitorBudget;
+        /// True if the control loop computed every obstacle distance exactly
+        bool objectDistancesExact;
+
+        /// True if the arm is moved to the estimated joint angles
+        bool stateEstimation;
+        /// Estimates the joint angles between the joint states
+        JointStateEstimator stateEstimator;
+        /// The joint angles estimated for the control loop
+        std::vector<double> estimatedAngles;
+        /// The error bound of the joint angles of the control loop
+        double stateErrorBound;
+        /// Largest motion of the links in m per rad of error of every joint
+        double stateReach;
+
         /// The number of joints in the arm
         int numJoints;
 
@@ -160,10 +307,13 @@ class ArmController
 
         // Lists of parameters and objects passed between functions
         std::vector<double> jointAngles;
-        std::vector<std::vector<double>> objectDistances;
-        std::vector<std::vector<double>> armDistances;
+        DistanceMatrix objectDistances;
+        DistanceMatrix armDistances;
+        /// The distances of the arm to the base of a mobile manipulator
+        DistanceMatrix baseDistances;
+        /// The distances of the base of a mobile manipulator to the obstacles
+        std::vector<double> baseObstacleDistances;
         Eigen::Vector4d origin;
-        std::vector<Primitive*> obstaclesAllocated;
         KDL::Twist twist;
         ros::NodeHandle n;
         ros::Publisher arrowsPub, linksCylindersPub, linksSpheresPub, baseCubePub;
@@ -30,6 +30,8 @@
 #include "kinova_arm.h"
 #include "monitor.h"
 #include "marker_publisher.h"
+#include "triple_buffer.h"
+#include "spsc_queue.h"
 // #include "arm_controller.h"
 
 //Math Libraries
@@ -41,9 +43,6 @@
 class RvizObstacle
 {
     public:
-        /// The index of the obstacle in Monitor obstacle list
-        int idx;
-
         /// The marker that represents the obstacle in rviz
         visualization_msgs::Marker marker;
 
@@ -54,9 +53,8 @@ class RvizObstacle
          * Constructor
          * 
          * @param markerIn The marker with dimensions suiting the obstacle
-         * @param index The location of the obstacle in the monitor obstacle list
          */
-        RvizObstacle(visualization_msgs::Marker::ConstPtr markerIn, int index);
+        RvizObstacle(visualization_msgs::Marker::ConstPtr markerIn);
 
         /// Destructor
         ~RvizObstacle();
@@ -104,12 +102,17 @@ class BaseController
         /// The monitor class used to perform collision monitoring
         Monitor* monitor;
 
-        /// The goal point of the robot motion
+        /// The goal point of the robot motion used by the current control loop
         Eigen::Vector3d goal;
 
         /**
          * Callback function updating the base positions
          * 
+         * The callbacks only publish their input for the next control loop,
+         * so they can run on a spinner thread while the control loop runs.
+         * All the callbacks of a controller must be called from the same
+         * thread.
+         * 
          * @param msg The ros sensor messsage containing the odometry messages
          */
         void baseCallback(const nav_msgs::Odometry::ConstPtr &msg);      
@@ -141,17 +144,51 @@ class BaseController
                                                 Eigen::Vector3d velocity);
 
         /**
-         * A callback function that updates or adds obstacles
+         * A callback function that updates, adds or removes obstacles
+         * 
+         * The marker is queued and applied by the next updateState(). Markers 
+         * are found by namespace and id in constant time. The DELETE and 
+         * DELETEALL actions remove the obstacles.
          * 
          * @param msg the ros marker message with the object parameters
          */
         void updateObstacles(const visualization_msgs::Marker::ConstPtr& msg);
 
-        /// A list of obstacles that are displayed in rviz
-        std::vector<RvizObstacle*> rvizObstacles;
+        /**
+         * Takes the latest input of the callbacks
+         * 
+         * The latest base position and goal are used and the queued obstacle 
+         * markers are applied to the monitor. It must run on the control 
+         * thread, before the control loop.
+         */
+        void updateState(void);
+
+        /// The obstacles that are displayed in rviz, by namespace and id
+        IdMap<RvizObstacle*> rvizObstacles;
 
     private:
 
+        /// The input of the control loop written by the callbacks
+        struct ControlInput
+        {
+            Eigen::Vector3d basePosition;
+            Eigen::Vector3d goal;
+        };
+
+        /// The latest input, only used by the callbacks
+        ControlInput callbackInput;
+        /// Passes the input from the callbacks to the control loop
+        TripleBuffer<ControlInput> input;
+        /// Markers received and not yet applied to the monitor
+        SpscQueue<visualization_msgs::Marker::ConstPtr> markerQueue;
+
+        /**
+         * Updates, adds or removes the obstacle of a marker
+         * 
+         * @param msg the ros marker message with the object parameters
+         */
+        void applyObstacle(const visualization_msgs::Marker::ConstPtr& msg);
+
         /// The number of joints in the arm
         int numJoints;
 
@@ -166,7 +203,6 @@ class BaseController
         std::vector<double> objectDistances;
         std::vector<std::vector<double>> armDistances;
         Eigen::Vector4d origin;
-        std::vector<Primitive*> obstaclesAllocated;
         geometry_msgs::Twist speed;
         ros::NodeHandle n;
         ros::Publisher CubePub,arrowsPub_base;
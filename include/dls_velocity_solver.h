@@ -0,0 +1,83 @@
+#ifndef DLS_VELOCITY_SOLVER_H
+#define DLS_VELOCITY_SOLVER_H
+
+#include <Eigen/Core>
+#include <Eigen/Cholesky>
+
+
+/**
+ * A damped least squares velocity IK solver for 7 joint arms
+ *
+ * The joint velocities reaching a twist are
+ *     qdot = (W J)^T ((W J) (W J)^T + lambda^2 I)^-1 W v
+ * with W the diagonal task space weights. Away from singularities lambda
+ * is 0 and this is the minimum norm solution, the same as the weighted
+ * pseudo inverse. The 6x6 system is solved with an LDLT decomposition on
+ * fixed-size matrices, so a call costs a few hundred flops and never
+ * allocates.
+ *
+ * The damping grows as the arm nears a singularity. The product of the
+ * pivots of the decomposition is det((W J) (W J)^T), the square of the
+ * manipulability w of the weighted Jacobian, and under the threshold w0
+ * the damping is lambda^2 = maxDamping^2 (1 - w / w0)^2.
+ *
+ * The joint velocities are then scaled down together until every joint is
+ * within its velocity limit, so the direction of the twist is kept.
+ */
+class DlsVelocitySolver
+{
+    public:
+        /// Number of joints of the arm
+        static const int N_JOINTS = 7;
+
+        /// Geometric Jacobian of the end effector in the arm base frame
+        typedef Eigen::Matrix<double, 6, N_JOINTS> Jacobian;
+        /// Joint velocities or their limits
+        typedef Eigen::Matrix<double, N_JOINTS, 1> JointVector;
+        /// Linear then angular velocity of the end effector
+        typedef Eigen::Matrix<double, 6, 1> Twist;
+
+        /** Constructor of DlsVelocitySolver
+        *
+        * The weights are 1 for the linear and 0.4 for the angular velocity,
+        * the limits are 10 rad/s for every joint.
+        */
+        DlsVelocitySolver();
+
+        /// Destructor of DlsVelocitySolver
+        ~DlsVelocitySolver();
+
+        /** Finds the joint velocities of a twist
+        *
+        * @param jacobian the Jacobian of the end effector
+        * @param twist the velocity of the end effector
+        * @param[out] jointVelocities the joint velocities, within the limits
+        * @return false if the system could not be solved, the velocities
+        *     are then 0
+        */
+        bool solve(const Jacobian &jacobian, const Twist &twist, JointVector &jointVelocities);
+
+        /// Diagonal of the task space weights
+        Twist weights;
+
+        /// The largest velocity of each joint in rad/s
+        JointVector velocityLimits;
+
+        /// The manipulability under which the solution is damped
+        double manipulabilityThreshold;
+
+        /// The damping factor lambda at a singularity
+        double maxDamping;
+
+        /// The damping lambda^2 of the last solution
+        double damping;
+
+        /// The factor the last solution was scaled by to keep the limits
+        double limitScale;
+
+    private:
+        /// The decomposition, kept to avoid allocations
+        Eigen::LDLT<Eigen::Matrix<double, 6, 6>> ldlt;
+};
+
+#endif // DLS_VELOCITY_SOLVER_H
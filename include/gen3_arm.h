@@ -0,0 +1,242 @@
+#ifndef GEN3_ARM_H
+#define GEN3_ARM_H
+
+#include <vector>
+#include <math.h>
+#include <iostream>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include "primitives.h"
+#include "arm.h"
+#include "dls_velocity_solver.h"
+
+
+/**
+ * An implementation of the Arm interface for the 7DOF Kinova Gen3.
+ *
+ * The kinematics of the Gen3 are known, so instead of walking a KDL chain
+ * the joints are compile time constants from urdf/GEN3_URDF_V12.urdf and
+ * the frames, links and Jacobians are computed with fixed-size Eigen types.
+ * Every joint turns about the z axis of its frame, so a joint only costs
+ * one sine and one cosine, computed once per pose and reused by the frames
+ * and the Jacobians.
+ *
+ * The frames, links, link velocities, kinematic state and velocity IK are
+ * the same as the ones of KinovaArm built from the same URDF.
+ */
+class Gen3Arm: public Arm
+{
+    public:
+        /// Number of joints of the Gen3
+        static const int N_JOINTS = 7;
+        /// Number of segments, the joints and the fixed end effector
+        static const int N_LINKS = 8;
+        /// Number of frames, the base and the tip of every segment
+        static const int N_FRAMES = 9;
+
+        /// Joint positions or velocities of the arm
+        typedef Eigen::Matrix<double, N_JOINTS, 1> JointVector;
+        /// Geometric Jacobian of a frame in the world frame
+        typedef Eigen::Matrix<double, 6, N_JOINTS> Jacobian;
+
+        /// Position of each joint in the frame of its parent, from the URDF
+        static constexpr double jointOrigins[N_LINKS][3] = {
+            {0, 0, 0.15643},
+            {0, 0.005375, -0.12838},
+            {0, -0.21038, -0.006375},
+            {0, 0.006375, -0.21038},
+            {0, -0.20843, -0.006375},
+            {0, 0.00017505, -0.10593},
+            {0, -0.10593, -0.00017505},
+            {0, 0, -0.0615250000000001}};
+
+        /// Roll, pitch and yaw of each joint in the frame of its parent
+        static constexpr double jointRpy[N_LINKS][3] = {
+            {3.1416, 2.7629E-18, -4.9305E-36},
+            {1.5708, 2.1343E-17, -1.1102E-16},
+            {-1.5708, 1.2326E-32, -2.9122E-16},
+            {1.5708, -6.6954E-17, -1.6653E-16},
+            {-1.5708, 2.2204E-16, -6.373E-17},
+            {1.5708, 9.2076E-28, -8.2157E-15},
+            {-1.5708, -5.5511E-17, 9.6396E-17},
+            {3.14159265358979, 1.09937075168372E-32, 0}};
+
+        /// Length of the capsule of each link
+        static constexpr double linkLengths[N_LINKS] = {
+            0.15643, 0.12838, 0.21038, 0.21038, 0.20843, 0.10593, 0.10593, 0.061525};
+
+        /// Radius of the capsule of each link
+        static constexpr double linkRadii[N_LINKS] = {
+            0.04, 0.04, 0.04, 0.04, 0.04, 0.04, 0.04, 0.04};
+
+        /// Largest velocity of each joint in rad/s, from the URDF
+        static constexpr double jointVelocityLimits[N_JOINTS] = {
+            0.8727, 0.8727, 0.8727, 0.8727, 0.8727, 0.8727, 0.8727};
+
+        /**
+         * Gen3Arm constructor, the joints start at 90 degrees like KinovaArm
+         *
+         * @return An instance of Gen3Arm class
+         */
+        Gen3Arm();
+
+        /**
+         * Gen3Arm constructor with set baseposition
+         *
+         * @param inputBaseTransform The global position of the robot base
+         * @return An instance of Gen3Arm class
+         */
+        Gen3Arm(Eigen::Matrix4d inputBaseTransform);
+
+        /// Gen3Arm Destructor
+        ~Gen3Arm();
+
+        /**
+         * A function to update the current virtual representation of the arm
+         *
+         * @param jointPositions The angular positions of the arm joints
+         *     in order of the joint in radians, extra positions are ignored
+         * @return False if there are less than 7 joint positions
+         */
+        bool updatePose(const std::vector<double> &jointPositions);
+
+        /**
+         * A function to update the arm from a span of joint positions
+         *
+         * @param jointPositions The angular positions of the arm joints in rad
+         * @param nPositions The number of joint positions, at least 7
+         * @return False if there are less than 7 joint positions
+         */
+        bool updatePose(const double* jointPositions, int nPositions);
+
+        /**
+         * A function to update the arm from fixed-size joint positions
+         *
+         * @param jointPositions The angular positions of the arm joints in rad
+         */
+        void updatePose(const JointVector &jointPositions);
+
+        /**
+         * A function to find the final joint pose
+         *
+         * @return The end effector pose
+         */
+        Eigen::Matrix4d getPose(void);
+
+        /**
+         * A function to find the pose of a given frame
+         *
+         * @param frameNumber The frame to get the pose of
+         * @return The frame pose, the end effector pose if out of range
+         */
+        Eigen::Matrix4d getPose(int frameNumber);
+
+        /**
+         * A function to find the geometric Jacobian at the origin of a frame
+         *
+         * The columns of the joints that do not move the frame are 0.
+         *
+         * @param frameNumber The frame, between 0 and 8
+         * @param[out] jacobian The linear then angular velocity of the frame
+         *     per joint velocity, in the world frame
+         */
+        void jacobian(int frameNumber, Jacobian &jacobian);
+
+        /**
+         * A function to find the velocities of the links from the Jacobian
+         *
+         * @param jointVelocities The velocities of the arm joints in rad/s
+         * @param[out] linear The linear velocity of the start of each link
+         * @param[out] angular The angular velocity of each link
+         * @return False if there are not 7 joint velocities
+         */
+        bool linkVelocities(const std::vector<double> &jointVelocities,
+                            std::vector<Eigen::Vector3d> &linear,
+                            std::vector<Eigen::Vector3d> &angular);
+
+        /**
+         * A function to find the joint velocities without allocating memory
+         *
+         * The damped least squares of DlsVelocitySolver on the endeffector
+         * Jacobian of the kinematic state, within the joint velocity limits.
+         *
+         * @param twist The linear then angular velocity of the endeffector
+         *     in the arm base frame
+         * @param[out] jointVelocities The joint velocities used to achieve the
+         *     desired velocity
+         * @param nVelocities The size of jointVelocities, at least 7
+         * @return False if the output is too small or the system could not
+         *     be solved
+         */
+        bool ikVelocitySolver(const Eigen::Matrix<double, 6, 1> &twist,
+                              double* jointVelocities, int nVelocities);
+
+        /**
+         * A function to get the kinematics of the current joint positions
+         *
+         * @return The frames and the Jacobians of the last pose, in the arm
+         *     base frame
+         */
+        const KinematicState* getKinematicState();
+
+        /**
+         * A function to create an independent copy of the arm
+         *
+         * @return A Gen3Arm in the same pose with its own links
+         */
+        Arm* clone();
+
+        /**
+         * A function to describe the chain and the link capsules
+         *
+         * @param[out] model The chain of the arm from the world frame
+         * @return True, the chain of the Gen3 is always known
+         */
+        bool getChainModel(ChainModel &model);
+
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    private:
+
+        /**
+         * Copy constructor used by clone, copies the links and the frames
+         *
+         * @param arm The arm to copy
+         */
+        Gen3Arm(const Gen3Arm &arm);
+
+        /// Sets the constants and creates the links, used by the constructors
+        void initialise();
+
+        /// Fixed rotation of each joint in the frame of its parent
+        Eigen::Matrix3d jointRotations[N_LINKS];
+
+        /// World frames of the base and of the tip of every segment
+        Eigen::Isometry3d frames[N_FRAMES];
+
+        /// The current joint positions
+        JointVector positions;
+
+        /// Frames and Jacobians of the current pose in the arm base frame
+        KinematicState kinematicState;
+
+        /// The velocity IK of the endeffector
+        DlsVelocitySolver dlsSolver;
+
+        /**
+         * Creates a link pose from the world origins of its start and end frames
+         *
+         * The pose has its position at the start frame and its z axis
+         * pointing towards the end frame, as the links of KinovaArm.
+         *
+         * @param basePoint The origin of the start frame in the world
+         * @param endPoint The origin of the end frame in the world
+         *
+         * @return The homogenous representation of the cylinder pose
+         */
+        Eigen::Matrix4d linkPose(const Eigen::Vector3d &basePoint,
+                                 const Eigen::Vector3d &endPoint);
+};
+
+#endif // GEN3_ARM_H
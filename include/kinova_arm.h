@@ -13,11 +13,16 @@
 #include <kdl/chainfksolver.hpp>
 #include <kdl/chainfksolverpos_recursive.hpp>
 #include <kdl_parser/kdl_parser.hpp>
+#include <urdf_parser/urdf_parser.h>
 #include <kdl/frames.hpp>
 #include <kdl/frames_io.hpp>
-#include <kdl/chainiksolvervel_wdls.hpp>
+#include <Eigen/SVD>
 #include "primitives.h"
 #include "arm.h"
+#include "kinematic_state.h"
+#include "dls_velocity_solver.h"
+#include "capsule_fit.h"
+#include "model_cache.h"
 
 
 /**
@@ -48,6 +53,30 @@ class KinovaArm: public Arm
          * @return An instance of KinovaArm class
          */
         KinovaArm(std::string urdf_filename, Eigen::Matrix4d inputBaseTransform);
+
+        /// Number of links with a default capsule
+        static const int N_DEFAULT_LINKS = 8;
+
+        /// Length of the capsule of each link without a fitted capsule
+        static constexpr double defaultLengths[N_DEFAULT_LINKS] = {
+            0.15643, 0.12838, 0.21038, 0.21038, 0.20843, 0.10593, 0.10593, 0.061525};
+
+        /// Radius of the capsule of each link without a fitted capsule
+        static constexpr double defaultRadii[N_DEFAULT_LINKS] = {
+            0.04, 0.04, 0.04, 0.04, 0.04, 0.04, 0.04, 0.04};
+
+        /// Links at most this far apart in the chain are allowed to collide
+        static const int ALLOWED_NEIGHBOURS = 1;
+
+        /**
+         * The defaults of the code the model is built with
+         * 
+         * The model cache is only used if it was built with the same 
+         * defaults, they are part of its hash.
+         * 
+         * @return The default lengths, radii and allowed neighbours
+         */
+        static std::vector<double> modelDefaults();
         /// KinovaArm Destructor
         ~KinovaArm();
 
@@ -58,7 +87,22 @@ class KinovaArm: public Arm
          *     in order of the joint in radians
          * @return The boolean true for a successful update, False otherwise
          */
-        bool updatePose(std::vector<double> jointPositions);
+        bool updatePose(const std::vector<double> &jointPositions);
+
+        /**
+         * A function to update the arm without allocating memory
+         * 
+         * Safe to call on a real-time thread, the frames and the links are
+         * updated in place. The kinematic state is only computed again if 
+         * the joint positions changed, and the links are only moved if the
+         * joint positions or the base transform changed.
+         * 
+         * @param jointPositions The angular positions of the arm joints
+         *     in order of the joint in radians
+         * @param nPositions The number of joint positions, at least nJoints
+         * @return False if there are less than nJoints joint positions
+         */
+        bool updatePose(const double* jointPositions, int nPositions);
 
         /**
          * A function to find the inverse kinematics of an endeffector trajectory
@@ -68,6 +112,77 @@ class KinovaArm: public Arm
          */
         std::vector<double> ikVelocitySolver(KDL::Twist twist);
 
+        /**
+         * A function to find the joint velocities without allocating memory
+         * 
+         * Safe to call on a real-time thread, the solver and its weights 
+         * are created with the arm and reused by every call. The solution
+         * is computed from the endeffector Jacobian of the kinematic state,
+         * the chain is not walked again. 7 joint arms use the damped least
+         * squares of DlsVelocitySolver, the other chains the weighted 
+         * pseudo inverse. The velocities are scaled down together to keep
+         * every joint within the velocity limit of the URDF.
+         * 
+         * @param twist The KDL::Twist velocity vector
+         * @param[out] jointVelocities The joint velocities used to achieve the
+         *     desired velocity, within the joint velocity limits
+         * @param nVelocities The size of jointVelocities, at least nJoints
+         * @return False if the output is too small
+         */
+        bool ikVelocitySolver(const KDL::Twist &twist, double* jointVelocities,
+                              int nVelocities);
+
+        /**
+         * A function to find the joint velocities of a twist given as a vector
+         * 
+         * Same as the KDL::Twist version, for the callers of the Arm interface.
+         * 
+         * @param twist The linear then angular velocity of the endeffector
+         * @param[out] jointVelocities The joint velocities used to achieve the
+         *     desired velocity, within the joint velocity limits
+         * @param nVelocities The size of jointVelocities, at least nJoints
+         * @return False if the output is too small
+         */
+        bool ikVelocitySolver(const Eigen::Matrix<double, 6, 1> &twist,
+                              double* jointVelocities, int nVelocities);
+
+        /**
+         * A function to find the velocities of the links from the Jacobian
+         * 
+         * The Jacobians are read from the kinematic state. Does not 
+         * allocate memory once the outputs have nLinks elements.
+         * 
+         * @param jointVelocities The velocities of the arm joints in rad/s
+         * @param[out] linear The linear velocity of the start of each link
+         * @param[out] angular The angular velocity of each link
+         * @return True if the velocities were computed, False otherwise
+         */
+        bool linkVelocities(const std::vector<double> &jointVelocities,
+                            std::vector<Eigen::Vector3d> &linear,
+                            std::vector<Eigen::Vector3d> &angular);
+
+        /**
+         * A function to get the kinematics of the current joint positions
+         * 
+         * @return The frames and the Jacobians of the last pose
+         */
+        const KinematicState* getKinematicState();
+
+        /**
+         * A function to create an independent copy of the arm
+         * 
+         * @return A KinovaArm in the same pose with its own links and frames
+         */
+        Arm* clone();
+
+        /**
+         * A function to describe the KDL chain and the link capsules
+         * 
+         * @param[out] model The chain of the arm from the world frame
+         * @return False if the chain has a joint that is not revolute
+         */
+        bool getChainModel(ChainModel &model);
+
         /**
          * A function to find the final joint pose
          * 
@@ -83,6 +198,18 @@ class KinovaArm: public Arm
          */
         Eigen::Matrix4d  getPose(int frameNumber);
 
+        /**
+         * A function to check if a pair of links may be in contact
+         * 
+         * The links that touch by design, a link and its neighbours in the
+         * chain, are allowed to collide and are not checked.
+         * 
+         * @param first The number of the first link
+         * @param second The number of the second link
+         * @return True if the pair is allowed to collide, False otherwise
+         */
+        bool allowedCollision(int first, int second);
+
         /// The KDL joint array to hold the joint angles
         KDL::JntArray jointArray;
         /// The KDL joint array to hold the joint velocities
@@ -92,18 +219,69 @@ class KinovaArm: public Arm
 
     private:
 
+        /**
+         * Copy constructor used by clone, copies the links and the frames
+         * 
+         * @param arm The arm to copy
+         */
+        KinovaArm(const KinovaArm &arm);
+
         /// A vector of the length of each of the links
         std::vector<double> lengths;
 
         /// A vector of the radius of each of the links
         std::vector<double> radii;
 
-        ///  A vector of all the link KDL frames
-        std::vector<KDL::Frame*> localPoses;
+        /// The velocity limit of the joint of each segment, 0 without one
+        std::vector<double> velocityLimits;
+
+        /// True for the links with a capsule fitted to their mesh
+        std::vector<bool> fittedLinks;
+
+        /// Ends of the fitted capsules in the frame of their link
+        std::vector<Eigen::Vector3d> linkStarts;
+        std::vector<Eigen::Vector3d> linkEnds;
+
+        /// True for the pairs of links that are not checked, row major
+        std::vector<bool> allowedCollisions;
+
+        ///  All the link KDL frames, contiguous and reused by every update
+        std::vector<KDL::Frame> localPoses;
+
+        /// The origins of the frames in the world, reused by every update
+        std::vector<Eigen::Vector3d> framePositions;
 
         /// The KDL chain used for calculating kinematics
         KDL::Chain fkChain;
 
+        /// The frames and Jacobians of the current joint positions
+        KinematicState kinematicState;
+
+        /// The base transform the links were last placed with
+        Eigen::Matrix4d placedBaseTransform;
+
+        /// The axis and a point of the axis of each joint, in the arm base
+        std::vector<Eigen::Vector3d> jointAxes;
+        std::vector<Eigen::Vector3d> jointPoints;
+
+        /// The task space weights of the velocity IK
+        Eigen::MatrixXd ikWeights;
+
+        /// The velocity limit of each joint in rad/s
+        Eigen::VectorXd jointVelocityLimits;
+
+        /// The velocity IK of the 7 joint arms
+        DlsVelocitySolver dlsSolver;
+
+        /// The buffers of the velocity IK, created once
+        Eigen::MatrixXd weightedJacobian;
+        Eigen::JacobiSVD<Eigen::MatrixXd> ikSvd;
+        Eigen::VectorXd weightedTwist;
+        Eigen::VectorXd projectedTwist;
+
+        /// The joint velocities of linkVelocities, reused by every call
+        Eigen::VectorXd velocityBuffer;
+
         /// Mathematical constants, declared in constructor for speed
         Eigen::Vector4d origin;
         Eigen::Vector3d directionVect;
@@ -137,6 +315,88 @@ class KinovaArm: public Arm
          */
         Eigen::Matrix4d linkFramesToPose(KDL::Frame startLink, KDL::Frame endLink);
 
+        /**
+         * Creates the pose of a link capsule for the current frames
+         * 
+         * A fitted capsule goes from its start to its end, otherwise the 
+         * capsule goes from the frame of the link to the next frame.
+         * 
+         * @param linkNum The index of the link
+         * 
+         * @return The homogenous representation of the cylinder pose
+         */
+        Eigen::Matrix4d linkPose(int linkNum);
+
+        /**
+         * Creates a link pose from the world origins of its start and end frames
+         * 
+         * Same as linkFramesToPose but without converting the frames.
+         * 
+         * @param basePoint The origin of the start frame in the world
+         * @param endPoint The origin of the end frame in the world
+         * 
+         * @return The homogenous representation of the cylinder pose
+         */
+        Eigen::Matrix4d linkPose(const Eigen::Vector3d &basePoint, 
+                                 const Eigen::Vector3d &endPoint);
+
+        /**
+         * Computes all the frames of the chain in one walk from the base
+         * 
+         * Every frame is the previous one moved by its segment for the 
+         * joint positions of jointArray, so the cost is linear in the number
+         * of segments and nothing is allocated. The frames are written to 
+         * localPoses and, with the Jacobian of every frame built from the 
+         * joint axes met on the way, to the kinematic state.
+         */
+        void forwardKinematics();
+
+        /**
+         * Places the origins of the frames in the world
+         * 
+         * The origins of localPoses are moved by the base transform to 
+         * framePositions.
+         */
+        void placeFrames();
+
+        /**
+         * Imports the chain from the URDF and creates the links
+         * 
+         * Used by the constructors once the base transform is set. The 
+         * model is read from the binary cache of the URDF if it is up to 
+         * date, otherwise the URDF is parsed and the cache is written.
+         * 
+         * @param urdf_filename The location of the urdf file
+         */
+        void initialise(std::string urdf_filename);
+
+        /**
+         * Reads the capsules fitted to the link meshes, if there are some
+         * 
+         * The links of the cache replace the default lengths and radii, 
+         * the links that are not in the cache keep them.
+         * 
+         * @param cacheFilename The location of the cache written by
+         *     FitLinkCapsules
+         */
+        void loadLinkCapsules(std::string cacheFilename);
+
+        /**
+         * Parses the URDF into the chain and the link capsules
+         * 
+         * @param urdf_filename The location of the urdf file
+         * @return False if the URDF cannot be parsed
+         */
+        bool parseModel(std::string urdf_filename);
+
+        /**
+         * Creates the kinematic state and the solver buffers for fkChain
+         * 
+         * Called once by the constructors so that the solvers never 
+         * allocate while the arm is controlled.
+         */
+        void createSolvers();
+
 };
 
 
@@ -0,0 +1,93 @@
+#ifndef MODEL_CACHE_H
+#define MODEL_CACHE_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <Eigen/Core>
+
+#include <kdl/chain.hpp>
+#include <kdl/frames.hpp>
+
+
+/**
+ * A binary cache of the kinematic model of an arm built from a URDF
+ *
+ * Parsing the URDF into a KDL tree is the slowest part of creating an arm,
+ * so the chain, the link capsules and the allowed collision matrix are
+ * saved in a file next to the URDF. The file has a fixed layout of a
+ * header and one record per segment, and is memory-mapped when it is read.
+ *
+ * The header holds a FNV-1a hash of the URDF, of its capsule cache and of
+ * the defaults of the code, so a cache is only used for the exact files 
+ * and defaults it was built from.
+ */
+class ModelCache
+{
+    public:
+        /// Version of the layout of the file, changed with the layout
+        static const uint32_t VERSION = 2;
+
+        /**
+         * The cache file of a URDF
+         *
+         * @param urdfFilename The location of the urdf file
+         * @return The location of the cache, the urdf location followed by .model
+         */
+        static std::string cacheFilename(const std::string &urdfFilename);
+
+        /**
+         * The hash of the files the model is built from
+         *
+         * @param urdfFilename The location of the urdf file
+         * @param defaults The values of the code the model is built with,
+         *     such as the capsules of the links that are not fitted
+         * @return The FNV-1a hash of the urdf, of its capsule cache, if
+         *     there is one, and of the defaults
+         */
+        static uint64_t hashSources(const std::string &urdfFilename,
+                                    const std::vector<double> &defaults);
+
+        /**
+         * Writes the model to a cache file
+         *
+         * @param filename The location of the cache
+         * @param hash The hash of the files the model is built from
+         * @return False if the file cannot be written or a name is too long
+         */
+        bool write(const std::string &filename, uint64_t hash);
+
+        /**
+         * Reads the model from a cache file
+         *
+         * @param filename The location of the cache
+         * @param hash The hash of the files the model must be built from
+         * @return False if the file is missing, from another version or
+         *     built from other files
+         */
+        bool read(const std::string &filename, uint64_t hash);
+
+        /// The chain of the arm
+        KDL::Chain chain;
+
+        /// The length of the capsule of each link
+        std::vector<double> lengths;
+
+        /// The radius of the capsule of each link
+        std::vector<double> radii;
+
+        /// The velocity limit of the joint of each segment, 0 if it has none
+        std::vector<double> velocityLimits;
+
+        /// True for the links with a capsule fitted to their mesh
+        std::vector<bool> fittedLinks;
+
+        /// Ends of the fitted capsules in the frame of their link
+        std::vector<Eigen::Vector3d> linkStarts;
+        std::vector<Eigen::Vector3d> linkEnds;
+
+        /// True for the pairs of links that are not checked, row major
+        std::vector<bool> allowedCollisions;
+};
+
+#endif // MODEL_CACHE_H
@@ -7,8 +7,11 @@
 // #define DEBUG
 // #define PRINTDATA
 
+// The marker queue holds as many markers as the subscriber queues
 ArmController::ArmController(Monitor* monitorObject, double k, double d,
-                                                    double gamma, double beta) {
+                                                    double gamma, double beta)
+                                                    : markerQueue(1000),
+                                                    stateEstimator(monitorObject->arm->nJoints) {
     
     // Intialise the controller based off the monitor
     Eigen::Matrix4d currEndPose;
@@ -16,6 +19,16 @@ ArmController::ArmController(Monitor* monitorObject, double k, double d,
     currEndPose = monitor->arm->getPose();
     this->numJoints = monitor->arm->nJoints;
 
+    // The joint velocities are not scaled unless enabled
+    this->speedAndSeparation = false;
+    this->monitorBudget = 0;
+    this->objectDistancesExact = false;
+
+    // The latest joint angles are used unless the estimation is enabled
+    this->stateEstimation = false;
+    this->stateErrorBound = 0;
+    this->stateReach = 0;
+
     // Constants for obstacle avoidance
     this->K = k;
     this->D = d;
@@ -31,6 +44,7 @@ ArmController::ArmController(Monitor* monitorObject, double k, double d,
     for(int i=0; i<numJoints; i++) {
         this->jointAngles.push_back(0.0);
     }
+    this->estimatedAngles = jointAngles;
 
     // Setup publisher for potential fields
     this->arrowsPub = n.advertise<visualization_msgs::Marker>("kinova_controller/distance_field", 1000);
@@ -40,33 +54,39 @@ ArmController::ArmController(Monitor* monitorObject, double k, double d,
     // Init the controller to the current arm state
     origin << 0, 0, 0, 1;
     this->goal = (currEndPose * origin).head(3);
-    objectDistances = monitor->distanceToObjects();
-    armDistances = monitor->distanceBetweenArmLinks();
+    callbackInput.jointAngles = jointAngles;
+    callbackInput.stamp = 0;
+    callbackInput.goal = goal;
+    callbackInput.basePose.setZero();
+    callbackInput.baseReceived = false;
+    input.write(callbackInput);
+    input.update();
+    monitor->distanceToObjects(objectDistances);
+    monitor->distanceBetweenArmLinks(armDistances);
 }
 
 ArmController::~ArmController() {
     // Delete all the rviz obstacles
-    for (int i=0; i<rvizObstacles.size();i++) {
-        delete(rvizObstacles[i]);
-    }
-
-    // Delete all the obstacles allocated at runtime
-    for (int i=0; i<obstaclesAllocated.size();i++) {
-        delete(obstaclesAllocated[i]);
-    }
+    rvizObstacles.forEach([](const std::string &ns, int id, RvizObstacle* &rvizObstacle) {
+        delete(rvizObstacle);
+    });
 }
 
 void ArmController::armCallback(const sensor_msgs::JointState::ConstPtr& msg) {
 
-    // copy the joint positions to the joint angles
-    jointAngles.assign(msg->position.begin(), msg->position.end());
+    // copy the joint positions to the joint angles of the next control loop
+    callbackInput.jointAngles.assign(msg->position.begin(), msg->position.end());
+    callbackInput.jointVelocities.assign(msg->velocity.begin(), msg->velocity.end());
+    callbackInput.stamp = msg->header.stamp.isZero() ? ros::Time::now().toSec() :
+                                                       msg->header.stamp.toSec();
+    input.write(callbackInput);
 
 }
 
 void ArmController::goalCallback(const geometry_msgs::Point::ConstPtr& msg) {
 
     #ifdef DEBUG
-    std::cout << "goalCallback:\n\tCurrent goal: "<<this->goal<<std::endl;
+    std::cout << "goalCallback:\n\tCurrent goal: "<<callbackInput.goal<<std::endl;
     std::cout << "\tincoming goal: " << msg->x << ", " << msg->y << ", " << msg->z << std::endl;
     #endif // DEBUG
 
@@ -76,16 +96,28 @@ void ArmController::goalCallback(const geometry_msgs::Point::ConstPtr& msg) {
     #endif
 
     //transform the message from its current type to Eigen::Vector3d and put in goal variable
-    this->goal[0] = msg->x;
-    this->goal[1] = msg->y;
-    this->goal[2] = msg->z;
+    callbackInput.goal[0] = msg->x;
+    callbackInput.goal[1] = msg->y;
+    callbackInput.goal[2] = msg->z;
+    input.write(callbackInput);
 
 
     #ifdef DEBUG
-    std::cout << "\tNew goal: "<<this->goal<<std::endl;
+    std::cout << "\tNew goal: "<<callbackInput.goal<<std::endl;
     #endif // DEBUG
 }
 
+void ArmController::odomCallback(const nav_msgs::Odometry::ConstPtr& msg) {
+
+    // Only the planar pose of the base is used
+    tf::Quaternion q(msg->pose.pose.orientation.x, msg->pose.pose.orientation.y,
+                     msg->pose.pose.orientation.z, msg->pose.pose.orientation.w);
+    callbackInput.basePose << msg->pose.pose.position.x, msg->pose.pose.position.y,
+                              tf::getYaw(q);
+    callbackInput.baseReceived = true;
+    input.write(callbackInput);
+}
+
 Eigen::Vector3d ArmController::obstaclePotentialField(Eigen::Vector3d currentPosition, 
                                         Eigen::Vector3d velocity) {
 
@@ -211,16 +243,38 @@ Eigen::Vector3d ArmController::obstaclePotentialField(Eigen::Vector3d currentPos
 KDL::Twist ArmController::controlLoop(void) {
     // Variable for storing the resulting joint velocities
     double x, y, z;
-    // Update the current state to match real arm state
-    this->monitor->arm->updatePose(this->jointAngles);
     Eigen::Matrix4d currEndPose = monitor->arm->getPose();
     Eigen::Vector3d currEndPoint = (currEndPose * origin).head(3);
     std::cout<<"End Pose: "<<currEndPoint<<std::endl;
     ROS_WARN_STREAM("End Pose Stream: \n " << currEndPoint<<"\n");
-    objectDistances = monitor->distanceToObjects();
-    armDistances = monitor->distanceBetweenArmLinks();
+    if (monitorBudget > 0) {
+        double resolvedDistance;
+        int unresolved = monitor->distanceToObjects(objectDistances, monitorBudget, 
+                                                    resolvedDistance);
+        if (unresolved > 0) {
+            ROS_WARN_THROTTLE(1, "%d obstacle pairs only bounded, all pairs closer than %f m are exact",
+                              unresolved, resolvedDistance);
+        }
+        objectDistancesExact = unresolved == 0;
+    } else {
+        monitor->distanceToObjects(objectDistances);
+        objectDistancesExact = true;
+    }
+    monitor->distanceBetweenArmLinks(armDistances);
+    if (monitor->body != NULL) {
+        // The base of a mobile manipulator is not among the obstacles, the 
+        // arm is kept off it by the speed scale and the base only reported
+        monitor->armDistanceToBase(baseDistances);
+        monitor->baseDistanceToObjects(baseObstacleDistances);
+        for (int i = 0; i < baseObstacleDistances.size(); i++) {
+            if (baseObstacleDistances[i] < separation.protectiveDistance) {
+                ROS_WARN_THROTTLE(1, "Base %f m from obstacle %d", 
+                                  baseObstacleDistances[i], i);
+            }
+        }
+    }
     Box3 *narkobase;
-    narkobase = dynamic_cast<Box3*>(monitor->base->base_primitive);
+    narkobase = monitor->base ? dynamic_cast<Box3*>(monitor->base->base_primitive) : NULL;
     if(narkobase){
         //  Eigen::Vector4d startPoint(0, 0, 0, 1);
         // Eigen::Vector4d endPoint(0, 0, capsuleLink->getLength(), 1);
@@ -320,84 +374,199 @@ KDL::Twist ArmController::controlLoop(void) {
     return twist;
 }
 
-void ArmController::updateObstacles(const visualization_msgs::Marker::ConstPtr& msg) {
-    #ifdef DEBUG
+void ArmController::enableSpeedAndSeparation(const SeparationParameters &parameters) {
+    this->separation = parameters;
+    this->speedAndSeparation = true;
+    // The scale reads the closest points of the distances of the control loop
+    objectDistances.computeWitnessPoints = true;
+    baseDistances.computeWitnessPoints = true;
+}
 
+double ArmController::scaleJointVelocities(std::vector<double> &jointVelocities) {
+    if (!speedAndSeparation) {
+        return 1.0;
+    }
+    // The links of estimated joint angles may be off by the error bound 
+    // turned by the reach of the joints
+    SeparationParameters parameters = separation;
+    if (stateEstimation) {
+        parameters.protectiveDistance += stateReach * stateErrorBound;
+    }
+
+    // The distances of the control loop are reused when they are all exact,
+    // the bounds of a limited budget have no closest points
+    double scale;
+    if (!objectDistancesExact) {
+        scale = monitor->speedScale(jointVelocities, parameters);
+    } else if (monitor->body != NULL) {
+        scale = monitor->speedScale(jointVelocities, parameters, objectDistances,
+                                    baseDistances);
+    } else {
+        scale = monitor->speedScale(jointVelocities, parameters, objectDistances);
+    }
+    for (int i = 0; i < jointVelocities.size(); i++) {
+        jointVelocities[i] *= scale;
+    }
+    #ifdef DEBUG
+    std::cout << "[ArmController] speed scale: " << scale << std::endl;
     #endif // DEBUG
-    std::cout << "New obstacle of type: " << msg->type <<std::endl;
-    if (msg->type == visualization_msgs::Marker::SPHERE) {
-        bool newObstacle = true;
-        for(int i=0; i<rvizObstacles.size();i++){
-            if(rvizObstacles[i]->marker.id == msg->id) {
-                newObstacle = false;
-                int index = rvizObstacles[i]->idx;
-                monitor->obstacles[index]->pose = rvizObstacles[i]->updatePose(msg);
-            }
-        }
+    return scale;
+}
 
-        if(newObstacle) {
-            RvizObstacle* rvizObstacle = new RvizObstacle(msg, rvizObstacles.size());
-            rvizObstacles.push_back(rvizObstacle);
-            Sphere* sphere = new Sphere(rvizObstacle->pose, rvizObstacle->marker.scale.x);
-            obstaclesAllocated.push_back(sphere);
-            monitor->addObstacle(sphere);
-        }
+void ArmController::setMonitorBudget(double budget) {
+    this->monitorBudget = budget;
+}
+
+void ArmController::enableJointStateEstimation(double maxAcceleration, 
+                                               double maxExtrapolation) {
+    stateEstimator.maxAcceleration = maxAcceleration;
+    stateEstimator.maxExtrapolation = maxExtrapolation;
+    this->stateEstimation = true;
+
+    // Sum of the reach of the joints, every joint may be off by the bound
+    std::vector<double> reach;
+    monitor->arm->jointReach(reach);
+    stateReach = 0;
+    for (int i = 0; i < reach.size(); i++) {
+        stateReach += reach[i];
     }
-    else if(msg->type == visualization_msgs::Marker::ARROW){
-        #ifdef DEBUG
-        std::cout << "arrow" << std::endl;
-        #endif // DEBUG
+}
+
+double ArmController::getStateErrorBound(void) {
+    return stateErrorBound;
+}
+
+void ArmController::updateObstacles(const visualization_msgs::Marker::ConstPtr& msg) {
+    if (!markerQueue.push(msg)) {
+        ROS_ERROR("Obstacle queue full, marker %s/%d dropped", msg->ns.c_str(), msg->id);
     }
-    else if(msg->type == visualization_msgs::Marker::CYLINDER){
-        bool newObstacle = true;
-        for(int i=0; i<rvizObstacles.size();i++){
-            if(rvizObstacles[i]->marker.id == msg->id) {
-                newObstacle = false;
-                int index = rvizObstacles[i]->idx;
-                monitor->obstacles[index]->pose = rvizObstacles[i]->updatePose(msg);
-            }
+}
+
+void ArmController::updateState(void) {
+    if (input.update()) {
+        const ControlInput &latest = input.read();
+        this->goal = latest.goal;
+        if (monitor->body != NULL && latest.baseReceived) {
+            monitor->body->setBasePose(latest.basePose);
         }
 
-        if(newObstacle) {
-            RvizObstacle* rvizObstacle = new RvizObstacle(msg, rvizObstacles.size());
-            rvizObstacles.push_back(rvizObstacle);
-            rvizObstacle->pose(2, 3) -= (rvizObstacle->marker.scale.z / 2.0);
-            Capsule* capsule = new Capsule(rvizObstacle->pose, rvizObstacle->marker.scale.z, rvizObstacle->marker.scale.x / 2);
-            obstaclesAllocated.push_back(capsule);
-            monitor->addObstacle(capsule);
+        // A size mismatch, such as the joints of a gripper, is reported once,
+        // the arm keeps its last joint angles if some are missing
+        bool complete = latest.jointAngles.size() >= numJoints;
+        if (!complete) {
+            ROS_ERROR_ONCE("Joint states have %d positions for %d joints, they are ignored",
+                           (int)latest.jointAngles.size(), numJoints);
+        } else if (latest.jointAngles.size() > numJoints) {
+            ROS_WARN_ONCE("Joint states have %d positions, the first %d are used",
+                          (int)latest.jointAngles.size(), numJoints);
+        }
+        if (complete) {
+            this->jointAngles = latest.jointAngles;
+        }
+        if (complete && stateEstimation && latest.stamp > 0) {
+            // Repeated by the goals, the estimator ignores the old samples
+            bool velocities = latest.jointVelocities.size() == latest.jointAngles.size();
+            stateEstimator.addSample(latest.stamp, latest.jointAngles.data(), 
+                                     velocities ? latest.jointVelocities.data() : NULL,
+                                     latest.jointAngles.size());
         }
     }
-	// ==================== Box obstacle ======================================
-
-	else if(msg->type == visualization_msgs::Marker::CUBE){
-        bool newObstacle = true;
-        for(int i=0; i<rvizObstacles.size();i++){
-            if(rvizObstacles[i]->marker.id == msg->id) {
-                newObstacle = false;
-                int index = rvizObstacles[i]->idx;
-                monitor->obstacles[index]->pose = rvizObstacles[i]->updatePose(msg);
-            }
+
+    visualization_msgs::Marker::ConstPtr msg;
+    while (markerQueue.pop(msg)) {
+        applyObstacle(msg);
+    }
+
+    // Update the current state to match real arm state
+    const std::vector<double>* angles = &this->jointAngles;
+    if (stateEstimation && stateEstimator.latestTime() > 0) {
+        if (!stateEstimator.estimate(ros::Time::now().toSec(), estimatedAngles.data(), 
+                                     estimatedAngles.size(), stateErrorBound)) {
+            ROS_WARN_THROTTLE(1, "Joint states too old or without velocities, joint angle error up to %f rad",
+                              stateErrorBound);
         }
+        angles = &this->estimatedAngles;
+    }
+
+    // The links of a mobile manipulator follow its base
+    if (monitor->body != NULL) {
+        monitor->body->setJointPositions(*angles);
+        monitor->body->update();
+        return;
+    }
+    this->monitor->arm->updatePose(*angles);
+}
 
-        if(newObstacle) {
-            RvizObstacle* rvizObstacle = new RvizObstacle(msg, rvizObstacles.size());
-            rvizObstacles.push_back(rvizObstacle);
-        Box3* box = new Box3(rvizObstacle->pose, rvizObstacle->marker.scale.x/2,rvizObstacle->marker.scale.y/2, rvizObstacle->marker.scale.z/2);
-            obstaclesAllocated.push_back(box);
-            monitor->addObstacle(box);
+void ArmController::applyObstacle(const visualization_msgs::Marker::ConstPtr& msg) {
+    #ifdef DEBUG
+    std::cout << "Obstacle marker " << msg->ns << "/" << msg->id << " of type: " << msg->type << std::endl;
+    #endif // DEBUG
+
+    // Removal of one or all the markers
+    if (msg->action == visualization_msgs::Marker::DELETE) {
+        monitor->removeMarkerObstacle(msg->ns, msg->id);
+        RvizObstacle** rvizObstacle = rvizObstacles.find(msg->ns, msg->id);
+        if (rvizObstacle != NULL) {
+            delete(*rvizObstacle);
+            rvizObstacles.erase(msg->ns, msg->id);
         }
+        return;
+    }
+    if (msg->action == visualization_msgs::Marker::DELETEALL) {
+        monitor->removeAllMarkerObstacles();
+        rvizObstacles.forEach([](const std::string &ns, int id, RvizObstacle* &rvizObstacle) {
+            delete(rvizObstacle);
+        });
+        rvizObstacles.clear();
+        return;
     }
 
-    //====================================================================================================================================
-    else {
+    if (msg->type == visualization_msgs::Marker::ARROW) {
+        #ifdef DEBUG
+        std::cout << "arrow" << std::endl;
+        #endif // DEBUG
+        return;
+    }
+    if (msg->type != visualization_msgs::Marker::SPHERE &&
+        msg->type != visualization_msgs::Marker::CYLINDER &&
+        msg->type != visualization_msgs::Marker::CUBE) {
         ROS_ERROR("Wrong shape for obstacle");
+        return;
+    }
+
+    // Find the marker by namespace and id, or add it
+    RvizObstacle* rvizObstacle;
+    RvizObstacle** found = rvizObstacles.find(msg->ns, msg->id);
+    if (found == NULL) {
+        rvizObstacle = new RvizObstacle(msg);
+        rvizObstacles.insert(msg->ns, msg->id, rvizObstacle);
+    } else {
+        rvizObstacle = *found;
+        rvizObstacle->updatePose(msg);
+    }
+
+    // The monitor updates the obstacle in place or replaces it if the 
+    // marker changed shape
+    if (msg->type == visualization_msgs::Marker::SPHERE) {
+        Sphere sphere(rvizObstacle->pose, rvizObstacle->marker.scale.x);
+        monitor->setMarkerObstacle(msg->ns, msg->id, &sphere);
+    }
+    else if (msg->type == visualization_msgs::Marker::CYLINDER) {
+        // The capsule starts at the bottom of the cylinder
+        Eigen::Matrix4d pose = rvizObstacle->pose;
+        pose.block<3, 1>(0, 3) -= pose.block<3, 1>(0, 2) * (rvizObstacle->marker.scale.z / 2.0);
+        Capsule capsule(pose, rvizObstacle->marker.scale.z, rvizObstacle->marker.scale.x / 2);
+        monitor->setMarkerObstacle(msg->ns, msg->id, &capsule);
+    }
+    else {
+        Box3 box(rvizObstacle->pose, rvizObstacle->marker.scale.x/2,rvizObstacle->marker.scale.y/2, rvizObstacle->marker.scale.z/2);
+        monitor->setMarkerObstacle(msg->ns, msg->id, &box);
     }
 }
 
 
-RvizObstacle::RvizObstacle(visualization_msgs::Marker::ConstPtr markerIn, int index) {
+RvizObstacle::RvizObstacle(visualization_msgs::Marker::ConstPtr markerIn) {
     marker = *markerIn;
-    idx = index;
     double qx = marker.pose.orientation.x;
     double qy = marker.pose.orientation.y;
     double qz = marker.pose.orientation.z;
@@ -76,22 +76,27 @@ int main(int argc, char **argv){
     ros::Publisher markersPub = n.advertise<visualization_msgs::Marker>("kinova_controller/markers", 1000);
     ros::Publisher baseVelPub = n.advertise<geometry_msgs::Twist>("cmd_vel", 1000);
     
-    ros::Rate loop_rate(10); 
+    // Rate of the control loop, the callbacks run on their own thread
+    double controlRate;
+    n.param<double>("/control_rate", controlRate, 10);
+    ros::Rate loop_rate(controlRate);
+    ros::AsyncSpinner spinner(1);
+    spinner.start();
 
 
     
     geometry_msgs::Twist baseVelocity;
     
     while(ros::ok()) {
+        baseController1.updateState();
         baseVelocity = baseController1.control_loop();
 
 
         baseVelPub.publish(baseVelocity);
-        for(int i=0; i<baseController1.rvizObstacles.size(); i++){
-            markersPub.publish(baseController1.rvizObstacles[i]->marker);
-        }
+        baseController1.rvizObstacles.forEach([&markersPub](const std::string &ns, int id, RvizObstacle* &rvizObstacle){
+            markersPub.publish(rvizObstacle->marker);
+        });
 
-        ros::spinOnce();
         loop_rate.sleep();
     }
 
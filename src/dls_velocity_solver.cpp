@@ -0,0 +1,57 @@
+#include "dls_velocity_solver.h"
+#include <math.h>
+#include <iostream>
+
+// #define DEBUG
+
+DlsVelocitySolver::DlsVelocitySolver(){
+    weights << 1, 1, 1, 0.4, 0.4, 0.4;
+    velocityLimits.setConstant(10);
+    manipulabilityThreshold = 1e-3;
+    maxDamping = 0.05;
+    damping = 0;
+    limitScale = 1;
+}
+
+DlsVelocitySolver::~DlsVelocitySolver(){
+}
+
+bool DlsVelocitySolver::solve(const Jacobian &jacobian, const Twist &twist,
+                              JointVector &jointVelocities){
+    Jacobian weighted = weights.asDiagonal() * jacobian;
+    Eigen::Matrix<double, 6, 6> system;
+    system.noalias() = weighted * weighted.transpose();
+    ldlt.compute(system);
+
+    // The pivots multiply to the square of the manipulability
+    double determinant = ldlt.vectorD().prod();
+    double manipulability = sqrt(determinant > 0 ? determinant : 0);
+    damping = 0;
+    if (manipulability < manipulabilityThreshold) {
+        double closeness = 1 - manipulability / manipulabilityThreshold;
+        damping = maxDamping * maxDamping * closeness * closeness;
+        system.diagonal().array() += damping;
+        ldlt.compute(system);
+    }
+    if (ldlt.info() != Eigen::Success) {
+        jointVelocities.setZero();
+        return false;
+    }
+    Twist weightedTwist = weights.cwiseProduct(twist);
+    jointVelocities.noalias() = weighted.transpose() * ldlt.solve(weightedTwist);
+
+    // One scale for all the joints keeps the direction of the twist
+    limitScale = 1;
+    for (int i = 0; i < N_JOINTS; i++) {
+        double speed = fabs(jointVelocities(i));
+        if (speed * limitScale > velocityLimits(i)) {
+            limitScale = velocityLimits(i) / speed;
+        }
+    }
+    jointVelocities *= limitScale;
+    #ifdef DEBUG
+    std::cout << "[DlsVelocitySolver] manipulability " << manipulability << ", damping "
+              << damping << ", scale " << limitScale << std::endl;
+    #endif
+    return true;
+}
@@ -71,6 +71,12 @@ int main(int argc, char **argv)
     n1.param<double>("/gamma", gamma, 100);
     n1.param<double>("/beta", beta, 20/3.1425);
 
+    // Threads used to evaluate the obstacles, 1 keeps it on this thread
+    int monitorThreads;
+    std::vector<int> monitorCores;
+    n1.param<int>("/monitor_threads", monitorThreads, 1);
+    n1.param<std::vector<int>>("/monitor_cores", monitorCores, std::vector<int>());
+
     std::string model = modelPath;
     Eigen::Matrix4d baseTransform1;
     Eigen::Matrix4d baseTransform2;
@@ -87,17 +93,53 @@ int main(int argc, char **argv)
     std::vector<double> initPose = {0, 0, 0, 0, 0, 0, 0};
     KinovaArm arm1(model, baseTransform1);
     KinovaArm arm2(model, baseTransform2);
-    Monitor monitor1(&arm1);
-    Monitor monitor2(&arm2);
     arm1.updatePose(initPose);
     arm2.updatePose(initPose);
-    monitor1.addObstacle(&arm2);
-    monitor2.addObstacle(&arm1);
+
+    // One world holds both arms and the obstacles, the distances between 
+    // the arms are computed once and each monitor is a view for one arm
+    WorldModel world;
+    Monitor monitor1(&world, world.addArm(&arm1));
+    Monitor monitor2(&world, world.addArm(&arm2));
+    ThreadPool monitorPool(monitorThreads, monitorCores);
+    if (monitorThreads > 1) {
+        world.setThreadPool(&monitorPool);
+    }
 
     // Create the armController class based off the first monitor
     ArmController armController1(&monitor1, K, D, gamma, beta);
     ArmController armController2(&monitor2, K, D, gamma, beta);
 
+    // Speed and separation monitoring scales the commanded joint velocities
+    bool speedAndSeparation;
+    SeparationParameters separation;
+    n1.param<bool>("/ssm_enabled", speedAndSeparation, false);
+    n1.param<double>("/ssm_reaction_time", separation.reactionTime, separation.reactionTime);
+    n1.param<double>("/ssm_deceleration", separation.deceleration, separation.deceleration);
+    n1.param<double>("/ssm_obstacle_speed", separation.obstacleSpeed, separation.obstacleSpeed);
+    n1.param<double>("/ssm_protective_distance", separation.protectiveDistance, separation.protectiveDistance);
+    if (speedAndSeparation) {
+        armController1.enableSpeedAndSeparation(separation);
+        armController2.enableSpeedAndSeparation(separation);
+    }
+
+    // Time allowed for the obstacle distances of a loop, 0 computes all the pairs
+    double monitorBudget;
+    n1.param<double>("/monitor_budget", monitorBudget, 0);
+    armController1.setMonitorBudget(monitorBudget);
+    armController2.setMonitorBudget(monitorBudget);
+
+    // Estimating the joint angles between joint states decouples the control rate from the feedback
+    bool stateEstimation;
+    double maxJointAcceleration, maxExtrapolation;
+    n1.param<bool>("/joint_state_estimation", stateEstimation, false);
+    n1.param<double>("/max_joint_acceleration", maxJointAcceleration, 5.0);
+    n1.param<double>("/max_extrapolation", maxExtrapolation, 0.2);
+    if (stateEstimation) {
+        armController1.enableJointStateEstimation(maxJointAcceleration, maxExtrapolation);
+        armController2.enableJointStateEstimation(maxJointAcceleration, maxExtrapolation);
+    }
+
     // Init ROS listeners for first arm
     ros::Subscriber armSub1 = n1.subscribe(armNameSpace1+jointStatesTopic, 1000, &ArmController::armCallback, &armController1);
     ros::Subscriber goalSub1 = n1.subscribe(armNameSpace1+goalTopic, 1000, &ArmController::goalCallback, &armController1);
@@ -119,11 +161,16 @@ int main(int argc, char **argv)
     ros::Publisher markersPub = n1.advertise<visualization_msgs::Marker>("kinova_controller/markers", 1000);
 
     
-    ros::Rate loop_rate(100); 
+    // Rate of the control loop, the callbacks run on their own thread
+    double controlRate;
+    n1.param<double>("/control_rate", controlRate, 100);
+    ros::Rate loop_rate(controlRate);
+    ros::AsyncSpinner spinner(1);
+    spinner.start();
 
 
     KDL::Twist endeffectorVelocity1;
-    std::vector<double> jointVelocities1;
+    std::vector<double> jointVelocities1(arm1.nJoints, 0.0);
     sensor_msgs::JointState jointStates1;
     for (int i=0; i<arm1.nJoints; i++) {
         jointStates1.position.push_back(0.0);
@@ -131,7 +178,7 @@ int main(int argc, char **argv)
     }
 
     KDL::Twist endeffectorVelocity2;
-    std::vector<double> jointVelocities2;
+    std::vector<double> jointVelocities2(arm2.nJoints, 0.0);
     sensor_msgs::JointState jointStates2;
     for (int i=0; i<arm2.nJoints; i++) {
         jointStates2.position.push_back(0.0);
@@ -140,10 +187,19 @@ int main(int argc, char **argv)
 
 
     while(ros::ok()) {
+        // Move both arms before the world computes the distances
+        armController1.updateState();
+        armController2.updateState();
+        world.update();
+
         endeffectorVelocity1 = armController1.controlLoop();
-        jointVelocities1 = arm1.ikVelocitySolver(endeffectorVelocity1);
+        arm1.ikVelocitySolver(endeffectorVelocity1, jointVelocities1.data(), 
+                              jointVelocities1.size());
+        armController1.scaleJointVelocities(jointVelocities1);
         endeffectorVelocity2 = armController2.controlLoop();
-        jointVelocities2 = arm2.ikVelocitySolver(endeffectorVelocity2);
+        arm2.ikVelocitySolver(endeffectorVelocity2, jointVelocities2.data(), 
+                              jointVelocities2.size());
+        armController2.scaleJointVelocities(jointVelocities2);
 
         for(int i=0; i<arm1.nJoints; i++){
             jointStates1.velocity[i] = jointVelocities1[i];
@@ -161,11 +217,10 @@ int main(int argc, char **argv)
         armPub1.publish(jointStates1);
         armPub2.publish(jointStates2);
 
-        for(int i=0; i<armController1.rvizObstacles.size(); i++){
-            markersPub.publish(armController1.rvizObstacles[i]->marker);
-        }
+        armController1.rvizObstacles.forEach([&markersPub](const std::string &ns, int id, RvizObstacle* &rvizObstacle){
+            markersPub.publish(rvizObstacle->marker);
+        });
 
-        ros::spinOnce();
         loop_rate.sleep();
     }
 
@@ -0,0 +1,109 @@
+// Fits a capsule to the mesh of every link of a URDF and caches them next
+// to it, for KinovaArm to read when it is created.
+//
+// Usage: FitLinkCapsules robot.urdf [package_directory]
+//
+// Mesh paths of the form package://name/path are resolved from the package
+// directory if it is given, and from the ROS package path otherwise.
+#include <iostream>
+#include <string>
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <urdf/model.h>
+#include <ros/package.h>
+#include "capsule_fit.h"
+
+/**
+ * Finds the file of a mesh
+ *
+ * @param filename The mesh filename of the URDF
+ * @param packageDirectory The directory of the packages, empty to use ROS
+ * @return The path of the mesh file
+ */
+std::string resolveMesh(const std::string &filename, const std::string &packageDirectory){
+    const std::string scheme = "package://";
+    if (filename.compare(0, scheme.size(), scheme) == 0) {
+        std::string path = filename.substr(scheme.size());
+        if (!packageDirectory.empty()) {
+            return packageDirectory + "/" + path;
+        }
+        std::string package = path.substr(0, path.find('/'));
+        return ros::package::getPath(package) + path.substr(package.size());
+    }
+    const std::string fileScheme = "file://";
+    if (filename.compare(0, fileScheme.size(), fileScheme) == 0) {
+        return filename.substr(fileScheme.size());
+    }
+    return filename;
+}
+
+int main(int argc, char** argv){
+    if (argc < 2) {
+        std::cout << "Usage: FitLinkCapsules robot.urdf [package_directory]" << std::endl;
+        return 1;
+    }
+    std::string urdfFilename = argv[1];
+    std::string packageDirectory = argc > 2 ? argv[2] : "";
+
+    urdf::Model model;
+    if (!model.initFile(urdfFilename)) {
+        std::cout << "[FitLinkCapsules] cannot read " << urdfFilename << std::endl;
+        return 1;
+    }
+
+    std::vector<LinkCapsule> capsules;
+    std::vector<urdf::LinkSharedPtr> links;
+    model.getLinks(links);
+    for (int l = 0; l < links.size(); l++) {
+        const urdf::Link &link = *links[l];
+
+        // The collision geometry, or the visual one if there is none
+        urdf::Geometry* geometry = NULL;
+        urdf::Pose origin;
+        if (link.collision && link.collision->geometry) {
+            geometry = link.collision->geometry.get();
+            origin = link.collision->origin;
+        } else if (link.visual && link.visual->geometry) {
+            geometry = link.visual->geometry.get();
+            origin = link.visual->origin;
+        }
+        urdf::Mesh* mesh = dynamic_cast<urdf::Mesh*>(geometry);
+        if (mesh == NULL) {
+            std::cout << "[FitLinkCapsules] " << link.name << " has no mesh" << std::endl;
+            continue;
+        }
+
+        std::vector<Eigen::Vector3d> vertices;
+        if (!CapsuleFit::readStl(resolveMesh(mesh->filename, packageDirectory), vertices)) {
+            continue;
+        }
+
+        // The vertices in the frame of the link
+        Eigen::Quaterniond rotation(origin.rotation.w, origin.rotation.x,
+                                    origin.rotation.y, origin.rotation.z);
+        Eigen::Vector3d translation(origin.position.x, origin.position.y,
+                                    origin.position.z);
+        Eigen::Vector3d scale(mesh->scale.x, mesh->scale.y, mesh->scale.z);
+        for (int v = 0; v < vertices.size(); v++) {
+            vertices[v] = rotation * vertices[v].cwiseProduct(scale) + translation;
+        }
+
+        LinkCapsule capsule;
+        capsule.link = link.name;
+        if (!CapsuleFit::fit(vertices, capsule)) {
+            continue;
+        }
+        std::cout << "[FitLinkCapsules] " << link.name << ": radius " << capsule.radius
+                  << ", length " << (capsule.end - capsule.start).norm() << std::endl;
+        capsules.push_back(capsule);
+    }
+
+    std::string cacheFilename = CapsuleFit::cacheFilename(urdfFilename);
+    if (!CapsuleFit::writeCache(cacheFilename, capsules)) {
+        return 1;
+    }
+    std::cout << "[FitLinkCapsules] " << capsules.size() << " capsules written to "
+              << cacheFilename << std::endl;
+    return 0;
+}
@@ -0,0 +1,283 @@
+#include "gen3_arm.h"
+
+// #define DEBUG
+
+constexpr double Gen3Arm::jointOrigins[Gen3Arm::N_LINKS][3];
+constexpr double Gen3Arm::jointRpy[Gen3Arm::N_LINKS][3];
+constexpr double Gen3Arm::linkLengths[Gen3Arm::N_LINKS];
+constexpr double Gen3Arm::linkRadii[Gen3Arm::N_LINKS];
+constexpr double Gen3Arm::jointVelocityLimits[Gen3Arm::N_JOINTS];
+
+Gen3Arm::Gen3Arm(){
+    this->baseTransform = Eigen::Matrix4d::Identity();
+    initialise();
+}
+
+Gen3Arm::Gen3Arm(Eigen::Matrix4d inputBaseTransform){
+    this->baseTransform = inputBaseTransform;
+    initialise();
+}
+
+Gen3Arm::Gen3Arm(const Gen3Arm &arm){
+    this->baseTransform = arm.baseTransform;
+    this->nJoints = arm.nJoints;
+    this->nLinks = arm.nLinks;
+    this->nFrames = arm.nFrames;
+    this->positions = arm.positions;
+    this->kinematicState = arm.kinematicState;
+    this->dlsSolver = arm.dlsSolver;
+    for(int k = 0; k < N_LINKS; k++)
+    {
+        jointRotations[k] = arm.jointRotations[k];
+    }
+    for(int k = 0; k < N_FRAMES; k++)
+    {
+        frames[k] = arm.frames[k];
+    }
+
+    // The links are owned by each arm
+    for(int linkNum = 0; linkNum < arm.links.size(); linkNum++)
+    {
+        links.push_back(new Capsule(static_cast<Capsule*>(arm.links[linkNum])));
+    }
+}
+
+Gen3Arm::~Gen3Arm(){
+    for(int i=0; i < links.size(); i++){
+        delete(links[i]);
+    }
+}
+
+void Gen3Arm::initialise(){
+    nJoints = N_JOINTS;
+    nLinks = N_LINKS;
+    nFrames = N_FRAMES;
+
+    // Rotations of the joints, R = Rz(yaw) Ry(pitch) Rx(roll) as in the URDF
+    for(int k = 0; k < N_LINKS; k++)
+    {
+        jointRotations[k] =
+            (Eigen::AngleAxisd(jointRpy[k][2], Eigen::Vector3d::UnitZ()) *
+             Eigen::AngleAxisd(jointRpy[k][1], Eigen::Vector3d::UnitY()) *
+             Eigen::AngleAxisd(jointRpy[k][0], Eigen::Vector3d::UnitX())).toRotationMatrix();
+    }
+
+    kinematicState.resize(N_JOINTS, N_FRAMES);
+    for(int i = 0; i < N_JOINTS; i++)
+    {
+        dlsSolver.velocityLimits(i) = jointVelocityLimits[i];
+    }
+
+    // Start with all the joints at 90 degrees
+    positions.setConstant(M_PI_2);
+    updatePose(positions);
+
+    for(int linkNum = 0; linkNum < N_LINKS; linkNum++)
+    {
+        Eigen::Matrix4d pose = linkPose(frames[linkNum].translation(),
+                                        frames[linkNum+1].translation());
+        links.push_back(new Capsule(pose, linkLengths[linkNum], linkRadii[linkNum]));
+    }
+    #ifdef DEBUG
+    std::cout << "[Gen3Arm] links: " << links.size() << std::endl;
+    #endif
+}
+
+bool Gen3Arm::updatePose(const std::vector<double> &jointPositions){
+    return updatePose(jointPositions.data(), jointPositions.size());
+}
+
+bool Gen3Arm::updatePose(const double* jointPositions, int nPositions){
+    if(nPositions < N_JOINTS){
+        std::cout << "Error: expected " << N_JOINTS << " joint positions" << std::endl;
+        return false;
+    }
+    JointVector fixedPositions;
+    for(int i = 0; i < N_JOINTS; i++)
+    {
+        fixedPositions(i) = jointPositions[i];
+    }
+    updatePose(fixedPositions);
+    return true;
+}
+
+void Gen3Arm::updatePose(const JointVector &jointPositions){
+    positions = jointPositions;
+    kinematicState.setJointPositions(jointPositions.data());
+
+    // Each joint is a fixed transform then a turn about its z axis, the
+    // state is in the arm base frame and the frames in the world
+    Eigen::Isometry3d base(baseTransform);
+    Eigen::Matrix3d rotation = Eigen::Matrix3d::Identity();
+    Eigen::Vector3d position = Eigen::Vector3d::Zero();
+    kinematicState.frames[0].setIdentity();
+    frames[0] = base;
+    for(int k = 0; k < N_LINKS; k++)
+    {
+        position += rotation * Eigen::Map<const Eigen::Vector3d>(jointOrigins[k]);
+        rotation = rotation * jointRotations[k];
+        if(k < N_JOINTS)
+        {
+            double c = std::cos(jointPositions(k));
+            double s = std::sin(jointPositions(k));
+            Eigen::Vector3d x = rotation.col(0);
+            rotation.col(0) = c * x + s * rotation.col(1);
+            rotation.col(1) = c * rotation.col(1) - s * x;
+        }
+        Eigen::Matrix4d &pose = kinematicState.frames[k+1];
+        pose.setIdentity();
+        pose.block<3, 3>(0, 0) = rotation;
+        pose.block<3, 1>(0, 3) = position;
+        frames[k+1] = base * Eigen::Isometry3d(pose);
+    }
+
+    // Joint i turns about the z axis of frame i+1, the frames before it
+    // do not depend on it
+    for(int frameNum = 0; frameNum < N_FRAMES; frameNum++)
+    {
+        Eigen::MatrixXd &jacobian = kinematicState.jacobians[frameNum];
+        jacobian.setZero();
+        Eigen::Vector3d origin = kinematicState.frames[frameNum].block<3, 1>(0, 3);
+        for(int i = 0; i < N_JOINTS && i + 1 <= frameNum; i++)
+        {
+            const Eigen::Matrix4d &joint = kinematicState.frames[i+1];
+            Eigen::Vector3d axis = joint.block<3, 1>(0, 2);
+            jacobian.block<3, 1>(0, i) = axis.cross(origin - joint.block<3, 1>(0, 3));
+            jacobian.block<3, 1>(3, i) = axis;
+        }
+    }
+
+    // Only the links that are created are moved, the constructor creates
+    // them after the first update
+    for(int linkNum = 0; linkNum < links.size(); linkNum++)
+    {
+        links[linkNum]->setPose(linkPose(frames[linkNum].translation(),
+                                         frames[linkNum+1].translation()));
+    }
+}
+
+Eigen::Matrix4d Gen3Arm::getPose(void){
+    return frames[N_FRAMES-1].matrix();
+}
+
+Eigen::Matrix4d Gen3Arm::getPose(int frameNumber){
+    if(frameNumber >= N_FRAMES || frameNumber < 0){
+        std::cout << "Access joint number larger than array in getPose.\n"<<
+                     "Returning endeffector Pose"<<std::endl;
+        return frames[N_FRAMES-1].matrix();
+    }
+    return frames[frameNumber].matrix();
+}
+
+void Gen3Arm::jacobian(int frameNumber, Jacobian &jacobian){
+    jacobian.setZero();
+    Eigen::Vector3d point = frames[frameNumber].translation();
+
+    // Joint i turns about the z axis of frame i+1, through its origin
+    for(int i = 0; i < N_JOINTS && i + 1 <= frameNumber; i++)
+    {
+        Eigen::Vector3d axis = frames[i+1].linear().col(2);
+        jacobian.block<3, 1>(0, i) = axis.cross(point - frames[i+1].translation());
+        jacobian.block<3, 1>(3, i) = axis;
+    }
+}
+
+bool Gen3Arm::linkVelocities(const std::vector<double> &jointVelocities,
+                             std::vector<Eigen::Vector3d> &linear,
+                             std::vector<Eigen::Vector3d> &angular){
+    if(jointVelocities.size() != N_JOINTS){
+        std::cout << "Error: expected " << N_JOINTS << " joint velocities" << std::endl;
+        return false;
+    }
+    JointVector velocities;
+    for(int i = 0; i < N_JOINTS; i++)
+    {
+        velocities(i) = jointVelocities[i];
+    }
+
+    linear.resize(N_LINKS);
+    angular.resize(N_LINKS);
+    Jacobian frameJacobian;
+    for(int linkNum = 0; linkNum < N_LINKS; linkNum++)
+    {
+        // The link moves with the start frame, the joint at its end does
+        // not move it
+        jacobian(linkNum, frameJacobian);
+        Eigen::Matrix<double, 6, 1> twist = frameJacobian * velocities;
+        linear[linkNum] = twist.head(3);
+        angular[linkNum] = twist.tail(3);
+    }
+    return true;
+}
+
+bool Gen3Arm::ikVelocitySolver(const Eigen::Matrix<double, 6, 1> &twist,
+                               double* jointVelocities, int nVelocities){
+    if(nVelocities < N_JOINTS){
+        std::cout << "Error: expected space for " << N_JOINTS << " joint velocities"
+                  << std::endl;
+        return false;
+    }
+    DlsVelocitySolver::Jacobian jacobian = kinematicState.jacobians.back();
+    DlsVelocitySolver::JointVector velocities;
+    bool solved = dlsSolver.solve(jacobian, twist, velocities);
+    for(int i = 0; i < N_JOINTS; i++)
+    {
+        jointVelocities[i] = velocities(i);
+    }
+    return solved;
+}
+
+const KinematicState* Gen3Arm::getKinematicState(){
+    return &kinematicState;
+}
+
+Arm* Gen3Arm::clone(){
+    return new Gen3Arm(*this);
+}
+
+bool Gen3Arm::getChainModel(ChainModel &model){
+    model.baseTransform = baseTransform;
+    model.segments.resize(N_LINKS);
+    for(int k = 0; k < N_LINKS; k++)
+    {
+        ChainModel::Segment &segment = model.segments[k];
+        Eigen::Vector3d origin = Eigen::Map<const Eigen::Vector3d>(jointOrigins[k]);
+
+        // The joint turns about the z axis of the joint frame
+        segment.revolute = k < N_JOINTS;
+        segment.axis = segment.revolute ?
+            Eigen::Vector3d(jointRotations[k].col(2)) : Eigen::Vector3d::Zero();
+        segment.axisPoint = origin;
+        segment.tip = Eigen::Matrix4d::Identity();
+        segment.tip.block<3, 3>(0, 0) = jointRotations[k];
+        segment.tip.block<3, 1>(0, 3) = origin;
+
+        segment.linkStart.setZero();
+        segment.linkEnd = linkLengths[k] * origin.normalized();
+        segment.linkRadius = linkRadii[k];
+    }
+    return true;
+}
+
+Eigen::Matrix4d Gen3Arm::linkPose(const Eigen::Vector3d &basePoint,
+                                  const Eigen::Vector3d &endPoint){
+    Eigen::Matrix4d pose = Eigen::Matrix4d::Zero();
+    pose(3, 3) = 1;
+
+    // A 0 matrix if the frames are at the same point, as in KinovaArm
+    Eigen::Vector3d midLine = endPoint - basePoint;
+    if(midLine.norm() > 0.0001)
+    {
+        midLine.normalize();
+        pose(0, 0) = 1;
+        pose(1, 1) = 1;
+        pose(2, 2) = 1;
+        if(midLine(2) != 0)
+        {
+            pose(1, 1) = 1/midLine(2);
+            pose.block<3, 1>(0, 2) = midLine;
+        }
+        pose.block<3, 1>(0, 3) = basePoint;
+    }
+    return pose;
+}
@@ -5,6 +5,7 @@
 #include <string>
 #include <kdl/chain.hpp>
 #include "kinova_arm.h"
+#include "gen3_arm.h"
 #include "primitives.h"
 #include "ros/ros.h"
 #include "std_msgs/Float64.h"
@@ -12,6 +13,7 @@
 #include "sensor_msgs/JointState.h"
 #include "visualization_msgs/Marker.h"
 #include "arm.h"
+#include "whole_body_model.h"
 
 
 int main(int argc, char **argv)
@@ -41,68 +43,160 @@ int main(int argc, char **argv)
     n.param<double>("/gamma", gamma, 100);
     n.param<double>("/beta", beta, 20/3.1425);
 
+    // Threads used to evaluate the obstacles, 1 keeps it on this thread
+    int monitorThreads;
+    std::vector<int> monitorCores;
+    n.param<int>("/monitor_threads", monitorThreads, 1);
+    n.param<std::vector<int>>("/monitor_cores", monitorCores, std::vector<int>());
+
+
+    // The Gen3 can use its closed form kinematics instead of the URDF chain
+    std::string armType;
+    n.param<std::string>(ros::this_node::getName()+"/arm_type", armType, "urdf");
 
     std::string model = modelPath;
-    KinovaArm arm1(model);
-    Monitor monitor1(&arm1);
+    Arm* arm1;
+    if (armType == "gen3") {
+        arm1 = new Gen3Arm();
+    } else {
+        if (armType != "urdf") {
+            ROS_WARN("Unknown arm_type %s, using the URDF model", armType.c_str());
+        }
+        arm1 = new KinovaArm(model);
+    }
+    // An arm on a mobile base is monitored with its base as one body, the
+    // base follows the odometry
+    bool mobileBase;
+    std::vector<double> armMount;
+    n.param<bool>(ros::this_node::getName()+"/mobile_base", mobileBase, false);
+    n.param<std::vector<double>>(ros::this_node::getName()+"/arm_mount", armMount, 
+                                 std::vector<double>({0, 0, 0.3}));
+    NarkinBase* base1 = NULL;
+    WholeBodyModel* body1 = NULL;
+    Monitor* monitor1;
+    if (mobileBase) {
+        if (armMount.size() != 3) {
+            ROS_WARN("arm_mount must be x, y and z, the arm is mounted at the base origin");
+            armMount.assign(3, 0.0);
+        }
+        Eigen::Matrix4d mount = Eigen::Matrix4d::Identity();
+        mount.block<3, 1>(0, 3) << armMount[0], armMount[1], armMount[2];
+        base1 = new NarkinBase(Eigen::Vector3d(0, 0, 0.15));
+        body1 = new WholeBodyModel(arm1, base1, mount);
+        monitor1 = new Monitor(body1);
+    } else {
+        monitor1 = new Monitor(arm1);
+    }
+    ThreadPool monitorPool(monitorThreads, monitorCores);
+    if (monitorThreads > 1) {
+        monitor1->setThreadPool(&monitorPool);
+    }
     std::vector<double> initPose = {0, 0, 0, 0, 0, 0, 0};
-    arm1.updatePose(initPose);
+    arm1->updatePose(initPose);
 
     // Create the armController class based off the first monitor
-    ArmController armController1(&monitor1, K, D, gamma, beta);
+    ArmController armController1(monitor1, K, D, gamma, beta);
+
+    // Speed and separation monitoring scales the commanded joint velocities
+    bool speedAndSeparation;
+    SeparationParameters separation;
+    n.param<bool>("/ssm_enabled", speedAndSeparation, false);
+    n.param<double>("/ssm_reaction_time", separation.reactionTime, separation.reactionTime);
+    n.param<double>("/ssm_deceleration", separation.deceleration, separation.deceleration);
+    n.param<double>("/ssm_obstacle_speed", separation.obstacleSpeed, separation.obstacleSpeed);
+    n.param<double>("/ssm_protective_distance", separation.protectiveDistance, separation.protectiveDistance);
+    if (speedAndSeparation) {
+        armController1.enableSpeedAndSeparation(separation);
+    }
+
+    // Time allowed for the obstacle distances of a loop, 0 computes all the pairs
+    double monitorBudget;
+    n.param<double>("/monitor_budget", monitorBudget, 0);
+    armController1.setMonitorBudget(monitorBudget);
+
+    // Estimating the joint angles between joint states decouples the control rate from the feedback
+    bool stateEstimation;
+    double maxJointAcceleration, maxExtrapolation;
+    n.param<bool>("/joint_state_estimation", stateEstimation, false);
+    n.param<double>("/max_joint_acceleration", maxJointAcceleration, 5.0);
+    n.param<double>("/max_extrapolation", maxExtrapolation, 0.2);
+    if (stateEstimation) {
+        armController1.enableJointStateEstimation(maxJointAcceleration, maxExtrapolation);
+    }
 
     // Init ROS listener
     ros::Subscriber armSub = n.subscribe(jointStatesTopic, 1000, &ArmController::armCallback, &armController1);
     ros::Subscriber goalSub = n.subscribe(goalTopic, 1000, &ArmController::goalCallback, &armController1);
     ros::Subscriber obstacleSub = n.subscribe("kinova_controller/obstacles", 1000, &ArmController::updateObstacles, &armController1);
-    ros::Subscriber baseobstacleSub = n.subscribe("Narko_base_marker", 1000, &ArmController::updateObstacles, &armController1);
+    ros::Subscriber baseobstacleSub, odomSub;
+    if (mobileBase) {
+        odomSub = n.subscribe("/odom", 1000, &ArmController::odomCallback, &armController1);
+    } else {
+        // Without its own base the arm avoids the base as an obstacle
+        baseobstacleSub = n.subscribe("Narko_base_marker", 1000, &ArmController::updateObstacles, &armController1);
+    }
 
 
     ros::Publisher armPub = n.advertise<sensor_msgs::JointState>(jointVelocityTopic, 1000);
     ros::Publisher markersPub = n.advertise<visualization_msgs::Marker>("kinova_controller/markers", 1000);
 
     
-    ros::Rate loop_rate(10); 
+    // Rate of the control loop, the callbacks run on their own thread
+    double controlRate;
+    n.param<double>("/control_rate", controlRate, 10);
+    ros::Rate loop_rate(controlRate);
+    ros::AsyncSpinner spinner(1);
+    spinner.start();
 
 
     KDL::Twist endeffectorVelocity;
-    std::vector<double> jointVelocities;
+    Eigen::Matrix<double, 6, 1> endeffectorTwist;
+    std::vector<double> jointVelocities(arm1->nJoints, 0.0);
     sensor_msgs::JointState jointStates;
-    for (int i=0; i<arm1.nJoints; i++) {
+    for (int i=0; i<arm1->nJoints; i++) {
         jointStates.position.push_back(0.0);
         jointStates.velocity.push_back(0.0);
     }
 
 
     while(ros::ok()) {
+        armController1.updateState();
         endeffectorVelocity = armController1.controlLoop();
-        jointVelocities = arm1.ikVelocitySolver(endeffectorVelocity);
+        for (int i=0; i<6; i++) {
+            endeffectorTwist(i) = endeffectorVelocity(i);
+        }
+        arm1->ikVelocitySolver(endeffectorTwist, jointVelocities.data(), jointVelocities.size());
+        armController1.scaleJointVelocities(jointVelocities);
 
         #ifdef DEBUG
         std::cout << "end vel: "<<endeffectorVelocity <<std::endl;
         std::cout << "joint Vels: ";
         #endif //DEBUG
 
-        for(int i=0; i<arm1.nJoints; i++){
+        const KinematicState* state = arm1->getKinematicState();
+        for(int i=0; i<arm1->nJoints; i++){
             #ifdef DEBUG
                 std::cout << jointVelocities[i] << " ";
             #endif // DEBUG
             jointStates.velocity[i] = jointVelocities[i];
-            jointStates.position[i] = arm1.jointArray(i);
+            jointStates.position[i] = state->jointPositions(i);
         }
 
         #ifdef DEBUG
             std::cout<< std::endl;
-            std::cout<< arm1.getPose() << std::endl;
+            std::cout<< arm1->getPose() << std::endl;
         #endif //DEBUG
         armPub.publish(jointStates);
-        for(int i=0; i<armController1.rvizObstacles.size(); i++){
-            markersPub.publish(armController1.rvizObstacles[i]->marker);
-        }
+        armController1.rvizObstacles.forEach([&markersPub](const std::string &ns, int id, RvizObstacle* &rvizObstacle){
+            markersPub.publish(rvizObstacle->marker);
+        });
 
-        ros::spinOnce();
         loop_rate.sleep();
     }
 
+    delete monitor1;
+    delete body1;
+    delete base1;
+    delete arm1;
     return 0;
 }
\ No newline at end of file
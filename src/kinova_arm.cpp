@@ -3,28 +3,80 @@
 
 // #define DEBUG
 
+constexpr double KinovaArm::defaultLengths[KinovaArm::N_DEFAULT_LINKS];
+constexpr double KinovaArm::defaultRadii[KinovaArm::N_DEFAULT_LINKS];
 
 KinovaArm::KinovaArm(std::string urdf_filename){
 
-    // ------------- import and initialise the KDL model --------------- //
-    /// This is used to import the URDF file
-    KDL::Tree armTree;
+    this->baseTransform << 1, 0, 0, 0,
+                           0, 1, 0, 0,
+                           0, 0, 1, 0,
+                           0, 0, 0, 1;
+    initialise(urdf_filename);
+}
 
-    // Import the tree from urdf
-    if (!kdl_parser::treeFromFile(urdf_filename, armTree)){
-        std::cout << "[KinovaArm] Failed to construct kdl tree" << std::endl;
+NarkinBase::NarkinBase(Eigen::Vector3d inputBaseTransform){
+    this->baseTransform = inputBaseTransform;
+
+    // The destructor deletes the frame, none is used yet
+    this->localPose = NULL;
+    Eigen::Vector3d pose = inputBaseTransform;
+    double x= 0.66;
+    double y= 0.60;
+    double z= 0.30;
+    
+    // ======================= need to import pose of narkin base from urdf model          
+    //Eigen::Matrix4d pose = linkFramesToPose(*localPoses[linkNum], *localPoses[linkNum+1]);
+    Box3* base = new Box3(pose, x, y, z);
+    this->base_primitive =base;
+
+
+}
+KinovaArm::KinovaArm(std::string urdf_filename, Eigen::Matrix4d inputBaseTransform){
+
+    this->baseTransform = inputBaseTransform;
+    initialise(urdf_filename);
+}
+
+void KinovaArm::initialise(std::string urdf_filename){
+
+    // ------------- import and initialise the KDL model --------------- //
+    // The cache of the model is only used if it was built from this URDF
+    // and these fitted capsules, otherwise it is rebuilt
+    ModelCache model;
+    uint64_t hash = ModelCache::hashSources(urdf_filename, modelDefaults());
+    std::string cacheFilename = ModelCache::cacheFilename(urdf_filename);
+    if (model.read(cacheFilename, hash)){
+        fkChain = model.chain;
+        nJoints = fkChain.getNrOfJoints();
+        nLinks = fkChain.getNrOfSegments();
+        lengths = model.lengths;
+        radii = model.radii;
+        velocityLimits = model.velocityLimits;
+        fittedLinks = model.fittedLinks;
+        linkStarts = model.linkStarts;
+        linkEnds = model.linkEnds;
+        allowedCollisions = model.allowedCollisions;
+    }
+    else if (parseModel(urdf_filename)){
+        model.chain = fkChain;
+        model.lengths = lengths;
+        model.radii = radii;
+        model.velocityLimits = velocityLimits;
+        model.fittedLinks = fittedLinks;
+        model.linkStarts = linkStarts;
+        model.linkEnds = linkEnds;
+        model.allowedCollisions = allowedCollisions;
+        if (!model.write(cacheFilename, hash)){
+            std::cout << "[KinovaArm] Failed to cache the model of " << urdf_filename 
+                      << std::endl;
+        }
     }
-    // Convert the tree to a chain and get the number of joints
-    armTree.getChain("base_link", "EndEffector_Link", fkChain);
-    nJoints = fkChain.getNrOfJoints();
-    nLinks = fkChain.getNrOfSegments();
     nFrames = nLinks+1;
 
-    // init frames for all the joints
-    for(int i = 0; i < nFrames; i++)
-    {
-        localPoses.push_back(new KDL::Frame());
-    }
+    // init frames for all the joints, stored contiguously
+    localPoses.resize(nFrames);
+    framePositions.resize(nFrames);
     #ifdef DEBUG
         std::cout << "\nnum_joints: " << nJoints << " " << localPoses.size() << std::endl;
         std::cout << "fkChain.getNrOfSegments(): " << fkChain.getNrOfSegments() << std::endl;
@@ -34,10 +86,16 @@ KinovaArm::KinovaArm(std::string urdf_filename){
         }
     #endif //DEBUG
 
+    // Mathematical constants, declared in constructor for speed
+    this->origin << 0, 0, 0, 1;
+    this->directionVect << 0, 0, 1;
+    this->i3 << 1, 0, 0,
+                0, 1, 0,
+                0, 0, 1;
+
     // ---------------- initialise the arm to init point ------------- //
 
-    // initailise the chain solver and the joint array
-    KDL::ChainFkSolverPos_recursive fksolver = KDL::ChainFkSolverPos_recursive(fkChain);
+    // initailise the joint array
     jointArray = KDL::JntArray(nJoints);
     jointVels = KDL::JntArray(nJoints);
 
@@ -48,123 +106,249 @@ KinovaArm::KinovaArm(std::string urdf_filename){
         jointVels(i) = 0.0;
     }
 
-    // solve for the frame at the "link" of the chain for the given joint positions
-    for(int frameNum = 0; frameNum < nFrames; frameNum++)
-    {
-        fksolver.JntToCart(jointArray, *localPoses[frameNum], frameNum);
-    }
-
-    // pass in the parameters for the link cylinder models
-    radii.assign({0.04, 0.04, 0.04, 0.04, 0.04, 0.04, 0.04, 0.04});
-    lengths.assign({0.15643, 0.12838, 0.21038, 0.21038, 0.20843, 0.10593, 0.10593, 0.061525});
+    // solve for the frames of the chain for the given joint positions
+    kinematicState.resize(nJoints, nFrames);
+    createSolvers();
+    forwardKinematics();
+    placeFrames();
 
     // Create the new link objects in default position and 
     // add them to the links vector
     for(int linkNum = 0; linkNum < nLinks; linkNum++)
     {
-        Eigen::Matrix4d pose = linkFramesToPose(*localPoses[linkNum], *localPoses[linkNum+1]);
-        Capsule* link = new Capsule(pose, lengths[linkNum], radii[linkNum]);
+        Capsule* link = new Capsule(linkPose(linkNum), lengths[linkNum], radii[linkNum]);
         links.push_back(link);
     }
     #ifdef DEBUG
     std::cout << "links.size(): " << links.size() << std::endl;
     #endif
-    // Mathematical constants, declared in constructor for speed
-    this->baseTransform << 1, 0, 0, 0,
-                           0, 1, 0, 0,
-                           0, 0, 1, 0,
-                           0, 0, 0, 1;
-    this->origin << 0, 0, 0, 1;
-    this->directionVect << 0, 0, 1;
-    this->i3 << 1, 0, 0,
-                0, 1, 0,
-                0, 0, 1;
 }
 
-NarkinBase::NarkinBase(Eigen::Vector3d inputBaseTransform){
-    this->baseTransform = inputBaseTransform;
-
-    // localPose =new KDL::Frame();
-    Eigen::Vector3d pose = inputBaseTransform;
-    double x= 0.66;
-    double y= 0.60;
-    double z= 0.30;
-    
-    // ======================= need to import pose of narkin base from urdf model          
-    //Eigen::Matrix4d pose = linkFramesToPose(*localPoses[linkNum], *localPoses[linkNum+1]);
-    Box3* base = new Box3(pose, x, y, z);
-    this->base_primitive =base;
-
-
+std::vector<double> KinovaArm::modelDefaults(){
+    std::vector<double> defaults(defaultLengths, defaultLengths + N_DEFAULT_LINKS);
+    defaults.insert(defaults.end(), defaultRadii, defaultRadii + N_DEFAULT_LINKS);
+    defaults.push_back(ALLOWED_NEIGHBOURS);
+    return defaults;
 }
-KinovaArm::KinovaArm(std::string urdf_filename, Eigen::Matrix4d inputBaseTransform){
 
-    // ------------- import and initialise the KDL model --------------- //
+bool KinovaArm::parseModel(std::string urdf_filename){
     /// This is used to import the URDF file
     KDL::Tree armTree;
 
-    this->baseTransform = inputBaseTransform;
-
     // Import the tree from urdf
     if (!kdl_parser::treeFromFile(urdf_filename, armTree)){
         std::cout << "[KinovaArm] Failed to construct kdl tree" << std::endl;
     }
     // Convert the tree to a chain and get the number of joints
-    armTree.getChain("base_link", "EndEffector_Link", fkChain);
+    bool parsed = armTree.getChain("base_link", "EndEffector_Link", fkChain);
     nJoints = fkChain.getNrOfJoints();
     nLinks = fkChain.getNrOfSegments();
-    nFrames = nLinks+1;
 
-    // init frames for all the joints
-    for(int i = 0; i < nFrames; i++)
+    // pass in the parameters for the link cylinder models, the fitted 
+    // capsules of the cache replace them
+    radii.assign(defaultRadii, defaultRadii + N_DEFAULT_LINKS);
+    lengths.assign(defaultLengths, defaultLengths + N_DEFAULT_LINKS);
+    loadLinkCapsules(CapsuleFit::cacheFilename(urdf_filename));
+
+    // The velocity limits of the joints are not kept by kdl_parser
+    velocityLimits.assign(nLinks, 0.0);
+    auto robot = urdf::parseURDFFile(urdf_filename);
+    for(int segmentNum = 0; robot && segmentNum < nLinks; segmentNum++)
     {
-        localPoses.push_back(new KDL::Frame());
+        auto joint = robot->getJoint(fkChain.getSegment(segmentNum).getJoint().getName());
+        if(joint && joint->limits)
+        {
+            velocityLimits[segmentNum] = joint->limits->velocity;
+        }
     }
-    #ifdef DEBUG
-        std::cout << "[KinovaArm] num_joints: " << nJoints << " " << localPoses.size() << std::endl;
-    #endif //DEBUG
 
-    // ---------------- initialise the arm to init point ------------- //
+    // A link touches the links before and after it at their joints
+    allowedCollisions.assign(nLinks * nLinks, false);
+    for(int first = 0; first < nLinks; first++)
+    {
+        for(int second = 0; second < nLinks; second++)
+        {
+            allowedCollisions[first * nLinks + second] = 
+                std::abs(first - second) <= ALLOWED_NEIGHBOURS;
+        }
+    }
+    return parsed;
+}
 
-    // initailise the chain solver and the joint array
-    KDL::ChainFkSolverPos_recursive fksolver = KDL::ChainFkSolverPos_recursive(fkChain);
-    jointArray = KDL::JntArray(nJoints);
-    jointVels = KDL::JntArray(nJoints);
+void KinovaArm::loadLinkCapsules(std::string cacheFilename){
+    fittedLinks.assign(nLinks, false);
+    linkStarts.assign(nLinks, Eigen::Vector3d::Zero());
+    linkEnds.assign(nLinks, Eigen::Vector3d::Zero());
 
-    // pass the joint angles from function input into the joint array
-    for(int i=0; i<nJoints; i++)
+    std::vector<LinkCapsule> capsules;
+    if(!CapsuleFit::readCache(cacheFilename, capsules))
     {
-        jointArray(i) = M_PI_2;
-        jointVels(i) = 0.0;
+        return;
     }
 
-    // solve for the frame at the "link" of the chain for the given joint positions
-    for(int frameNum = 0; frameNum < nFrames; frameNum++)
+    // Link k is rigid in frame k, the frame of the child of segment k-1
+    for(int linkNum = 0; linkNum < nLinks; linkNum++)
+    {
+        std::string name = linkNum == 0 ? "base_link" : 
+                           fkChain.getSegment(linkNum - 1).getName();
+        for(int c = 0; c < capsules.size(); c++)
+        {
+            if(capsules[c].link != name)
+            {
+                continue;
+            }
+            fittedLinks[linkNum] = true;
+            linkStarts[linkNum] = capsules[c].start;
+            linkEnds[linkNum] = capsules[c].end;
+            lengths[linkNum] = (capsules[c].end - capsules[c].start).norm();
+            radii[linkNum] = capsules[c].radius;
+        }
+        #ifdef DEBUG
+        std::cout << "[KinovaArm] link " << name << " fitted: " << fittedLinks[linkNum] 
+                  << std::endl;
+        #endif
+    }
+}
+
+KinovaArm::KinovaArm(const KinovaArm &arm){
+    this->baseTransform = arm.baseTransform;
+    this->nJoints = arm.nJoints;
+    this->nLinks = arm.nLinks;
+    this->nFrames = arm.nFrames;
+    this->fkChain = arm.fkChain;
+    this->jointArray = arm.jointArray;
+    this->jointVels = arm.jointVels;
+    this->lengths = arm.lengths;
+    this->radii = arm.radii;
+    this->velocityLimits = arm.velocityLimits;
+    this->origin = arm.origin;
+    this->directionVect = arm.directionVect;
+    this->i3 = arm.i3;
+
+    this->localPoses = arm.localPoses;
+    this->framePositions = arm.framePositions;
+    this->kinematicState = arm.kinematicState;
+    this->placedBaseTransform = arm.placedBaseTransform;
+    this->fittedLinks = arm.fittedLinks;
+    this->linkStarts = arm.linkStarts;
+    this->linkEnds = arm.linkEnds;
+    this->allowedCollisions = arm.allowedCollisions;
+
+    // The links are owned by each arm
+    for(int linkNum = 0; linkNum < arm.links.size(); linkNum++)
     {
-        fksolver.JntToCart(jointArray, *localPoses[frameNum], frameNum);
+        links.push_back(new Capsule(static_cast<Capsule*>(arm.links[linkNum])));
     }
+    createSolvers();
+}
 
-    // pass in the parameters for the link cylinder models
-    radii.assign({0.04, 0.04, 0.04, 0.04, 0.04, 0.04, 0.04, 0.04});
-    lengths.assign({0.15643, 0.12838, 0.21038, 0.21038, 0.20843, 0.10593, 0.10593, 0.061525});
+void KinovaArm::createSolvers(){
+    jointAxes.resize(nJoints);
+    jointPoints.resize(nJoints);
+    velocityBuffer = Eigen::VectorXd::Zero(nJoints);
+    weightedJacobian = Eigen::MatrixXd::Zero(6, nJoints);
+    ikSvd = Eigen::JacobiSVD<Eigen::MatrixXd>(6, nJoints, Eigen::ComputeFullU | Eigen::ComputeFullV);
+    weightedTwist = Eigen::VectorXd::Zero(6);
+    projectedTwist = Eigen::VectorXd::Zero(6);
+
+    // Set the weights for singularity handling
+    ikWeights.resize(6, 6);
+    ikWeights.setIdentity();
+    ikWeights(0, 0) = 1;
+    ikWeights(1, 1) = 1;
+    ikWeights(2, 2) = 1;
+    ikWeights(3, 3) = 0.4;
+    ikWeights(4, 4) = 0.4;
+    ikWeights(5, 5) = 0.4;
+
+    // The limits of the URDF, MAX_JOINT_VEL for the joints without one
+    jointVelocityLimits = Eigen::VectorXd::Constant(nJoints, MAX_JOINT_VEL);
+    int joint = 0;
+    for(int segmentNum = 0; segmentNum < nLinks; segmentNum++)
+    {
+        if(fkChain.getSegment(segmentNum).getJoint().getType() == KDL::Joint::None)
+        {
+            continue;
+        }
+        if(velocityLimits[segmentNum] > 0)
+        {
+            jointVelocityLimits(joint) = velocityLimits[segmentNum];
+        }
+        joint++;
+    }
+    if(nJoints == DlsVelocitySolver::N_JOINTS)
+    {
+        dlsSolver.weights = ikWeights.diagonal();
+        dlsSolver.velocityLimits = jointVelocityLimits;
+    }
+}
+
+Arm* KinovaArm::clone(){
+    return new KinovaArm(*this);
+}
+
+bool KinovaArm::getChainModel(ChainModel &model){
+    model.baseTransform = baseTransform;
+    model.segments.resize(nLinks);
 
-    // Create the new link objects in default position and 
-    // add them to the links vector
     for(int linkNum = 0; linkNum < nLinks; linkNum++)
     {
-        Eigen::Matrix4d pose = linkFramesToPose(*localPoses[linkNum], *localPoses[linkNum+1]);
-        Capsule* link = new Capsule(pose, lengths[linkNum], radii[linkNum]);
-        links.push_back(link);
+        const KDL::Segment &segment = fkChain.getSegment(linkNum);
+        const KDL::Joint &joint = segment.getJoint();
+        ChainModel::Segment &modelSegment = model.segments[linkNum];
+
+        switch(joint.getType())
+        {
+            case KDL::Joint::None:
+                modelSegment.revolute = false;
+                break;
+            case KDL::Joint::RotAxis:
+            case KDL::Joint::RotX:
+            case KDL::Joint::RotY:
+            case KDL::Joint::RotZ:
+                modelSegment.revolute = true;
+                break;
+            default:
+                std::cout << "[KinovaArm] joint " << joint.getName() 
+                          << " is not revolute" << std::endl;
+                return false;
+        }
+
+        // The segment turns about the joint axis, then moves to its tip
+        KDL::Vector axis = joint.JointAxis();
+        KDL::Vector point = joint.JointOrigin();
+        modelSegment.axis << axis.x(), axis.y(), axis.z();
+        if(modelSegment.revolute)
+        {
+            modelSegment.axis.normalize();
+        }
+        modelSegment.axisPoint << point.x(), point.y(), point.z();
+        KDL::Frame tip = segment.pose(0);
+        for(int i=0; i < 4; i++)
+        {
+            for(int j=0; j < 4; j++)
+            {
+                modelSegment.tip(i, j) = tip(i, j);
+            }
+        }
+
+        // The link goes from the frame towards the next frame, which the
+        // joint does not move as its axis goes through it, unless fitted
+        Eigen::Vector3d next = modelSegment.tip.block<3, 1>(0, 3);
+        modelSegment.linkStart.setZero();
+        modelSegment.linkEnd.setZero();
+        if(fittedLinks[linkNum])
+        {
+            modelSegment.linkStart = linkStarts[linkNum];
+            modelSegment.linkEnd = linkEnds[linkNum];
+        }
+        else if(next.norm() > 0.0001)
+        {
+            modelSegment.linkEnd = lengths[linkNum] * next.normalized();
+        }
+        modelSegment.linkRadius = radii[linkNum];
     }
-    #ifdef DEBUG
-    std::cout << "# links: " << links.size() << std::endl;
-    #endif
-    // Mathematical constants, declared in constructor for speed
-    this->origin << 0, 0, 0, 1;
-    this->directionVect << 0, 0, 1;
-    this->i3 << 1, 0, 0,
-                0, 1, 0,
-                0, 0, 1;
+    return true;
 }
 
 KinovaArm::~KinovaArm(){
@@ -172,10 +356,6 @@ KinovaArm::~KinovaArm(){
     for(int i=0; i < links.size(); i++){
         delete(links[i]);
     }
-
-    for(int i=0; i < localPoses.size(); i++){
-        delete(localPoses[i]);
-    }
 }
 
 
@@ -190,97 +370,258 @@ NarkinBase::~NarkinBase(){
 
 bool NarkinBase::updatePose(Eigen::Vector3d basePositions){
     this->baseTransform = basePositions;
-    // this->base_primitive->box_center = basePositions;
+
+    // Move the box, its version only changes if the base has moved
+    Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+    pose.block<3, 1>(0, 3) = basePositions;
+    this->base_primitive->setPose(pose);
     return true;
 }
 
-bool KinovaArm::updatePose(std::vector<double> jointPositions){
+bool KinovaArm::updatePose(const std::vector<double> &jointPositions){
+    return updatePose(jointPositions.data(), jointPositions.size());
+}
+
+bool KinovaArm::updatePose(const double* jointPositions, int nPositions){
 
-    // initailise the chain solver and the joint array
-    KDL::ChainFkSolverPos_recursive fksolver = KDL::ChainFkSolverPos_recursive(fkChain);
+    if(nPositions < nJoints){
+        std::cout << "Error: expected " << nJoints << " joint positions" << std::endl;
+        return false;
+    }
+
+    // Nothing moved since the last update
+    bool jointsChanged = !kinematicState.isCurrent(jointPositions, nPositions);
+    if(!jointsChanged && baseTransform == placedBaseTransform)
+    {
+        return true;
+    }
 
     // pass the joint angles from function input into the joint array
     for(int i=0; i<nJoints; i++)
     {
         jointArray(i) = jointPositions[i];
     }
-    
 
-    // solve for the frame at the "link" of the chain for the given joint positions
+    // solve for all the frames of the chain in one walk, only if they
+    // depend on the joints that changed
+    if(jointsChanged)
+    {
+        forwardKinematics();
+    }
+    placeFrames();
+
+    // For all the link objects (nFrames-1) update the pose from the origins
+    // of their frames, the version of a link only changes if it has moved
+    for(int linkNum = 0; linkNum < nLinks; linkNum++)
+    {
+        links[linkNum]->setPose(linkPose(linkNum));
+    }
+    #ifdef DEBUG
+    // print the resulting link calculations
     for(int frameNum = 0; frameNum < nFrames; frameNum++)
     {
-        if(fksolver.JntToCart(jointArray, *localPoses[frameNum], frameNum) >= 0)
+        std::cout << "Calculations to link number: " << frameNum << std::endl 
+                  << localPoses[frameNum] << std::endl;
+    }
+    #endif //DEBUG
+
+    // Return true if performed successfully
+    return true;
+}
+
+void KinovaArm::forwardKinematics(){
+    // Each frame is the previous one moved by its segment, the axis of a
+    // joint is fixed in the frame at the start of its segment
+    int joint = 0;
+    for(int segmentNum = 0; segmentNum < nLinks; segmentNum++)
+    {
+        const KDL::Segment &segment = fkChain.getSegment(segmentNum);
+        const KDL::Frame &start = localPoses[segmentNum];
+        double position = 0.0;
+        if(segment.getJoint().getType() != KDL::Joint::None)
         {
-            #ifdef DEBUG
-            // print the resulting link calculations
-            std::cout << "Calculations to link number: " << frameNum << std::endl 
-                      << *localPoses[frameNum] << std::endl
-                      << "Success" << std::endl;
-            #endif //DEBUG
+            KDL::Vector axis = start.M * segment.getJoint().JointAxis();
+            KDL::Vector point = start * segment.getJoint().JointOrigin();
+            jointAxes[joint] = Eigen::Vector3d(axis.x(), axis.y(), axis.z());
+            jointPoints[joint] = Eigen::Vector3d(point.x(), point.y(), point.z());
+            position = jointArray(joint++);
         }
-        // If calculation fails print error and return false
-        else
+        localPoses[segmentNum+1] = start * segment.pose(position);
+    }
+
+    // The Jacobian of a frame has a column for each joint before it
+    kinematicState.setJointPositions(jointArray.data.data());
+    joint = 0;
+    for(int frameNum = 0; frameNum < nFrames; frameNum++)
+    {
+        const KDL::Frame &frame = localPoses[frameNum];
+        Eigen::Matrix4d &pose = kinematicState.frames[frameNum];
+        for(int i = 0; i < 3; i++)
         {
-            std::cout << "Error: could not calculate forward kinematics" << std::endl;
-            return false;
+            for(int j = 0; j < 3; j++)
+            {
+                pose(i, j) = frame.M(i, j);
+            }
+            pose(i, 3) = frame.p(i);
         }
 
-        // For all the link objects (nFrames-1) update the pose.
-        if(frameNum != 0)
+        Eigen::MatrixXd &jacobian = kinematicState.jacobians[frameNum];
+        jacobian.setZero();
+        Eigen::Vector3d origin = pose.block<3, 1>(0, 3);
+        for(int j = 0; j < joint; j++)
+        {
+            jacobian.block<3, 1>(0, j) = jointAxes[j].cross(origin - jointPoints[j]);
+            jacobian.block<3, 1>(3, j) = jointAxes[j];
+        }
+        if(frameNum < nLinks && 
+           fkChain.getSegment(frameNum).getJoint().getType() != KDL::Joint::None)
         {
-            links[frameNum-1]->pose = linkFramesToPose(*localPoses[frameNum-1], *localPoses[frameNum]);
+            joint++;
         }
     }
+}
 
-    // Return true if performed successfully
-    return true;
+void KinovaArm::placeFrames(){
+    // The origins of the frames in the world
+    Eigen::Matrix3d rotation = baseTransform.block<3, 3>(0, 0);
+    Eigen::Vector3d translation = baseTransform.block<3, 1>(0, 3);
+    for(int frameNum = 0; frameNum < nFrames; frameNum++)
+    {
+        const KDL::Vector &position = localPoses[frameNum].p;
+        framePositions[frameNum] = rotation * Eigen::Vector3d(position.x(), position.y(), position.z()) 
+                                   + translation;
+    }
+    placedBaseTransform = baseTransform;
+}
+
+const KinematicState* KinovaArm::getKinematicState(){
+    return &kinematicState;
 }
 
 
 std::vector<double> KinovaArm::ikVelocitySolver(KDL::Twist twist){
 
     // vector to store output values
-    std::vector<double> jointVelocitiesOut;
+    std::vector<double> jointVelocitiesOut(nJoints, 0.0);
+    ikVelocitySolver(twist, jointVelocitiesOut.data(), jointVelocitiesOut.size());
 
-    // inverse kinemetics solver
-    KDL::ChainIkSolverVel_wdls ikSolver = KDL::ChainIkSolverVel_wdls(fkChain);
+    // Return the joint velocities
+    return jointVelocitiesOut;
+}
 
-    // Set the weights for singularity handling
-    Eigen::MatrixXd weight_ts;
-    weight_ts.resize(6, 6);
-    weight_ts.setIdentity();
-    weight_ts(0, 0) = 1;
-    weight_ts(1, 1) = 1;
-    weight_ts(2, 2) = 1;
-    weight_ts(3, 3) = 0.4;
-    weight_ts(4, 4) = 0.4;
-    weight_ts(5, 5) = 0.4;
-    ikSolver.setWeightTS(weight_ts);
-
-    //solver for joint velocities
-    ikSolver.CartToJnt(jointArray, twist, jointVels);
-
-    // push velocities onto the vector
-    for (int i=0; i<jointVels.rows(); i++){
-        double velocity;
-
-        // Keep the max velocity to the limit
-        if(jointVels(i) > MAX_JOINT_VEL) {
-            velocity = MAX_JOINT_VEL;
+bool KinovaArm::ikVelocitySolver(const Eigen::Matrix<double, 6, 1> &twist,
+                                 double* jointVelocities, int nVelocities){
+    KDL::Twist kdlTwist(KDL::Vector(twist(0), twist(1), twist(2)),
+                        KDL::Vector(twist(3), twist(4), twist(5)));
+    return ikVelocitySolver(kdlTwist, jointVelocities, nVelocities);
+}
+
+bool KinovaArm::ikVelocitySolver(const KDL::Twist &twist, double* jointVelocities,
+                                 int nVelocities){
+
+    if(nVelocities < nJoints){
+        std::cout << "Error: expected space for " << nJoints << " joint velocities" 
+                  << std::endl;
+        return false;
+    }
+
+    // The state follows updatePose, unless jointArray was set directly
+    if(!kinematicState.isCurrent(jointArray.data.data(), nJoints))
+    {
+        forwardKinematics();
+    }
+
+    // The fixed-size solver of the 7 joint arms
+    if(nJoints == DlsVelocitySolver::N_JOINTS)
+    {
+        DlsVelocitySolver::Jacobian jacobian = kinematicState.jacobians.back();
+        DlsVelocitySolver::Twist target;
+        for(int i=0; i<6; i++)
+        {
+            target(i) = twist(i);
         }
-        else if(jointVels(i) < -MAX_JOINT_VEL) {
-            velocity = -MAX_JOINT_VEL;
+        DlsVelocitySolver::JointVector velocities;
+        bool solved = dlsSolver.solve(jacobian, target, velocities);
+        for(int i=0; i<nJoints; i++)
+        {
+            jointVels(i) = velocities(i);
+            jointVelocities[i] = velocities(i);
         }
-        else {
-            velocity = jointVels(i);
+        return solved;
+    }
+
+    // Weighted pseudo inverse of the endeffector Jacobian for the other 
+    // chains, the directions of the singular values under 1e-5 are left out
+    weightedJacobian.noalias() = ikWeights * kinematicState.jacobians.back();
+    for(int i=0; i<6; i++)
+    {
+        projectedTwist(i) = twist(i);
+    }
+    weightedTwist.noalias() = ikWeights * projectedTwist;
+    ikSvd.compute(weightedJacobian);
+    projectedTwist.noalias() = ikSvd.matrixU().transpose() * weightedTwist;
+    const Eigen::VectorXd &singularValues = ikSvd.singularValues();
+    velocityBuffer.setZero();
+    for(int i=0; i<singularValues.size(); i++)
+    {
+        if(singularValues(i) > 1e-5)
+        {
+            velocityBuffer(i) = projectedTwist(i) / singularValues(i);
         }
+    }
+    jointVels.data.noalias() = ikSvd.matrixV() * velocityBuffer;
 
-        // Add the joint angles to the list
-        jointVelocitiesOut.push_back(velocity);
+    // Scale all the velocities down to keep every joint within its limit
+    double scale = 1.0;
+    for(int i=0; i<nJoints; i++)
+    {
+        double speed = fabs(jointVels(i));
+        if(speed * scale > jointVelocityLimits(i))
+        {
+            scale = jointVelocityLimits(i) / speed;
+        }
     }
+    for(int i=0; i<nJoints; i++)
+    {
+        jointVels(i) *= scale;
+        jointVelocities[i] = jointVels(i);
+    }
+    return true;
+}
 
-    // Return the joint velocities
-    return jointVelocitiesOut;
+bool KinovaArm::linkVelocities(const std::vector<double> &jointVelocities,
+                               std::vector<Eigen::Vector3d> &linear,
+                               std::vector<Eigen::Vector3d> &angular){
+
+    if(jointVelocities.size() != nJoints){
+        std::cout << "Error: expected " << nJoints << " joint velocities" << std::endl;
+        return false;
+    }
+
+    // The reference point of the Jacobian is the tip of the last segment
+    // solved, which is the start of the link
+    for(int i=0; i<nJoints; i++)
+    {
+        velocityBuffer(i) = jointVelocities[i];
+    }
+    Eigen::Matrix3d rotation = baseTransform.block<3, 3>(0, 0);
+
+    linear.resize(nLinks);
+    angular.resize(nLinks);
+    if(!kinematicState.isCurrent(jointArray.data.data(), nJoints))
+    {
+        forwardKinematics();
+    }
+    for(int linkNum = 0; linkNum < nLinks; linkNum++)
+    {
+        // The joint at the end of the link does not move the link, its
+        // axis goes through the end of the link
+        const Eigen::MatrixXd &jacobian = kinematicState.jacobians[linkNum];
+        Eigen::Matrix<double, 6, 1> twist = jacobian * velocityBuffer;
+        linear[linkNum] = rotation * twist.head(3);
+        angular[linkNum] = rotation * twist.tail(3);
+    }
+    return true;
 }
 
 Eigen::Vector3d NarkinBase::getPose(void){
@@ -312,7 +653,7 @@ Eigen::Vector3d NarkinBase::getPose(void){
 Eigen::Matrix4d KinovaArm::getPose(void)
 {
     // Get the final pose from the list
-    return frameToMatrix(*localPoses.back());
+    return frameToMatrix(localPoses.back());
 }
 
 Eigen::Matrix4d KinovaArm::getPose(int frameNumber)
@@ -321,11 +662,20 @@ Eigen::Matrix4d KinovaArm::getPose(int frameNumber)
     if(frameNumber >= localPoses.size() | frameNumber < 0){
         std::cout << "Access joint number larger than array in getPose.\n"<<
                      "Returning endeffector Pose"<<std::endl;
-        return frameToMatrix(*localPoses.back());
+        return frameToMatrix(localPoses.back());
     }
 
     // return joint pose
-    return frameToMatrix(*localPoses[frameNumber]);
+    return frameToMatrix(localPoses[frameNumber]);
+}
+
+bool KinovaArm::allowedCollision(int first, int second)
+{
+    if(first < 0 || second < 0 || first >= nLinks || second >= nLinks){
+        std::cout << "Error: link number out of range in allowedCollision" << std::endl;
+        return false;
+    }
+    return allowedCollisions[first * nLinks + second];
 }
 
 
@@ -354,17 +704,48 @@ Eigen::Matrix4d KinovaArm::linkFramesToPose(KDL::Frame startLink, KDL::Frame end
     Eigen::Matrix4d startPose = frameToMatrix(startLink);
     Eigen::Matrix4d endPose = frameToMatrix(endLink);
 
-    // Find the start and end points
-    Eigen::Vector4d basePoint = startPose * origin;
-    Eigen::Vector4d endPoint = endPose * origin;
+    return linkPose(startPose.block<3, 1>(0, 3), endPose.block<3, 1>(0, 3));
+}
+
+Eigen::Matrix4d KinovaArm::linkPose(int linkNum)
+{
+    if(!fittedLinks[linkNum])
+    {
+        return linkPose(framePositions[linkNum], framePositions[linkNum+1]);
+    }
 
+    // The fitted axis, from the frame of the link to the world
+    Eigen::Matrix3d rotation = baseTransform.block<3, 3>(0, 0);
+    Eigen::Vector3d translation = baseTransform.block<3, 1>(0, 3);
+    const Eigen::Vector3d* points[2] = {&linkStarts[linkNum], &linkEnds[linkNum]};
+    Eigen::Vector3d world[2];
+    for(int end = 0; end < 2; end++)
+    {
+        KDL::Vector point = localPoses[linkNum] * 
+            KDL::Vector((*points[end])(0), (*points[end])(1), (*points[end])(2));
+        world[end] = rotation * Eigen::Vector3d(point.x(), point.y(), point.z()) + translation;
+    }
+
+    // A fitted sphere keeps its position
+    if((world[1] - world[0]).norm() <= 0.0001)
+    {
+        Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+        pose.block<3, 1>(0, 3) = world[0];
+        return pose;
+    }
+    return linkPose(world[0], world[1]);
+}
+
+Eigen::Matrix4d KinovaArm::linkPose(const Eigen::Vector3d &basePoint, 
+                                    const Eigen::Vector3d &endPoint)
+{
     // create matrix to store the final pose to be returned
     Eigen::Matrix4d finalPose;
     
     // Check to see if the link a starts and originates at the same point
     if(fabs((basePoint - endPoint).norm()) > 0.0001) {
         // Get the vector representing the line from the start to end point
-        Eigen::Vector3d midLine = (endPoint - basePoint).head(3);
+        Eigen::Vector3d midLine = endPoint - basePoint;
         midLine = midLine.normalized();
         // Get the vector that is prependicular to the midline and z vector
         // matrix to store the rotaion matrix
@@ -0,0 +1,231 @@
+#include "model_cache.h"
+#include "capsule_fit.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// #define DEBUG
+
+/// First bytes of a model cache
+static const char MODEL_MAGIC[4] = {'K', 'M', 'D', 'L'};
+
+/// Size of the names in the records, with the terminating 0
+static const int NAME_SIZE = 64;
+
+/// The start of the file
+struct ModelHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t hash;
+    uint32_t nSegments;
+    uint32_t reserved;
+};
+
+/// A segment of the chain and the capsule of its link
+struct SegmentRecord
+{
+    char segmentName[NAME_SIZE];
+    char jointName[NAME_SIZE];
+    int32_t jointType;
+    uint32_t fitted;
+    double jointOrigin[3];
+    double jointAxis[3];
+    double tipRotation[9];
+    double tipPosition[3];
+    double linkStart[3];
+    double linkEnd[3];
+    double length;
+    double radius;
+    double velocityLimit;
+};
+
+/// Continues a FNV-1a hash with a range of bytes
+static uint64_t hashBytes(const char* bytes, size_t size, uint64_t hash){
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (unsigned char)bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Continues a FNV-1a hash with the bytes of a file
+ *
+ * @param filename The location of the file
+ * @param hash The hash so far
+ * @return The hash of the file, the hash so far if there is no file
+ */
+static uint64_t hashFile(const std::string &filename, uint64_t hash){
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    char buffer[4096];
+    while (file) {
+        file.read(buffer, sizeof(buffer));
+        hash = hashBytes(buffer, file.gcount(), hash);
+    }
+    return hash;
+}
+
+std::string ModelCache::cacheFilename(const std::string &urdfFilename){
+    return urdfFilename + ".model";
+}
+
+uint64_t ModelCache::hashSources(const std::string &urdfFilename,
+                                 const std::vector<double> &defaults){
+    uint64_t hash = 14695981039346656037ULL;
+    hash = hashFile(urdfFilename, hash);
+    hash = hashFile(CapsuleFit::cacheFilename(urdfFilename), hash);
+    return hashBytes(reinterpret_cast<const char*>(defaults.data()), 
+                     defaults.size() * sizeof(double), hash);
+}
+
+bool ModelCache::write(const std::string &filename, uint64_t hash){
+    int nSegments = chain.getNrOfSegments();
+    if (lengths.size() != nSegments || radii.size() != nSegments ||
+        velocityLimits.size() != nSegments || fittedLinks.size() != nSegments ||
+        linkStarts.size() != nSegments || linkEnds.size() != nSegments ||
+        allowedCollisions.size() != nSegments * nSegments) {
+        std::cout << "[ModelCache] the links do not match the chain" << std::endl;
+        return false;
+    }
+
+    ModelHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MODEL_MAGIC, sizeof(header.magic));
+    header.version = VERSION;
+    header.hash = hash;
+    header.nSegments = nSegments;
+
+    std::vector<SegmentRecord> records(nSegments);
+    for (int k = 0; k < nSegments; k++) {
+        const KDL::Segment &segment = chain.getSegment(k);
+        const KDL::Joint &joint = segment.getJoint();
+        SegmentRecord &record = records[k];
+        std::memset(&record, 0, sizeof(record));
+        if (segment.getName().size() >= NAME_SIZE || joint.getName().size() >= NAME_SIZE) {
+            std::cout << "[ModelCache] the name of segment " << k << " is too long"
+                      << std::endl;
+            return false;
+        }
+        std::strcpy(record.segmentName, segment.getName().c_str());
+        std::strcpy(record.jointName, joint.getName().c_str());
+        record.jointType = joint.getType();
+        record.fitted = fittedLinks[k];
+
+        KDL::Vector origin = joint.JointOrigin();
+        KDL::Vector axis = joint.JointAxis();
+        KDL::Frame tip = segment.getFrameToTip();
+        for (int i = 0; i < 3; i++) {
+            record.jointOrigin[i] = origin(i);
+            record.jointAxis[i] = axis(i);
+            record.tipPosition[i] = tip.p(i);
+            record.linkStart[i] = linkStarts[k](i);
+            record.linkEnd[i] = linkEnds[k](i);
+            for (int j = 0; j < 3; j++) {
+                record.tipRotation[3 * i + j] = tip.M(i, j);
+            }
+        }
+        record.length = lengths[k];
+        record.radius = radii[k];
+        record.velocityLimit = velocityLimits[k];
+    }
+    std::vector<char> allowed(allowedCollisions.begin(), allowedCollisions.end());
+
+    // Written to a new file then renamed, so a reader never maps half a file
+    std::string temporary = filename + ".tmp";
+    std::ofstream file(temporary.c_str(), std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(records.data()),
+               records.size() * sizeof(SegmentRecord));
+    file.write(allowed.data(), allowed.size());
+    file.close();
+    if (!file || std::rename(temporary.c_str(), filename.c_str()) != 0) {
+        std::cout << "[ModelCache] cannot write " << filename << std::endl;
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool ModelCache::read(const std::string &filename, uint64_t hash){
+    int descriptor = open(filename.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        return false;
+    }
+    struct stat status;
+    if (fstat(descriptor, &status) != 0 || status.st_size < sizeof(ModelHeader)) {
+        close(descriptor);
+        return false;
+    }
+    size_t size = status.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    const char* data = static_cast<const char*>(mapping);
+
+    ModelHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    size_t expected = sizeof(ModelHeader) + header.nSegments * sizeof(SegmentRecord) +
+                      header.nSegments * header.nSegments;
+    if (std::memcmp(header.magic, MODEL_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != VERSION || header.hash != hash || size != expected) {
+        #ifdef DEBUG
+        std::cout << "[ModelCache] " << filename << " is out of date" << std::endl;
+        #endif
+        munmap(mapping, size);
+        return false;
+    }
+
+    int nSegments = header.nSegments;
+    chain = KDL::Chain();
+    lengths.resize(nSegments);
+    radii.resize(nSegments);
+    velocityLimits.resize(nSegments);
+    fittedLinks.resize(nSegments);
+    linkStarts.resize(nSegments);
+    linkEnds.resize(nSegments);
+    const char* records = data + sizeof(ModelHeader);
+    for (int k = 0; k < nSegments; k++) {
+        SegmentRecord record;
+        std::memcpy(&record, records + k * sizeof(SegmentRecord), sizeof(record));
+        record.segmentName[NAME_SIZE - 1] = 0;
+        record.jointName[NAME_SIZE - 1] = 0;
+
+        // The joints of kdl_parser have an axis or are fixed
+        KDL::Joint::JointType type = static_cast<KDL::Joint::JointType>(record.jointType);
+        KDL::Vector origin(record.jointOrigin[0], record.jointOrigin[1], record.jointOrigin[2]);
+        KDL::Vector axis(record.jointAxis[0], record.jointAxis[1], record.jointAxis[2]);
+        KDL::Joint joint = (type == KDL::Joint::RotAxis || type == KDL::Joint::TransAxis) ?
+                           KDL::Joint(record.jointName, origin, axis, type) :
+                           KDL::Joint(record.jointName, type);
+        const double* r = record.tipRotation;
+        KDL::Frame tip(KDL::Rotation(r[0], r[1], r[2], r[3], r[4], r[5], r[6], r[7], r[8]),
+                       KDL::Vector(record.tipPosition[0], record.tipPosition[1],
+                                   record.tipPosition[2]));
+        chain.addSegment(KDL::Segment(record.segmentName, joint, tip));
+
+        lengths[k] = record.length;
+        radii[k] = record.radius;
+        velocityLimits[k] = record.velocityLimit;
+        fittedLinks[k] = record.fitted != 0;
+        linkStarts[k] = Eigen::Vector3d(record.linkStart[0], record.linkStart[1],
+                                        record.linkStart[2]);
+        linkEnds[k] = Eigen::Vector3d(record.linkEnd[0], record.linkEnd[1],
+                                      record.linkEnd[2]);
+    }
+    const char* allowed = records + nSegments * sizeof(SegmentRecord);
+    allowedCollisions.assign(allowed, allowed + nSegments * nSegments);
+    munmap(mapping, size);
+    #ifdef DEBUG
+    std::cout << "[ModelCache] read " << nSegments << " segments from " << filename
+              << std::endl;
+    #endif
+    return true;
+}
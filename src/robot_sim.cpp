@@ -97,8 +97,7 @@ class KinovaSimulator
                 jointStates.velocity.push_back(0.0);
                 jointStates.position.push_back(M_PI_2);
             }
-            jointStates.header.stamp.nsec = time.toNSec();
-            jointStates.header.stamp.sec = time.toSec();
+            jointStates.header.stamp = time;
 
             ros::NodeHandle n;
 
@@ -126,8 +125,8 @@ class KinovaSimulator
                 jointStates.velocity[i] = jointVelocities[i];
                 std::cout << prevPosition << ", " << jointVelocities[i] << ", " << jointStates.position[i] << std::endl;
             }
-            jointStates.header.stamp.nsec = time.toNSec();
-            jointStates.header.stamp.sec = time.toSec();
+            // The stamp is the time of the positions, the monitor extrapolates from it
+            jointStates.header.stamp = time;
             velPub.publish(jointStates);
             prevTime = curTime;
         }
@@ -12,13 +12,89 @@
 #include <stdlib.h>
 #include <iostream>
 #include <libgen.h>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <cstdio>
 
 
 #define private public
+#include <kdl/chainjnttojacsolver.hpp>
+#include <kdl/chainiksolvervel_wdls.hpp>
 #include "kinova_arm.h"
+#include "gen3_arm.h"
 #include "primitives.h"
 #include "monitor.h"
 #include "arm.h"
+#include "triple_buffer.h"
+#include "spsc_queue.h"
+#include "trajectory_validator.h"
+#include "batch_kinematics.h"
+#include "capsule_fit.h"
+#include "whole_body_model.h"
+#include "joint_state_estimator.h"
+
+/// True while the allocations are counted
+static std::atomic<bool> countingAllocations(false);
+/// The number of allocations since the counting started
+static std::atomic<long> allocationCount(0);
+
+#ifdef __GLIBC__
+// Replaces malloc so that the allocations of Eigen are counted as well as
+// the ones of operator new
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+
+extern "C" void* malloc(size_t size) noexcept {
+    if (countingAllocations) {
+        allocationCount++;
+    }
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) noexcept {
+    if (countingAllocations) {
+        allocationCount++;
+    }
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size) noexcept {
+    if (countingAllocations) {
+        allocationCount++;
+    }
+    return __libc_realloc(pointer, size);
+}
+#else
+void* operator new(std::size_t size) {
+    if (countingAllocations) {
+        allocationCount++;
+    }
+    void* pointer = std::malloc(size);
+    if (pointer == NULL) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+#endif
+
+/// Starts counting the allocations of the current code
+void startCountingAllocations() {
+    allocationCount = 0;
+    countingAllocations = true;
+}
+
+/// Stops counting and returns the allocations since the start
+long stopCountingAllocations() {
+    countingAllocations = false;
+    return allocationCount;
+}
 
 double deg2rad(double v) {
     return v / 180 * M_PI;
@@ -333,13 +409,13 @@ TEST_CASE("Kinova_arm test link positions", "[arm]") {
 
     for(int i=0; i < kinovaArm.nLinks; i++) {
         // get endpoints from the frames calculation
-        Eigen::Matrix4d baseMatLink = kinovaArm.frameToMatrix(*kinovaArm.localPoses[i]);
-        Eigen::Matrix4d endMatLink = kinovaArm.frameToMatrix(*kinovaArm.localPoses[i+1]);
+        Eigen::Matrix4d baseMatLink = kinovaArm.frameToMatrix(kinovaArm.localPoses[i]);
+        Eigen::Matrix4d endMatLink = kinovaArm.frameToMatrix(kinovaArm.localPoses[i+1]);
         Eigen::Vector3d basePointLink = (baseMatLink * origin).head(3);
         Eigen::Vector3d endPointLink = (endMatLink * origin).head(3);
 
         // Get the pose from these points using the same method in kinovaArm
-        Eigen::Matrix4d pose = kinovaArm.linkFramesToPose(*kinovaArm.localPoses[i], *kinovaArm.localPoses[i+1]);
+        Eigen::Matrix4d pose = kinovaArm.linkFramesToPose(kinovaArm.localPoses[i], kinovaArm.localPoses[i+1]);
 
 
         // get endpoints from the pose calculation
@@ -395,13 +471,13 @@ TEST_CASE("Kinova_arm test link positions global move", "[arm]") {
 
     for(int i=0; i < kinovaArm.nJoints-1; i++) {
         // get endpoints from the frames calculation
-        Eigen::Matrix4d baseMatLink = kinovaArm.frameToMatrix(*kinovaArm.localPoses[i]);
-        Eigen::Matrix4d endMatLink = kinovaArm.frameToMatrix(*kinovaArm.localPoses[i+1]);
+        Eigen::Matrix4d baseMatLink = kinovaArm.frameToMatrix(kinovaArm.localPoses[i]);
+        Eigen::Matrix4d endMatLink = kinovaArm.frameToMatrix(kinovaArm.localPoses[i+1]);
         Eigen::Vector3d basePointLink = (baseMatLink * origin).head(3);
         Eigen::Vector3d endPointLink = (endMatLink * origin).head(3);
 
         // Get the pose from these points using the same method in kinovaArm
-        Eigen::Matrix4d pose = kinovaArm.linkFramesToPose(*kinovaArm.localPoses[i], *kinovaArm.localPoses[i+1]);
+        Eigen::Matrix4d pose = kinovaArm.linkFramesToPose(kinovaArm.localPoses[i], kinovaArm.localPoses[i+1]);
 
         // get endpoints from the pose calculation
         Eigen::Vector4d zDirectionObstacle(0, 0, kinovaArm.lengths[i], 1);
@@ -414,17 +490,526 @@ TEST_CASE("Kinova_arm test link positions global move", "[arm]") {
     }
 }
 
+
+TEST_CASE("Kinova_arm single pass forward kinematics", "[arm]") {
+    Eigen::Matrix4d basePosition;
+    basePosition << 0, -1, 0, 0.1,
+                    1,  0, 0, 0.2,
+                    0,  0, 1, 0.4,
+                    0,  0, 0, 1;
+    KinovaArm kinovaArm(urdf_filename, basePosition);
+    KDL::ChainFkSolverPos_recursive fksolver(kinovaArm.fkChain);
+
+    // Same frames and links as the recursive solver of KDL
+    for(int n = 0; n < 5; n++) {
+        std::vector<double> testPose;
+        for(int i = 0; i < kinovaArm.nJoints; i++) {
+            testPose.push_back(0.4 * n - 0.3 * i);
+        }
+        REQUIRE(kinovaArm.updatePose(testPose));
+
+        std::vector<KDL::Frame> expected(kinovaArm.nFrames);
+        for(int frameNum = 0; frameNum < kinovaArm.nFrames; frameNum++) {
+            fksolver.JntToCart(kinovaArm.jointArray, expected[frameNum], frameNum);
+            REQUIRE((kinovaArm.getPose(frameNum) - 
+                     kinovaArm.frameToMatrix(expected[frameNum])).norm() < 1e-12);
+        }
+        for(int linkNum = 0; linkNum < kinovaArm.nLinks; linkNum++) {
+            Eigen::Matrix4d pose = kinovaArm.linkFramesToPose(expected[linkNum], 
+                                                              expected[linkNum+1]);
+            REQUIRE((kinovaArm.links[linkNum]->pose - pose).norm() < 1e-12);
+        }
+    }
+
+    // Too few joint positions leave the arm where it is
+    unsigned long version = kinovaArm.links.back()->version;
+    std::vector<double> shortPose(3, 0.0);
+    REQUIRE_FALSE(kinovaArm.updatePose(shortPose));
+    REQUIRE(kinovaArm.links.back()->version == version);
+}
+TEST_CASE("Gen3_arm matches the KDL arm", "[arm]") {
+    Eigen::Matrix4d basePosition;
+    basePosition << 0, -1, 0, 0.1,
+                    1,  0, 0, 0.2,
+                    0,  0, 1, 0.4,
+                    0,  0, 0, 1;
+    KinovaArm kinovaArm(urdf_filename, basePosition);
+    Gen3Arm gen3Arm(basePosition);
+    REQUIRE(gen3Arm.nJoints == kinovaArm.nJoints);
+    REQUIRE(gen3Arm.nLinks == kinovaArm.nLinks);
+    REQUIRE(gen3Arm.nFrames == kinovaArm.nFrames);
+
+    for(int n = 0; n < 6; n++) {
+        std::vector<double> testPose, testVelocities;
+        for(int i = 0; i < kinovaArm.nJoints; i++) {
+            testPose.push_back(0.5 * n - 0.4 * i + 0.1);
+            testVelocities.push_back(0.2 * i - 0.3 * n);
+        }
+        if(n == 0) {
+            // The starting pose of both arms
+            testPose.assign(kinovaArm.nJoints, M_PI_2);
+        }
+        REQUIRE(kinovaArm.updatePose(testPose));
+        REQUIRE(gen3Arm.updatePose(testPose));
+
+        // Same frames and links
+        for(int frameNum = 0; frameNum < kinovaArm.nFrames; frameNum++) {
+            REQUIRE((gen3Arm.getPose(frameNum) - kinovaArm.getPose(frameNum)).norm() < 1e-9);
+        }
+        for(int linkNum = 0; linkNum < kinovaArm.nLinks; linkNum++) {
+            Capsule* gen3Link = static_cast<Capsule*>(gen3Arm.links[linkNum]);
+            Capsule* kinovaLink = static_cast<Capsule*>(kinovaArm.links[linkNum]);
+            // The 1/z entry of the pose grows for flat links, compare the ends
+            REQUIRE((gen3Link->pose.block<3, 2>(0, 2) - 
+                     kinovaLink->pose.block<3, 2>(0, 2)).norm() < 1e-9);
+            REQUIRE(gen3Link->getLength() == kinovaLink->getLength());
+            REQUIRE(gen3Link->getRadius() == kinovaLink->getRadius());
+        }
+
+        // Same link velocities
+        std::vector<Eigen::Vector3d> gen3Linear, gen3Angular, kinovaLinear, kinovaAngular;
+        REQUIRE(gen3Arm.linkVelocities(testVelocities, gen3Linear, gen3Angular));
+        REQUIRE(kinovaArm.linkVelocities(testVelocities, kinovaLinear, kinovaAngular));
+        for(int linkNum = 0; linkNum < kinovaArm.nLinks; linkNum++) {
+            REQUIRE((gen3Linear[linkNum] - kinovaLinear[linkNum]).norm() < 1e-9);
+            REQUIRE((gen3Angular[linkNum] - kinovaAngular[linkNum]).norm() < 1e-9);
+        }
+
+        // Same kinematic state and velocity IK through the Arm interface
+        Arm* gen3 = &gen3Arm;
+        Arm* kinova = &kinovaArm;
+        const KinematicState* gen3State = gen3->getKinematicState();
+        const KinematicState* kinovaState = kinova->getKinematicState();
+        REQUIRE(gen3State != NULL);
+        REQUIRE((gen3State->jointPositions - kinovaState->jointPositions).norm() == 0);
+        for(int frameNum = 0; frameNum < kinovaArm.nFrames; frameNum++) {
+            REQUIRE((gen3State->frames[frameNum] - kinovaState->frames[frameNum]).norm() < 1e-9);
+            REQUIRE((gen3State->jacobians[frameNum] - 
+                     kinovaState->jacobians[frameNum]).norm() < 1e-9);
+        }
+        Eigen::Matrix<double, 6, 1> twist;
+        twist << 0.05 * n, -0.1, 0.08, 0, 0.2, -0.1 * n;
+        std::vector<double> gen3Velocities(kinovaArm.nJoints), kinovaVelocities(kinovaArm.nJoints);
+        REQUIRE(gen3->ikVelocitySolver(twist, gen3Velocities.data(), gen3Velocities.size()));
+        REQUIRE(kinova->ikVelocitySolver(twist, kinovaVelocities.data(), kinovaVelocities.size()));
+        for(int i = 0; i < kinovaArm.nJoints; i++) {
+            REQUIRE(gen3Velocities[i] == Approx(kinovaVelocities[i]).margin(1e-9));
+        }
+    }
+    double shortVelocities[3];
+    REQUIRE_FALSE(gen3Arm.ikVelocitySolver(Eigen::Matrix<double, 6, 1>::Zero(), 
+                                           shortVelocities, 3));
+
+    // Same chain model
+    ChainModel gen3Model, kinovaModel;
+    REQUIRE(gen3Arm.getChainModel(gen3Model));
+    REQUIRE(kinovaArm.getChainModel(kinovaModel));
+    std::vector<double> testPose(kinovaArm.nJoints, 0.3);
+    std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>> gen3Frames, kinovaFrames;
+    REQUIRE(gen3Model.forwardKinematics(testPose, gen3Frames));
+    REQUIRE(kinovaModel.forwardKinematics(testPose, kinovaFrames));
+    for(int frameNum = 0; frameNum < kinovaArm.nFrames; frameNum++) {
+        REQUIRE((gen3Frames[frameNum] - kinovaFrames[frameNum]).norm() < 1e-9);
+    }
+    for(int linkNum = 0; linkNum < kinovaArm.nLinks; linkNum++) {
+        REQUIRE((gen3Model.segments[linkNum].linkEnd - 
+                 kinovaModel.segments[linkNum].linkEnd).norm() < 1e-9);
+    }
+
+    // A copy moves on its own
+    Arm* copy = gen3Arm.clone();
+    REQUIRE(copy != NULL);
+    Eigen::Matrix4d endEffector = gen3Arm.getPose();
+    copy->updatePose(std::vector<double>(kinovaArm.nJoints, 0.0));
+    REQUIRE(gen3Arm.getPose() == endEffector);
+    REQUIRE(copy->getPose() != endEffector);
+    delete copy;
+
+    std::vector<double> shortPose(3, 0.0);
+    REQUIRE_FALSE(gen3Arm.updatePose(shortPose));
+}
+
+TEST_CASE("Kinova_arm batch forward kinematics", "[arm]") {
+    Eigen::Matrix4d basePosition;
+    basePosition << 0, -1, 0, 0.1,
+                    1,  0, 0, 0.2,
+                    0,  0, 1, 0.4,
+                    0,  0, 0, 1;
+    KinovaArm kinovaArm(urdf_filename, basePosition);
+    ChainModel model;
+    REQUIRE(kinovaArm.getChainModel(model));
+    BatchKinematics batch(model);
+    REQUIRE(batch.nJoints() == kinovaArm.nJoints);
+    REQUIRE(batch.nLinks() == kinovaArm.nLinks);
+
+    // Not a multiple of any vector width
+    std::vector<std::vector<double>> configurations;
+    for (int c = 0; c < 37; c++) {
+        std::vector<double> positions;
+        for (int i = 0; i < kinovaArm.nJoints; i++) {
+            positions.push_back(std::sin(1.3 * c + 0.7 * i) * M_PI);
+        }
+        configurations.push_back(positions);
+    }
+    REQUIRE(batch.linkEndpoints(configurations));
+    REQUIRE(batch.size() == configurations.size());
+
+    // Same capsules as the arm, one configuration at a time
+    for (int c = 0; c < configurations.size(); c++) {
+        REQUIRE(kinovaArm.updatePose(configurations[c]));
+        for (int j = 0; j < kinovaArm.nLinks; j++) {
+            Capsule* link = static_cast<Capsule*>(kinovaArm.links[j]);
+            Eigen::Vector3d start = link->pose.block<3, 1>(0, 3);
+            Eigen::Vector3d end = (link->pose * 
+                Eigen::Vector4d(0, 0, link->getLength(), 1)).head(3);
+            REQUIRE((batch.linkStart(j, c) - start).norm() < 1e-9);
+            REQUIRE((batch.linkEnd(j, c) - end).norm() < 1e-6);
+            REQUIRE(batch.radii[j] == Approx(link->getRadius()));
+        }
+    }
+
+    // The joint by joint layout gives the same end points
+    std::vector<double> interleaved(kinovaArm.nJoints * configurations.size());
+    for (int c = 0; c < configurations.size(); c++) {
+        for (int i = 0; i < kinovaArm.nJoints; i++) {
+            interleaved[i * configurations.size() + c] = configurations[c][i];
+        }
+    }
+    Eigen::ArrayXXd starts = batch.starts;
+    Eigen::ArrayXXd ends = batch.ends;
+    REQUIRE(batch.linkEndpoints(interleaved.data(), configurations.size()));
+    REQUIRE((batch.starts - starts).abs().maxCoeff() == 0);
+    REQUIRE((batch.ends - ends).abs().maxCoeff() == 0);
+
+    // A batch of one configuration is the configuration
+    REQUIRE(batch.linkEndpoints(configurations[0].data(), 1));
+    REQUIRE(batch.starts.rows() == 1);
+    REQUIRE((batch.linkStart(3, 0) - Eigen::Vector3d(starts(0, 9), starts(0, 10), 
+                                                     starts(0, 11))).norm() < 1e-12);
+
+    configurations[5].pop_back();
+    REQUIRE_FALSE(batch.linkEndpoints(configurations));
+    BatchKinematics empty;
+    REQUIRE_FALSE(empty.linkEndpoints(interleaved.data(), 1));
+}
+
+/// Distance from a point to the axis of a capsule
+double distanceToAxis(const LinkCapsule &capsule, const Eigen::Vector3d &point) {
+    Eigen::Vector3d axis = capsule.end - capsule.start;
+    double t = 0;
+    if (axis.squaredNorm() > 0) {
+        t = std::min(std::max((point - capsule.start).dot(axis) / axis.squaredNorm(), 0.0), 1.0);
+    }
+    return (point - capsule.start - t * axis).norm();
+}
+
+TEST_CASE("Capsule fit of link meshes", "[arm]") {
+    // A closed cylinder along a tilted axis, as an ASCII STL
+    Eigen::Vector3d direction = Eigen::Vector3d(1, 2, 2).normalized();
+    Eigen::Vector3d u = direction.unitOrthogonal();
+    Eigen::Vector3d v = direction.cross(u);
+    Eigen::Vector3d base(0.1, -0.2, 0.3);
+    double radius = 0.05;
+    double length = 0.3;
+    std::vector<Eigen::Vector3d> rim[2];
+    for (int k = 0; k < 24; k++) {
+        double angle = 2 * M_PI * k / 24;
+        for (int end = 0; end < 2; end++) {
+            rim[end].push_back(base + end * length * direction + 
+                               radius * (std::cos(angle) * u + std::sin(angle) * v));
+        }
+    }
+    std::string asciiFilename = "capsule_fit_test_ascii.stl";
+    std::ofstream ascii(asciiFilename.c_str());
+    ascii << "solid cylinder" << std::endl;
+    for (int k = 0; k < 24; k++) {
+        const Eigen::Vector3d* corners[2][3] = {
+            {&rim[0][k], &rim[1][k], &rim[0][(k + 1) % 24]},
+            {&rim[1][k], &rim[1][(k + 1) % 24], &rim[0][(k + 1) % 24]}};
+        for (int t = 0; t < 2; t++) {
+            ascii << "facet normal 0 0 0" << std::endl << "outer loop" << std::endl;
+            for (int c = 0; c < 3; c++) {
+                ascii << "vertex " << (*corners[t][c])(0) << " " << (*corners[t][c])(1) 
+                      << " " << (*corners[t][c])(2) << std::endl;
+            }
+            ascii << "endloop" << std::endl << "endfacet" << std::endl;
+        }
+    }
+    ascii << "endsolid cylinder" << std::endl;
+    ascii.close();
+
+    std::vector<Eigen::Vector3d> vertices;
+    REQUIRE(CapsuleFit::readStl(asciiFilename, vertices));
+    REQUIRE(vertices.size() == 48);
+    std::remove(asciiFilename.c_str());
+
+    // Encloses the mesh along the cylinder, no larger than the cylinder capsule
+    LinkCapsule capsule;
+    REQUIRE(CapsuleFit::fit(vertices, capsule));
+    for (int p = 0; p < vertices.size(); p++) {
+        REQUIRE(distanceToAxis(capsule, vertices[p]) <= capsule.radius + 1e-9);
+    }
+    REQUIRE(std::fabs((capsule.end - capsule.start).normalized().dot(direction)) > 0.99);
+    LinkCapsule cylinder;
+    cylinder.start = base;
+    cylinder.end = base + length * direction;
+    cylinder.radius = radius;
+    REQUIRE(CapsuleFit::volume(capsule) <= CapsuleFit::volume(cylinder) * 1.001);
+
+    // A binary mesh of the Gen3
+    std::string meshFilename = 
+        "../catkin_workspace/src/kortex_description/arms/gen3/7dof/meshes/forearm_link.STL";
+    REQUIRE(CapsuleFit::readStl(meshFilename, vertices));
+    REQUIRE(vertices.size() > 100);
+    REQUIRE(CapsuleFit::fit(vertices, capsule));
+    for (int p = 0; p < vertices.size(); p++) {
+        REQUIRE(distanceToAxis(capsule, vertices[p]) <= capsule.radius + 1e-9);
+    }
+    REQUIRE(capsule.radius < 0.1);
+    REQUIRE_FALSE(CapsuleFit::readStl("missing.stl", vertices));
+    vertices.clear();
+    REQUIRE_FALSE(CapsuleFit::fit(vertices, capsule));
+
+    // The cache keeps the capsules and still encloses the mesh
+    std::vector<LinkCapsule> capsules(1, capsule);
+    capsules[0].link = "ForeArm_Link";
+    std::string cacheFilename = "capsule_fit_test.capsules";
+    REQUIRE(CapsuleFit::writeCache(cacheFilename, capsules));
+    std::vector<LinkCapsule> cached;
+    REQUIRE(CapsuleFit::readCache(cacheFilename, cached));
+    REQUIRE(cached.size() == 1);
+    REQUIRE(cached[0].link == "ForeArm_Link");
+    REQUIRE((cached[0].start - capsule.start).norm() < 1e-6);
+    REQUIRE((cached[0].end - capsule.end).norm() < 1e-6);
+    double shift = std::max((cached[0].start - capsule.start).norm(), 
+                            (cached[0].end - capsule.end).norm());
+    REQUIRE(cached[0].radius >= capsule.radius + shift);
+    REQUIRE(cached[0].radius < capsule.radius + 1e-6);
+
+    std::ofstream other(cacheFilename.c_str(), std::ios::binary | std::ios::trunc);
+    other << "not a cache";
+    other.close();
+    REQUIRE_FALSE(CapsuleFit::readCache(cacheFilename, cached));
+    REQUIRE(cached.empty());
+    std::remove(cacheFilename.c_str());
+    REQUIRE_FALSE(CapsuleFit::readCache(cacheFilename, cached));
+}
+
+TEST_CASE("Kinova_arm reads the fitted link capsules", "[arm]") {
+    // A copy of the URDF with a cache for the shoulder
+    std::string fittedUrdf = "capsule_fit_test.urdf";
+    std::ifstream source(urdf_filename.c_str());
+    std::ofstream copy(fittedUrdf.c_str());
+    copy << source.rdbuf();
+    copy.close();
+    std::vector<LinkCapsule> capsules(2);
+    capsules[0].link = "Shoulder_Link";
+    capsules[0].start = Eigen::Vector3d(0, 0.01, -0.02);
+    capsules[0].end = Eigen::Vector3d(0, -0.01, -0.12);
+    capsules[0].radius = 0.06;
+    capsules[1].link = "Not_A_Link";
+    capsules[1].start = Eigen::Vector3d::Zero();
+    capsules[1].end = Eigen::Vector3d::Zero();
+    capsules[1].radius = 1;
+    REQUIRE(CapsuleFit::writeCache(CapsuleFit::cacheFilename(fittedUrdf), capsules));
+    std::vector<LinkCapsule> cached;
+    REQUIRE(CapsuleFit::readCache(CapsuleFit::cacheFilename(fittedUrdf), cached));
+
+    Eigen::Matrix4d basePosition;
+    basePosition << 0, -1, 0, 0.1,
+                    1,  0, 0, 0.2,
+                    0,  0, 1, 0.4,
+                    0,  0, 0, 1;
+    KinovaArm fittedArm(fittedUrdf, basePosition);
+    KinovaArm defaultArm(urdf_filename, basePosition);
+    std::remove(CapsuleFit::cacheFilename(fittedUrdf).c_str());
+    std::remove(ModelCache::cacheFilename(fittedUrdf).c_str());
+    std::remove(fittedUrdf.c_str());
+    REQUIRE(fittedArm.fittedLinks[1]);
+
+    std::vector<double> positions = {0.3, 0.5, 0, 1.2, 0, 0.4, 0};
+    for (int n = 0; n < 2; n++) {
+        if (n == 1) {
+            REQUIRE(fittedArm.updatePose(positions));
+            REQUIRE(defaultArm.updatePose(positions));
+        }
+        for (int j = 0; j < fittedArm.nLinks; j++) {
+            Capsule* fitted = static_cast<Capsule*>(fittedArm.links[j]);
+            Capsule* unfitted = static_cast<Capsule*>(defaultArm.links[j]);
+            if (j != 1) {
+                REQUIRE(fitted->pose == unfitted->pose);
+                REQUIRE(fitted->getRadius() == unfitted->getRadius());
+                REQUIRE(fitted->getLength() == unfitted->getLength());
+                continue;
+            }
+            // The fitted capsule moves with the frame of the shoulder
+            Eigen::Matrix4d frame = fittedArm.getPose(1);
+            Eigen::Vector3d start = (frame * cached[0].start.homogeneous()).head(3);
+            Eigen::Vector3d end = (frame * cached[0].end.homogeneous()).head(3);
+            REQUIRE((fitted->pose.block<3, 1>(0, 3) - start).norm() < 1e-9);
+            REQUIRE(((fitted->pose * Eigen::Vector4d(0, 0, fitted->getLength(), 1)).head(3) - 
+                     end).norm() < 1e-6);
+            REQUIRE(fitted->getRadius() == Approx(cached[0].radius));
+        }
+    }
+
+    // The chain model and the copies use the fitted capsule
+    ChainModel model;
+    REQUIRE(fittedArm.getChainModel(model));
+    REQUIRE(model.segments[1].linkStart == cached[0].start);
+    REQUIRE(model.segments[1].linkEnd == cached[0].end);
+    REQUIRE(model.segments[1].linkRadius == Approx(cached[0].radius));
+    Arm* clone = fittedArm.clone();
+    REQUIRE(static_cast<KinovaArm*>(clone)->fittedLinks[1]);
+    delete clone;
+
+    // The speed of the fitted capsule is bounded at its own end points
+    Eigen::Vector3d start, end;
+    fittedArm.linkEndPoints(1, start, end);
+    Capsule* shoulder = static_cast<Capsule*>(fittedArm.links[1]);
+    REQUIRE((shoulder->pose.block<3, 1>(0, 3) - start).norm() < 1e-12);
+    std::vector<double> velocities = {0.8, 0, 0, 0, 0, 0, 0};
+    double dt = 1e-6;
+    std::vector<double> moved = positions;
+    moved[0] += velocities[0] * dt;
+    REQUIRE(fittedArm.updatePose(moved));
+    Eigen::Vector3d movedStart, movedEnd;
+    fittedArm.linkEndPoints(1, movedStart, movedEnd);
+    REQUIRE(fittedArm.updatePose(positions));
+    double endSpeed = std::max((movedStart - start).norm(), (movedEnd - end).norm()) / dt;
+
+    Monitor monitor(&fittedArm);
+    Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+    pose.block<3, 1>(0, 3) = end + Eigen::Vector3d(0.1, 0, 0);
+    Sphere near(pose, 0.01);
+    monitor.addObstacle(&near);
+    std::vector<ImminentContact> contacts;
+    REQUIRE(monitor.predictCollisions(positions, velocities, 100, contacts));
+    bool shoulderFound = false;
+    for (int c = 0; c < contacts.size(); c++) {
+        if (contacts[c].link == 1) {
+            shoulderFound = true;
+            REQUIRE(contacts[c].maxClosingSpeed >= endSpeed * (1 - 1e-3));
+        }
+    }
+    REQUIRE(shoulderFound);
+
+    // So is the motion of the fitted capsule along a trajectory
+    TrajectoryValidator validator(&monitor);
+    moved = positions;
+    moved[0] += 0.5;
+    REQUIRE(fittedArm.updatePose(moved));
+    fittedArm.linkEndPoints(1, movedStart, movedEnd);
+    REQUIRE(fittedArm.updatePose(positions));
+    REQUIRE(validator.motionBound(positions, moved) >= (movedStart - start).norm());
+    REQUIRE(validator.motionBound(positions, moved) >= (movedEnd - end).norm());
+}
+
+TEST_CASE("Kinova_arm model cache", "[arm]") {
+    // A copy of the URDF, so that the test owns its cache
+    std::string cachedUrdf = "model_cache_test.urdf";
+    std::string cacheFilename = ModelCache::cacheFilename(cachedUrdf);
+    std::ifstream source(urdf_filename.c_str());
+    std::ofstream copy(cachedUrdf.c_str());
+    copy << source.rdbuf();
+    copy.close();
+    std::remove(CapsuleFit::cacheFilename(cachedUrdf).c_str());
+    std::remove(cacheFilename.c_str());
+
+    // The first arm parses the URDF and writes the cache, the second reads it
+    KinovaArm parsedArm(cachedUrdf);
+    std::vector<double> defaults = KinovaArm::modelDefaults();
+    uint64_t hash = ModelCache::hashSources(cachedUrdf, defaults);
+    ModelCache model;
+    REQUIRE(model.read(cacheFilename, hash));
+    REQUIRE(model.chain.getNrOfSegments() == parsedArm.fkChain.getNrOfSegments());
+    REQUIRE(model.chain.getNrOfJoints() == parsedArm.fkChain.getNrOfJoints());
+    REQUIRE(model.lengths == parsedArm.lengths);
+    REQUIRE(model.radii == parsedArm.radii);
+    KinovaArm cachedArm(cachedUrdf);
+
+    for (int k = 0; k < parsedArm.fkChain.getNrOfSegments(); k++) {
+        const KDL::Segment &parsed = parsedArm.fkChain.getSegment(k);
+        const KDL::Segment &cached = cachedArm.fkChain.getSegment(k);
+        REQUIRE(parsed.getName() == cached.getName());
+        REQUIRE(parsed.getJoint().getName() == cached.getJoint().getName());
+        REQUIRE(parsed.getJoint().getType() == cached.getJoint().getType());
+        REQUIRE(KDL::Equal(parsed.getFrameToTip(), cached.getFrameToTip(), 0));
+    }
+    std::vector<double> positions = {0.3, 0.5, 0, 1.2, 0, 0.4, 0};
+    REQUIRE(parsedArm.updatePose(positions));
+    REQUIRE(cachedArm.updatePose(positions));
+    for (int j = 0; j < parsedArm.nLinks; j++) {
+        REQUIRE(static_cast<Capsule*>(parsedArm.links[j])->pose == 
+                static_cast<Capsule*>(cachedArm.links[j])->pose);
+        REQUIRE(static_cast<Capsule*>(parsedArm.links[j])->getRadius() == 
+                static_cast<Capsule*>(cachedArm.links[j])->getRadius());
+    }
+
+    // Neighbouring links are allowed to touch
+    for (int first = 0; first < cachedArm.nLinks; first++) {
+        for (int second = 0; second < cachedArm.nLinks; second++) {
+            REQUIRE(cachedArm.allowedCollision(first, second) == (std::abs(first - second) <= 1));
+        }
+    }
+    REQUIRE_FALSE(cachedArm.allowedCollision(-1, 0));
+    REQUIRE_FALSE(cachedArm.allowedCollision(0, cachedArm.nLinks));
+
+    // Changing a default of the code makes the cache out of date
+    for (int k = 0; k < defaults.size(); k++) {
+        std::vector<double> changed = defaults;
+        changed[k] += 0.01;
+        REQUIRE(ModelCache::hashSources(cachedUrdf, changed) != hash);
+        REQUIRE_FALSE(model.read(cacheFilename, ModelCache::hashSources(cachedUrdf, changed)));
+    }
+
+    // Changing the URDF or its capsules makes the cache out of date
+    std::ofstream edit(cachedUrdf.c_str(), std::ios::app);
+    edit << "<!-- edited -->" << std::endl;
+    edit.close();
+    REQUIRE(ModelCache::hashSources(cachedUrdf, defaults) != hash);
+    REQUIRE_FALSE(model.read(cacheFilename, ModelCache::hashSources(cachedUrdf, defaults)));
+    KinovaArm editedArm(cachedUrdf);
+    REQUIRE(model.read(cacheFilename, ModelCache::hashSources(cachedUrdf, defaults)));
+    hash = ModelCache::hashSources(cachedUrdf, defaults);
+    std::vector<LinkCapsule> capsules(1);
+    capsules[0].link = "Shoulder_Link";
+    capsules[0].start = Eigen::Vector3d(0, 0, -0.02);
+    capsules[0].end = Eigen::Vector3d(0, 0, -0.12);
+    capsules[0].radius = 0.06;
+    REQUIRE(CapsuleFit::writeCache(CapsuleFit::cacheFilename(cachedUrdf), capsules));
+    REQUIRE(ModelCache::hashSources(cachedUrdf, defaults) != hash);
+    KinovaArm fittedArm(cachedUrdf);
+    REQUIRE(fittedArm.fittedLinks[1]);
+    REQUIRE(model.read(cacheFilename, ModelCache::hashSources(cachedUrdf, defaults)));
+    REQUIRE(model.fittedLinks[1]);
+    std::vector<LinkCapsule> cached;
+    REQUIRE(CapsuleFit::readCache(CapsuleFit::cacheFilename(cachedUrdf), cached));
+    REQUIRE(model.linkEnds[1] == cached[0].end);
+
+    // A truncated cache is rejected
+    std::ofstream truncated(cacheFilename.c_str(), std::ios::binary | std::ios::trunc);
+    truncated << "KMDL";
+    truncated.close();
+    REQUIRE_FALSE(model.read(cacheFilename, ModelCache::hashSources(cachedUrdf, defaults)));
+
+    std::remove(CapsuleFit::cacheFilename(cachedUrdf).c_str());
+    std::remove(cacheFilename.c_str());
+    std::remove(cachedUrdf.c_str());
+}
+
 TEST_CASE("Kinova_arm test inverse kinematics", "[arm]") {
     KinovaArm kinovaArm(urdf_filename);
     std::vector<double> testPose = {deg2rad(30), deg2rad(30), deg2rad(30), deg2rad(30),
                                     deg2rad(30), deg2rad(30), deg2rad(30)};
-    std::vector<double> outputPose = {0.768989, 2.89724, -0.913496, -5.39591, -1.04212,
-                                      2.87854, 0.806753};
+    // Slow enough for every joint to stay within its velocity limit
+    std::vector<double> outputPose = {0.0768989, 0.289724, -0.0913496, -0.539591, -0.104212,
+                                      0.287854, 0.0806753};
     kinovaArm.updatePose(testPose);
 
     double x, y, z, alpha, beta, gamma;
 
-    x = 1;
+    x = 0.1;
     y = 0;
     z = 0;
     alpha = 0;
@@ -436,7 +1021,7 @@ TEST_CASE("Kinova_arm test inverse kinematics", "[arm]") {
     KDL::Vector pos(x, y, z);
     KDL::Vector rot(alpha, beta, gamma);
     KDL::Twist twist(pos, rot);
-    double difference;
+    double difference = 0;
 
     output = kinovaArm.ikVelocitySolver(twist);
     for (int i=0; i<output.size(); i++) {
@@ -446,6 +1031,119 @@ TEST_CASE("Kinova_arm test inverse kinematics", "[arm]") {
     REQUIRE( difference < 0.001);
 }
 
+TEST_CASE("Kinova_arm shared kinematic state", "[arm]") {
+    KinovaArm kinovaArm(urdf_filename);
+    const KinematicState* state = kinovaArm.getKinematicState();
+    REQUIRE(state != NULL);
+    REQUIRE(state->frames.size() == kinovaArm.nFrames);
+    REQUIRE(state->jacobians.size() == kinovaArm.nFrames);
+
+    std::vector<double> positions = {0.3, 0.5, -0.2, 1.2, 0.1, 0.4, -0.6};
+    REQUIRE(kinovaArm.updatePose(positions));
+    unsigned long version = state->version;
+    unsigned long linkVersion = kinovaArm.links[4]->version;
+
+    // The frames and the Jacobians of every frame are those of KDL
+    KDL::ChainJntToJacSolver jacSolver(kinovaArm.fkChain);
+    KDL::Jacobian jacobian(kinovaArm.nJoints);
+    for (int k = 0; k < kinovaArm.nFrames; k++) {
+        REQUIRE((kinovaArm.baseTransform * state->frames[k] - kinovaArm.getPose(k)).norm() 
+                < 1e-12);
+        REQUIRE(jacSolver.JntToJac(kinovaArm.jointArray, jacobian, k) >= 0);
+        REQUIRE((state->jacobians[k] - jacobian.data).norm() < 1e-12);
+    }
+
+    // So is the velocity IK
+    KDL::ChainIkSolverVel_wdls ikSolver(kinovaArm.fkChain);
+    Eigen::MatrixXd weights = Eigen::MatrixXd::Identity(6, 6);
+    weights.block<3, 3>(3, 3) *= 0.4;
+    ikSolver.setWeightTS(weights);
+    KDL::Twist twist(KDL::Vector(0.1, -0.05, 0.02), KDL::Vector(0, 0.1, 0));
+    KDL::JntArray expected(kinovaArm.nJoints);
+    REQUIRE(ikSolver.CartToJnt(kinovaArm.jointArray, twist, expected) >= 0);
+    std::vector<double> velocities = kinovaArm.ikVelocitySolver(twist);
+    for (int i = 0; i < kinovaArm.nJoints; i++) {
+        REQUIRE(velocities[i] == Approx(expected(i)).margin(1e-9));
+    }
+
+    // Reading the state or updating to the same pose computes nothing
+    std::vector<Eigen::Vector3d> linear, angular;
+    REQUIRE(kinovaArm.linkVelocities(velocities, linear, angular));
+    REQUIRE(kinovaArm.updatePose(positions));
+    REQUIRE(state->version == version);
+    REQUIRE(kinovaArm.links[4]->version == linkVersion);
+
+    // A base motion moves the links but keeps the state
+    kinovaArm.baseTransform(0, 3) = 0.5;
+    REQUIRE(kinovaArm.updatePose(positions));
+    REQUIRE(state->version == version);
+    REQUIRE(kinovaArm.links[4]->version != linkVersion);
+    REQUIRE((kinovaArm.getPose(4) - kinovaArm.baseTransform * state->frames[4]).norm() 
+            < 1e-12);
+
+    // New joint positions give a new state
+    positions[2] = 0.1;
+    REQUIRE(kinovaArm.updatePose(positions));
+    REQUIRE(state->version != version);
+    REQUIRE(state->jointPositions(2) == 0.1);
+}
+
+TEST_CASE("Kinova_arm damped least squares velocity IK", "[arm]") {
+    KinovaArm kinovaArm(urdf_filename);
+
+    // The velocity limits of the joints are those of the URDF
+    REQUIRE(kinovaArm.jointVelocityLimits.size() == kinovaArm.nJoints);
+    for (int i = 0; i < kinovaArm.nJoints; i++) {
+        REQUIRE(kinovaArm.jointVelocityLimits(i) == Approx(0.8727));
+        REQUIRE(kinovaArm.dlsSolver.velocityLimits(i) == kinovaArm.jointVelocityLimits(i));
+    }
+
+    // Away from singularities it is the weighted pseudo inverse
+    std::vector<double> positions = {0.3, 0.5, -0.2, 1.2, 0.1, 0.4, -0.6};
+    REQUIRE(kinovaArm.updatePose(positions));
+    const Eigen::MatrixXd &jacobian = kinovaArm.getKinematicState()->jacobians.back();
+    Eigen::Matrix<double, 6, 1> weights;
+    weights << 1, 1, 1, 0.4, 0.4, 0.4;
+    Eigen::MatrixXd pseudoInverse = (weights.asDiagonal() * jacobian).
+        jacobiSvd(Eigen::ComputeThinU | Eigen::ComputeThinV).
+        solve(Eigen::MatrixXd(weights.asDiagonal()));
+    KDL::Twist twist(KDL::Vector(0.05, 0.02, -0.03), KDL::Vector(0.02, 0, 0.05));
+    Eigen::Matrix<double, 6, 1> twistVector;
+    for (int i = 0; i < 6; i++) {
+        twistVector(i) = twist(i);
+    }
+    Eigen::VectorXd expected = pseudoInverse * twistVector;
+    std::vector<double> velocities = kinovaArm.ikVelocitySolver(twist);
+    REQUIRE(kinovaArm.dlsSolver.damping == 0);
+    REQUIRE(kinovaArm.dlsSolver.limitScale == 1);
+    for (int i = 0; i < kinovaArm.nJoints; i++) {
+        REQUIRE(velocities[i] == Approx(expected(i)).margin(1e-9));
+    }
+
+    // A fast twist is scaled down as a whole to the limits
+    twist = KDL::Twist(KDL::Vector(1.0, 0.4, -0.6), KDL::Vector(0.4, 0, 1.0));
+    velocities = kinovaArm.ikVelocitySolver(twist);
+    double scale = kinovaArm.dlsSolver.limitScale;
+    REQUIRE(scale < 1);
+    double fastest = 0;
+    for (int i = 0; i < kinovaArm.nJoints; i++) {
+        REQUIRE(velocities[i] == Approx(20 * scale * expected(i)).margin(1e-9));
+        fastest = std::max(fastest, fabs(velocities[i]));
+    }
+    REQUIRE(fastest == Approx(0.8727));
+
+    // The stretched arm is singular, the solution is damped and stays finite
+    std::vector<double> stretched(kinovaArm.nJoints, 0.0);
+    REQUIRE(kinovaArm.updatePose(stretched));
+    twist = KDL::Twist(KDL::Vector(0, 0, 0.1), KDL::Vector(0, 0, 0));
+    velocities = kinovaArm.ikVelocitySolver(twist);
+    REQUIRE(kinovaArm.dlsSolver.damping > 0);
+    for (int i = 0; i < kinovaArm.nJoints; i++) {
+        REQUIRE(std::isfinite(velocities[i]));
+        REQUIRE(fabs(velocities[i]) <= 0.8727 + 1e-9);
+    }
+}
+
 TEST_CASE("Kinova_arm distance to obstacle", "[monitor]") {
 
     KinovaArm kinovaArm(urdf_filename);
@@ -474,15 +1172,17 @@ TEST_CASE("Kinova_arm distance to obstacle", "[monitor]") {
     std::vector<std::vector<double>>  ObstaclesResult{
         {-10.04, -9.92939, -9.83483, -9.69385, -9.53986, -9.36271, -9.26948, -9.17337 }
     };
+    // The neighbouring links touch by design and are not checked
+    double inf = std::numeric_limits<double>::infinity();
     std::vector<std::vector<double>>  LinksResult{
-        {0,-0.08,0.0484925,0.248115,0.456469,0.636643,0.73324,0.805921},
-        {-0.08,0,-0.0798875,0.130574,0.341038,0.531145,0.631666,0.710244},
-        {0.0484925,-0.0798875,0,-0.0799034,0.130573,0.324834,0.427848,0.512702},
-        {0.248115,0.130574,-0.0799034,0,-0.0799034,0.128611,0.234511,0.330082},
-        {0.456469,0.341038,0.130573,-0.0799034,0,-0.0799025,0.0260276,0.124736},
-        {0.636643,0.531145,0.324834,0.128611,-0.0799025,0,-0.0799999,0.0259303},
-        {0.73324,0.631666,0.427848,0.234511,0.0260276,-0.0799999,0,-0.0799999},
-        {0.805921,0.710244,0.512702,0.330082,0.124736,0.0259303,-0.0799999,0}
+        {0,inf,0.0484925,0.248115,0.456469,0.636643,0.73324,0.805921},
+        {inf,0,inf,0.130574,0.341038,0.531145,0.631666,0.710244},
+        {0.0484925,inf,0,inf,0.130573,0.324834,0.427848,0.512702},
+        {0.248115,0.130574,inf,0,inf,0.128611,0.234511,0.330082},
+        {0.456469,0.341038,0.130573,inf,0,inf,0.0260276,0.124736},
+        {0.636643,0.531145,0.324834,0.128611,inf,0,inf,0.0259303},
+        {0.73324,0.631666,0.427848,0.234511,0.0260276,inf,0,inf},
+        {0.805921,0.710244,0.512702,0.330082,0.124736,0.0259303,inf,0}
     };
 
     for(int i=0; i < ToObstacles.size(); i++ ) {
@@ -496,12 +1196,1854 @@ TEST_CASE("Kinova_arm distance to obstacle", "[monitor]") {
     for(int i=0; i < ToLinks.size(); i++ ) {
         double norm = 0;
         for(int j=0; j< ToLinks[i].size(); j++){
+            if (std::isinf(LinksResult[i][j])) {
+                REQUIRE(ToLinks[i][j] == LinksResult[i][j]);
+                continue;
+            }
             norm += std::pow(fabs(ToLinks[i][j]-LinksResult[i][j]), 2);
         }
         REQUIRE(norm < 0.1);
     }
 }
 
+TEST_CASE("Kinova_arm distance buffers", "[monitor]") {
+
+    KinovaArm kinovaArm(urdf_filename);
+    std::vector<double> testPose = {deg2rad(30), deg2rad(30), deg2rad(30), deg2rad(30),
+                                    deg2rad(30), deg2rad(30), deg2rad(30)};
+    kinovaArm.updatePose(testPose);
+
+    Eigen::Matrix4d pose_1;
+    pose_1 << 1, 0, 0, 0.5,
+              0, 1, 0, 0.2,
+              0, 0, 1, 0.3,
+              0, 0, 0, 1;
+    Sphere sphere_1(pose_1, 0.1);
+    pose_1(0, 3) = -0.4;
+    Capsule capsule_1(pose_1, 0.3, 0.05);
+
+    Monitor monitor(&kinovaArm);
+    monitor.addObstacle(&sphere_1);
+    monitor.addObstacle(&capsule_1);
+
+    std::vector<std::vector<double>> ToObstacles = monitor.distanceToObjects();
+    std::vector<std::vector<double>> ToLinks = monitor.distanceBetweenArmLinks();
+
+    DistanceMatrix obstacleBuffer;
+    DistanceMatrix linkBuffer;
+    obstacleBuffer.computeWitnessPoints = true;
+    monitor.distanceToObjects(obstacleBuffer);
+    monitor.distanceBetweenArmLinks(linkBuffer);
+
+    REQUIRE(obstacleBuffer.rows == 2);
+    REQUIRE(obstacleBuffer.cols == kinovaArm.nLinks);
+    REQUIRE(linkBuffer.witnessPoints.size() == 0);
+
+    for(int i=0; i < obstacleBuffer.rows; i++ ) {
+        for(int j=0; j < obstacleBuffer.cols; j++){
+            REQUIRE(obstacleBuffer.at(i, j) == Approx(ToObstacles[i][j]));
+
+            // the witness points are as far apart as the axis distance
+            double* witness = obstacleBuffer.witness(i, j);
+            Eigen::Vector3d own(witness[0], witness[1], witness[2]);
+            Eigen::Vector3d other(witness[3], witness[4], witness[5]);
+            REQUIRE((other - own).norm() > obstacleBuffer.at(i, j));
+        }
+    }
+
+    for(int i=0; i < linkBuffer.rows; i++ ) {
+        for(int j=0; j < linkBuffer.cols; j++){
+            // the neighbouring links are not checked
+            REQUIRE(std::isinf(linkBuffer.at(i, j)) == (i != j && kinovaArm.allowedCollision(i, j)));
+            REQUIRE(linkBuffer.at(i, j) == Approx(ToLinks[i][j]));
+        }
+    }
+
+    // Reusing the buffer keeps the same storage
+    const double* storage = obstacleBuffer.distances.data();
+    monitor.distanceToObjects(obstacleBuffer);
+    REQUIRE(obstacleBuffer.distances.data() == storage);
+}
+
+/// Checks that the store visits every obstacle at its position
+struct PositionCheck
+{
+    std::vector<Primitive*>* obstacles;
+    std::vector<int> visited;
+
+    template<typename Shape>
+    void operator()(int position, Shape &obstacle)
+    {
+        REQUIRE((*obstacles)[position] == &obstacle);
+        visited.push_back(position);
+    }
+};
+
+TEST_CASE("Monitor obstacle store", "[monitor]") {
+
+    KinovaArm kinovaArm(urdf_filename);
+    Monitor monitor(&kinovaArm);
+
+    Eigen::Matrix4d pose_1 = Eigen::Matrix4d::Identity();
+    pose_1(0, 3) = 0.5;
+    Sphere sphere_1(pose_1, 0.1);
+    Capsule capsule_1(pose_1, 0.3, 0.05);
+    Box3 box_1(pose_1, 0.2, 0.2, 0.2);
+
+    // Capsules are listed after the spheres whatever the order they are added
+    ObstacleHandle capsuleHandle = monitor.addObstacle(&capsule_1);
+    std::vector<Primitive*> newObstacles;
+    for (int i = 0; i < 100; i++) {
+        newObstacles.push_back(&sphere_1);
+    }
+    newObstacles.push_back(&box_1);
+    std::vector<ObstacleHandle> handles = monitor.addObstacles(newObstacles);
+
+    REQUIRE(handles.size() == 101);
+    REQUIRE(monitor.obstacles.size() == 102);
+    REQUIRE(monitor.store.items<Sphere>().size() == 100);
+    REQUIRE(monitor.obstacleIndex(handles[0]) == 0);
+    REQUIRE(monitor.obstacleIndex(capsuleHandle) == 100);
+    REQUIRE(monitor.obstacleIndex(handles[100]) == 101);
+    REQUIRE(monitor.obstacles[100] == monitor.store.get(capsuleHandle));
+
+    // The stored obstacles are copies
+    pose_1(1, 3) = 0.5;
+    REQUIRE(monitor.updateObstacle(handles[99], pose_1));
+    REQUIRE(monitor.store.get(handles[99])->pose(1, 3) == 0.5);
+    REQUIRE(sphere_1.pose(1, 3) == 0);
+
+    // Removing moves the last sphere, its handle still finds it
+    REQUIRE(monitor.removeObstacle(handles[3]));
+    REQUIRE_FALSE(monitor.removeObstacle(handles[3]));
+    REQUIRE(monitor.store.get(handles[3]) == NULL);
+    REQUIRE(monitor.obstacleIndex(handles[99]) == 3);
+    REQUIRE(monitor.store.get(handles[99])->pose(1, 3) == 0.5);
+    REQUIRE(monitor.obstacles.size() == 101);
+
+    // A reused slot does not answer to the old handle
+    ObstacleHandle reused = monitor.addObstacle(&sphere_1);
+    REQUIRE(reused.slot == handles[3].slot);
+    REQUIRE_FALSE(monitor.updateObstacle(handles[3], pose_1));
+
+    int nSpheres = 0;
+    monitor.store.forEach<Sphere>([&](Sphere &sphere) {
+        nSpheres++;
+    });
+    REQUIRE(nSpheres == 100);
+
+    // A range across the shapes is visited in the order of the positions
+    PositionCheck check;
+    check.obstacles = &monitor.obstacles;
+    monitor.store.forEachInRange(98, 102, check);
+    REQUIRE(check.visited == std::vector<int>({98, 99, 100, 101}));
+
+    // The arm links are listed after the stored obstacles
+    monitor.addObstacle(&kinovaArm);
+    REQUIRE(monitor.obstacles.size() == 102 + kinovaArm.nLinks);
+    REQUIRE(monitor.obstacles.back() == kinovaArm.links.back());
+
+    // The rows computed from the shape arrays are those of the primitives
+    DistanceMatrix distances;
+    monitor.distanceToObjects(distances);
+    std::vector<std::vector<double>> expected = monitor.distanceToObjects();
+    for (int i = 0; i < distances.rows; i++) {
+        for (int j = 0; j < distances.cols; j++) {
+            REQUIRE(distances.at(i, j) == expected[i][j]);
+        }
+    }
+}
+
+TEST_CASE("IdMap insert find erase", "[monitor]") {
+
+    IdMap<int> map(4);
+    for (int i = 0; i < 1000; i++) {
+        map.insert(i % 2 ? "cubes" : "spheres", i, i * 10);
+    }
+    REQUIRE(map.size() == 1000);
+    REQUIRE(*map.find("cubes", 11) == 110);
+    REQUIRE(map.find("spheres", 11) == NULL);
+
+    // Erasing leaves tombstones that must not break the probing
+    for (int i = 0; i < 1000; i += 3) {
+        REQUIRE(map.erase(i % 2 ? "cubes" : "spheres", i));
+    }
+    REQUIRE_FALSE(map.erase("spheres", 0));
+    for (int i = 0; i < 1000; i++) {
+        int* value = map.find(i % 2 ? "cubes" : "spheres", i);
+        if (i % 3 == 0) {
+            REQUIRE(value == NULL);
+        } else {
+            REQUIRE(*value == i * 10);
+        }
+    }
+
+    map.insert("cubes", 11, 7);
+    REQUIRE(*map.find("cubes", 11) == 7);
+    int sum = 0;
+    map.forEach([&sum](const std::string &ns, int id, int &value) {
+        sum++;
+    });
+    REQUIRE(sum == map.size());
+    map.clear();
+    REQUIRE(map.size() == 0);
+    REQUIRE(map.find("cubes", 11) == NULL);
+}
+
+TEST_CASE("Monitor marker obstacles", "[monitor]") {
+
+    KinovaArm kinovaArm(urdf_filename);
+    Monitor monitor(&kinovaArm);
+    monitor.addObstacle(&kinovaArm);
+
+    Eigen::Matrix4d pose_1 = Eigen::Matrix4d::Identity();
+    pose_1(0, 3) = 0.5;
+    Sphere sphere_1(pose_1, 0.1);
+    Box3 box_1(pose_1, 0.2, 0.2, 0.2);
+
+    ObstacleHandle first = monitor.setMarkerObstacle("obstacles", 1, &sphere_1);
+    monitor.setMarkerObstacle("obstacles", 2, &sphere_1);
+    monitor.setMarkerObstacle("others", 1, &sphere_1);
+    REQUIRE(monitor.obstacles.size() == 3 + kinovaArm.nLinks);
+
+    // Republishing the same marker keeps the obstacle and its version
+    unsigned long version = monitor.store.get(first)->version;
+    ObstacleHandle same = monitor.setMarkerObstacle("obstacles", 1, &sphere_1);
+    REQUIRE(same.slot == first.slot);
+    REQUIRE(monitor.store.get(first)->version == version);
+
+    pose_1(1, 3) = 0.3;
+    sphere_1.setPose(pose_1);
+    monitor.setMarkerObstacle("obstacles", 1, &sphere_1);
+    REQUIRE(monitor.store.get(first)->pose(1, 3) == 0.3);
+    REQUIRE(monitor.store.get(first)->version != version);
+
+    // A marker changing shape gets a new obstacle
+    ObstacleHandle changed = monitor.setMarkerObstacle("obstacles", 1, &box_1);
+    REQUIRE(monitor.store.get(first) == NULL);
+    REQUIRE(dynamic_cast<Box3*>(monitor.store.get(changed)) != NULL);
+    REQUIRE(monitor.markerObstacle("obstacles", 1).slot == changed.slot);
+    REQUIRE(monitor.obstacles.size() == 3 + kinovaArm.nLinks);
+
+    REQUIRE(monitor.removeMarkerObstacle("obstacles", 2));
+    REQUIRE_FALSE(monitor.removeMarkerObstacle("obstacles", 2));
+    REQUIRE(monitor.obstacles.size() == 2 + kinovaArm.nLinks);
+
+    // Removing all the markers keeps the arm links
+    monitor.removeAllMarkerObstacles();
+    REQUIRE(monitor.obstacles.size() == kinovaArm.nLinks);
+    REQUIRE_FALSE(monitor.markerObstacle("others", 1).valid());
+}
+
+TEST_CASE("Kinova_arm incremental distances", "[monitor]") {
+
+    KinovaArm kinovaArm(urdf_filename);
+    std::vector<double> testPose = {deg2rad(30), deg2rad(30), deg2rad(30), deg2rad(30),
+                                    deg2rad(30), deg2rad(30), deg2rad(30)};
+    kinovaArm.updatePose(testPose);
+
+    Eigen::Matrix4d pose_1;
+    pose_1 << 1, 0, 0, 0.5,
+              0, 1, 0, 0.2,
+              0, 0, 1, 0.3,
+              0, 0, 0, 1;
+    Sphere sphere_1(pose_1, 0.1);
+    pose_1(0, 3) = -0.4;
+    Capsule capsule_1(pose_1, 0.3, 0.05);
+
+    Monitor monitor(&kinovaArm);
+    monitor.addObstacle(&sphere_1);
+    monitor.addObstacle(&capsule_1);
+
+    DistanceMatrix obstacleBuffer;
+    DistanceMatrix linkBuffer;
+    monitor.distanceToObjects(obstacleBuffer);
+    monitor.distanceBetweenArmLinks(linkBuffer);
+
+    // The same joint angles leave the links untouched
+    unsigned long linkVersion = kinovaArm.links[3]->version;
+    kinovaArm.updatePose(testPose);
+    REQUIRE(kinovaArm.links[3]->version == linkVersion);
+
+    // Nothing moved, so the cached entries are not recomputed
+    obstacleBuffer.at(0, 0) = 123;
+    obstacleBuffer.at(1, 0) = 123;
+    linkBuffer.at(1, 2) = 123;
+    monitor.distanceToObjects(obstacleBuffer);
+    monitor.distanceBetweenArmLinks(linkBuffer);
+    REQUIRE(obstacleBuffer.at(0, 0) == 123);
+    REQUIRE(linkBuffer.at(1, 2) == 123);
+
+    // Moving one obstacle only recomputes its row
+    pose_1(0, 3) = 0.6;
+    REQUIRE(monitor.updateObstacle(0, pose_1));
+    REQUIRE_FALSE(monitor.updateObstacle(5, pose_1));
+    monitor.distanceToObjects(obstacleBuffer);
+    std::vector<std::vector<double>> ToObstacles = monitor.distanceToObjects();
+    REQUIRE(obstacleBuffer.at(0, 0) == Approx(ToObstacles[0][0]));
+    REQUIRE(obstacleBuffer.at(1, 0) == 123);
+
+    // Moving the last joint only recomputes the pairs of the last links
+    testPose[6] = deg2rad(60);
+    kinovaArm.updatePose(testPose);
+    REQUIRE(kinovaArm.links[3]->version == linkVersion);
+    monitor.distanceToObjects(obstacleBuffer);
+    monitor.distanceBetweenArmLinks(linkBuffer);
+    REQUIRE(obstacleBuffer.at(1, 0) == 123);
+    REQUIRE(linkBuffer.at(1, 2) == 123);
+
+    // Moving the second joint moves every link but the first one
+    testPose[1] = deg2rad(60);
+    kinovaArm.updatePose(testPose);
+    monitor.distanceToObjects(obstacleBuffer);
+    monitor.distanceBetweenArmLinks(linkBuffer);
+    REQUIRE(obstacleBuffer.at(1, 0) == 123);
+    ToObstacles = monitor.distanceToObjects();
+    std::vector<std::vector<double>> ToLinks = monitor.distanceBetweenArmLinks();
+    for(int i=0; i < obstacleBuffer.rows; i++ ) {
+        for(int j=1; j < obstacleBuffer.cols; j++){
+            REQUIRE(obstacleBuffer.at(i, j) == Approx(ToObstacles[i][j]));
+        }
+    }
+    for(int i=0; i < linkBuffer.rows; i++ ) {
+        for(int j=0; j < linkBuffer.cols; j++){
+            REQUIRE(linkBuffer.at(i, j) == Approx(ToLinks[i][j]));
+        }
+    }
+}
+
+TEST_CASE("Kinova_arm parallel distance to obstacles", "[monitor]") {
+
+    KinovaArm kinovaArm(urdf_filename);
+    std::vector<double> testPose = {deg2rad(30), deg2rad(30), deg2rad(30), deg2rad(30),
+                                    deg2rad(30), deg2rad(30), deg2rad(30)};
+    kinovaArm.updatePose(testPose);
+
+    // A grid of spheres, two rows share the smallest distance to test ties
+    Monitor monitor(&kinovaArm);
+    Eigen::Matrix4d pose_1 = Eigen::Matrix4d::Identity();
+    for (int i = 0; i < 200; i++) {
+        pose_1(0, 3) = -1.0 + 0.1 * (i % 20);
+        pose_1(1, 3) = -1.0 + 0.2 * (i / 20);
+        pose_1(2, 3) = 1.5;
+        Sphere sphere_1(pose_1, 0.05);
+        monitor.addObstacle(&sphere_1);
+    }
+    // Larger and centered on a link, so deeper than any sphere of the grid
+    pose_1.block<3, 1>(0, 3) = kinovaArm.links[3]->pose.block<3, 1>(0, 3);
+    Sphere closest(pose_1, 0.2);
+    monitor.addObstacle(&closest);
+    monitor.addObstacle(&closest);
+
+    DistanceMatrix serial;
+    serial.computeWitnessPoints = true;
+    monitor.distanceToObjects(serial);
+
+    ThreadPool pool(4);
+    monitor.setThreadPool(&pool);
+    monitor.tilePairs = 64;
+
+    DistanceMatrix parallel;
+    parallel.computeWitnessPoints = true;
+    for (int run = 0; run < 5; run++) {
+        monitor.distanceToObjects(parallel);
+
+        REQUIRE(parallel.distances == serial.distances);
+        REQUIRE(parallel.witnessPoints == serial.witnessPoints);
+        REQUIRE(parallel.minimum == serial.minimum);
+        REQUIRE(parallel.minimumRow == serial.minimumRow);
+        REQUIRE(parallel.minimumCol == serial.minimumCol);
+    }
+    REQUIRE(serial.minimumRow == 200);
+
+    // Every index of the range is visited exactly once
+    std::vector<int> visits(1000, 0);
+    pool.parallelFor(visits.size(), 7, [&](int begin, int end, int worker) {
+        for (int i = begin; i < end; i++) {
+            visits[i]++;
+        }
+    });
+    REQUIRE(std::count(visits.begin(), visits.end(), 1) == 1000);
+
+    // Queues smaller than the job take several grains per tile
+    ThreadPool smallPool(4, std::vector<int>(), 2);
+    REQUIRE(smallPool.maxTiles() == 8);
+    std::fill(visits.begin(), visits.end(), 0);
+    std::atomic<int> misaligned(0);
+    smallPool.parallelFor(visits.size(), 7, [&](int begin, int end, int worker) {
+        if (begin % 7 != 0) {
+            misaligned++;
+        }
+        for (int i = begin; i < end; i++) {
+            visits[i]++;
+        }
+    });
+    REQUIRE(std::count(visits.begin(), visits.end(), 1) == 1000);
+    REQUIRE(misaligned == 0);
+
+    monitor.setThreadPool(&smallPool);
+    monitor.distanceToObjects(parallel);
+    REQUIRE(parallel.distances == serial.distances);
+    REQUIRE(parallel.minimumRow == serial.minimumRow);
+    monitor.setThreadPool(NULL);
+}
+
+TEST_CASE("World model shares obstacles and robot pairs", "[monitor]") {
+
+    Eigen::Matrix4d baseTransform = Eigen::Matrix4d::Identity();
+    baseTransform(1, 3) = 0.5;
+    KinovaArm arm1(urdf_filename);
+    KinovaArm arm2(urdf_filename, baseTransform);
+    KinovaArm arm3(urdf_filename, baseTransform);
+    std::vector<double> pose1 = {0.3, 0.5, 0, 1.2, 0, 0.4, 0};
+    std::vector<double> pose2 = {-0.2, 0.7, 0.1, 0.9, 0, 0, 0};
+    arm1.updatePose(pose1);
+    arm2.updatePose(pose2);
+    arm3.updatePose(pose2);
+
+    WorldModel world;
+    Monitor monitor1(&world, world.addArm(&arm1));
+    Monitor monitor2(&world, world.addArm(&arm2));
+
+    // Obstacles added through one view are shared with the other
+    Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+    pose(0, 3) = 0.4;
+    pose(2, 3) = 0.6;
+    Sphere sphere(pose, 0.1);
+    ObstacleHandle handle = monitor1.addObstacle(&sphere);
+    monitor2.setMarkerObstacle("obstacles", 3, &sphere);
+    monitor1.setMarkerObstacle("obstacles", 3, &sphere);
+    REQUIRE(world.store.size() == 2);
+
+    // Same distances as a standalone monitor with the other arm as obstacle
+    Monitor reference(&arm1);
+    reference.addObstacle(&sphere);
+    reference.addObstacle(&sphere);
+    reference.addObstacle(&arm3);
+
+    DistanceMatrix viewDistances;
+    DistanceMatrix referenceDistances;
+    viewDistances.computeWitnessPoints = true;
+    referenceDistances.computeWitnessPoints = true;
+    monitor1.distanceToObjects(viewDistances);
+    reference.distanceToObjects(referenceDistances);
+    REQUIRE(monitor1.obstacles.size() == 2 + arm2.nLinks);
+    REQUIRE(viewDistances.rows == referenceDistances.rows);
+    for (int i = 0; i < viewDistances.rows; i++) {
+        for (int j = 0; j < viewDistances.cols; j++) {
+            REQUIRE(viewDistances.at(i, j) == Approx(referenceDistances.at(i, j)));
+            for (int k = 0; k < DistanceMatrix::WITNESS_SIZE; k++) {
+                REQUIRE(viewDistances.witness(i, j)[k] == 
+                        Approx(referenceDistances.witness(i, j)[k]).margin(1e-9));
+            }
+        }
+    }
+    REQUIRE(viewDistances.minimum == Approx(referenceDistances.minimum));
+    REQUIRE(viewDistances.minimumRow == referenceDistances.minimumRow);
+    REQUIRE(viewDistances.minimumCol == referenceDistances.minimumCol);
+
+    // The view of the second arm reads the same pair, transposed
+    DistanceMatrix otherDistances;
+    monitor2.distanceToObjects(otherDistances);
+    for (int i = 0; i < arm1.nLinks; i++) {
+        for (int j = 0; j < arm2.nLinks; j++) {
+            REQUIRE(otherDistances.at(2 + i, j) == viewDistances.at(2 + j, i));
+            REQUIRE(world.distance(0, i, 1, j) == world.distance(1, j, 0, i));
+        }
+    }
+
+    // The pair is only recomputed for the link that moved
+    world.robotDistances(0, 1).at(0, 0) = 123;
+    pose2[3] = 0.5;
+    arm2.updatePose(pose2);
+    world.update();
+    REQUIRE(world.robotDistances(1, 0).at(0, 0) == 123);
+
+    // The witness points were only computed for the view that asked for them
+    REQUIRE_FALSE(world.computeWitnessPoints);
+    REQUIRE_FALSE(world.robotDistances(0, 1).witnessesStored);
+
+    REQUIRE(monitor2.removeObstacle(handle));
+    REQUIRE(monitor2.removeMarkerObstacle("obstacles", 3));
+    monitor1.distanceToObjects(viewDistances);
+    REQUIRE(world.store.size() == 0);
+    REQUIRE(viewDistances.rows == arm2.nLinks);
+
+    // A base has its primitive as only column
+    NarkinBase base(Eigen::Vector3d(1, 0, 0.15));
+    Monitor baseMonitor(&world, world.addBase(&base));
+    DistanceMatrix baseDistances;
+    baseDistances.computeWitnessPoints = true;
+    baseMonitor.distanceToObjects(baseDistances);
+    REQUIRE(baseDistances.rows == arm1.nLinks + arm2.nLinks);
+    REQUIRE(baseDistances.cols == 1);
+    for (int i = 0; i < arm1.nLinks; i++) {
+        REQUIRE(baseDistances.at(i, 0) == 
+                Approx(base.base_primitive->getShortestDistance(arm1.links[i])));
+    }
+}
+
+TEST_CASE("Whole body model of an arm on a moving base", "[monitor]") {
+    KinovaArm arm(urdf_filename);
+    NarkinBase base(Eigen::Vector3d(0, 0, 0.15));
+    Eigen::Matrix4d mount = Eigen::Matrix4d::Identity();
+    mount(0, 3) = 0.2;
+    mount(2, 3) = 0.3;
+    WholeBodyModel body(&arm, &base, mount);
+    Monitor monitor(&body);
+    REQUIRE(monitor.arm == &arm);
+    REQUIRE(monitor.base == &base);
+
+    Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+    pose(0, 3) = 1.5;
+    pose(1, 3) = 2.2;
+    pose(2, 3) = 0.6;
+    Sphere sphere(pose, 0.1);
+    monitor.addObstacle(&sphere);
+
+    // Nothing moves until the distances are computed
+    std::vector<double> positions = {0.3, 0.5, 0, 1.2, 0, 0.4, 0};
+    REQUIRE(body.setJointPositions(positions));
+    REQUIRE_FALSE(body.setJointPositions(std::vector<double>(3, 0)));
+    body.setBasePose(Eigen::Vector3d(1, 2, M_PI_2));
+    Eigen::Matrix4d previousLink = arm.links[3]->pose;
+    REQUIRE(base.base_primitive->box_center == Eigen::Vector3d(0, 0, 0.15));
+
+    // The arm and the base are placed in one pass by the monitor
+    std::vector<std::vector<double>> armDistances = monitor.distanceToObjects();
+    std::vector<double> baseDistances = monitor.baseDistanceToObjects();
+    REQUIRE(arm.links[3]->pose != previousLink);
+    Eigen::Matrix4d frame;
+    frame << 0, -1, 0, 1,
+             1,  0, 0, 2,
+             0,  0, 1, 0,
+             0,  0, 0, 1;
+    REQUIRE((body.baseFrame() - frame).norm() < 1e-12);
+    REQUIRE((base.getPose() - Eigen::Vector3d(1, 2, M_PI_2)).norm() < 1e-12);
+    Box3* box = base.base_primitive;
+    REQUIRE((box->box_center - Eigen::Vector3d(1, 2, 0.15)).norm() < 1e-12);
+    REQUIRE((box->extents - Eigen::Vector3d(0.30, 0.33, 0.15)).norm() < 1e-12);
+    REQUIRE((box->maxPoint - Eigen::Vector3d(1.30, 2.33, 0.30)).norm() < 1e-12);
+
+    // The links are those of an arm fixed at the mount on the base
+    KinovaArm reference(urdf_filename, frame * mount);
+    REQUIRE(reference.updatePose(positions));
+    REQUIRE((arm.baseTransform - frame * mount).norm() < 1e-12);
+    for (int j = 0; j < arm.nLinks; j++) {
+        Capsule* link = static_cast<Capsule*>(arm.links[j]);
+        Capsule* expected = static_cast<Capsule*>(reference.links[j]);
+        REQUIRE((link->pose.block<3, 2>(0, 2) - expected->pose.block<3, 2>(0, 2)).norm() 
+                < 1e-9);
+        REQUIRE(armDistances[0][j] == Approx(expected->getShortestDistance(&sphere)));
+    }
+    REQUIRE(baseDistances.size() == 1);
+    REQUIRE(baseDistances[0] == Approx(box->getShortestDistance(&sphere)));
+
+    // Without a new pose the next queries do not move anything
+    unsigned long linkVersion = arm.links[3]->version;
+    unsigned long boxVersion = box->version;
+    monitor.distanceToObjects();
+    monitor.baseDistanceToObjects();
+    REQUIRE(arm.links[3]->version == linkVersion);
+    REQUIRE(box->version == boxVersion);
+
+    // A base motion alone moves the arm with it
+    body.setBasePose(1.5, 2, M_PI_2);
+    monitor.distanceToObjects();
+    REQUIRE(arm.links[3]->version != linkVersion);
+    REQUIRE((box->box_center - Eigen::Vector3d(1.5, 2, 0.15)).norm() < 1e-12);
+    frame(0, 3) = 1.5;
+    REQUIRE((arm.baseTransform - frame * mount).norm() < 1e-12);
+
+    // The bounds over a joint box follow the base too
+    DistanceMatrix bounds;
+    std::vector<double> lower(positions), upper(positions);
+    REQUIRE(monitor.distanceBoundsOverBox(lower, upper, bounds));
+    DistanceMatrix exact;
+    monitor.distanceToObjects(exact);
+    for (int j = 0; j < arm.nLinks; j++) {
+        REQUIRE(bounds.at(0, j) <= exact.at(0, j) + 1e-6);
+        REQUIRE(bounds.at(0, j) >= exact.at(0, j) - 0.05);
+    }
+
+    // The buffered queries place the body before computing the distances
+    body.setBasePose(0.5, 1, 0.3);
+    positions[3] = 0.8;
+    REQUIRE(body.setJointPositions(positions));
+    DistanceMatrix obstacleBuffer;
+    monitor.distanceToObjects(obstacleBuffer);
+    REQUIRE((arm.baseTransform - body.baseFrame() * mount).norm() < 1e-12);
+    KinovaArm moved(urdf_filename, body.baseFrame() * mount);
+    REQUIRE(moved.updatePose(positions));
+    for (int j = 0; j < arm.nLinks; j++) {
+        REQUIRE(obstacleBuffer.at(0, j) == Approx(moved.links[j]->getShortestDistance(&sphere)));
+    }
+    body.setBasePose(0.5, 1.5, 0.3);
+    DistanceMatrix linkBuffer;
+    monitor.distanceBetweenArmLinks(linkBuffer);
+    REQUIRE((box->box_center - Eigen::Vector3d(0.5, 1.5, 0.15)).norm() < 1e-12);
+    REQUIRE((arm.baseTransform - body.baseFrame() * mount).norm() < 1e-12);
+
+    // The arm against its own base, the first link stands on it
+    DistanceMatrix baseBuffer;
+    baseBuffer.computeWitnessPoints = true;
+    REQUIRE(monitor.armDistanceToBase(baseBuffer));
+    std::vector<double> toBase = monitor.armDistanceToBase();
+    REQUIRE(baseBuffer.rows == 1);
+    REQUIRE(baseBuffer.cols == arm.nLinks);
+    REQUIRE(toBase.size() == arm.nLinks);
+    REQUIRE(std::isinf(baseBuffer.at(0, 0)));
+    REQUIRE(std::isinf(toBase[0]));
+    for (int j = body.mountedLinks; j < arm.nLinks; j++) {
+        double expected = arm.links[j]->getShortestDistance(box);
+        REQUIRE(baseBuffer.at(0, j) == Approx(expected));
+        REQUIRE(toBase[j] == Approx(expected));
+        double* witness = baseBuffer.witness(0, j);
+        Eigen::Vector3d onBox(witness[3], witness[4], witness[5]);
+        REQUIRE(((onBox - box->box_center).cwiseAbs() - box->extents).maxCoeff() < 1e-6);
+    }
+
+    // Only a motion of the base or of the links recomputes the row
+    baseBuffer.at(0, 4) = 123;
+    REQUIRE(monitor.armDistanceToBase(baseBuffer));
+    REQUIRE(baseBuffer.at(0, 4) == 123);
+    body.setBasePose(0.5, 1.5, 0.6);
+    REQUIRE(monitor.armDistanceToBase(baseBuffer));
+    REQUIRE(baseBuffer.at(0, 4) == Approx(arm.links[4]->getShortestDistance(box)));
+
+    // A monitor without a base has no row for it
+    Monitor armOnly(&moved);
+    REQUIRE(armOnly.armDistanceToBase().empty());
+    REQUIRE_FALSE(armOnly.armDistanceToBase(baseBuffer));
+}
+
+TEST_CASE("Speed and separation of an arm on a moving base", "[monitor]") {
+    KinovaArm arm(urdf_filename);
+    NarkinBase base(Eigen::Vector3d(0, 0, 0.15));
+    Eigen::Matrix4d mount = Eigen::Matrix4d::Identity();
+    mount(2, 3) = 0.3;
+    WholeBodyModel body(&arm, &base, mount);
+    Monitor monitor(&body);
+    SeparationParameters parameters;
+    parameters.reactionTime = 0.2;
+    parameters.deceleration = 0.5;
+
+    // The distances of a control loop, the arm folded over its base
+    body.setBasePose(1, 2, 0.4);
+    std::vector<double> positions = {0, 1.5, 0, 1.5, 0, 1.0, 0};
+    REQUIRE(body.setJointPositions(positions));
+    DistanceMatrix objectDistances;
+    DistanceMatrix baseDistances;
+    objectDistances.computeWitnessPoints = true;
+    baseDistances.computeWitnessPoints = true;
+    monitor.distanceToObjects(objectDistances);
+    REQUIRE(monitor.armDistanceToBase(baseDistances));
+    REQUIRE(objectDistances.rows == 0);
+
+    // Only the base limits the arm lowered onto it
+    std::vector<double> lowering(arm.nJoints, 0);
+    lowering[1] = 1;
+    std::vector<double> raising(arm.nJoints, 0);
+    raising[1] = -1;
+    REQUIRE(monitor.speedScale(lowering, parameters, objectDistances) == 1);
+    double scale = monitor.speedScale(lowering, parameters, objectDistances, baseDistances);
+    REQUIRE(scale > 0);
+    REQUIRE(scale < 1);
+    REQUIRE(monitor.speedScale(raising, parameters, objectDistances, baseDistances) == 1);
+
+    // The mounted links standing on the base never limit the arm
+    std::vector<double> still(arm.nJoints, 0);
+    REQUIRE(monitor.speedScale(still, parameters, objectDistances, baseDistances) == 1);
+    for (int j = 0; j < body.mountedLinks; j++) {
+        REQUIRE(std::isinf(baseDistances.at(0, j)));
+    }
+
+    // Without the distances of the control loop the base is included too
+    REQUIRE(monitor.speedScale(lowering, parameters) == Approx(scale));
+
+    // The base reaches an obstacle the arm is far from
+    Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+    pose(0, 3) = 1.0;
+    pose(1, 3) = 2.5;
+    pose(2, 3) = 0.1;
+    Sphere sphere(pose, 0.1);
+    monitor.addObstacle(&sphere);
+    std::vector<double> baseObstacleDistances;
+    REQUIRE(monitor.baseDistanceToObjects(baseObstacleDistances));
+    REQUIRE(baseObstacleDistances.size() == 1);
+    REQUIRE(baseObstacleDistances[0] == Approx(base.base_primitive->getShortestDistance(&sphere)));
+    Monitor armOnly(&arm);
+    REQUIRE_FALSE(armOnly.baseDistanceToObjects(baseObstacleDistances));
+    REQUIRE(baseObstacleDistances.empty());
+}
+
+TEST_CASE("Kinova_arm link velocities and collision prediction", "[monitor]") {
+
+    KinovaArm kinovaArm(urdf_filename);
+    std::vector<double> positions = {0.3, 0.5, 0, 1.2, 0, 0.4, 0};
+    std::vector<double> velocities = {0.2, -0.4, 0.1, 0.3, 0.5, -0.2, 0.1};
+    kinovaArm.updatePose(positions);
+
+    // The link velocities match a finite difference of the frames
+    std::vector<Eigen::Vector3d> linear;
+    std::vector<Eigen::Vector3d> angular;
+    REQUIRE(kinovaArm.linkVelocities(velocities, linear, angular));
+    REQUIRE(linear.size() == kinovaArm.nLinks);
+    std::vector<Eigen::Vector3d> starts;
+    for (int k = 0; k <= kinovaArm.nLinks; k++) {
+        starts.push_back(kinovaArm.getPose(k).block<3, 1>(0, 3));
+    }
+    double dt = 1e-6;
+    std::vector<double> moved = positions;
+    for (int i = 0; i < moved.size(); i++) {
+        moved[i] += velocities[i] * dt;
+    }
+    kinovaArm.updatePose(moved);
+    for (int k = 0; k < kinovaArm.nLinks; k++) {
+        Eigen::Vector3d difference = (kinovaArm.getPose(k).block<3, 1>(0, 3) - starts[k]) / dt;
+        REQUIRE((difference - linear[k]).norm() < 1e-4);
+        Eigen::Vector3d endDifference = (kinovaArm.getPose(k + 1).block<3, 1>(0, 3) - starts[k + 1]) / dt;
+        Eigen::Vector3d endVelocity = linear[k] + angular[k].cross(starts[k + 1] - starts[k]);
+        REQUIRE((endDifference - endVelocity).norm() < 1e-4);
+    }
+
+    // A sphere close to the end effector
+    kinovaArm.updatePose(positions);
+    Monitor monitor(&kinovaArm);
+    Eigen::Matrix4d pose = kinovaArm.getPose();
+    pose(0, 3) += 0.1;
+    pose(2, 3) += 0.1;
+    Sphere near(pose, 0.02);
+    pose(0, 3) += 5;
+    Sphere far(pose, 0.02);
+    monitor.addObstacle(&near);
+    monitor.addObstacle(&far);
+
+    std::vector<ImminentContact> contacts;
+    REQUIRE(monitor.predictCollisions(positions, velocities, 0.5, contacts));
+    REQUIRE(contacts.size() > 0);
+    for (int c = 0; c < contacts.size(); c++) {
+        // The far sphere cannot be reached within the horizon
+        REQUIRE(contacts[c].obstacle == 0);
+        REQUIRE(contacts[c].minimumTimeToCollision <= 0.5);
+        REQUIRE(contacts[c].distanceRate >= -contacts[c].maxClosingSpeed - 1e-9);
+        REQUIRE(contacts[c].timeToCollision >= contacts[c].minimumTimeToCollision);
+        if (c > 0) {
+            REQUIRE(contacts[c - 1].timeToCollision <= contacts[c].timeToCollision);
+        }
+
+        // The rate matches a finite difference of the distance
+        int link = contacts[c].link;
+        double before = kinovaArm.links[link]->getShortestDistance(monitor.obstacles[0]);
+        kinovaArm.updatePose(moved);
+        double after = kinovaArm.links[link]->getShortestDistance(monitor.obstacles[0]);
+        kinovaArm.updatePose(positions);
+        REQUIRE((after - before) / dt == Approx(contacts[c].distanceRate).margin(1e-3));
+    }
+
+    // Nothing is imminent for a still arm
+    std::vector<double> still(7, 0.0);
+    REQUIRE(monitor.predictCollisions(positions, still, 0.5, contacts));
+    REQUIRE(contacts.size() == 0);
+}
+
+TEST_CASE("Kinova_arm distance bounds over a joint box", "[monitor]") {
+
+    KinovaArm kinovaArm(urdf_filename);
+    std::vector<double> center = {0.3, 0.5, 0, 1.2, 0, 0.4, 0};
+    kinovaArm.updatePose(center);
+
+    // The chain model gives the frames and the links of the arm
+    ChainModel model;
+    REQUIRE(kinovaArm.getChainModel(model));
+    REQUIRE(model.nJoints() == kinovaArm.nJoints);
+    REQUIRE(model.segments.size() == kinovaArm.nLinks);
+    std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>> frames;
+    REQUIRE(model.forwardKinematics(center, frames));
+    for (int k = 0; k < kinovaArm.nFrames; k++) {
+        REQUIRE((frames[k] - kinovaArm.getPose(k)).norm() < 1e-9);
+    }
+    for (int k = 0; k < kinovaArm.nLinks; k++) {
+        Capsule* link = static_cast<Capsule*>(kinovaArm.links[k]);
+        Eigen::Vector4d end = link->pose * Eigen::Vector4d(0, 0, link->getLength(), 1);
+        Eigen::Vector3d start = link->pose.block<3, 1>(0, 3);
+        const ChainModel::Segment &segment = model.segments[k];
+        REQUIRE((frames[k].block<3, 3>(0, 0) * segment.linkStart +
+                 frames[k].block<3, 1>(0, 3) - start).norm() < 1e-6);
+        REQUIRE((frames[k].block<3, 3>(0, 0) * segment.linkEnd +
+                 frames[k].block<3, 1>(0, 3) - end.head(3)).norm() < 1e-6);
+    }
+
+    Monitor monitor(&kinovaArm);
+    Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+    for (int i = 0; i < 12; i++) {
+        pose(0, 3) = 0.6 * std::cos(0.5 * i);
+        pose(1, 3) = 0.6 * std::sin(0.5 * i);
+        pose(2, 3) = 0.1 * i;
+        if (i % 2 == 0) {
+            Sphere sphere(pose, 0.05);
+            monitor.addObstacle(&sphere);
+        } else {
+            Capsule capsule(pose, 0.15, 0.03);
+            monitor.addObstacle(&capsule);
+        }
+    }
+    DistanceMatrix exact;
+    monitor.distanceToObjects(exact);
+
+    // A box of one configuration gives its distances to the spheres, the 
+    // capsule distances are between segments and never above the monitor's
+    DistanceMatrix bounds;
+    Eigen::Matrix4d endEffector = kinovaArm.getPose();
+    REQUIRE(monitor.distanceBoundsOverBox(center, center, bounds));
+    REQUIRE(bounds.rows == exact.rows);
+    REQUIRE(bounds.cols == exact.cols);
+    for (int i = 0; i < exact.rows; i++) {
+        for (int j = 0; j < exact.cols; j++) {
+            if (dynamic_cast<Sphere*>(monitor.obstacles[i]) != NULL) {
+                REQUIRE(bounds.at(i, j) == Approx(exact.at(i, j)).margin(1e-5));
+            } else {
+                REQUIRE(bounds.at(i, j) <= exact.at(i, j) + 1e-5);
+            }
+        }
+    }
+    REQUIRE(kinovaArm.getPose() == endEffector);
+
+    // The bounds hold for every configuration of a box
+    std::vector<double> lower(center), upper(center);
+    for (int i = 0; i < kinovaArm.nJoints; i++) {
+        lower[i] -= 0.05;
+        upper[i] += 0.05;
+    }
+    REQUIRE(monitor.distanceBoundsOverBox(lower, upper, bounds));
+    REQUIRE(bounds.minimum <= exact.minimum);
+    for (int n = 0; n < 64; n++) {
+        std::vector<double> sample(center);
+        for (int i = 0; i < kinovaArm.nJoints; i++) {
+            // Corners and points spread inside the box
+            double t = n < 16 ? ((n >> (i % 4)) & 1) : 0.5 + 0.5 * std::sin(12.9898 * n + 78.233 * i);
+            sample[i] = lower[i] + t * (upper[i] - lower[i]);
+        }
+        kinovaArm.updatePose(sample);
+        monitor.distanceToObjects(exact);
+        // Up to the float dimensions of the primitives
+        for (int k = 0; k < exact.distances.size(); k++) {
+            REQUIRE(bounds.distances[k] <= exact.distances[k] + 1e-6);
+        }
+    }
+    kinovaArm.updatePose(center);
+
+    // A box far from every obstacle is certified collision free
+    Monitor farMonitor(&kinovaArm);
+    pose(0, 3) = 3.0;
+    Sphere far(pose, 0.1);
+    farMonitor.addObstacle(&far);
+    REQUIRE(farMonitor.distanceBoundsOverBox(lower, upper, bounds));
+    REQUIRE(bounds.minimum > 1.0);
+
+    // An obstacle at the end effector is not
+    pose.block<3, 1>(0, 3) = endEffector.block<3, 1>(0, 3);
+    Sphere near(pose, 0.02);
+    farMonitor.addObstacle(&near);
+    REQUIRE(farMonitor.distanceBoundsOverBox(lower, upper, bounds));
+    REQUIRE(bounds.minimum < 0);
+    REQUIRE(bounds.minimumRow == 1);
+
+    // Boxes of the wrong size or empty are refused
+    std::vector<double> shortBox(3, 0.0);
+    REQUIRE_FALSE(monitor.distanceBoundsOverBox(shortBox, shortBox, bounds));
+    REQUIRE_FALSE(monitor.distanceBoundsOverBox(upper, lower, bounds));
+}
+
+TEST_CASE("Kinova_arm obstacle clustering", "[monitor]") {
+
+    KinovaArm kinovaArm(urdf_filename);
+    std::vector<double> positions = {0.3, 0.5, 0, 1.2, 0, 0.4, 0};
+    kinovaArm.updatePose(positions);
+    Monitor monitor(&kinovaArm);
+
+    // One obstacle next to the end effector
+    Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+    pose.block<3, 1>(0, 3) = kinovaArm.getPose(kinovaArm.nFrames - 1).block<3, 1>(0, 3);
+    pose(0, 3) += 0.1;
+    Sphere near(pose, 0.02);
+    monitor.addObstacle(&near);
+
+    // Small obstacles on a shelf far from the arm
+    for (int a = 0; a < 10; a++) {
+        for (int b = 0; b < 10; b++) {
+            for (int c = 0; c < 2; c++) {
+                Eigen::Matrix4d shelf = Eigen::Matrix4d::Identity();
+                shelf(0, 3) = 3.0 + 0.04 * a;
+                shelf(1, 3) = -0.2 + 0.04 * b;
+                shelf(2, 3) = 0.5 + 0.1 * c;
+                if ((a + b) % 2 == 0) {
+                    Sphere sphere(shelf, 0.01);
+                    monitor.addObstacle(&sphere);
+                } else {
+                    Capsule capsule(shelf, 0.03, 0.01);
+                    monitor.addObstacle(&capsule);
+                }
+            }
+        }
+    }
+    int nObstacles = monitor.obstacles.size();
+
+    DistanceMatrix exact;
+    monitor.distanceToObjects(exact);
+    REQUIRE(monitor.effectiveObstacleCount() == nObstacles);
+
+    // The shelf is a few groups that are never refined
+    double refinementDistance = 0.5;
+    monitor.enableObstacleClustering(0.5, refinementDistance);
+    DistanceMatrix clustered;
+    clustered.computeWitnessPoints = true;
+    monitor.distanceToObjects(clustered);
+    REQUIRE(monitor.effectiveObstacleCount() < 10);
+    REQUIRE(clustered.minimum == exact.minimum);
+    REQUIRE(clustered.minimumRow == exact.minimumRow);
+    for (int k = 0; k < exact.distances.size(); k++) {
+        REQUIRE(clustered.distances[k] <= exact.distances[k] + 1e-9);
+        if (clustered.distances[k] < refinementDistance) {
+            REQUIRE(clustered.distances[k] == exact.distances[k]);
+        }
+    }
+    for (int j = 0; j < exact.cols; j++) {
+        REQUIRE(clustered.at(0, j) == exact.at(0, j));
+    }
+
+    // The members of a group share its witness points, which are kept 
+    // while nothing moves
+    int last = nObstacles - 1;
+    double approximated = clustered.at(last, 0);
+    REQUIRE(approximated < exact.at(last, 0));
+    clustered.at(last, 0) = 123;
+    monitor.distanceToObjects(clustered);
+    REQUIRE(clustered.at(last, 0) == 123);
+    clustered.at(last, 0) = approximated;
+    Eigen::MatrixXd points(2, 3);
+    monitor.clusters.bound(monitor.clusters.size() - 1)->getClosestPoints(points, 
+                                                                         kinovaArm.links[0]);
+    for (int k = 0; k < 3; k++) {
+        REQUIRE(clustered.witness(last, 0)[k] == Approx(points(1, k)));
+    }
+
+    // Moving an obstacle next to the arm rebuilds the groups
+    monitor.obstacles[7]->setPose(near.pose);
+    monitor.disableObstacleClustering();
+    monitor.distanceToObjects(exact);
+    monitor.enableObstacleClustering(0.5, refinementDistance);
+    monitor.distanceToObjects(clustered);
+    for (int j = 0; j < exact.cols; j++) {
+        REQUIRE(clustered.at(7, j) == exact.at(7, j));
+    }
+    REQUIRE(clustered.minimum == exact.minimum);
+
+    // With a long refinement distance every group is refined
+    monitor.enableObstacleClustering(0.5, 100.0);
+    monitor.distanceToObjects(clustered);
+    REQUIRE(monitor.effectiveObstacleCount() > nObstacles);
+    REQUIRE(clustered.distances == exact.distances);
+
+    // Nothing is computed when nothing moved
+    monitor.distanceToObjects(clustered);
+    REQUIRE(monitor.effectiveObstacleCount() == 0);
+
+    // Without clustering the lower bounds are computed again
+    DistanceMatrix bounded;
+    monitor.enableObstacleClustering(0.5, refinementDistance);
+    monitor.distanceToObjects(bounded);
+    REQUIRE(bounded.distances != exact.distances);
+    monitor.disableObstacleClustering();
+    monitor.distanceToObjects(bounded);
+    REQUIRE(bounded.distances == exact.distances);
+    REQUIRE(monitor.effectiveObstacleCount() == nObstacles);
+}
+
+TEST_CASE("Kinova_arm anytime distance to obstacles", "[monitor]") {
+
+    KinovaArm kinovaArm(urdf_filename);
+    std::vector<double> positions = {0.3, 0.5, 0, 1.2, 0, 0.4, 0};
+    kinovaArm.updatePose(positions);
+    Monitor monitor(&kinovaArm);
+
+    // Spheres and capsules spread around the arm
+    Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+    std::vector<ObstacleHandle> handles;
+    for (int i = 0; i < 60; i++) {
+        pose(0, 3) = -0.9 + 0.03 * i;
+        pose(1, 3) = 0.4 * std::sin(0.7 * i);
+        pose(2, 3) = 0.2 + 0.01 * i;
+        if (i % 2 == 0) {
+            Sphere sphere(pose, 0.03);
+            handles.push_back(monitor.addObstacle(&sphere));
+        } else {
+            Capsule capsule(pose, 0.2, 0.02);
+            handles.push_back(monitor.addObstacle(&capsule));
+        }
+    }
+
+    // The enclosing spheres contain the shapes
+    Eigen::Vector3d center;
+    double radius;
+    Box3 box(pose, 0.1, 0.05, 0.08);
+    box.getBoundingSphere(center, radius);
+    for (int corner = 0; corner < 8; corner++) {
+        REQUIRE((box.CornerPoint(corner) - center).norm() <= radius + 1e-9);
+    }
+    Capsule capsule(pose, 0.2, 0.02);
+    capsule.getBoundingSphere(center, radius);
+    REQUIRE((pose.block<3, 1>(0, 3) - center).norm() + 0.02 <= radius + 1e-9);
+
+    DistanceMatrix exact;
+    monitor.distanceToObjects(exact);
+
+    // With time to spare every pair is exact
+    DistanceMatrix anytime;
+    double resolvedDistance;
+    REQUIRE(monitor.distanceToObjects(anytime, 10.0, resolvedDistance) == 0);
+    REQUIRE(resolvedDistance == std::numeric_limits<double>::infinity());
+    REQUIRE(anytime.distances == exact.distances);
+    REQUIRE(anytime.minimum == exact.minimum);
+
+    // The exact entries are kept, only the moved obstacle is bounded
+    int nPairs = exact.rows * exact.cols;
+    REQUIRE(monitor.distanceToObjects(anytime, 0.0, resolvedDistance) == 0);
+    REQUIRE(anytime.distances == exact.distances);
+    int row = monitor.obstacleIndex(handles[4]);
+    Eigen::Matrix4d moved = monitor.obstacles[row]->pose;
+    moved(2, 3) += 0.01;
+    REQUIRE(monitor.updateObstacle(handles[4], moved));
+    monitor.distanceToObjects(exact);
+    int unresolved = monitor.distanceToObjects(anytime, 0.0, resolvedDistance);
+    REQUIRE(unresolved == exact.cols);
+    REQUIRE(resolvedDistance == -std::numeric_limits<double>::infinity());
+    for (int k = 0; k < nPairs; k++) {
+        if (k / exact.cols != row) {
+            REQUIRE(anytime.distances[k] == exact.distances[k]);
+        }
+    }
+    // The unresolved row is computed again by the next call
+    REQUIRE(monitor.distanceToObjects(anytime, 10.0, resolvedDistance) == 0);
+    REQUIRE(anytime.distances == exact.distances);
+
+    // The pairs resolved by a pool are the same
+    ThreadPool pool(3);
+    monitor.setThreadPool(&pool);
+    monitor.tilePairs = 16;
+    DistanceMatrix parallel;
+    REQUIRE(monitor.distanceToObjects(parallel, 10.0, resolvedDistance) == 0);
+    REQUIRE(parallel.distances == exact.distances);
+    REQUIRE(parallel.minimumRow == exact.minimumRow);
+    REQUIRE(parallel.minimumCol == exact.minimumCol);
+    monitor.setThreadPool(NULL);
+
+    // A short budget resolves the most critical pairs first, the bounds 
+    // never overestimate
+    DistanceMatrix partial;
+    unresolved = monitor.distanceToObjects(partial, 20e-6, resolvedDistance);
+    anytime = partial;
+    REQUIRE(unresolved >= 0);
+    REQUIRE(unresolved <= nPairs);
+    for (int k = 0; k < nPairs; k++) {
+        REQUIRE(anytime.distances[k] <= exact.distances[k] + 1e-9);
+        // Pairs that can be closer than the resolved distance are exact
+        if (anytime.distances[k] < resolvedDistance) {
+            REQUIRE(anytime.distances[k] == exact.distances[k]);
+        }
+    }
+
+    // The incremental evaluation does not trust the bounds
+    monitor.distanceToObjects(anytime);
+    REQUIRE(anytime.distances == exact.distances);
+}
+
+TEST_CASE("Kinova_arm speed and separation scale", "[monitor]") {
+
+    KinovaArm kinovaArm(urdf_filename);
+    std::vector<double> positions = {0.3, 0.5, 0, 1.2, 0, 0.4, 0};
+    std::vector<double> velocities = {0.2, -0.4, 0.1, 0.3, 0.5, -0.2, 0.1};
+    kinovaArm.updatePose(positions);
+    Monitor monitor(&kinovaArm);
+    SeparationParameters separation;
+    separation.reactionTime = 0.1;
+    separation.deceleration = 2.0;
+    separation.obstacleSpeed = 0.2;
+    separation.protectiveDistance = 0.02;
+
+    // Full speed without obstacles or motion
+    REQUIRE(monitor.speedScale(velocities, separation) == 1);
+
+    // A sphere in front of the end effector, in the direction it moves
+    std::vector<Eigen::Vector3d> linear;
+    std::vector<Eigen::Vector3d> angular;
+    REQUIRE(kinovaArm.linkVelocities(velocities, linear, angular));
+    int last = kinovaArm.nLinks - 1;
+    Eigen::Vector3d tip = kinovaArm.getPose(last + 1).block<3, 1>(0, 3);
+    Eigen::Vector3d tipVelocity = linear[last] + angular[last].cross(
+                                  tip - kinovaArm.getPose(last).block<3, 1>(0, 3));
+    Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+    pose.block<3, 1>(0, 3) = tip + 0.15 * tipVelocity.normalized();
+    Sphere sphere(pose, 0.02);
+    ObstacleHandle handle = monitor.addObstacle(&sphere);
+
+    double scale = monitor.speedScale(velocities, separation);
+    REQUIRE(scale > 0);
+    REQUIRE(scale < 1);
+
+    // Same scale from the distances of the caller, which need the witnesses
+    DistanceMatrix distances;
+    monitor.distanceToObjects(distances);
+    REQUIRE(monitor.speedScale(velocities, separation, distances) == 0);
+    distances.computeWitnessPoints = true;
+    monitor.distanceToObjects(distances);
+    REQUIRE(monitor.speedScale(velocities, separation, distances) == scale);
+
+    // At the scaled speed every closing pair can stop in time
+    std::vector<double> scaled = velocities;
+    for (int i = 0; i < scaled.size(); i++) {
+        scaled[i] *= scale;
+    }
+    std::vector<ImminentContact> contacts;
+    REQUIRE(monitor.predictCollisions(positions, scaled, 100, contacts));
+    double tightest = std::numeric_limits<double>::max();
+    for (int c = 0; c < contacts.size(); c++) {
+        double speed = -contacts[c].distanceRate;
+        double obstacleTravel = separation.obstacleSpeed * 
+            (separation.reactionTime + std::max(speed, 0.0) / separation.deceleration);
+        double stopping = std::max(speed, 0.0) * separation.reactionTime + 
+            speed * std::max(speed, 0.0) / (2 * separation.deceleration);
+        double left = contacts[c].distance - stopping - obstacleTravel - 
+                      separation.protectiveDistance;
+        REQUIRE(left >= -1e-9);
+        tightest = std::min(tightest, left);
+    }
+    // The scale is the largest one, the tightest pair stops right at the limit
+    REQUIRE(tightest == Approx(0).margin(1e-9));
+
+    // Moving away is not limited
+    std::vector<double> away = velocities;
+    for (int i = 0; i < away.size(); i++) {
+        away[i] = -away[i];
+    }
+    REQUIRE(monitor.speedScale(away, separation) == 1);
+
+    // Within the protective distance the arm must stop
+    pose.block<3, 1>(0, 3) = tip + 0.03 * tipVelocity.normalized();
+    REQUIRE(monitor.updateObstacle(handle, pose));
+    REQUIRE(monitor.speedScale(velocities, separation) == 0);
+
+    // A capsule shorter than the link, across and along its motion
+    REQUIRE(monitor.removeObstacle(handle));
+    Capsule* lastLink = static_cast<Capsule*>(kinovaArm.links[last]);
+    Eigen::Vector3d across = tipVelocity.cross(Eigen::Vector3d::UnitX()).normalized();
+    std::vector<Eigen::Vector3d> axes = {across, lastLink->pose.block<3, 1>(0, 2)};
+    for (int a = 0; a < axes.size(); a++) {
+        double length = 0.5 * lastLink->getLength();
+        Eigen::Matrix4d capsulePose = Eigen::Matrix4d::Identity();
+        capsulePose.block<3, 3>(0, 0) = Eigen::Quaterniond::FromTwoVectors(
+            Eigen::Vector3d::UnitZ(), axes[a]).toRotationMatrix();
+        capsulePose.block<3, 1>(0, 3) = tip + 0.15 * tipVelocity.normalized() - 
+                                        0.5 * length * axes[a];
+        Capsule shortCapsule(capsulePose, length, 0.02);
+        ObstacleHandle capsuleHandle = monitor.addObstacle(&shortCapsule);
+
+        // The first witness point is on the link
+        DistanceMatrix witnesses;
+        witnesses.computeWitnessPoints = true;
+        monitor.distanceToObjects(witnesses);
+        Eigen::Vector3d linkStart = lastLink->pose.block<3, 1>(0, 3);
+        Eigen::Vector3d linkEnd = (lastLink->pose * 
+            Eigen::Vector4d(0, 0, lastLink->getLength(), 1)).head(3);
+        double* witness = witnesses.witness(0, last);
+        Line linkAxis(linkStart, linkEnd);
+        REQUIRE(linkAxis.getShortestDistanceToPoint(
+            Eigen::Vector3d(witness[0], witness[1], witness[2])) < 1e-9);
+
+        // Towards the capsule is slowed and predicted as closing
+        double capsuleScale = monitor.speedScale(velocities, separation);
+        REQUIRE(capsuleScale > 0);
+        REQUIRE(capsuleScale < 1);
+        REQUIRE(monitor.predictCollisions(positions, velocities, 100, contacts));
+        bool lastFound = false;
+        for (int c = 0; c < contacts.size(); c++) {
+            if (contacts[c].link == last) {
+                lastFound = true;
+                REQUIRE(contacts[c].distanceRate < 0);
+                REQUIRE(contacts[c].timeToCollision < 
+                        std::numeric_limits<double>::infinity());
+            }
+        }
+        REQUIRE(lastFound);
+
+        // Away from it is neither slowed nor closing
+        REQUIRE(monitor.speedScale(away, separation) == 1);
+        REQUIRE(monitor.predictCollisions(positions, away, 100, contacts));
+        for (int c = 0; c < contacts.size(); c++) {
+            if (contacts[c].link == last) {
+                REQUIRE(contacts[c].distanceRate > 0);
+            }
+        }
+        REQUIRE(monitor.removeObstacle(capsuleHandle));
+    }
+}
+
+TEST_CASE("Kinova_arm batch configuration check", "[monitor]") {
+
+    KinovaArm kinovaArm(urdf_filename);
+    std::vector<double> livePose = {0.3, 0.5, 0, 1.2, 0, 0.4, 0};
+    kinovaArm.updatePose(livePose);
+    Eigen::Matrix4d endEffector = kinovaArm.getPose();
+
+    Monitor monitor(&kinovaArm);
+    Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+    pose(0, 3) = 0.4;
+    pose(2, 3) = 0.6;
+    Sphere sphere(pose, 0.1);
+    monitor.addObstacle(&sphere);
+    // The links of the arm itself are not checked against the configurations
+    monitor.addObstacle(&kinovaArm);
+
+    // A sweep of the first two joints
+    std::vector<std::vector<double>> configurations;
+    for (int c = 0; c < 300; c++) {
+        std::vector<double> q = livePose;
+        q[0] = -M_PI + 2 * M_PI * c / 300;
+        q[1] = 0.8 * std::sin(0.05 * c);
+        configurations.push_back(q);
+    }
+
+    std::vector<double> serial;
+    int serialInvalid;
+    REQUIRE(monitor.checkConfigurations(configurations, 0.05, serial, serialInvalid));
+    REQUIRE(serial.size() == configurations.size());
+
+    // The live arm did not move
+    REQUIRE(kinovaArm.getPose() == endEffector);
+
+    // Same distances as moving a single arm configuration by configuration
+    KinovaArm reference(urdf_filename);
+    int expectedInvalid = -1;
+    for (int c = 0; c < configurations.size(); c++) {
+        reference.updatePose(configurations[c]);
+        double minimum = std::numeric_limits<double>::max();
+        for (int j = 0; j < reference.nLinks; j++) {
+            minimum = std::min(minimum, reference.links[j]->getShortestDistance(&sphere));
+        }
+        REQUIRE(serial[c] == Approx(minimum));
+        if (expectedInvalid < 0 && minimum < 0.05) {
+            expectedInvalid = c;
+        }
+    }
+    REQUIRE(expectedInvalid >= 0);
+    REQUIRE(serialInvalid == expectedInvalid);
+
+    // The parallel evaluation gives the same result
+    ThreadPool pool(4);
+    monitor.setThreadPool(&pool);
+    monitor.tileConfigurations = 16;
+    std::vector<double> parallel;
+    int parallelInvalid;
+    REQUIRE(monitor.checkConfigurations(configurations, 0.05, parallel, parallelInvalid));
+    REQUIRE(parallel == serial);
+    REQUIRE(parallelInvalid == serialInvalid);
+
+    // All valid with no clearance needed far from the sphere
+    REQUIRE(monitor.checkConfigurations(configurations, -1, parallel, parallelInvalid));
+    REQUIRE(parallelInvalid == -1);
+
+    // The end points of the links come from the chain, no copy is made
+    REQUIRE(monitor.batchArms.empty());
+    REQUIRE(monitor.batchKinematics.size() == configurations.size());
+
+    // Stored capsules and boxes and the links of another arm
+    pose(0, 3) = -0.4;
+    Capsule capsule(pose, 0.3, 0.05);
+    monitor.addObstacle(&capsule);
+    pose(0, 3) = 0;
+    pose(1, 3) = 0.5;
+    Box3 box(pose, 0.1, 0.2, 0.1);
+    monitor.addObstacle(&box);
+    Eigen::Matrix4d otherBase = Eigen::Matrix4d::Identity();
+    otherBase(0, 3) = 0.9;
+    KinovaArm other(urdf_filename, otherBase);
+    monitor.addObstacle(&other);
+    // Capsule pairs use the exact distance between the axes
+    REQUIRE(monitor.checkConfigurations(configurations, 0.05, parallel, parallelInvalid));
+    std::vector<Primitive*> all = {&sphere, &capsule, &box};
+    all.insert(all.end(), other.links.begin(), other.links.end());
+    for (int c = 0; c < configurations.size(); c++) {
+        reference.updatePose(configurations[c]);
+        double minimum = std::numeric_limits<double>::max();
+        for (int j = 0; j < reference.nLinks; j++) {
+            Capsule* link = static_cast<Capsule*>(reference.links[j]);
+            Eigen::Vector3d start = link->pose.block<3, 1>(0, 3);
+            Eigen::Vector3d end = (link->pose * 
+                Eigen::Vector4d(0, 0, link->getLength(), 1)).head(3);
+            for (int i = 0; i < all.size(); i++) {
+                minimum = std::min(minimum, Monitor::capsuleDistance(start, end, 
+                                   link->getRadius(), all[i]));
+            }
+        }
+        REQUIRE(parallel[c] == Approx(minimum).margin(1e-6));
+    }
+
+    // A configuration with the wrong number of joints is rejected
+    configurations[10].pop_back();
+    REQUIRE_FALSE(monitor.checkConfigurations(configurations, 0.05, parallel, parallelInvalid));
+}
+
+TEST_CASE("Kinova_arm trajectory validation", "[monitor]") {
+
+    KinovaArm kinovaArm(urdf_filename);
+    std::vector<double> livePose = {0.3, 0.5, 0, 1.2, 0, 0.4, 0};
+    kinovaArm.updatePose(livePose);
+    Eigen::Matrix4d liveEndEffector = kinovaArm.getPose();
+    Monitor monitor(&kinovaArm);
+    TrajectoryValidator validator(&monitor);
+
+    // The motion bound holds for the ends of every link
+    KinovaArm reference(urdf_filename);
+    std::vector<double> start = {0.1, -0.4, 0.3, 1.0, -0.2, 0.6, 0.1};
+    std::vector<double> end = {0.4, 0.2, -0.3, 1.5, 0.5, -0.2, 0.9};
+    double bound = validator.motionBound(start, end);
+    reference.updatePose(start);
+    std::vector<Eigen::Vector3d> startPoints;
+    for (int k = 0; k < reference.nFrames; k++) {
+        startPoints.push_back(reference.getPose(k).block<3, 1>(0, 3));
+    }
+    for (int step = 1; step <= 20; step++) {
+        std::vector<double> q = start;
+        for (int i = 0; i < q.size(); i++) {
+            q[i] += step / 20.0 * (end[i] - start[i]);
+        }
+        reference.updatePose(q);
+        for (int k = 0; k < reference.nFrames; k++) {
+            REQUIRE((reference.getPose(k).block<3, 1>(0, 3) - startPoints[k]).norm() <= bound);
+        }
+    }
+
+    // A long sweep of the first joint in free space
+    Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+    pose(2, 3) = 3;
+    Sphere far(pose, 0.1);
+    ObstacleHandle farHandle = monitor.addObstacle(&far);
+    std::vector<std::vector<double>> sweep;
+    for (int w = 0; w <= 50; w++) {
+        std::vector<double> q = livePose;
+        q[0] = -M_PI + 2 * M_PI * w / 50;
+        sweep.push_back(q);
+    }
+    validator.clearance = 0.05;
+    REQUIRE(validator.validate(sweep));
+    REQUIRE(validator.invalidSegment == -1);
+    REQUIRE(validator.nChecks < 2 * sweep.size());
+
+    // A sphere between two waypoints that are both clear
+    monitor.removeObstacle(farHandle);
+    std::vector<double> first = livePose;
+    std::vector<double> second = livePose;
+    first[0] = -0.5;
+    second[0] = 0.5;
+    std::vector<std::vector<double>> crossing = {livePose, first, second};
+    kinovaArm.updatePose(livePose);
+    pose.block<3, 1>(0, 3) = kinovaArm.getPose().block<3, 1>(0, 3);
+    Sphere small(pose, 0.01);
+    monitor.addObstacle(&small);
+    for (int w = 1; w < crossing.size(); w++) {
+        reference.updatePose(crossing[w]);
+        double waypointDistance = std::numeric_limits<double>::max();
+        for (int j = 0; j < reference.nLinks; j++) {
+            waypointDistance = std::min(waypointDistance,
+                                        reference.links[j]->getShortestDistance(&small));
+        }
+        REQUIRE(waypointDistance > 0.05);
+    }
+
+    // Starting at the sphere is invalid right away
+    REQUIRE_FALSE(validator.validate(crossing));
+    REQUIRE(validator.invalidSegment == 0);
+    REQUIRE(validator.invalidFraction == 0);
+
+    crossing.erase(crossing.begin());
+    REQUIRE_FALSE(validator.validate(crossing));
+    REQUIRE(validator.invalidSegment == 0);
+    REQUIRE(validator.invalidFraction > 0);
+    REQUIRE(validator.invalidFraction < 1);
+
+    // The configuration found is really too close
+    std::vector<double> found = first;
+    found[0] += validator.invalidFraction * (second[0] - first[0]);
+    reference.updatePose(found);
+    double foundDistance = std::numeric_limits<double>::max();
+    for (int j = 0; j < reference.nLinks; j++) {
+        foundDistance = std::min(foundDistance, reference.links[j]->getShortestDistance(&small));
+    }
+    REQUIRE(foundDistance < validator.clearance);
+
+    // A valid trajectory has no dense sample within the clearance
+    validator.clearance = 0;
+    std::vector<double> aside = first;
+    aside[0] = -1.2;
+    std::vector<std::vector<double>> around = {aside, first};
+    REQUIRE(validator.validate(around));
+    for (int step = 0; step <= 200; step++) {
+        std::vector<double> q = aside;
+        q[0] += step / 200.0 * (first[0] - aside[0]);
+        reference.updatePose(q);
+        for (int j = 0; j < reference.nLinks; j++) {
+            REQUIRE(reference.links[j]->getShortestDistance(&small) >= 0);
+        }
+    }
+
+    // The live arm did not move, nor did the copy of the validator as the
+    // links are placed from the chain
+    REQUIRE(kinovaArm.getPose() == liveEndEffector);
+    REQUIRE(validator.chainLoaded);
+    REQUIRE(validator.arm->getPose() == liveEndEffector);
+    std::vector<std::vector<double>> wrong = {std::vector<double>(3, 0.0)};
+    REQUIRE_FALSE(validator.validate(wrong));
+}
+
+TEST_CASE("Kinova_arm configuration cache", "[monitor]") {
+
+    KinovaArm kinovaArm(urdf_filename);
+    std::vector<double> positions = {0.3, 0.5, 0, 1.2, 0, 0.4, 0};
+    kinovaArm.updatePose(positions);
+    Monitor monitor(&kinovaArm);
+    Eigen::Matrix4d pose = kinovaArm.getPose();
+    pose(0, 3) += 0.2;
+    Sphere sphere(pose, 0.05);
+    ObstacleHandle handle = monitor.addObstacle(&sphere);
+
+    double tolerance = 1e-3;
+    monitor.enableConfigurationCache(2, tolerance);
+    REQUIRE(monitor.configurationCacheError() > 0);
+
+    // The bound follows the reach of every joint to the ends of the links
+    std::vector<double> reach;
+    kinovaArm.jointReach(reach);
+    REQUIRE(reach.size() == kinovaArm.nJoints);
+    double reachSum = 0;
+    for (int i = 0; i < reach.size(); i++) {
+        reachSum += reach[i];
+    }
+    REQUIRE(monitor.configurationCacheError() == Approx(tolerance * reachSum));
+    Eigen::Vector3d axis = kinovaArm.getPose(1).block<3, 1>(0, 3);
+    for (int k = 1; k < kinovaArm.nLinks; k++) {
+        Eigen::Vector3d linkStart, linkEnd;
+        kinovaArm.linkEndPoints(k, linkStart, linkEnd);
+        REQUIRE((linkStart - axis).norm() <= reach[0] + 1e-9);
+        REQUIRE((linkEnd - axis).norm() <= reach[0] + 1e-9);
+    }
+
+    DistanceMatrix obstacleDistances;
+    DistanceMatrix linkDistances;
+    REQUIRE_FALSE(monitor.configurationDistances(positions, obstacleDistances, linkDistances));
+    REQUIRE(obstacleDistances.rows == 1);
+    REQUIRE(obstacleDistances.cols == kinovaArm.nLinks);
+    REQUIRE(monitor.configurationCache.size() == 1);
+
+    // A nearby configuration is a hit and the arm is not moved
+    std::vector<double> nearby = positions;
+    nearby[1] += 0.3 * tolerance;
+    std::vector<unsigned long> versions;
+    for (int k = 0; k < kinovaArm.nLinks; k++) {
+        versions.push_back(kinovaArm.links[k]->version);
+    }
+    DistanceMatrix cachedObstacles;
+    DistanceMatrix cachedLinks;
+    REQUIRE(monitor.configurationDistances(nearby, cachedObstacles, cachedLinks));
+    for (int k = 0; k < kinovaArm.nLinks; k++) {
+        REQUIRE(kinovaArm.links[k]->version == versions[k]);
+    }
+
+    // The cached distances are within the bound of the exact ones
+    kinovaArm.updatePose(nearby);
+    double error = monitor.configurationCacheError();
+    for (int k = 0; k < kinovaArm.nLinks; k++) {
+        double exact = kinovaArm.links[k]->getShortestDistance(monitor.obstacles[0]);
+        REQUIRE(std::abs(cachedObstacles.at(0, k) - exact) <= error);
+    }
+    std::vector<std::vector<double>> exactLinks = monitor.distanceBetweenArmLinks();
+    for (int i = 0; i < kinovaArm.nLinks; i++) {
+        for (int j = 0; j < kinovaArm.nLinks; j++) {
+            if (kinovaArm.allowedCollision(i, j)) {
+                REQUIRE(cachedLinks.at(i, j) == exactLinks[i][j]);
+                continue;
+            }
+            REQUIRE(std::abs(cachedLinks.at(i, j) - exactLinks[i][j]) <= 2 * error);
+        }
+    }
+
+    // The least recently used configuration is evicted
+    std::vector<double> second = positions;
+    second[3] += 0.1;
+    std::vector<double> third = positions;
+    third[3] -= 0.1;
+    REQUIRE_FALSE(monitor.configurationDistances(second, obstacleDistances, linkDistances));
+    REQUIRE(monitor.configurationDistances(positions, obstacleDistances, linkDistances));
+    REQUIRE_FALSE(monitor.configurationDistances(third, obstacleDistances, linkDistances));
+    REQUIRE(monitor.configurationCache.size() == 2);
+    REQUIRE(monitor.configurationDistances(positions, obstacleDistances, linkDistances));
+    REQUIRE_FALSE(monitor.configurationDistances(second, obstacleDistances, linkDistances));
+
+    // Hits are copied into the buffers of the caller without allocating
+    bool hits = true;
+    startCountingAllocations();
+    for (int n = 0; n < 10; n++) {
+        hits = monitor.configurationDistances(n % 2 ? positions : second, 
+                                              obstacleDistances, linkDistances) && hits;
+    }
+    REQUIRE(stopCountingAllocations() == 0);
+    REQUIRE(hits);
+
+    // Only the rows of the static obstacles are computed on a miss
+    monitor.addObstacle(&kinovaArm);
+    REQUIRE_FALSE(monitor.configurationDistances(third, obstacleDistances, linkDistances));
+    REQUIRE(obstacleDistances.rows == 1);
+    kinovaArm.updatePose(third);
+    for (int k = 0; k < kinovaArm.nLinks; k++) {
+        REQUIRE(obstacleDistances.at(0, k) == 
+                Approx(kinovaArm.links[k]->getShortestDistance(monitor.obstacles[0])));
+    }
+
+    // Moving an obstacle clears the cache
+    pose(1, 3) += 0.1;
+    REQUIRE(monitor.updateObstacle(handle, pose));
+    REQUIRE_FALSE(monitor.configurationDistances(positions, obstacleDistances, linkDistances));
+    REQUIRE(monitor.configurationCache.size() == 1);
+    double exact = kinovaArm.links[obstacleDistances.minimumCol]->getShortestDistance(monitor.obstacles[0]);
+    REQUIRE(obstacleDistances.minimum == Approx(exact));
+
+    // Moving the base of the arm clears the cache too
+    REQUIRE(monitor.configurationDistances(positions, obstacleDistances, linkDistances));
+    kinovaArm.baseTransform(0, 3) += 0.1;
+    REQUIRE_FALSE(monitor.configurationDistances(positions, obstacleDistances, linkDistances));
+    REQUIRE(monitor.configurationCache.size() == 1);
+    KinovaArm movedArm(urdf_filename, kinovaArm.baseTransform);
+    REQUIRE(movedArm.updatePose(positions));
+    for (int k = 0; k < kinovaArm.nLinks; k++) {
+        REQUIRE(obstacleDistances.at(0, k) == 
+                Approx(movedArm.links[k]->getShortestDistance(monitor.obstacles[0])));
+    }
+
+    monitor.disableConfigurationCache();
+    REQUIRE_FALSE(monitor.configurationDistances(positions, obstacleDistances, linkDistances));
+    REQUIRE(monitor.configurationCache.size() == 0);
+}
+
+TEST_CASE("Kinova_arm real-time paths do not allocate", "[monitor]") {
+
+    KinovaArm kinovaArm(urdf_filename);
+    Gen3Arm gen3Arm;
+    Monitor monitor(&kinovaArm);
+
+    // Spheres, capsules and boxes around the arm
+    std::vector<Sphere*> spheres;
+    std::vector<Capsule*> capsules;
+    std::vector<Box3*> boxes;
+    for (int k = 0; k < 4; k++) {
+        Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+        pose.block<3, 1>(0, 3) = Eigen::Vector3d(0.3 * k - 0.4, 0.5, 0.2 * k);
+        spheres.push_back(new Sphere(pose, 0.05));
+        monitor.addObstacle(spheres.back());
+        pose(1, 3) = -0.5;
+        capsules.push_back(new Capsule(pose, 0.3, 0.05));
+        monitor.addObstacle(capsules.back());
+        pose(0, 3) = 0.6;
+        boxes.push_back(new Box3(pose, 0.1, 0.2, 0.1));
+        monitor.addObstacle(boxes.back());
+    }
+
+    std::vector<std::vector<double>> configurations;
+    for (int n = 0; n < 10; n++) {
+        std::vector<double> positions;
+        for (int i = 0; i < kinovaArm.nJoints; i++) {
+            positions.push_back(0.3 * n - 0.2 * i);
+        }
+        configurations.push_back(positions);
+    }
+    std::vector<double> velocities = {0.2, -0.4, 0.1, 0.3, 0.5, -0.2, 0.1};
+    KDL::Twist twist(KDL::Vector(0.1, -0.05, 0.02), KDL::Vector(0, 0.1, 0));
+    SeparationParameters separation;
+    separation.reactionTime = 0.1;
+    separation.deceleration = 2.0;
+    separation.obstacleSpeed = 0.2;
+    separation.protectiveDistance = 0.02;
+
+    // Output buffers, sized once by the first calls
+    std::vector<double> jointVelocities(kinovaArm.nJoints);
+    std::vector<Eigen::Vector3d> linear, angular;
+    DistanceMatrix obstacleDistances, linkDistances;
+    obstacleDistances.computeWitnessPoints = true;
+    std::vector<ImminentContact> contacts;
+    contacts.reserve(monitor.obstacles.size() * kinovaArm.nLinks);
+
+    // The same calls without and with a pool of workers
+    ThreadPool pool(3);
+    for (int usePool = 0; usePool < 2; usePool++) {
+        // One row per tile so that the rows are spread over the workers
+        monitor.setThreadPool(usePool ? &pool : NULL);
+        monitor.tilePairs = kinovaArm.nLinks;
+
+        long allocations[2];
+        for (int pass = 0; pass < 2; pass++) {
+            // The first pass warms up the buffers, the second one must not 
+            // allocate
+            startCountingAllocations();
+            for (int n = 0; n < configurations.size(); n++) {
+                const std::vector<double> &positions = configurations[n];
+                kinovaArm.updatePose(positions.data(), positions.size());
+                kinovaArm.updatePose(positions);
+                kinovaArm.ikVelocitySolver(twist, jointVelocities.data(), 
+                                           jointVelocities.size());
+                kinovaArm.linkVelocities(velocities, linear, angular);
+                gen3Arm.updatePose(positions.data(), positions.size());
+                gen3Arm.linkVelocities(velocities, linear, angular);
+                monitor.distanceToObjects(obstacleDistances);
+                monitor.distanceBetweenArmLinks(linkDistances);
+                monitor.speedScale(velocities, separation);
+                monitor.speedScale(velocities, separation, obstacleDistances);
+                monitor.predictCollisions(positions, velocities, 1.0, contacts);
+            }
+            allocations[pass] = stopCountingAllocations();
+        }
+        if (!usePool) {
+            REQUIRE(allocations[0] > 0);
+        }
+        REQUIRE(allocations[1] == 0);
+    }
+    monitor.setThreadPool(NULL);
+    monitor.tilePairs = 256;
+
+    // The buffers give the same results as the allocating calls
+    for (int n = 0; n < configurations.size(); n++) {
+        REQUIRE(kinovaArm.updatePose(configurations[n].data(), configurations[n].size()));
+        REQUIRE(kinovaArm.ikVelocitySolver(twist, jointVelocities.data(), 
+                                           jointVelocities.size()));
+        std::vector<double> expected = kinovaArm.ikVelocitySolver(twist);
+        REQUIRE(expected == jointVelocities);
+    }
+    REQUIRE_FALSE(kinovaArm.updatePose(velocities.data(), 3));
+    REQUIRE_FALSE(kinovaArm.ikVelocitySolver(twist, jointVelocities.data(), 3));
+
+    // A copy has its own solvers and kinematic state
+    Arm* copy = kinovaArm.clone();
+    REQUIRE(copy->getKinematicState() != kinovaArm.getKinematicState());
+    REQUIRE(static_cast<KinovaArm*>(copy)->ikVelocitySolver(twist) == 
+            kinovaArm.ikVelocitySolver(twist));
+    unsigned long version = kinovaArm.getKinematicState()->version;
+    REQUIRE(copy->updatePose(velocities));
+    REQUIRE(kinovaArm.getKinematicState()->version == version);
+    delete copy;
+
+    for (int k = 0; k < spheres.size(); k++) {
+        delete spheres[k];
+        delete capsules[k];
+        delete boxes[k];
+    }
+}
+
+TEST_CASE("Joint state estimator between feedback messages", "[monitor]") {
+    // Joints moving along sines, accelerations up to 0.5 * 2^2 rad/s^2
+    const int nJoints = 7;
+    double amplitude = 0.5, frequency = 2.0;
+    auto position = [&](int i, double t) { return amplitude * sin(frequency * t + i); };
+    auto velocity = [&](int i, double t) { 
+        return amplitude * frequency * cos(frequency * t + i); 
+    };
+    JointStateEstimator estimator(nJoints, amplitude * frequency * frequency, 0.1);
+
+    std::vector<double> positions(nJoints), velocities(nJoints), estimated(nJoints);
+    double errorBound;
+    REQUIRE_FALSE(estimator.estimate(0.0, estimated.data(), nJoints, errorBound));
+    REQUIRE(estimator.latestTime() == 0);
+
+    // Feedback at 20 Hz, estimates at 1 kHz from 10 ms after the second one
+    long allocations = 0;
+    double period = 0.05;
+    for (int n = 1; n <= 20; n++) {
+        double stamp = n * period;
+        for (int i = 0; i < nJoints; i++) {
+            positions[i] = position(i, stamp);
+            velocities[i] = velocity(i, stamp);
+        }
+        startCountingAllocations();
+        REQUIRE(estimator.addSample(stamp, positions.data(), velocities.data(), nJoints));
+        allocations += stopCountingAllocations();
+        if (n == 1) {
+            continue;
+        }
+        for (double t = stamp - period + 0.01; t < stamp + period; t += 0.001) {
+            startCountingAllocations();
+            bool estimatedOk = estimator.estimate(t, estimated.data(), nJoints, errorBound);
+            allocations += stopCountingAllocations();
+            REQUIRE(estimatedOk);
+            REQUIRE(errorBound < 0.01);
+            for (int i = 0; i < nJoints; i++) {
+                REQUIRE(fabs(estimated[i] - position(i, t)) <= errorBound + 1e-12);
+            }
+        }
+    }
+    REQUIRE(allocations == 0);
+
+    // The samples are exact, older or repeated ones are ignored
+    double latest = estimator.latestTime();
+    REQUIRE(estimator.estimate(latest, estimated.data(), nJoints, errorBound));
+    REQUIRE(errorBound == 0);
+    REQUIRE(estimated == positions);
+    REQUIRE_FALSE(estimator.addSample(latest, velocities.data(), NULL, nJoints));
+    REQUIRE_FALSE(estimator.addSample(latest - 1, velocities.data(), NULL, nJoints));
+    REQUIRE_FALSE(estimator.addSample(latest + 1, positions.data(), NULL, 3));
+    REQUIRE(estimator.latestTime() == latest);
+    REQUIRE_FALSE(estimator.estimate(latest, estimated.data(), 3, errorBound));
+
+    // Only the first joints of a longer feedback are used
+    std::vector<double> longer(positions), longerVelocities(velocities);
+    longer.push_back(123);
+    longerVelocities.push_back(456);
+    JointStateEstimator copy = estimator;
+    REQUIRE(copy.addSample(latest + 0.05, longer.data(), longerVelocities.data(), 
+                           longer.size()));
+    REQUIRE(copy.estimate(latest + 0.05, estimated.data(), nJoints, errorBound));
+    REQUIRE(estimated == positions);
+
+    // Stale feedback is held at the extrapolation limit
+    REQUIRE(estimator.estimate(latest + 0.09, estimated.data(), nJoints, errorBound));
+    REQUIRE_FALSE(estimator.estimate(latest + 1.0, estimated.data(), nJoints, errorBound));
+    for (int i = 0; i < nJoints; i++) {
+        REQUIRE(estimated[i] == Approx(positions[i] + 0.1 * velocities[i]));
+    }
+    REQUIRE(errorBound == Approx(0.5 * estimator.maxAcceleration * 0.1 * 0.1));
+
+    // Without velocities the first sample cannot be extrapolated, the next
+    // ones use the difference with the previous one
+    estimator.reset();
+    REQUIRE(estimator.latestTime() == 0);
+    for (int n = 0; n < 10; n++) {
+        double stamp = n * period;
+        for (int i = 0; i < nJoints; i++) {
+            positions[i] = position(i, stamp);
+        }
+        REQUIRE(estimator.addSample(stamp, positions.data(), NULL, nJoints));
+        double t = stamp + 0.02;
+        bool estimatedOk = estimator.estimate(t, estimated.data(), nJoints, errorBound);
+        REQUIRE(estimatedOk == (n > 0));
+        if (n == 0) {
+            REQUIRE(estimated == positions);
+            REQUIRE(std::isinf(errorBound));
+            continue;
+        }
+        for (int i = 0; i < nJoints; i++) {
+            REQUIRE(fabs(estimated[i] - position(i, t)) <= errorBound + 1e-12);
+        }
+
+        // Between two samples without velocities the curve holds too
+        if (n < 2) {
+            continue;
+        }
+        for (t = stamp - period; t < stamp; t += 0.001) {
+            REQUIRE(estimator.estimate(t, estimated.data(), nJoints, errorBound));
+            for (int i = 0; i < nJoints; i++) {
+                REQUIRE(fabs(estimated[i] - position(i, t)) <= errorBound + 1e-12);
+            }
+        }
+    }
+
+    // The difference quotients of a uniform motion are exact and the curve
+    // is straight, the bound still covers the worst velocity errors
+    estimator.reset();
+    std::vector<double> start(nJoints, 0.1), end(nJoints, 0.2), later(nJoints, 0.3);
+    REQUIRE(estimator.addSample(0, start.data(), NULL, nJoints));
+    REQUIRE(estimator.addSample(period, end.data(), NULL, nJoints));
+    REQUIRE(estimator.addSample(2 * period, later.data(), NULL, nJoints));
+    REQUIRE(estimator.estimate(1.5 * period, estimated.data(), nJoints, errorBound));
+    for (int i = 0; i < nJoints; i++) {
+        REQUIRE(estimated[i] == Approx(0.25));
+    }
+    double a = estimator.maxAcceleration;
+    double velocityErrors = 2 * a * period;
+    double nearest = 0.5 * period;
+    double expected = 0.5 * (a + 4 * velocityErrors / period) * nearest * nearest +
+                      4.0 / 27.0 * period * velocityErrors;
+    REQUIRE(errorBound == Approx(expected));
+}
+
+TEST_CASE("TripleBuffer latest consistent version", "[concurrency]") {
+
+    // The reader must never see a version with mixed values
+    std::vector<int> initial(16, 0);
+    TripleBuffer<std::vector<int>> buffer(initial);
+    REQUIRE_FALSE(buffer.update());
+    REQUIRE(buffer.read()[0] == 0);
+
+    const int nVersions = 100000;
+    std::thread writer([&buffer, nVersions]() {
+        for (int version = 1; version <= nVersions; version++) {
+            std::vector<int> &values = buffer.writeBuffer();
+            for (int i = 0; i < values.size(); i++) {
+                values[i] = version;
+            }
+            buffer.publish();
+        }
+    });
+
+    int last = 0;
+    bool consistent = true;
+    bool increasing = true;
+    while (last < nVersions) {
+        if (buffer.update()) {
+            const std::vector<int> &values = buffer.read();
+            for (int i = 1; i < values.size(); i++) {
+                consistent = consistent && values[i] == values[0];
+            }
+            increasing = increasing && values[0] > last;
+            last = values[0];
+        }
+    }
+    writer.join();
+    REQUIRE(consistent);
+    REQUIRE(increasing);
+    REQUIRE_FALSE(buffer.update());
+}
+
+TEST_CASE("SpscQueue keeps the order", "[concurrency]") {
+
+    SpscQueue<int> queue(3);
+    int item;
+    REQUIRE(queue.empty());
+    REQUIRE(queue.push(1));
+    REQUIRE(queue.push(2));
+    REQUIRE(queue.push(3));
+    REQUIRE_FALSE(queue.push(4));
+    REQUIRE(queue.pop(item));
+    REQUIRE(item == 1);
+    REQUIRE(queue.push(4));
+
+    const int nItems = 100000;
+    std::thread producer([&queue, nItems]() {
+        for (int i = 5; i <= nItems; i++) {
+            while (!queue.push(i)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    int expected = 2;
+    bool ordered = true;
+    while (expected <= nItems) {
+        if (queue.pop(item)) {
+            ordered = ordered && item == expected;
+            expected++;
+        }
+    }
+    producer.join();
+    REQUIRE(ordered);
+    REQUIRE(queue.empty());
+    REQUIRE_FALSE(queue.pop(item));
+}
+
 TEST_CASE( "Custom test case box", "[Sphere - box]" ) {
     double radius_1 = 12;
     Eigen::Matrix4d pose_1;